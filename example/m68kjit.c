@@ -0,0 +1 @@
+../m68kjit.c
\ No newline at end of file
@@ -0,0 +1 @@
+../m68ktrace.c
\ No newline at end of file
@@ -208,6 +208,17 @@ void m68k_write_memory_32(unsigned int address, unsigned int value);
  */
 void m68k_write_memory_32_pd(unsigned int address, unsigned int value);
 
+/* Block transfers of size bytes at address, in 68000 (big endian) byte
+ * order.  Return nonzero if the transfer was done, or 0 to have the CPU do
+ * it with the normal read/write functions instead.  The address is even on
+ * the 68000/68010 and size is at most 96 bytes, and a block never wraps the
+ * address space or covers pages mapped with m68k_map_memory().
+ *
+ * Enable this functionality with M68K_MEMORY_BLOCKS in m68kconf.h.
+ */
+int m68k_read_memory_block(unsigned int address, unsigned char* data, unsigned int size);
+int m68k_write_memory_block(unsigned int address, const unsigned char* data, unsigned int size);
+
 
 
 /* ======================================================================== */
@@ -302,6 +313,21 @@ void m68k_set_fc_callback(void  (*callback)(unsigned int new_fc));
 void m68k_set_instr_hook_callback(void  (*callback)(unsigned int pc));
 
 
+/* Set the callback for the fetch window.
+ * You must enable M68K_FETCH_WINDOW in m68kconf.h.
+ * When the CPU fetches instruction words from a new page of
+ * M68K_MAP_PAGE_SIZE bytes that the fast memory map does not cover, it calls
+ * this callback with the page address.  The host can return host memory
+ * holding the whole page in 68k (big endian) byte order, which the CPU then
+ * reads instruction words from until the PC leaves the page, or NULL to have
+ * them read with m68k_read_immediate_xx().  The memory must stay valid until
+ * m68k_invalidate_code() or m68k_flush_code_cache() is called, so call one of
+ * them when switching banks.
+ * Default behavior: return NULL.
+ */
+void m68k_set_fetch_window_callback(const void* (*callback)(unsigned int page));
+
+
 
 /* ======================================================================== */
 /* ====================== FUNCTIONS TO ACCESS THE CPU ===================== */
@@ -356,21 +382,337 @@ unsigned int m68k_get_virq(unsigned int level);
 void m68k_pulse_halt(void);
 
 
-/* Trigger a bus error exception */
+/* Trigger a bus error exception.
+ * With M68K_PENDING_FAULTS, this returns and the exception is taken at the
+ * end of the current instruction (or on the next call to m68k_execute()).
+ */
 void m68k_pulse_bus_error(void);
 
 
-/* Context switching to allow multiple CPUs */
+/* Fast memory map.
+ * RAM and ROM regions can be handed to the CPU as host memory, laid out in
+ * 68k (big endian) byte order.  Reads and writes to mapped pages are then
+ * done directly on that memory and the functions above are only called for
+ * pages that are not mapped for the access, such as memory-mapped I/O or
+ * writes to ROM.  Immediate and PC-relative reads only use the map when
+ * M68K_SEPARATE_READS is off.  The map applies to all function codes and
+ * addresses are 68k addresses after PMMU translation.
+ * address and size must be multiples of M68K_MAP_PAGE_SIZE.  The map belongs
+ * to the current CPU instance.
+ *
+ * Enable this functionality with M68K_FAST_MEMORY_MAP in m68kconf.h.
+ */
+#define M68K_MAP_PAGE_SIZE 0x1000
+
+#define M68K_MAP_READ  1
+#define M68K_MAP_WRITE 2
+#define M68K_MAP_RW    (M68K_MAP_READ | M68K_MAP_WRITE)
+
+/* Map size bytes of host memory at address.  Returns 0 on failure. */
+int m68k_map_memory(unsigned int address, unsigned int size, void* memory, unsigned int flags);
+
+/* Return a range to the memory access functions */
+void m68k_unmap_memory(unsigned int address, unsigned int size);
+
+
+/* Block cache.
+ * Writes done by the CPU drop any cached code they touch.  Call
+ * m68k_invalidate_code() when the host changes memory holding code behind
+ * the CPU's back (DMA into mapped RAM, bank switching, loading a new program)
+ * or m68k_flush_code_cache() to drop everything.  Mapping memory and
+ * pulsing reset also flush the affected code.  The cache belongs to the
+ * current CPU instance.
+ *
+ * Enable this functionality with M68K_BLOCK_CACHE in m68kconf.h.
+ */
+void m68k_invalidate_code(unsigned int address, unsigned int size);
+void m68k_flush_code_cache(void);
+
+/* JIT.
+ * With M68K_JIT, hot blocks of the block cache run as x86-64 code, with the
+ * same cycle counts, exceptions and memory callbacks as the interpreter.
+ *
+ * m68k_set_jit_perf_map() writes the address and 68k PC of each block the
+ * current CPU instance compiles to /tmp/perf-<pid>.map, so that perf can
+ * name them.
+ *
+ * With M68K_JIT_LOCKSTEP, each compiled block is rerun by the interpreter
+ * with the same memory accesses and the results are compared.  Differences
+ * are reported on stderr, and m68k_jit_lockstep_mismatches() counts them for
+ * the current CPU instance.  Memory callbacks are only called by the compiled
+ * run.  A block in which a callback changes the CPU through this API (its
+ * registers, timeslice, interrupt level or events) is not rerun, and the
+ * change is kept.
+ */
+void m68k_set_jit_perf_map(int enable);
+unsigned int m68k_jit_lockstep_mismatches(void);
+
+
+/* PMMU address translation cache.
+ * With M68K_EMULATE_PMMU, translations are kept in a cache of
+ * M68K_PMMU_ATC_ENTRIES entries per CPU instance.  As on the real chips, the
+ * guest must use PFLUSH after changing its translation tables; PMOVE to TC,
+ * CRP or SRP and pulsing reset drop the whole cache.
+ *
+ * m68k_get_pmmu_atc_stats() reports the translations served from the cache
+ * and the table walks done for the current CPU instance, since it was created
+ * or m68k_clear_pmmu_atc_stats() was last called.  Either pointer may be NULL.
+ */
+void m68k_get_pmmu_atc_stats(unsigned long long* hits, unsigned long long* misses);
+void m68k_clear_pmmu_atc_stats(void);
+
+
+/* Profile counters.
+ * With M68K_PROFILE, each CPU instance counts the instructions it runs and
+ * the cycles they take by opcode handler, the FPU instructions by type and
+ * by fpgen opmode, and the exceptions and interrupts taken by vector.
+ * Idle loops that are skipped and loops run as one host operation count as
+ * one instruction with all of their cycles.
+ *
+ * m68k_profile_handlers() is the number of handlers (0 when M68K_PROFILE is
+ * off), and m68k_profile_handler_name() gives the name of one, such as
+ * "m68k_op_move_32_d_ai".  m68k_profile_snapshot() copies the counters of
+ * the current CPU instance: count and cycles take m68k_profile_handlers()
+ * entries each, and any pointer may be NULL.  m68k_profile_reset() zeroes
+ * them.  m68k_profile_dump() passes one line at a time to print, with the
+ * handlers that ran sorted by cycles.
+ */
+#define M68K_PROFILE_FPU_OPS 8   /* Bits 13-15 of the FPU command word */
+#define M68K_PROFILE_FPU_GEN 128 /* fpgen opmodes */
+#define M68K_PROFILE_VECTORS 256
+
+typedef struct
+{
+	unsigned long long fpu_ops[M68K_PROFILE_FPU_OPS];
+	unsigned long long fpu_gen[M68K_PROFILE_FPU_GEN];
+	unsigned long long vectors[M68K_PROFILE_VECTORS];
+} m68k_profile;
+
+unsigned int m68k_profile_handlers(void);
+const char* m68k_profile_handler_name(unsigned int index);
+void m68k_profile_snapshot(unsigned long long* count, unsigned long long* cycles, m68k_profile* other);
+void m68k_profile_reset(void);
+void m68k_profile_dump(void (*print)(const char* line));
+
+
+/* Event queue.
+ * With M68K_EVENT_QUEUE, each CPU instance keeps a clock of the cycles it has
+ * run since it was created, and m68k_get_cycle_count() reads it.
+ *
+ * m68k_schedule_event() asks for callback(param, cycle) to be called once the
+ * clock reaches cycle.  m68k_execute() runs up to the first instruction
+ * boundary at or after each deadline, calls the callback and carries on with
+ * the rest of the timeslice, so long timeslices keep device timing exact.
+ * Events due at the same cycle are called in the order they were scheduled.
+ * Callbacks may schedule and cancel events, change the interrupt level (which
+ * is checked as soon as the callbacks return) and end or modify the
+ * timeslice.  A CPU halted by STOP skips straight to the
+ * next event instead of running out the timeslice.
+ *
+ * m68k_schedule_event() returns an id for m68k_cancel_event(), or -1 if
+ * M68K_MAX_EVENTS events are already pending.  m68k_cancel_event() returns 1
+ * if the event was still pending, and 0 otherwise.
+ */
+unsigned long long m68k_get_cycle_count(void);
+int m68k_schedule_event(unsigned long long cycle, void (*callback)(void* param, unsigned long long cycle), void* param);
+int m68k_cancel_event(int id);
+
+
+/* Sampling profiler.
+ * With M68K_SAMPLE_PROFILER and M68K_EVENT_QUEUE, m68k_start_sampling()
+ * takes a sample every period cycles of the current CPU instance, using an
+ * event, so nothing is done between samples.  A sample is the PC followed by
+ * up to depth - 1 return addresses found by following the LINK A6 frame
+ * chain through memory given to m68k_map_memory(), up to a null A6.
+ * Samples of the same stack are counted together in a table of
+ * M68K_SAMPLE_SLOTS stacks.
+ * It returns 0 if sampling is not available or the event queue is full.
+ *
+ * m68k_stop_sampling() keeps the samples and m68k_clear_samples() drops
+ * them.  m68k_get_sample() copies slot index (below M68K_SAMPLE_SLOTS),
+ * innermost frame first, and returns the number of frames, or 0 if the slot
+ * is free.  m68k_dump_samples() passes one line per stack to print in the
+ * folded format of flamegraph.pl, such as "001040;0012a6 1234".  With
+ * annotate, the innermost PC is followed by its disassembly.
+ */
+int m68k_start_sampling(unsigned int period, unsigned int depth);
+void m68k_stop_sampling(void);
+void m68k_clear_samples(void);
+unsigned int m68k_get_sample(unsigned int index, unsigned int* pc, unsigned long long* count);
+void m68k_dump_samples(void (*print)(const char* line), int annotate);
+
+
+/* Call graph.
+ * With M68K_CALL_GRAPH, each CPU instance keeps a shadow call stack: JSR,
+ * BSR and exceptions push a frame for the code they enter, and RTS, RTD,
+ * RTR and RTE pop the frame whose return address or exception frame they
+ * return through, together with any frames above it that were left by a
+ * longjmp.  A call drops the frames it can no longer return to on the same
+ * stack, but not those of a task on another stack (see M68K_CALL_STACK_SHIFT
+ * in m68kconf.h).  Returns that match no frame, as after switching stacks,
+ * leave the shadow stack alone until a known frame is returned through.  The
+ * cycles of each instruction go to the function on top of the stack.
+ *
+ * m68k_dump_call_graph() passes one line at a time to print: the total, and
+ * then the address, call count, inclusive and exclusive cycles of up to top
+ * functions, most exclusive cycles first.  Calls still running are included.
+ * Recursive calls add to the inclusive cycles of the outermost call only.
+ * m68k_clear_call_graph() zeroes the counts but keeps the shadow stack.
+ */
+void m68k_clear_call_graph(void);
+void m68k_dump_call_graph(void (*print)(const char* line), unsigned int top);
+
+
+/* Flight recorder.
+ * With M68K_FLIGHT_RECORDER, each CPU instance records every instruction it
+ * runs in a ring buffer of the last M68K_FLIGHT_RECORDS instructions.
+ * m68k_get_flight_records() copies up to max of the latest records, oldest
+ * first, and returns how many it copied.  An instruction that takes a bus or
+ * address error is recorded too, with the cycles of the exception.  The opcode words can be decoded
+ * later with m68k_disassemble() on a copy of memory.
+ * m68k_clear_flight_recorder() empties the buffer.
+ */
+typedef struct
+{
+	unsigned int pc;          /* Address of the instruction */
+	unsigned int address;     /* Last data address read or written (0 if none), with M68K_FLIGHT_ADDRESSES */
+	unsigned int cycles;      /* Including any exception it caused */
+	unsigned short ir;        /* First word of the instruction */
+} m68k_flight_record;
+
+unsigned int m68k_get_flight_records(m68k_flight_record* records, unsigned int max);
+void m68k_clear_flight_recorder(void);
+
+
+/* Trace file.
+ * With M68K_TRACE, m68k_start_trace() records every instruction the current
+ * CPU instance runs to the file at path: its PC, opcode word and cycles, the
+ * registers it changed and the data it read and wrote.  A background thread
+ * does the writing.  m68k_stop_trace() flushes the file and adds an index of
+ * its chunks.  Both return 0 on failure.
+ *
+ * m68k_read_trace() calls callback with each instruction of a trace file,
+ * starting at instruction number first, until it returns nonzero.  The index
+ * makes starting late in a file cheap.  record->regs holds the registers
+ * after the instruction: D0-D7, A0-A7 and SR.  Only the first
+ * M68K_TRACE_ACCESSES accesses of an instruction are kept; truncated is set
+ * if it made more.  Returns 0 if the file could not be read.
+ */
+#define M68K_TRACE_REGS     17
+#define M68K_TRACE_ACCESSES 64
+
+typedef struct
+{
+	unsigned int address;
+	unsigned int value;
+	unsigned char size;       /* 1, 2 or 4 bytes */
+	unsigned char write;
+} m68k_trace_access;
+
+typedef struct
+{
+	unsigned long long number; /* Instructions traced before this one */
+	unsigned int pc;
+	unsigned int ir;
+	unsigned int cycles;
+	unsigned int regs[M68K_TRACE_REGS];
+	unsigned int truncated;
+	unsigned int accesses;
+	m68k_trace_access access[M68K_TRACE_ACCESSES];
+} m68k_trace_record;
+
+int m68k_start_trace(const char* path);
+int m68k_stop_trace(void);
+int m68k_read_trace(const char* path, unsigned long long first,
+	int (*callback)(const m68k_trace_record* record, void* param), void* param);
+
+/* Trace queries.
+ * A trace file also holds a checkpoint every M68K_TRACE_CHECKPOINT
+ * instructions, with the memory pages written and run since the last one.
+ * m68k_open_trace_query() reads the index and checkpoints of a stopped trace
+ * file (NULL on failure), so that each query below only decodes the stretches
+ * of the trace that can hold the answer.  Instruction numbers count from 0;
+ * m68k_trace_length() is how many instructions the trace holds.
+ *
+ * m68k_query_state() gets the PC and registers (as in m68k_trace_record)
+ * before instruction number runs.
+ * m68k_query_memory() gets size bytes at address before instruction number
+ * runs.  Only memory written while tracing is known: known[i] is 0 for bytes
+ * the trace does not have.
+ * m68k_query_last_write() finds the last instruction before number that
+ * wrote the byte at address, and the write.
+ * m68k_query_next_pc() finds the first instruction from number on at pc.
+ * These return 0 if there is no answer.  Memory written by the host is not
+ * seen, and addresses are as on the CPU's address bus.
+ */
+typedef struct m68k_trace_query m68k_trace_query;
+
+m68k_trace_query* m68k_open_trace_query(const char* path);
+void m68k_close_trace_query(m68k_trace_query* query);
+unsigned long long m68k_trace_length(m68k_trace_query* query);
+int m68k_query_state(m68k_trace_query* query, unsigned long long number, unsigned int* pc, unsigned int* regs);
+int m68k_query_memory(m68k_trace_query* query, unsigned long long number, unsigned int address,
+	unsigned int size, unsigned char* data, unsigned char* known);
+int m68k_query_last_write(m68k_trace_query* query, unsigned long long number, unsigned int address,
+	unsigned long long* found, m68k_trace_access* access);
+int m68k_query_next_pc(m68k_trace_query* query, unsigned long long number, unsigned int pc,
+	unsigned long long* found);
+
+/* Context switching to allow multiple CPUs.
+ * A context holds the CPU state: registers, cycle counters, callbacks and
+ * pending events.  What an instance owns is not part of it: the memory map,
+ * the block cache and compiled code, the sampler and the trace writer stay
+ * with the instance they were set up on.  Restoring a context keeps the
+ * current instance's, and a saved context shares none of them.
+ */
 
 /* Get the size of the cpu context in bytes */
 unsigned int m68k_context_size(void);
 
-/* Get a cpu context */
+/* Get a cpu context.  If dst is an instance, its own resources are kept. */
 unsigned int m68k_get_context(void* dst);
 
 /* set the current cpu context */
 void m68k_set_context(void* dst);
 
+
+/* Independent CPU instances.
+ * Each instance carries its own registers, cycle counters, callbacks and
+ * error recovery state, so different instances may run concurrently on
+ * different host threads.  All of the single-CPU functions in this header
+ * operate on the instance selected on the calling thread (by default the
+ * built-in instance), and an instance handle is also a valid context for
+ * m68k_get_reg().
+ */
+
+/* Allocate a new CPU instance of the given type with default callbacks.
+ * user_data is returned by m68k_get_user_data() while the instance runs.
+ * Returns NULL if out of memory.  Pulse reset before executing it.
+ */
+void* m68k_create(unsigned int cpu_type, void* user_data);
+
+/* Free an instance created with m68k_create() */
+void m68k_destroy(void* cpu);
+
+/* Make cpu the current instance on the calling thread (NULL selects the
+ * built-in instance).  Returns the previously selected instance.
+ */
+void* m68k_select_context(void* cpu);
+
+/* Get the instance selected on the calling thread */
+void* m68k_get_current_context(void);
+
+/* Run cpu for num_cycles as m68k_execute() would, then restore the previous
+ * selection.  Returns the number of cycles used.
+ */
+int m68k_execute_ctx(void* cpu, int num_cycles);
+
+/* Get/set the host data of the current instance.  Memory access functions
+ * and callbacks can use this to find the machine they belong to.
+ */
+void* m68k_get_user_data(void);
+void m68k_set_user_data(void* user_data);
+
 /* Register the CPU state information */
 void m68k_state_register(const char *type, int index);
 
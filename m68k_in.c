@@ -54,9 +54,10 @@ must fix:
  *    M68KMAKE_OPCODE_HANDLER_HEADER - header for opcode handler implementation
  *    M68KMAKE_OPCODE_HANDLER_FOOTER - footer for opcode handler implementation
  *    M68KMAKE_OPCODE_HANDLER_BODY   - body section for opcode handler implementation
+ *    M68KMAKE_FUSED_PAIRS           - opcode handler pairs to fuse (optional)
  *
- * NOTE: M68KMAKE_OPCODE_HANDLER_BODY must be last in the file and
- *       M68KMAKE_TABLE_BODY must be second last in the file.
+ * NOTE: M68KMAKE_OPCODE_HANDLER_BODY must be last in the file (before the
+ *       fused pairs) and M68KMAKE_TABLE_BODY must be second last.
  *
  * The M68KMAKE_OPHANDLER_BODY section contains the opcode handler
  * primitives themselves.  Each opcode handler begins with:
@@ -109,11 +110,21 @@ XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 M68KMAKE_PROTOTYPE_FOOTER
 
 
-/* Build the opcode handler table */
-void m68ki_build_opcode_table(void);
+/* Opcode tables, resolved by m68kmake */
+extern void (*const m68ki_instruction_handler_table[M68KI_HANDLER_COUNT])(void); /* opcode handlers */
+extern const unsigned short m68ki_instruction_index_table[0x10000]; /* handler of each opcode */
+extern const unsigned char m68ki_cycles[][M68KI_HANDLER_COUNT]; /* Cycles used by CPU type */
+extern const char* const m68ki_instruction_handler_names[M68KI_HANDLER_COUNT]; /* For M68K_PROFILE */
 
-extern void (*m68ki_instruction_jump_table[0x10000])(void); /* opcode handler jump table */
-extern unsigned char m68ki_cycles[][0x10000];
+/* Handler sets built for a single CPU family (see M68K_SPECIALIZED_HANDLERS) */
+extern void (*const m68ki_instruction_handler_table_000[M68KI_HANDLER_COUNT])(void);
+extern void (*const m68ki_instruction_handler_table_010[M68KI_HANDLER_COUNT])(void);
+extern void (*const m68ki_instruction_handler_table_020[M68KI_HANDLER_COUNT])(void);
+extern void (*const m68ki_instruction_handler_table_030[M68KI_HANDLER_COUNT])(void);
+extern void (*const m68ki_instruction_handler_table_040[M68KI_HANDLER_COUNT])(void);
+
+/* Run the threaded core until the cycles run out */
+void m68ki_execute_threaded(void);
 
 
 /* ======================================================================== */
@@ -128,150 +139,21 @@ XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 M68KMAKE_TABLE_HEADER
 
 /* ======================================================================== */
-/* ========================= OPCODE TABLE BUILDER ========================= */
+/* ============================= OPCODE TABLES ============================ */
 /* ======================================================================== */
 
-#include <stdio.h>
-#include "m68kops.h"
-
-#define NUM_CPU_TYPES 5
-
-void  (*m68ki_instruction_jump_table[0x10000])(void); /* opcode handler jump table */
-unsigned char m68ki_cycles[NUM_CPU_TYPES][0x10000]; /* Cycles used by CPU type */
-
-/* This is used to generate the opcode handler jump table */
-typedef struct
-{
-	void (*opcode_handler)(void);        /* handler function */
-	unsigned int  mask;                  /* mask on opcode */
-	unsigned int  match;                 /* what to match after masking */
-	unsigned char cycles[NUM_CPU_TYPES]; /* cycles each cpu type takes */
-} opcode_handler_struct;
-
-
-/* Opcode handler table */
-static const opcode_handler_struct m68k_opcode_handler_table[] =
-{
-/*   function                      mask    match    000  010  020  040 */
+/* m68kmake matches every opcode against the handler masks (the most specific
+ * mask wins) and writes out the results, so the tables are constant data
+ * and nothing needs to be built at startup.  Dispatch goes through a 16-bit
+ * index per opcode into small per-handler tables, which keeps the data an
+ * instruction touches to one 128K table plus a few hot lines.
+ */
 
 
 
 XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 M68KMAKE_TABLE_FOOTER
 
-	{0, 0, 0, {0, 0, 0, 0, 0}}
-};
-
-
-/* Build the opcode handler jump table */
-void m68ki_build_opcode_table(void)
-{
-	const opcode_handler_struct *ostruct;
-	int cycle_cost;
-	int instr;
-	int i;
-	int j;
-	int k;
-
-	for(i = 0; i < 0x10000; i++)
-	{
-		/* default to illegal */
-		m68ki_instruction_jump_table[i] = m68k_op_illegal;
-		for(k=0;k<NUM_CPU_TYPES;k++)
-			m68ki_cycles[k][i] = 0;
-	}
-
-	ostruct = m68k_opcode_handler_table;
-	while(ostruct->mask != 0xff00)
-	{
-		for(i = 0;i < 0x10000;i++)
-		{
-			if((i & ostruct->mask) == ostruct->match)
-			{
-				m68ki_instruction_jump_table[i] = ostruct->opcode_handler;
-				for(k=0;k<NUM_CPU_TYPES;k++)
-					m68ki_cycles[k][i] = ostruct->cycles[k];
-			}
-		}
-		ostruct++;
-	}
-	while(ostruct->mask == 0xff00)
-	{
-		for(i = 0;i <= 0xff;i++)
-		{
-			m68ki_instruction_jump_table[ostruct->match | i] = ostruct->opcode_handler;
-			for(k=0;k<NUM_CPU_TYPES;k++)
-				m68ki_cycles[k][ostruct->match | i] = ostruct->cycles[k];
-		}
-		ostruct++;
-	}
-	while(ostruct->mask == 0xf1f8)
-	{
-		for(i = 0;i < 8;i++)
-		{
-			for(j = 0;j < 8;j++)
-			{
-				instr = ostruct->match | (i << 9) | j;
-				m68ki_instruction_jump_table[instr] = ostruct->opcode_handler;
-				for(k=0;k<NUM_CPU_TYPES;k++)
-					m68ki_cycles[k][instr] = ostruct->cycles[k];
-/* SBF: don't add it here or the costs are added twice!
-				// For all shift operations with known shift distance (encoded in instruction word)
-				if((instr & 0xf000) == 0xe000 && (!(instr & 0x20)))
-				{
-					// On the 68000 and 68010 shift distance affect execution time.
-					// Add the cycle cost of shifting; 2 times the shift distance
-					cycle_cost = ((((i-1)&7)+1)<<1);
-					m68ki_cycles[0][instr] += cycle_cost;
-					m68ki_cycles[1][instr] += cycle_cost;
-					// On the 68020 shift distance does not affect execution time
-					m68ki_cycles[2][instr] += 0;
-				}
-*/
-			}
-		}
-		ostruct++;
-	}
-	while(ostruct->mask == 0xfff0)
-	{
-		for(i = 0;i <= 0x0f;i++)
-		{
-			m68ki_instruction_jump_table[ostruct->match | i] = ostruct->opcode_handler;
-			for(k=0;k<NUM_CPU_TYPES;k++)
-				m68ki_cycles[k][ostruct->match | i] = ostruct->cycles[k];
-		}
-		ostruct++;
-	}
-	while(ostruct->mask == 0xf1ff)
-	{
-		for(i = 0;i <= 0x07;i++)
-		{
-			m68ki_instruction_jump_table[ostruct->match | (i << 9)] = ostruct->opcode_handler;
-			for(k=0;k<NUM_CPU_TYPES;k++)
-				m68ki_cycles[k][ostruct->match | (i << 9)] = ostruct->cycles[k];
-		}
-		ostruct++;
-	}
-	while(ostruct->mask == 0xfff8)
-	{
-		for(i = 0;i <= 0x07;i++)
-		{
-			m68ki_instruction_jump_table[ostruct->match | i] = ostruct->opcode_handler;
-			for(k=0;k<NUM_CPU_TYPES;k++)
-				m68ki_cycles[k][ostruct->match | i] = ostruct->cycles[k];
-		}
-		ostruct++;
-	}
-	while(ostruct->mask == 0xffff)
-	{
-		m68ki_instruction_jump_table[ostruct->match] = ostruct->opcode_handler;
-		for(k=0;k<NUM_CPU_TYPES;k++)
-			m68ki_cycles[k][ostruct->match] = ostruct->cycles[k];
-		ostruct++;
-	}
-}
-
-
 /* ======================================================================== */
 /* ============================== END OF FILE ============================= */
 /* ======================================================================== */
@@ -282,10 +164,52 @@ XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 M68KMAKE_OPCODE_HANDLER_HEADER
 
 #include <stdio.h>
+#include "m68kops.h"
 #include "m68kcpu.h"
 extern void m68040_fpu_op0(void);
 extern void m68040_fpu_op1(void);
 extern void m68881_mmu_ops(void);
+extern void m68040_mmu_ops(void);
+extern uint m68040_mmu_movec_from(uint reg);
+extern void m68040_mmu_movec_to(uint reg, uint value);
+
+#if M68KI_FUSED_PAIRS
+/* Handler index of the next instruction, for a fused handler to run it
+ * straight away.  Only if the main loop would go on to it after the current
+ * instruction (handled by the given handler) without a trace exception, and
+ * its opcode word is in the prefetch queue or the fetch window.
+ * M68KI_HANDLER_COUNT otherwise, which matches no handler.
+ */
+M68KI_FORCE_INLINE uint m68ki_fuse_peek(uint handler)
+{
+#if !M68K_EMULATE_PREFETCH
+	uint address = ADDRESS_68K(REG_PC);
+#endif
+
+	if(GET_CYCLES() <= (sint)CYC_INSTRUCTION[handler] || m68ki_tracing || m68ki_fault_pending())
+		return M68KI_HANDLER_COUNT;
+#if M68K_EMULATE_PREFETCH
+	if(CPU_PREF_ADDR != REG_PC)
+		return M68KI_HANDLER_COUNT;
+	return m68ki_instruction_index_table[MASK_OUT_ABOVE_16(CPU_PREF_DATA)];
+#else
+	if(address - m68ki_cpu.fetch_page >= m68ki_cpu.fetch_limit)
+		return M68KI_HANDLER_COUNT;
+	return m68ki_instruction_index_table[m68ki_get_mem_16(m68ki_cpu.fetch_mem + (address - m68ki_cpu.fetch_page))];
+#endif /* M68K_EMULATE_PREFETCH */
+}
+
+/* Finish the current instruction and start the one m68ki_fuse_peek() found.
+ * No trace exception is due, or the peek would have failed.
+ */
+M68KI_FORCE_INLINE void m68ki_fuse_continue(uint handler)
+{
+	USE_CYCLES(CYC_INSTRUCTION[handler]);
+	m68ki_profile_end(); /* auto-disable (see m68kcpu.h) */
+	m68ki_begin_instruction();
+	REG_IR = m68ki_read_imm_16();
+}
+#endif /* M68KI_FUSED_PAIRS */
 
 /* ======================================================================== */
 /* ========================= INSTRUCTION HANDLERS ========================= */
@@ -771,8 +695,9 @@ pack      16  mm    ay7   1000...101001111  ..........  . . U U U   .   .  13  1
 pack      16  mm    axy7  1000111101001111  ..........  . . U U U   .   .  13  13  13
 pack      16  mm    .     1000...101001...  ..........  . . U U U   .   .  13  13  13
 pea       32  .     .     0100100001......  A..DXWLdx.  U U U U U   6   6   5   5   5
-pflush    32  .     .     1111010100011000  ..........  . . . . S   .   .   .   .   4   TODO: correct timing
+pflush    32  .     .     11110101000.....  ..........  . . . . S   .   .   .   .   4   TODO: correct timing
 pmmu      32  .     .     1111000.........  ..........  . . S S S   .   .   8   8   8
+ptest     32  .     .     1111010101.01...  ..........  . . . . S   .   .   .   .   8   TODO: correct timing
 reset      0  .     .     0100111001110000  ..........  S S S S S   0   0   0   0   0
 ror        8  s     .     1110...000011...  ..........  U U U U U   6   6   8   8   8
 ror       16  s     .     1110...001011...  ..........  U U U U U   6   6   8   8   8
@@ -1075,12 +1000,9 @@ M68KMAKE_OP(add, 8, er, d)
 	uint dst = MASK_OUT_ABOVE_8(*r_dst);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_V = VFLAG_ADD_8(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
+	m68ki_set_add_flags_8(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_8(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_8(*r_dst) | MASK_OUT_ABOVE_8(res);
 }
 
 
@@ -1091,12 +1013,9 @@ M68KMAKE_OP(add, 8, er, .)
 	uint dst = MASK_OUT_ABOVE_8(*r_dst);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_V = VFLAG_ADD_8(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
+	m68ki_set_add_flags_8(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_8(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_8(*r_dst) | MASK_OUT_ABOVE_8(res);
 }
 
 
@@ -1107,12 +1026,9 @@ M68KMAKE_OP(add, 16, er, d)
 	uint dst = MASK_OUT_ABOVE_16(*r_dst);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_V = VFLAG_ADD_16(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
+	m68ki_set_add_flags_16(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_16(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_16(*r_dst) | MASK_OUT_ABOVE_16(res);
 }
 
 
@@ -1123,12 +1039,9 @@ M68KMAKE_OP(add, 16, er, a)
 	uint dst = MASK_OUT_ABOVE_16(*r_dst);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_V = VFLAG_ADD_16(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
+	m68ki_set_add_flags_16(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_16(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_16(*r_dst) | MASK_OUT_ABOVE_16(res);
 }
 
 
@@ -1139,12 +1052,9 @@ M68KMAKE_OP(add, 16, er, .)
 	uint dst = MASK_OUT_ABOVE_16(*r_dst);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_V = VFLAG_ADD_16(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
+	m68ki_set_add_flags_16(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_16(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_16(*r_dst) | MASK_OUT_ABOVE_16(res);
 }
 
 
@@ -1155,12 +1065,9 @@ M68KMAKE_OP(add, 32, er, d)
 	uint dst = *r_dst;
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_V = VFLAG_ADD_32(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_ADD_32(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
+	m68ki_set_add_flags_32(src, dst, res);
 
-	*r_dst = FLAG_Z;
+	*r_dst = MASK_OUT_ABOVE_32(res);
 }
 
 
@@ -1171,12 +1078,9 @@ M68KMAKE_OP(add, 32, er, a)
 	uint dst = *r_dst;
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_V = VFLAG_ADD_32(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_ADD_32(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
+	m68ki_set_add_flags_32(src, dst, res);
 
-	*r_dst = FLAG_Z;
+	*r_dst = MASK_OUT_ABOVE_32(res);
 }
 
 
@@ -1187,12 +1091,9 @@ M68KMAKE_OP(add, 32, er, .)
 	uint dst = *r_dst;
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_V = VFLAG_ADD_32(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_ADD_32(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
+	m68ki_set_add_flags_32(src, dst, res);
 
-	*r_dst = FLAG_Z;
+	*r_dst = MASK_OUT_ABOVE_32(res);
 }
 
 
@@ -1203,12 +1104,9 @@ M68KMAKE_OP(add, 8, re, .)
 	uint dst = m68ki_read_8(ea);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_V = VFLAG_ADD_8(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
+	m68ki_set_add_flags_8(src, dst, res);
 
-	m68ki_write_8(ea, FLAG_Z);
+	m68ki_write_8(ea, MASK_OUT_ABOVE_8(res));
 }
 
 
@@ -1219,12 +1117,9 @@ M68KMAKE_OP(add, 16, re, .)
 	uint dst = m68ki_read_16(ea);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_V = VFLAG_ADD_16(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
+	m68ki_set_add_flags_16(src, dst, res);
 
-	m68ki_write_16(ea, FLAG_Z);
+	m68ki_write_16(ea, MASK_OUT_ABOVE_16(res));
 }
 
 
@@ -1235,12 +1130,9 @@ M68KMAKE_OP(add, 32, re, .)
 	uint dst = m68ki_read_32(ea);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_V = VFLAG_ADD_32(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_ADD_32(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
+	m68ki_set_add_flags_32(src, dst, res);
 
-	m68ki_write_32(ea, FLAG_Z);
+	m68ki_write_32(ea, MASK_OUT_ABOVE_32(res));
 }
 
 
@@ -1301,12 +1193,9 @@ M68KMAKE_OP(addi, 8, ., d)
 	uint dst = MASK_OUT_ABOVE_8(*r_dst);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_V = VFLAG_ADD_8(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
+	m68ki_set_add_flags_8(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_8(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_8(*r_dst) | MASK_OUT_ABOVE_8(res);
 }
 
 
@@ -1317,12 +1206,9 @@ M68KMAKE_OP(addi, 8, ., .)
 	uint dst = m68ki_read_8(ea);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_V = VFLAG_ADD_8(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
+	m68ki_set_add_flags_8(src, dst, res);
 
-	m68ki_write_8(ea, FLAG_Z);
+	m68ki_write_8(ea, MASK_OUT_ABOVE_8(res));
 }
 
 
@@ -1333,12 +1219,9 @@ M68KMAKE_OP(addi, 16, ., d)
 	uint dst = MASK_OUT_ABOVE_16(*r_dst);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_V = VFLAG_ADD_16(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
+	m68ki_set_add_flags_16(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_16(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_16(*r_dst) | MASK_OUT_ABOVE_16(res);
 }
 
 
@@ -1349,12 +1232,9 @@ M68KMAKE_OP(addi, 16, ., .)
 	uint dst = m68ki_read_16(ea);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_V = VFLAG_ADD_16(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
+	m68ki_set_add_flags_16(src, dst, res);
 
-	m68ki_write_16(ea, FLAG_Z);
+	m68ki_write_16(ea, MASK_OUT_ABOVE_16(res));
 }
 
 
@@ -1365,12 +1245,9 @@ M68KMAKE_OP(addi, 32, ., d)
 	uint dst = *r_dst;
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_V = VFLAG_ADD_32(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_ADD_32(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
+	m68ki_set_add_flags_32(src, dst, res);
 
-	*r_dst = FLAG_Z;
+	*r_dst = MASK_OUT_ABOVE_32(res);
 }
 
 
@@ -1381,12 +1258,9 @@ M68KMAKE_OP(addi, 32, ., .)
 	uint dst = m68ki_read_32(ea);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_V = VFLAG_ADD_32(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_ADD_32(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
+	m68ki_set_add_flags_32(src, dst, res);
 
-	m68ki_write_32(ea, FLAG_Z);
+	m68ki_write_32(ea, MASK_OUT_ABOVE_32(res));
 }
 
 
@@ -1397,12 +1271,9 @@ M68KMAKE_OP(addq, 8, ., d)
 	uint dst = MASK_OUT_ABOVE_8(*r_dst);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_V = VFLAG_ADD_8(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
+	m68ki_set_add_flags_8(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_8(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_8(*r_dst) | MASK_OUT_ABOVE_8(res);
 }
 
 
@@ -1413,12 +1284,9 @@ M68KMAKE_OP(addq, 8, ., .)
 	uint dst = m68ki_read_8(ea);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_V = VFLAG_ADD_8(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
+	m68ki_set_add_flags_8(src, dst, res);
 
-	m68ki_write_8(ea, FLAG_Z);
+	m68ki_write_8(ea, MASK_OUT_ABOVE_8(res));
 }
 
 
@@ -1429,12 +1297,9 @@ M68KMAKE_OP(addq, 16, ., d)
 	uint dst = MASK_OUT_ABOVE_16(*r_dst);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_V = VFLAG_ADD_16(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
+	m68ki_set_add_flags_16(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_16(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_16(*r_dst) | MASK_OUT_ABOVE_16(res);
 }
 
 
@@ -1453,12 +1318,9 @@ M68KMAKE_OP(addq, 16, ., .)
 	uint dst = m68ki_read_16(ea);
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_V = VFLAG_ADD_16(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
+	m68ki_set_add_flags_16(src, dst, res);
 
-	m68ki_write_16(ea, FLAG_Z);
+	m68ki_write_16(ea, MASK_OUT_ABOVE_16(res));
 }
 
 
@@ -1469,12 +1331,9 @@ M68KMAKE_OP(addq, 32, ., d)
 	uint dst = *r_dst;
 	uint res = src + dst;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_V = VFLAG_ADD_32(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_ADD_32(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
+	m68ki_set_add_flags_32(src, dst, res);
 
-	*r_dst = FLAG_Z;
+	*r_dst = MASK_OUT_ABOVE_32(res);
 }
 
 
@@ -1494,12 +1353,9 @@ M68KMAKE_OP(addq, 32, ., .)
 	uint res = src + dst;
 
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_V = VFLAG_ADD_32(src, dst, res);
-	FLAG_X = FLAG_C = CFLAG_ADD_32(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
+	m68ki_set_add_flags_32(src, dst, res);
 
-	m68ki_write_32(ea, FLAG_Z);
+	m68ki_write_32(ea, MASK_OUT_ABOVE_32(res));
 }
 
 
@@ -1667,61 +1523,37 @@ M68KMAKE_OP(addx, 32, mm, .)
 
 M68KMAKE_OP(and, 8, er, d)
 {
-	FLAG_Z = MASK_OUT_ABOVE_8(DX &= (DY | 0xffffff00));
-
-	FLAG_N = NFLAG_8(FLAG_Z);
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(MASK_OUT_ABOVE_8(DX &= (DY | 0xffffff00)));
 }
 
 
 M68KMAKE_OP(and, 8, er, .)
 {
-	FLAG_Z = MASK_OUT_ABOVE_8(DX &= (M68KMAKE_GET_OPER_AY_8 | 0xffffff00));
-
-	FLAG_N = NFLAG_8(FLAG_Z);
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(MASK_OUT_ABOVE_8(DX &= (M68KMAKE_GET_OPER_AY_8 | 0xffffff00)));
 }
 
 
 M68KMAKE_OP(and, 16, er, d)
 {
-	FLAG_Z = MASK_OUT_ABOVE_16(DX &= (DY | 0xffff0000));
-
-	FLAG_N = NFLAG_16(FLAG_Z);
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(MASK_OUT_ABOVE_16(DX &= (DY | 0xffff0000)));
 }
 
 
 M68KMAKE_OP(and, 16, er, .)
 {
-	FLAG_Z = MASK_OUT_ABOVE_16(DX &= (M68KMAKE_GET_OPER_AY_16 | 0xffff0000));
-
-	FLAG_N = NFLAG_16(FLAG_Z);
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(MASK_OUT_ABOVE_16(DX &= (M68KMAKE_GET_OPER_AY_16 | 0xffff0000)));
 }
 
 
 M68KMAKE_OP(and, 32, er, d)
 {
-	FLAG_Z = DX &= DY;
-
-	FLAG_N = NFLAG_32(FLAG_Z);
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(DX &= DY);
 }
 
 
 M68KMAKE_OP(and, 32, er, .)
 {
-	FLAG_Z = DX &= M68KMAKE_GET_OPER_AY_32;
-
-	FLAG_N = NFLAG_32(FLAG_Z);
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(DX &= M68KMAKE_GET_OPER_AY_32);
 }
 
 
@@ -1758,10 +1590,7 @@ M68KMAKE_OP(and, 32, re, .)
 	uint ea = M68KMAKE_GET_EA_AY_32;
 	uint res = DX & m68ki_read_32(ea);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 
 	m68ki_write_32(ea, res);
 }
@@ -1769,11 +1598,7 @@ M68KMAKE_OP(and, 32, re, .)
 
 M68KMAKE_OP(andi, 8, ., d)
 {
-	FLAG_Z = MASK_OUT_ABOVE_8(DY &= (OPER_I_8() | 0xffffff00));
-
-	FLAG_N = NFLAG_8(FLAG_Z);
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(MASK_OUT_ABOVE_8(DY &= (OPER_I_8() | 0xffffff00)));
 }
 
 
@@ -1783,10 +1608,7 @@ M68KMAKE_OP(andi, 8, ., .)
 	uint ea = M68KMAKE_GET_EA_AY_8;
 	uint res = src & m68ki_read_8(ea);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 
 	m68ki_write_8(ea, res);
 }
@@ -1794,11 +1616,7 @@ M68KMAKE_OP(andi, 8, ., .)
 
 M68KMAKE_OP(andi, 16, ., d)
 {
-	FLAG_Z = MASK_OUT_ABOVE_16(DY &= (OPER_I_16() | 0xffff0000));
-
-	FLAG_N = NFLAG_16(FLAG_Z);
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(MASK_OUT_ABOVE_16(DY &= (OPER_I_16() | 0xffff0000)));
 }
 
 
@@ -1808,10 +1626,7 @@ M68KMAKE_OP(andi, 16, ., .)
 	uint ea = M68KMAKE_GET_EA_AY_16;
 	uint res = src & m68ki_read_16(ea);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 
 	m68ki_write_16(ea, res);
 }
@@ -1819,11 +1634,7 @@ M68KMAKE_OP(andi, 16, ., .)
 
 M68KMAKE_OP(andi, 32, ., d)
 {
-	FLAG_Z = DY &= (OPER_I_32());
-
-	FLAG_N = NFLAG_32(FLAG_Z);
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(DY &= (OPER_I_32()));
 }
 
 
@@ -1833,10 +1644,7 @@ M68KMAKE_OP(andi, 32, ., .)
 	uint ea = M68KMAKE_GET_EA_AY_32;
 	uint res = src & m68ki_read_32(ea);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 
 	m68ki_write_32(ea, res);
 }
@@ -1973,10 +1781,7 @@ M68KMAKE_OP(asr, 8, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_8(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(src);
 }
 
 
@@ -2026,10 +1831,7 @@ M68KMAKE_OP(asr, 16, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_16(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(src);
 }
 
 
@@ -2079,10 +1881,7 @@ M68KMAKE_OP(asr, 32, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_32(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(src);
 }
 
 
@@ -2195,10 +1994,7 @@ M68KMAKE_OP(asl, 8, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_8(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(src);
 }
 
 
@@ -2233,10 +2029,7 @@ M68KMAKE_OP(asl, 16, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_16(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(src);
 }
 
 
@@ -2271,10 +2064,7 @@ M68KMAKE_OP(asl, 32, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_32(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(src);
 }
 
 
@@ -2300,6 +2090,7 @@ M68KMAKE_OP(bcc, 8, ., .)
 	{
 		m68ki_trace_t0();			   /* auto-disable (see m68kcpu.h) */
 		m68ki_branch_8(MASK_OUT_ABOVE_8(REG_IR));
+		m68ki_skip_loop_bcc();		   /* auto-disable (see m68kcpu.h) */
 		return;
 	}
 	USE_CYCLES(CYC_BCC_NOTAKE_B);
@@ -2906,10 +2697,7 @@ M68KMAKE_OP(bfins, 32, ., .)
 
 		insert_base = MASK_OUT_ABOVE_32(insert_base << (32 - width));
 
-		FLAG_N = NFLAG_32(insert_base);
-		FLAG_Z = insert_base;
-		FLAG_V = VFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
+		m68ki_set_logic_flags_32(insert_base);
 
 		data.field = (data.field & ~mask_base) | insert_base;
 		m68ki_store_bitfield(ea, offset, width, data.field, &data);
@@ -3179,6 +2967,7 @@ M68KMAKE_OP(bsr, 8, ., .)
 	m68ki_trace_t0();				   /* auto-disable (see m68kcpu.h) */
 	m68ki_push_32(REG_PC);
 	m68ki_branch_8(MASK_OUT_ABOVE_8(REG_IR));
+	m68ki_call_enter();				   /* auto-disable (see m68kcpu.h) */
 }
 
 
@@ -3189,6 +2978,7 @@ M68KMAKE_OP(bsr, 16, ., .)
 	m68ki_push_32(REG_PC);
 	REG_PC -= 2;
 	m68ki_branch_16(offset);
+	m68ki_call_enter();			   /* auto-disable (see m68kcpu.h) */
 }
 
 
@@ -3201,6 +2991,7 @@ M68KMAKE_OP(bsr, 32, ., .)
 		m68ki_push_32(REG_PC);
 		REG_PC -= 4;
 		m68ki_branch_32(offset);
+		m68ki_call_enter();		   /* auto-disable (see m68kcpu.h) */
 		return;
 	}
 	else
@@ -3208,6 +2999,7 @@ M68KMAKE_OP(bsr, 32, ., .)
 		m68ki_trace_t0();				   /* auto-disable (see m68kcpu.h) */
 		m68ki_push_32(REG_PC);
 		m68ki_branch_8(MASK_OUT_ABOVE_8(REG_IR));
+		m68ki_call_enter();			   /* auto-disable (see m68kcpu.h) */
 	}
 }
 
@@ -3736,10 +3528,7 @@ M68KMAKE_OP(clr, 8, ., d)
 {
 	DY &= 0xffffff00;
 
-	FLAG_N = NFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_Z = ZFLAG_SET;
+	m68ki_set_logic_flags_32(0);
 }
 
 
@@ -3747,10 +3536,7 @@ M68KMAKE_OP(clr, 8, ., .)
 {
 	m68ki_write_8(M68KMAKE_GET_EA_AY_8, 0);
 
-	FLAG_N = NFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_Z = ZFLAG_SET;
+	m68ki_set_logic_flags_32(0);
 }
 
 
@@ -3758,10 +3544,7 @@ M68KMAKE_OP(clr, 16, ., d)
 {
 	DY &= 0xffff0000;
 
-	FLAG_N = NFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_Z = ZFLAG_SET;
+	m68ki_set_logic_flags_32(0);
 }
 
 
@@ -3769,10 +3552,7 @@ M68KMAKE_OP(clr, 16, ., .)
 {
 	m68ki_write_16(M68KMAKE_GET_EA_AY_16, 0);
 
-	FLAG_N = NFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_Z = ZFLAG_SET;
+	m68ki_set_logic_flags_32(0);
 }
 
 
@@ -3780,10 +3560,7 @@ M68KMAKE_OP(clr, 32, ., d)
 {
 	DY = 0;
 
-	FLAG_N = NFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_Z = ZFLAG_SET;
+	m68ki_set_logic_flags_32(0);
 }
 
 
@@ -3791,10 +3568,7 @@ M68KMAKE_OP(clr, 32, ., .)
 {
 	m68ki_write_32(M68KMAKE_GET_EA_AY_32, 0);
 
-	FLAG_N = NFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_Z = ZFLAG_SET;
+	m68ki_set_logic_flags_32(0);
 }
 
 
@@ -3804,10 +3578,7 @@ M68KMAKE_OP(cmp, 8, ., d)
 	uint dst = MASK_OUT_ABOVE_8(DX);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
-	FLAG_C = CFLAG_8(res);
+	m68ki_set_cmp_flags_8(src, dst, res);
 }
 
 
@@ -3817,10 +3588,7 @@ M68KMAKE_OP(cmp, 8, ., .)
 	uint dst = MASK_OUT_ABOVE_8(DX);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
-	FLAG_C = CFLAG_8(res);
+	m68ki_set_cmp_flags_8(src, dst, res);
 }
 
 
@@ -3830,10 +3598,7 @@ M68KMAKE_OP(cmp, 16, ., d)
 	uint dst = MASK_OUT_ABOVE_16(DX);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
-	FLAG_C = CFLAG_16(res);
+	m68ki_set_cmp_flags_16(src, dst, res);
 }
 
 
@@ -3843,10 +3608,7 @@ M68KMAKE_OP(cmp, 16, ., a)
 	uint dst = MASK_OUT_ABOVE_16(DX);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
-	FLAG_C = CFLAG_16(res);
+	m68ki_set_cmp_flags_16(src, dst, res);
 }
 
 
@@ -3856,10 +3618,7 @@ M68KMAKE_OP(cmp, 16, ., .)
 	uint dst = MASK_OUT_ABOVE_16(DX);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
-	FLAG_C = CFLAG_16(res);
+	m68ki_set_cmp_flags_16(src, dst, res);
 }
 
 
@@ -3869,10 +3628,7 @@ M68KMAKE_OP(cmp, 32, ., d)
 	uint dst = DX;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_C = CFLAG_SUB_32(src, dst, res);
+	m68ki_set_cmp_flags_32(src, dst, res);
 }
 
 
@@ -3882,10 +3638,7 @@ M68KMAKE_OP(cmp, 32, ., a)
 	uint dst = DX;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_C = CFLAG_SUB_32(src, dst, res);
+	m68ki_set_cmp_flags_32(src, dst, res);
 }
 
 
@@ -3895,10 +3648,7 @@ M68KMAKE_OP(cmp, 32, ., .)
 	uint dst = DX;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_C = CFLAG_SUB_32(src, dst, res);
+	m68ki_set_cmp_flags_32(src, dst, res);
 }
 
 
@@ -3908,10 +3658,7 @@ M68KMAKE_OP(cmpa, 16, ., d)
 	uint dst = AX;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_C = CFLAG_SUB_32(src, dst, res);
+	m68ki_set_cmp_flags_32(src, dst, res);
 }
 
 
@@ -3921,10 +3668,7 @@ M68KMAKE_OP(cmpa, 16, ., a)
 	uint dst = AX;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_C = CFLAG_SUB_32(src, dst, res);
+	m68ki_set_cmp_flags_32(src, dst, res);
 }
 
 
@@ -3934,10 +3678,7 @@ M68KMAKE_OP(cmpa, 16, ., .)
 	uint dst = AX;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_C = CFLAG_SUB_32(src, dst, res);
+	m68ki_set_cmp_flags_32(src, dst, res);
 }
 
 
@@ -3947,10 +3688,7 @@ M68KMAKE_OP(cmpa, 32, ., d)
 	uint dst = AX;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_C = CFLAG_SUB_32(src, dst, res);
+	m68ki_set_cmp_flags_32(src, dst, res);
 }
 
 
@@ -3960,10 +3698,7 @@ M68KMAKE_OP(cmpa, 32, ., a)
 	uint dst = AX;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_C = CFLAG_SUB_32(src, dst, res);
+	m68ki_set_cmp_flags_32(src, dst, res);
 }
 
 
@@ -3973,10 +3708,7 @@ M68KMAKE_OP(cmpa, 32, ., .)
 	uint dst = AX;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_C = CFLAG_SUB_32(src, dst, res);
+	m68ki_set_cmp_flags_32(src, dst, res);
 }
 
 
@@ -3986,10 +3718,7 @@ M68KMAKE_OP(cmpi, 8, ., d)
 	uint dst = MASK_OUT_ABOVE_8(DY);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
-	FLAG_C = CFLAG_8(res);
+	m68ki_set_cmp_flags_8(src, dst, res);
 }
 
 
@@ -3999,10 +3728,7 @@ M68KMAKE_OP(cmpi, 8, ., .)
 	uint dst = M68KMAKE_GET_OPER_AY_8;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
-	FLAG_C = CFLAG_8(res);
+	m68ki_set_cmp_flags_8(src, dst, res);
 }
 
 
@@ -4014,10 +3740,7 @@ M68KMAKE_OP(cmpi, 8, ., pcdi)
 		uint dst = OPER_PCDI_8();
 		uint res = dst - src;
 
-		FLAG_N = NFLAG_8(res);
-		FLAG_Z = MASK_OUT_ABOVE_8(res);
-		FLAG_V = VFLAG_SUB_8(src, dst, res);
-		FLAG_C = CFLAG_8(res);
+		m68ki_set_cmp_flags_8(src, dst, res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -4032,10 +3755,7 @@ M68KMAKE_OP(cmpi, 8, ., pcix)
 		uint dst = OPER_PCIX_8();
 		uint res = dst - src;
 
-		FLAG_N = NFLAG_8(res);
-		FLAG_Z = MASK_OUT_ABOVE_8(res);
-		FLAG_V = VFLAG_SUB_8(src, dst, res);
-		FLAG_C = CFLAG_8(res);
+		m68ki_set_cmp_flags_8(src, dst, res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -4048,10 +3768,7 @@ M68KMAKE_OP(cmpi, 16, ., d)
 	uint dst = MASK_OUT_ABOVE_16(DY);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
-	FLAG_C = CFLAG_16(res);
+	m68ki_set_cmp_flags_16(src, dst, res);
 }
 
 
@@ -4061,10 +3778,7 @@ M68KMAKE_OP(cmpi, 16, ., .)
 	uint dst = M68KMAKE_GET_OPER_AY_16;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
-	FLAG_C = CFLAG_16(res);
+	m68ki_set_cmp_flags_16(src, dst, res);
 }
 
 
@@ -4076,10 +3790,7 @@ M68KMAKE_OP(cmpi, 16, ., pcdi)
 		uint dst = OPER_PCDI_16();
 		uint res = dst - src;
 
-		FLAG_N = NFLAG_16(res);
-		FLAG_Z = MASK_OUT_ABOVE_16(res);
-		FLAG_V = VFLAG_SUB_16(src, dst, res);
-		FLAG_C = CFLAG_16(res);
+		m68ki_set_cmp_flags_16(src, dst, res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -4094,10 +3805,7 @@ M68KMAKE_OP(cmpi, 16, ., pcix)
 		uint dst = OPER_PCIX_16();
 		uint res = dst - src;
 
-		FLAG_N = NFLAG_16(res);
-		FLAG_Z = MASK_OUT_ABOVE_16(res);
-		FLAG_V = VFLAG_SUB_16(src, dst, res);
-		FLAG_C = CFLAG_16(res);
+		m68ki_set_cmp_flags_16(src, dst, res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -4111,10 +3819,7 @@ M68KMAKE_OP(cmpi, 32, ., d)
 	uint res = dst - src;
 
 	m68ki_cmpild_callback(src, REG_IR & 7);		   /* auto-disable (see m68kcpu.h) */
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_C = CFLAG_SUB_32(src, dst, res);
+	m68ki_set_cmp_flags_32(src, dst, res);
 }
 
 
@@ -4124,10 +3829,7 @@ M68KMAKE_OP(cmpi, 32, ., .)
 	uint dst = M68KMAKE_GET_OPER_AY_32;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_C = CFLAG_SUB_32(src, dst, res);
+	m68ki_set_cmp_flags_32(src, dst, res);
 }
 
 
@@ -4139,10 +3841,7 @@ M68KMAKE_OP(cmpi, 32, ., pcdi)
 		uint dst = OPER_PCDI_32();
 		uint res = dst - src;
 
-		FLAG_N = NFLAG_32(res);
-		FLAG_Z = MASK_OUT_ABOVE_32(res);
-		FLAG_V = VFLAG_SUB_32(src, dst, res);
-		FLAG_C = CFLAG_SUB_32(src, dst, res);
+		m68ki_set_cmp_flags_32(src, dst, res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -4157,10 +3856,7 @@ M68KMAKE_OP(cmpi, 32, ., pcix)
 		uint dst = OPER_PCIX_32();
 		uint res = dst - src;
 
-		FLAG_N = NFLAG_32(res);
-		FLAG_Z = MASK_OUT_ABOVE_32(res);
-		FLAG_V = VFLAG_SUB_32(src, dst, res);
-		FLAG_C = CFLAG_SUB_32(src, dst, res);
+		m68ki_set_cmp_flags_32(src, dst, res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -4173,10 +3869,7 @@ M68KMAKE_OP(cmpm, 8, ., ax7)
 	uint dst = OPER_A7_PI_8();
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
-	FLAG_C = CFLAG_8(res);
+	m68ki_set_cmp_flags_8(src, dst, res);
 }
 
 
@@ -4186,10 +3879,7 @@ M68KMAKE_OP(cmpm, 8, ., ay7)
 	uint dst = OPER_AX_PI_8();
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
-	FLAG_C = CFLAG_8(res);
+	m68ki_set_cmp_flags_8(src, dst, res);
 }
 
 
@@ -4199,10 +3889,7 @@ M68KMAKE_OP(cmpm, 8, ., axy7)
 	uint dst = OPER_A7_PI_8();
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
-	FLAG_C = CFLAG_8(res);
+	m68ki_set_cmp_flags_8(src, dst, res);
 }
 
 
@@ -4212,10 +3899,7 @@ M68KMAKE_OP(cmpm, 8, ., .)
 	uint dst = OPER_AX_PI_8();
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
-	FLAG_C = CFLAG_8(res);
+	m68ki_set_cmp_flags_8(src, dst, res);
 }
 
 
@@ -4225,10 +3909,7 @@ M68KMAKE_OP(cmpm, 16, ., .)
 	uint dst = OPER_AX_PI_16();
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
-	FLAG_C = CFLAG_16(res);
+	m68ki_set_cmp_flags_16(src, dst, res);
 }
 
 
@@ -4238,10 +3919,7 @@ M68KMAKE_OP(cmpm, 32, ., .)
 	uint dst = OPER_AX_PI_32();
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_C = CFLAG_SUB_32(src, dst, res);
+	m68ki_set_cmp_flags_32(src, dst, res);
 }
 
 
@@ -4331,6 +4009,7 @@ M68KMAKE_OP(dbf, 16, ., .)
 		m68ki_trace_t0();			   /* auto-disable (see m68kcpu.h) */
 		m68ki_branch_16(offset);
 		USE_CYCLES(CYC_DBCC_F_NOEXP);
+		m68ki_skip_loop_dbcc(r_dst);	   /* auto-disable (see m68kcpu.h) */
 		return;
 	}
 	REG_PC += 2;
@@ -4353,6 +4032,7 @@ M68KMAKE_OP(dbcc, 16, ., .)
 			m68ki_trace_t0();			   /* auto-disable (see m68kcpu.h) */
 			m68ki_branch_16(offset);
 			USE_CYCLES(CYC_DBCC_F_NOEXP);
+			m68ki_skip_loop_dbcc(r_dst);	   /* auto-disable (see m68kcpu.h) */
 			return;
 		}
 		REG_PC += 2;
@@ -4687,10 +4367,7 @@ M68KMAKE_OP(divl, 32, ., d)
 				quotient = REG_D[(word2 >> 12) & 7] = MASK_OUT_ABOVE_32(dividend_lo) / MASK_OUT_ABOVE_32(divisor);
 			}
 
-			FLAG_N = NFLAG_32(quotient);
-			FLAG_Z = quotient;
-			FLAG_V = VFLAG_CLEAR;
-			FLAG_C = CFLAG_CLEAR;
+			m68ki_set_logic_flags_32(quotient);
 			return;
 		}
 		m68ki_exception_trap(EXCEPTION_ZERO_DIVIDE);
@@ -4898,10 +4575,7 @@ M68KMAKE_OP(divl, 32, ., .)
 				quotient = REG_D[(word2 >> 12) & 7] = MASK_OUT_ABOVE_32(dividend_lo) / MASK_OUT_ABOVE_32(divisor);
 			}
 
-			FLAG_N = NFLAG_32(quotient);
-			FLAG_Z = quotient;
-			FLAG_V = VFLAG_CLEAR;
-			FLAG_C = CFLAG_CLEAR;
+			m68ki_set_logic_flags_32(quotient);
 			return;
 		}
 		m68ki_exception_trap(EXCEPTION_ZERO_DIVIDE);
@@ -4917,10 +4591,7 @@ M68KMAKE_OP(eor, 8, ., d)
 {
 	uint res = MASK_OUT_ABOVE_8(DY ^= MASK_OUT_ABOVE_8(DX));
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -4931,10 +4602,7 @@ M68KMAKE_OP(eor, 8, ., .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -4942,10 +4610,7 @@ M68KMAKE_OP(eor, 16, ., d)
 {
 	uint res = MASK_OUT_ABOVE_16(DY ^= MASK_OUT_ABOVE_16(DX));
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -4956,10 +4621,7 @@ M68KMAKE_OP(eor, 16, ., .)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -4967,10 +4629,7 @@ M68KMAKE_OP(eor, 32, ., d)
 {
 	uint res = DY ^= DX;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -4981,10 +4640,7 @@ M68KMAKE_OP(eor, 32, ., .)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -4992,10 +4648,7 @@ M68KMAKE_OP(eori, 8, ., d)
 {
 	uint res = MASK_OUT_ABOVE_8(DY ^= OPER_I_8());
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5007,10 +4660,7 @@ M68KMAKE_OP(eori, 8, ., .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5018,10 +4668,7 @@ M68KMAKE_OP(eori, 16, ., d)
 {
 	uint res = MASK_OUT_ABOVE_16(DY ^= OPER_I_16());
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -5033,10 +4680,7 @@ M68KMAKE_OP(eori, 16, ., .)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -5044,10 +4688,7 @@ M68KMAKE_OP(eori, 32, ., d)
 {
 	uint res = DY ^= OPER_I_32();
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -5059,10 +4700,7 @@ M68KMAKE_OP(eori, 32, ., .)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -5179,6 +4817,7 @@ M68KMAKE_OP(jsr, 32, ., .)
 	m68ki_trace_t0();				   /* auto-disable (see m68kcpu.h) */
 	m68ki_push_32(REG_PC);
 	m68ki_jump(ea);
+	m68ki_call_enter();				   /* auto-disable (see m68kcpu.h) */
 }
 
 
@@ -5190,6 +4829,7 @@ M68KMAKE_OP(lea, 32, ., .)
 
 M68KMAKE_OP(link, 16, ., a7)
 {
+	m68ki_save_sp();
 	REG_A[7] -= 4;
 	m68ki_write_32(REG_A[7], REG_A[7]);
 	REG_A[7] = MASK_OUT_ABOVE_32(REG_A[7] + MAKE_INT_16(OPER_I_16()));
@@ -5201,6 +4841,7 @@ M68KMAKE_OP(link, 16, ., .)
 	uint* r_dst = &AY;
 
 	m68ki_push_32(*r_dst);
+	m68ki_save_ay();
 	*r_dst = REG_A[7];
 	REG_A[7] = MASK_OUT_ABOVE_32(REG_A[7] + MAKE_INT_16(OPER_I_16()));
 }
@@ -5210,6 +4851,7 @@ M68KMAKE_OP(link, 32, ., a7)
 {
 	if(CPU_TYPE_IS_EC020_PLUS(CPU_TYPE))
 	{
+		m68ki_save_sp();
 		REG_A[7] -= 4;
 		m68ki_write_32(REG_A[7], REG_A[7]);
 		REG_A[7] = MASK_OUT_ABOVE_32(REG_A[7] + OPER_I_32());
@@ -5226,6 +4868,7 @@ M68KMAKE_OP(link, 32, ., .)
 		uint* r_dst = &AY;
 
 		m68ki_push_32(*r_dst);
+		m68ki_save_ay();
 		*r_dst = REG_A[7];
 		REG_A[7] = MASK_OUT_ABOVE_32(REG_A[7] + OPER_I_32());
 		return;
@@ -5315,17 +4958,11 @@ M68KMAKE_OP(lsr, 8, r, .)
 
 		*r_dst &= 0xffffff00;
 		FLAG_X = XFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
-		FLAG_N = NFLAG_CLEAR;
-		FLAG_Z = ZFLAG_SET;
-		FLAG_V = VFLAG_CLEAR;
+		m68ki_set_logic_flags_32(0);
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_8(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(src);
 }
 
 
@@ -5353,17 +4990,11 @@ M68KMAKE_OP(lsr, 16, r, .)
 
 		*r_dst &= 0xffff0000;
 		FLAG_X = XFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
-		FLAG_N = NFLAG_CLEAR;
-		FLAG_Z = ZFLAG_SET;
-		FLAG_V = VFLAG_CLEAR;
+		m68ki_set_logic_flags_32(0);
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_16(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(src);
 }
 
 
@@ -5397,10 +5028,7 @@ M68KMAKE_OP(lsr, 32, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_32(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(src);
 }
 
 
@@ -5500,17 +5128,11 @@ M68KMAKE_OP(lsl, 8, r, .)
 
 		*r_dst &= 0xffffff00;
 		FLAG_X = XFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
-		FLAG_N = NFLAG_CLEAR;
-		FLAG_Z = ZFLAG_SET;
-		FLAG_V = VFLAG_CLEAR;
+		m68ki_set_logic_flags_32(0);
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_8(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(src);
 }
 
 
@@ -5538,17 +5160,11 @@ M68KMAKE_OP(lsl, 16, r, .)
 
 		*r_dst &= 0xffff0000;
 		FLAG_X = XFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
-		FLAG_N = NFLAG_CLEAR;
-		FLAG_Z = ZFLAG_SET;
-		FLAG_V = VFLAG_CLEAR;
+		m68ki_set_logic_flags_32(0);
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_16(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(src);
 }
 
 
@@ -5582,10 +5198,7 @@ M68KMAKE_OP(lsl, 32, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_32(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(src);
 }
 
 
@@ -5611,10 +5224,7 @@ M68KMAKE_OP(move, 8, d, d)
 
 	*r_dst = MASK_OUT_BELOW_8(*r_dst) | res;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5625,10 +5235,7 @@ M68KMAKE_OP(move, 8, d, .)
 
 	*r_dst = MASK_OUT_BELOW_8(*r_dst) | res;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5639,10 +5246,7 @@ M68KMAKE_OP(move, 8, ai, d)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5653,10 +5257,7 @@ M68KMAKE_OP(move, 8, ai, .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5667,10 +5268,7 @@ M68KMAKE_OP(move, 8, pi7, d)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5681,10 +5279,7 @@ M68KMAKE_OP(move, 8, pi, d)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5695,10 +5290,7 @@ M68KMAKE_OP(move, 8, pi7, .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5709,10 +5301,7 @@ M68KMAKE_OP(move, 8, pi, .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5723,10 +5312,7 @@ M68KMAKE_OP(move, 8, pd7, d)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5737,10 +5323,7 @@ M68KMAKE_OP(move, 8, pd, d)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5751,10 +5334,7 @@ M68KMAKE_OP(move, 8, pd7, .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5765,10 +5345,7 @@ M68KMAKE_OP(move, 8, pd, .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5779,10 +5356,7 @@ M68KMAKE_OP(move, 8, di, d)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5793,10 +5367,7 @@ M68KMAKE_OP(move, 8, di, .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5807,10 +5378,7 @@ M68KMAKE_OP(move, 8, ix, d)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5821,10 +5389,7 @@ M68KMAKE_OP(move, 8, ix, .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5835,10 +5400,7 @@ M68KMAKE_OP(move, 8, aw, d)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5849,10 +5411,7 @@ M68KMAKE_OP(move, 8, aw, .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5863,10 +5422,7 @@ M68KMAKE_OP(move, 8, al, d)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5877,10 +5433,7 @@ M68KMAKE_OP(move, 8, al, .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -5891,10 +5444,7 @@ M68KMAKE_OP(move, 16, d, d)
 
 	*r_dst = MASK_OUT_BELOW_16(*r_dst) | res;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -5905,10 +5455,7 @@ M68KMAKE_OP(move, 16, d, a)
 
 	*r_dst = MASK_OUT_BELOW_16(*r_dst) | res;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -5919,10 +5466,7 @@ M68KMAKE_OP(move, 16, d, .)
 
 	*r_dst = MASK_OUT_BELOW_16(*r_dst) | res;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -5933,10 +5477,7 @@ M68KMAKE_OP(move, 16, ai, d)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -5947,10 +5488,7 @@ M68KMAKE_OP(move, 16, ai, a)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -5961,10 +5499,7 @@ M68KMAKE_OP(move, 16, ai, .)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -5975,10 +5510,7 @@ M68KMAKE_OP(move, 16, pi, d)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -5989,10 +5521,7 @@ M68KMAKE_OP(move, 16, pi, a)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6003,10 +5532,7 @@ M68KMAKE_OP(move, 16, pi, .)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6017,10 +5543,7 @@ M68KMAKE_OP(move, 16, pd, d)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6031,10 +5554,7 @@ M68KMAKE_OP(move, 16, pd, a)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6045,10 +5565,7 @@ M68KMAKE_OP(move, 16, pd, .)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6059,10 +5576,7 @@ M68KMAKE_OP(move, 16, di, d)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6073,10 +5587,7 @@ M68KMAKE_OP(move, 16, di, a)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6087,10 +5598,7 @@ M68KMAKE_OP(move, 16, di, .)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6101,10 +5609,7 @@ M68KMAKE_OP(move, 16, ix, d)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6115,10 +5620,7 @@ M68KMAKE_OP(move, 16, ix, a)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6129,10 +5631,7 @@ M68KMAKE_OP(move, 16, ix, .)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6143,10 +5642,7 @@ M68KMAKE_OP(move, 16, aw, d)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6157,10 +5653,7 @@ M68KMAKE_OP(move, 16, aw, a)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6171,10 +5664,7 @@ M68KMAKE_OP(move, 16, aw, .)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6185,10 +5675,7 @@ M68KMAKE_OP(move, 16, al, d)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6199,10 +5686,7 @@ M68KMAKE_OP(move, 16, al, a)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6213,10 +5697,7 @@ M68KMAKE_OP(move, 16, al, .)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -6227,10 +5708,7 @@ M68KMAKE_OP(move, 32, d, d)
 
 	*r_dst = res;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6241,10 +5719,7 @@ M68KMAKE_OP(move, 32, d, a)
 
 	*r_dst = res;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6255,10 +5730,7 @@ M68KMAKE_OP(move, 32, d, .)
 
 	*r_dst = res;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6269,10 +5741,7 @@ M68KMAKE_OP(move, 32, ai, d)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6283,10 +5752,7 @@ M68KMAKE_OP(move, 32, ai, a)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6297,10 +5763,7 @@ M68KMAKE_OP(move, 32, ai, .)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6311,10 +5774,7 @@ M68KMAKE_OP(move, 32, pi, d)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6325,10 +5785,7 @@ M68KMAKE_OP(move, 32, pi, a)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6339,10 +5796,7 @@ M68KMAKE_OP(move, 32, pi, .)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6354,10 +5808,7 @@ M68KMAKE_OP(move, 32, pd, d)
 	m68ki_write_16(ea+2, res & 0xFFFF );
 	m68ki_write_16(ea, (res >> 16) & 0xFFFF );
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6369,10 +5820,7 @@ M68KMAKE_OP(move, 32, pd, a)
 	m68ki_write_16(ea+2, res & 0xFFFF );
 	m68ki_write_16(ea, (res >> 16) & 0xFFFF );
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6384,10 +5832,7 @@ M68KMAKE_OP(move, 32, pd, .)
 	m68ki_write_16(ea+2, res & 0xFFFF );
 	m68ki_write_16(ea, (res >> 16) & 0xFFFF );
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6398,10 +5843,7 @@ M68KMAKE_OP(move, 32, di, d)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6412,10 +5854,7 @@ M68KMAKE_OP(move, 32, di, a)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6426,10 +5865,7 @@ M68KMAKE_OP(move, 32, di, .)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6440,10 +5876,7 @@ M68KMAKE_OP(move, 32, ix, d)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6454,10 +5887,7 @@ M68KMAKE_OP(move, 32, ix, a)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6468,10 +5898,7 @@ M68KMAKE_OP(move, 32, ix, .)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6482,10 +5909,7 @@ M68KMAKE_OP(move, 32, aw, d)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6496,10 +5920,7 @@ M68KMAKE_OP(move, 32, aw, a)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6510,10 +5931,7 @@ M68KMAKE_OP(move, 32, aw, .)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6524,10 +5942,7 @@ M68KMAKE_OP(move, 32, al, d)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6538,10 +5953,7 @@ M68KMAKE_OP(move, 32, al, a)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6552,10 +5964,7 @@ M68KMAKE_OP(move, 32, al, .)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -6754,65 +6163,16 @@ M68KMAKE_OP(movec, 32, cr, .)
 				m68ki_exception_illegal();
 				return;
 			case 0x003:				/* TC */
-				if(CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x004:				/* ITT0 */
-				if(CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x005:				/* ITT1 */
-				if(CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x006:				/* DTT0 */
-				if(CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x007:				/* DTT1 */
-				if(CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x805:				/* MMUSR */
-				if(CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x806:				/* URP */
-				if(CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x807:				/* SRP */
 				if(CPU_TYPE_IS_040_PLUS(CPU_TYPE))
 				{
-					/* TODO */
+					REG_DA[(word2 >> 12) & 15] = m68040_mmu_movec_from(word2 & 0xfff);
 					return;
 				}
 				m68ki_exception_illegal();
@@ -6909,65 +6269,16 @@ M68KMAKE_OP(movec, 32, rc, .)
 				m68ki_exception_illegal();
 				return;
 			case 0x003:			/* TC */
-				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x004:			/* ITT0 */
-				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x005:			/* ITT1 */
-				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x006:			/* DTT0 */
-				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x007:			/* DTT1 */
-				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x805:			/* MMUSR */
-				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x806:			/* URP */
-				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
-				{
-					/* TODO */
-					return;
-				}
-				m68ki_exception_illegal();
-				return;
 			case 0x807:			/* SRP */
 				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
 				{
-					/* TODO */
+					m68040_mmu_movec_to(word2 & 0xfff, REG_DA[(word2 >> 12) & 15]);
 					return;
 				}
 				m68ki_exception_illegal();
@@ -6989,15 +6300,16 @@ M68KMAKE_OP(movem, 16, re, pd)
 	uint i = 0;
 	uint register_list = OPER_I_16();
 	uint ea = AY;
-	uint count = 0;
+	uint count = m68ki_movem_write_block(&ea, register_list, 2, 1);
 
-	for(; i < 16; i++)
-		if(register_list & (1 << i))
-		{
-			ea -= 2;
-			m68ki_write_16(ea, MASK_OUT_ABOVE_16(REG_DA[15-i]));
-			count++;
-		}
+	if(count == 0)
+		for(; i < 16; i++)
+			if(register_list & (1 << i))
+			{
+				ea -= 2;
+				m68ki_write_16(ea, MASK_OUT_ABOVE_16(REG_DA[15-i]));
+				count++;
+			}
 	AY = ea;
 
 	USE_CYCLES(count<<CYC_MOVEM_W);
@@ -7009,15 +6321,16 @@ M68KMAKE_OP(movem, 16, re, .)
 	uint i = 0;
 	uint register_list = OPER_I_16();
 	uint ea = M68KMAKE_GET_EA_AY_16;
-	uint count = 0;
+	uint count = m68ki_movem_write_block(&ea, register_list, 2, 0);
 
-	for(; i < 16; i++)
-		if(register_list & (1 << i))
-		{
-			m68ki_write_16(ea, MASK_OUT_ABOVE_16(REG_DA[i]));
-			ea += 2;
-			count++;
-		}
+	if(count == 0)
+		for(; i < 16; i++)
+			if(register_list & (1 << i))
+			{
+				m68ki_write_16(ea, MASK_OUT_ABOVE_16(REG_DA[i]));
+				ea += 2;
+				count++;
+			}
 
 	USE_CYCLES(count<<CYC_MOVEM_W);
 }
@@ -7028,16 +6341,17 @@ M68KMAKE_OP(movem, 32, re, pd)
 	uint i = 0;
 	uint register_list = OPER_I_16();
 	uint ea = AY;
-	uint count = 0;
+	uint count = m68ki_movem_write_block(&ea, register_list, 4, 1);
 
-	for(; i < 16; i++)
-		if(register_list & (1 << i))
-		{
-			ea -= 4;
-			m68ki_write_16(ea+2, REG_DA[15-i] & 0xFFFF );
-			m68ki_write_16(ea, (REG_DA[15-i] >> 16) & 0xFFFF );
-			count++;
-		}
+	if(count == 0)
+		for(; i < 16; i++)
+			if(register_list & (1 << i))
+			{
+				ea -= 4;
+				m68ki_write_16(ea+2, REG_DA[15-i] & 0xFFFF );
+				m68ki_write_16(ea, (REG_DA[15-i] >> 16) & 0xFFFF );
+				count++;
+			}
 	AY = ea;
 
 	USE_CYCLES(count<<CYC_MOVEM_L);
@@ -7049,15 +6363,16 @@ M68KMAKE_OP(movem, 32, re, .)
 	uint i = 0;
 	uint register_list = OPER_I_16();
 	uint ea = M68KMAKE_GET_EA_AY_32;
-	uint count = 0;
+	uint count = m68ki_movem_write_block(&ea, register_list, 4, 0);
 
-	for(; i < 16; i++)
-		if(register_list & (1 << i))
-		{
-			m68ki_write_32(ea, REG_DA[i]);
-			ea += 4;
-			count++;
-		}
+	if(count == 0)
+		for(; i < 16; i++)
+			if(register_list & (1 << i))
+			{
+				m68ki_write_32(ea, REG_DA[i]);
+				ea += 4;
+				count++;
+			}
 
 	USE_CYCLES(count<<CYC_MOVEM_L);
 }
@@ -7068,15 +6383,17 @@ M68KMAKE_OP(movem, 16, er, pi)
 	uint i = 0;
 	uint register_list = OPER_I_16();
 	uint ea = AY;
-	uint count = 0;
+	uint count = m68ki_movem_read_block(&ea, register_list, 2);
 
-	for(; i < 16; i++)
-		if(register_list & (1 << i))
-		{
-			REG_DA[i] = MAKE_INT_16(MASK_OUT_ABOVE_16(m68ki_read_16(ea)));
-			ea += 2;
-			count++;
-		}
+	if(count == 0)
+		for(; i < 16; i++)
+			if(register_list & (1 << i))
+			{
+				m68ki_save_da(i);
+				REG_DA[i] = MAKE_INT_16(MASK_OUT_ABOVE_16(m68ki_read_16(ea)));
+				ea += 2;
+				count++;
+			}
 	AY = ea;
 
 	USE_CYCLES(count<<CYC_MOVEM_W);
@@ -7093,6 +6410,7 @@ M68KMAKE_OP(movem, 16, er, pcdi)
 	for(; i < 16; i++)
 		if(register_list & (1 << i))
 		{
+			m68ki_save_da(i);
 			REG_DA[i] = MAKE_INT_16(MASK_OUT_ABOVE_16(m68ki_read_pcrel_16(ea)));
 			ea += 2;
 			count++;
@@ -7112,6 +6430,7 @@ M68KMAKE_OP(movem, 16, er, pcix)
 	for(; i < 16; i++)
 		if(register_list & (1 << i))
 		{
+			m68ki_save_da(i);
 			REG_DA[i] = MAKE_INT_16(MASK_OUT_ABOVE_16(m68ki_read_pcrel_16(ea)));
 			ea += 2;
 			count++;
@@ -7126,15 +6445,17 @@ M68KMAKE_OP(movem, 16, er, .)
 	uint i = 0;
 	uint register_list = OPER_I_16();
 	uint ea = M68KMAKE_GET_EA_AY_16;
-	uint count = 0;
+	uint count = m68ki_movem_read_block(&ea, register_list, 2);
 
-	for(; i < 16; i++)
-		if(register_list & (1 << i))
-		{
-			REG_DA[i] = MAKE_INT_16(MASK_OUT_ABOVE_16(m68ki_read_16(ea)));
-			ea += 2;
-			count++;
-		}
+	if(count == 0)
+		for(; i < 16; i++)
+			if(register_list & (1 << i))
+			{
+				m68ki_save_da(i);
+				REG_DA[i] = MAKE_INT_16(MASK_OUT_ABOVE_16(m68ki_read_16(ea)));
+				ea += 2;
+				count++;
+			}
 
 	USE_CYCLES(count<<CYC_MOVEM_W);
 }
@@ -7145,15 +6466,17 @@ M68KMAKE_OP(movem, 32, er, pi)
 	uint i = 0;
 	uint register_list = OPER_I_16();
 	uint ea = AY;
-	uint count = 0;
+	uint count = m68ki_movem_read_block(&ea, register_list, 4);
 
-	for(; i < 16; i++)
-		if(register_list & (1 << i))
-		{
-			REG_DA[i] = m68ki_read_32(ea);
-			ea += 4;
-			count++;
-		}
+	if(count == 0)
+		for(; i < 16; i++)
+			if(register_list & (1 << i))
+			{
+				m68ki_save_da(i);
+				REG_DA[i] = m68ki_read_32(ea);
+				ea += 4;
+				count++;
+			}
 	AY = ea;
 
 	USE_CYCLES(count<<CYC_MOVEM_L);
@@ -7170,6 +6493,7 @@ M68KMAKE_OP(movem, 32, er, pcdi)
 	for(; i < 16; i++)
 		if(register_list & (1 << i))
 		{
+			m68ki_save_da(i);
 			REG_DA[i] = m68ki_read_pcrel_32(ea);
 			ea += 4;
 			count++;
@@ -7189,6 +6513,7 @@ M68KMAKE_OP(movem, 32, er, pcix)
 	for(; i < 16; i++)
 		if(register_list & (1 << i))
 		{
+			m68ki_save_da(i);
 			REG_DA[i] = m68ki_read_pcrel_32(ea);
 			ea += 4;
 			count++;
@@ -7203,15 +6528,17 @@ M68KMAKE_OP(movem, 32, er, .)
 	uint i = 0;
 	uint register_list = OPER_I_16();
 	uint ea = M68KMAKE_GET_EA_AY_32;
-	uint count = 0;
+	uint count = m68ki_movem_read_block(&ea, register_list, 4);
 
-	for(; i < 16; i++)
-		if(register_list & (1 << i))
-		{
-			REG_DA[i] = m68ki_read_32(ea);
-			ea += 4;
-			count++;
-		}
+	if(count == 0)
+		for(; i < 16; i++)
+			if(register_list & (1 << i))
+			{
+				m68ki_save_da(i);
+				REG_DA[i] = m68ki_read_32(ea);
+				ea += 4;
+				count++;
+			}
 
 	USE_CYCLES(count<<CYC_MOVEM_L);
 }
@@ -7361,10 +6688,7 @@ M68KMAKE_OP(moveq, 32, ., .)
 {
 	uint res = DX = MAKE_INT_8(MASK_OUT_ABOVE_8(REG_IR));
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -7373,6 +6697,25 @@ M68KMAKE_OP(move16, 32, ., .)
 	uint16 w2 = OPER_I_16();
 	int ax = REG_IR & 7;
 	int ay = (w2 >> 12) & 7;
+#if M68KI_MEMORY_BLOCKS
+	uint8 line[16];
+
+	/* The interleaved word by word copy differs for overlapping lines */
+	if((REG_A[ay] == REG_A[ax] || REG_A[ay] - REG_A[ax] + 15 > 30) &&
+		m68ki_read_block(REG_A[ax], line, 16))
+	{
+		if(!m68ki_write_block(REG_A[ay], line, 16))
+		{
+			m68ki_write_32(REG_A[ay],    m68ki_get_mem_32(line));
+			m68ki_write_32(REG_A[ay]+4,  m68ki_get_mem_32(line + 4));
+			m68ki_write_32(REG_A[ay]+8,  m68ki_get_mem_32(line + 8));
+			m68ki_write_32(REG_A[ay]+12, m68ki_get_mem_32(line + 12));
+		}
+		REG_A[ax] += 16;
+		REG_A[ay] += 16;
+		return;
+	}
+#endif
 
 	m68ki_write_32(REG_A[ay],    m68ki_read_32(REG_A[ax]));
 	m68ki_write_32(REG_A[ay]+4,  m68ki_read_32(REG_A[ax]+4));
@@ -7403,10 +6746,7 @@ M68KMAKE_OP(muls, 16, ., d)
 
 	*r_dst = res;
 
-	FLAG_Z = res;
-	FLAG_N = NFLAG_32(res);
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -7428,10 +6768,7 @@ M68KMAKE_OP(muls, 16, ., .)
 
 	*r_dst = res;
 
-	FLAG_Z = res;
-	FLAG_N = NFLAG_32(res);
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -7452,10 +6789,7 @@ M68KMAKE_OP(mulu, 16, ., d)
 
 	*r_dst = res;
 
-	FLAG_Z = res;
-	FLAG_N = NFLAG_32(res);
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -7477,10 +6811,7 @@ M68KMAKE_OP(mulu, 16, ., .)
 
 	*r_dst = res;
 
-	FLAG_Z = res;
-	FLAG_N = NFLAG_32(res);
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -7997,10 +7328,7 @@ M68KMAKE_OP(not, 8, ., d)
 
 	*r_dst = MASK_OUT_BELOW_8(*r_dst) | res;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -8011,10 +7339,7 @@ M68KMAKE_OP(not, 8, ., .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -8025,10 +7350,7 @@ M68KMAKE_OP(not, 16, ., d)
 
 	*r_dst = MASK_OUT_BELOW_16(*r_dst) | res;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -8039,10 +7361,7 @@ M68KMAKE_OP(not, 16, ., .)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -8051,10 +7370,7 @@ M68KMAKE_OP(not, 32, ., d)
 	uint* r_dst = &DY;
 	uint res = *r_dst = MASK_OUT_ABOVE_32(~*r_dst);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -8065,10 +7381,7 @@ M68KMAKE_OP(not, 32, ., .)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -8076,10 +7389,7 @@ M68KMAKE_OP(or, 8, er, d)
 {
 	uint res = MASK_OUT_ABOVE_8((DX |= MASK_OUT_ABOVE_8(DY)));
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -8087,10 +7397,7 @@ M68KMAKE_OP(or, 8, er, .)
 {
 	uint res = MASK_OUT_ABOVE_8((DX |= M68KMAKE_GET_OPER_AY_8));
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -8098,10 +7405,7 @@ M68KMAKE_OP(or, 16, er, d)
 {
 	uint res = MASK_OUT_ABOVE_16((DX |= MASK_OUT_ABOVE_16(DY)));
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -8109,10 +7413,7 @@ M68KMAKE_OP(or, 16, er, .)
 {
 	uint res = MASK_OUT_ABOVE_16((DX |= M68KMAKE_GET_OPER_AY_16));
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -8120,10 +7421,7 @@ M68KMAKE_OP(or, 32, er, d)
 {
 	uint res = DX |= DY;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -8131,10 +7429,7 @@ M68KMAKE_OP(or, 32, er, .)
 {
 	uint res = DX |= M68KMAKE_GET_OPER_AY_32;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -8145,10 +7440,7 @@ M68KMAKE_OP(or, 8, re, .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -8159,10 +7451,7 @@ M68KMAKE_OP(or, 16, re, .)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -8173,10 +7462,7 @@ M68KMAKE_OP(or, 32, re, .)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -8184,10 +7470,7 @@ M68KMAKE_OP(ori, 8, ., d)
 {
 	uint res = MASK_OUT_ABOVE_8((DY |= OPER_I_8()));
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -8199,10 +7482,7 @@ M68KMAKE_OP(ori, 8, ., .)
 
 	m68ki_write_8(ea, res);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -8210,10 +7490,7 @@ M68KMAKE_OP(ori, 16, ., d)
 {
 	uint res = MASK_OUT_ABOVE_16(DY |= OPER_I_16());
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -8225,10 +7502,7 @@ M68KMAKE_OP(ori, 16, ., .)
 
 	m68ki_write_16(ea, res);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -8236,10 +7510,7 @@ M68KMAKE_OP(ori, 32, ., d)
 {
 	uint res = DY |= OPER_I_32();
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -8251,10 +7522,7 @@ M68KMAKE_OP(ori, 32, ., .)
 
 	m68ki_write_32(ea, res);
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -8368,9 +7636,14 @@ M68KMAKE_OP(pea, 32, ., .)
 
 M68KMAKE_OP(pflush, 32, ., .)
 {
-	if ((CPU_TYPE_IS_EC020_PLUS(CPU_TYPE)) && (HAS_PMMU))
+	if ((CPU_TYPE_IS_040_PLUS(CPU_TYPE)) && (HAS_PMMU))
 	{
-		fprintf(stderr,"68040: unhandled PFLUSH\n");
+		if(FLAG_S)
+		{
+			m68040_mmu_ops();
+			return;
+		}
+		m68ki_exception_privilege_violation();
 		return;
 	}
 	m68ki_exception_1111();
@@ -8388,6 +7661,21 @@ M68KMAKE_OP(pmmu, 32, ., .)
 	}
 }
 
+M68KMAKE_OP(ptest, 32, ., .)
+{
+	if ((CPU_TYPE_IS_040_PLUS(CPU_TYPE)) && (HAS_PMMU))
+	{
+		if(FLAG_S)
+		{
+			m68040_mmu_ops();
+			return;
+		}
+		m68ki_exception_privilege_violation();
+		return;
+	}
+	m68ki_exception_1111();
+}
+
 M68KMAKE_OP(reset, 0, ., .)
 {
 	if(FLAG_S)
@@ -8478,10 +7766,7 @@ M68KMAKE_OP(ror, 8, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_8(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(src);
 }
 
 
@@ -8505,10 +7790,7 @@ M68KMAKE_OP(ror, 16, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_16(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(src);
 }
 
 
@@ -8532,10 +7814,7 @@ M68KMAKE_OP(ror, 32, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_32(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(src);
 }
 
 
@@ -8640,10 +7919,7 @@ M68KMAKE_OP(rol, 8, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_8(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_8(src);
 }
 
 
@@ -8675,10 +7951,7 @@ M68KMAKE_OP(rol, 16, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_16(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_16(src);
 }
 
 
@@ -8703,10 +7976,7 @@ M68KMAKE_OP(rol, 32, r, .)
 		return;
 	}
 
-	FLAG_C = CFLAG_CLEAR;
-	FLAG_N = NFLAG_32(src);
-	FLAG_Z = src;
-	FLAG_V = VFLAG_CLEAR;
+	m68ki_set_logic_flags_32(src);
 }
 
 
@@ -9178,7 +8448,10 @@ M68KMAKE_OP(rtd, 32, ., .)
 {
 	if(CPU_TYPE_IS_010_PLUS(CPU_TYPE))
 	{
-		uint new_pc = m68ki_pull_32();
+		uint new_pc;
+
+		m68ki_call_return(REG_A[7]);   /* auto-disable (see m68kcpu.h) */
+		new_pc = m68ki_pull_32();
 
 		m68ki_trace_t0();			   /* auto-disable (see m68kcpu.h) */
 		REG_A[7] = MASK_OUT_ABOVE_32(REG_A[7] + MAKE_INT_16(OPER_I_16()));
@@ -9199,6 +8472,7 @@ M68KMAKE_OP(rte, 32, ., .)
 
 		m68ki_rte_callback();		   /* auto-disable (see m68kcpu.h) */
 		m68ki_trace_t0();			   /* auto-disable (see m68kcpu.h) */
+		m68ki_call_return(REG_A[7]);   /* auto-disable (see m68kcpu.h) */
 
 		if(CPU_TYPE_IS_000(CPU_TYPE))
 		{
@@ -9290,8 +8564,21 @@ rte_loop:
 				CPU_INSTR_MODE = INSTRUCTION_YES;
 				CPU_RUN_MODE = RUN_MODE_NORMAL;
 				return;
+			case 7:   /* Access error (68040) */
+			case 0xa: /* Short bus fault */
+			case 0xb: /* Long bus fault */
+				/* Our bus error frames always restart the instruction */
+				new_sr = m68ki_pull_16();
+				new_pc = m68ki_pull_32();
+				m68ki_fake_pull_16();	/* format word */
+				REG_A[7] += format_word == 7 ? 52 : format_word == 0xa ? 24 : 84;
+				m68ki_jump(new_pc);
+				m68ki_set_sr(new_sr);
+				CPU_INSTR_MODE = INSTRUCTION_YES;
+				CPU_RUN_MODE = RUN_MODE_NORMAL;
+				return;
 		}
-		/* Not handling long or short bus fault */
+		/* Unknown frame format */
 		CPU_INSTR_MODE = INSTRUCTION_YES;
 		CPU_RUN_MODE = RUN_MODE_NORMAL;
 		m68ki_exception_format_error();
@@ -9318,6 +8605,7 @@ M68KMAKE_OP(rtm, 32, ., .)
 M68KMAKE_OP(rtr, 32, ., .)
 {
 	m68ki_trace_t0();				   /* auto-disable (see m68kcpu.h) */
+	m68ki_call_return(REG_A[7] + 2);   /* auto-disable (see m68kcpu.h) */
 	m68ki_set_ccr(m68ki_pull_16());
 	m68ki_jump(m68ki_pull_32());
 }
@@ -9326,6 +8614,7 @@ M68KMAKE_OP(rtr, 32, ., .)
 M68KMAKE_OP(rts, 32, ., .)
 {
 	m68ki_trace_t0();				   /* auto-disable (see m68kcpu.h) */
+	m68ki_call_return(REG_A[7]);	   /* auto-disable (see m68kcpu.h) */
 	m68ki_jump(m68ki_pull_32());
 }
 
@@ -9510,8 +8799,8 @@ M68KMAKE_OP(stop, 0, ., .)
 		m68ki_trace_t0();			   /* auto-disable (see m68kcpu.h) */
 		CPU_STOPPED |= STOP_LEVEL_STOP;
 		m68ki_set_sr(new_sr);
-		if(m68ki_remaining_cycles >= CYC_INSTRUCTION[REG_IR])
-			m68ki_remaining_cycles = CYC_INSTRUCTION[REG_IR];
+		if(m68ki_remaining_cycles >= CYC_OPCODE(REG_IR))
+			m68ki_remaining_cycles = CYC_OPCODE(REG_IR);
 		else
 			USE_ALL_CYCLES();
 		return;
@@ -9527,12 +8816,9 @@ M68KMAKE_OP(sub, 8, er, d)
 	uint dst = MASK_OUT_ABOVE_8(*r_dst);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
+	m68ki_set_sub_flags_8(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_8(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_8(*r_dst) | MASK_OUT_ABOVE_8(res);
 }
 
 
@@ -9543,12 +8829,9 @@ M68KMAKE_OP(sub, 8, er, .)
 	uint dst = MASK_OUT_ABOVE_8(*r_dst);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
+	m68ki_set_sub_flags_8(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_8(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_8(*r_dst) | MASK_OUT_ABOVE_8(res);
 }
 
 
@@ -9559,12 +8842,9 @@ M68KMAKE_OP(sub, 16, er, d)
 	uint dst = MASK_OUT_ABOVE_16(*r_dst);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
+	m68ki_set_sub_flags_16(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_16(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_16(*r_dst) | MASK_OUT_ABOVE_16(res);
 }
 
 
@@ -9575,12 +8855,9 @@ M68KMAKE_OP(sub, 16, er, a)
 	uint dst = MASK_OUT_ABOVE_16(*r_dst);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
+	m68ki_set_sub_flags_16(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_16(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_16(*r_dst) | MASK_OUT_ABOVE_16(res);
 }
 
 
@@ -9591,12 +8868,9 @@ M68KMAKE_OP(sub, 16, er, .)
 	uint dst = MASK_OUT_ABOVE_16(*r_dst);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
+	m68ki_set_sub_flags_16(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_16(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_16(*r_dst) | MASK_OUT_ABOVE_16(res);
 }
 
 
@@ -9607,12 +8881,9 @@ M68KMAKE_OP(sub, 32, er, d)
 	uint dst = *r_dst;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_X = FLAG_C = CFLAG_SUB_32(src, dst, res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
+	m68ki_set_sub_flags_32(src, dst, res);
 
-	*r_dst = FLAG_Z;
+	*r_dst = MASK_OUT_ABOVE_32(res);
 }
 
 
@@ -9623,12 +8894,9 @@ M68KMAKE_OP(sub, 32, er, a)
 	uint dst = *r_dst;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_X = FLAG_C = CFLAG_SUB_32(src, dst, res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
+	m68ki_set_sub_flags_32(src, dst, res);
 
-	*r_dst = FLAG_Z;
+	*r_dst = MASK_OUT_ABOVE_32(res);
 }
 
 
@@ -9639,12 +8907,9 @@ M68KMAKE_OP(sub, 32, er, .)
 	uint dst = *r_dst;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_X = FLAG_C = CFLAG_SUB_32(src, dst, res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
+	m68ki_set_sub_flags_32(src, dst, res);
 
-	*r_dst = FLAG_Z;
+	*r_dst = MASK_OUT_ABOVE_32(res);
 }
 
 
@@ -9655,12 +8920,9 @@ M68KMAKE_OP(sub, 8, re, .)
 	uint dst = m68ki_read_8(ea);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
+	m68ki_set_sub_flags_8(src, dst, res);
 
-	m68ki_write_8(ea, FLAG_Z);
+	m68ki_write_8(ea, MASK_OUT_ABOVE_8(res));
 }
 
 
@@ -9671,12 +8933,9 @@ M68KMAKE_OP(sub, 16, re, .)
 	uint dst = m68ki_read_16(ea);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
+	m68ki_set_sub_flags_16(src, dst, res);
 
-	m68ki_write_16(ea, FLAG_Z);
+	m68ki_write_16(ea, MASK_OUT_ABOVE_16(res));
 }
 
 
@@ -9687,12 +8946,9 @@ M68KMAKE_OP(sub, 32, re, .)
 	uint dst = m68ki_read_32(ea);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_X = FLAG_C = CFLAG_SUB_32(src, dst, res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
+	m68ki_set_sub_flags_32(src, dst, res);
 
-	m68ki_write_32(ea, FLAG_Z);
+	m68ki_write_32(ea, MASK_OUT_ABOVE_32(res));
 }
 
 
@@ -9753,12 +9009,9 @@ M68KMAKE_OP(subi, 8, ., d)
 	uint dst = MASK_OUT_ABOVE_8(*r_dst);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
+	m68ki_set_sub_flags_8(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_8(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_8(*r_dst) | MASK_OUT_ABOVE_8(res);
 }
 
 
@@ -9769,12 +9022,9 @@ M68KMAKE_OP(subi, 8, ., .)
 	uint dst = m68ki_read_8(ea);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
+	m68ki_set_sub_flags_8(src, dst, res);
 
-	m68ki_write_8(ea, FLAG_Z);
+	m68ki_write_8(ea, MASK_OUT_ABOVE_8(res));
 }
 
 
@@ -9785,12 +9035,9 @@ M68KMAKE_OP(subi, 16, ., d)
 	uint dst = MASK_OUT_ABOVE_16(*r_dst);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
+	m68ki_set_sub_flags_16(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_16(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_16(*r_dst) | MASK_OUT_ABOVE_16(res);
 }
 
 
@@ -9801,12 +9048,9 @@ M68KMAKE_OP(subi, 16, ., .)
 	uint dst = m68ki_read_16(ea);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
+	m68ki_set_sub_flags_16(src, dst, res);
 
-	m68ki_write_16(ea, FLAG_Z);
+	m68ki_write_16(ea, MASK_OUT_ABOVE_16(res));
 }
 
 
@@ -9817,12 +9061,9 @@ M68KMAKE_OP(subi, 32, ., d)
 	uint dst = *r_dst;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_X = FLAG_C = CFLAG_SUB_32(src, dst, res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
+	m68ki_set_sub_flags_32(src, dst, res);
 
-	*r_dst = FLAG_Z;
+	*r_dst = MASK_OUT_ABOVE_32(res);
 }
 
 
@@ -9833,12 +9074,9 @@ M68KMAKE_OP(subi, 32, ., .)
 	uint dst = m68ki_read_32(ea);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_X = FLAG_C = CFLAG_SUB_32(src, dst, res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
+	m68ki_set_sub_flags_32(src, dst, res);
 
-	m68ki_write_32(ea, FLAG_Z);
+	m68ki_write_32(ea, MASK_OUT_ABOVE_32(res));
 }
 
 
@@ -9849,12 +9087,9 @@ M68KMAKE_OP(subq, 8, ., d)
 	uint dst = MASK_OUT_ABOVE_8(*r_dst);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
+	m68ki_set_sub_flags_8(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_8(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_8(*r_dst) | MASK_OUT_ABOVE_8(res);
 }
 
 
@@ -9865,12 +9100,9 @@ M68KMAKE_OP(subq, 8, ., .)
 	uint dst = m68ki_read_8(ea);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = MASK_OUT_ABOVE_8(res);
-	FLAG_X = FLAG_C = CFLAG_8(res);
-	FLAG_V = VFLAG_SUB_8(src, dst, res);
+	m68ki_set_sub_flags_8(src, dst, res);
 
-	m68ki_write_8(ea, FLAG_Z);
+	m68ki_write_8(ea, MASK_OUT_ABOVE_8(res));
 }
 
 
@@ -9881,12 +9113,9 @@ M68KMAKE_OP(subq, 16, ., d)
 	uint dst = MASK_OUT_ABOVE_16(*r_dst);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
+	m68ki_set_sub_flags_16(src, dst, res);
 
-	*r_dst = MASK_OUT_BELOW_16(*r_dst) | FLAG_Z;
+	*r_dst = MASK_OUT_BELOW_16(*r_dst) | MASK_OUT_ABOVE_16(res);
 }
 
 
@@ -9905,12 +9134,9 @@ M68KMAKE_OP(subq, 16, ., .)
 	uint dst = m68ki_read_16(ea);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = MASK_OUT_ABOVE_16(res);
-	FLAG_X = FLAG_C = CFLAG_16(res);
-	FLAG_V = VFLAG_SUB_16(src, dst, res);
+	m68ki_set_sub_flags_16(src, dst, res);
 
-	m68ki_write_16(ea, FLAG_Z);
+	m68ki_write_16(ea, MASK_OUT_ABOVE_16(res));
 }
 
 
@@ -9921,12 +9147,9 @@ M68KMAKE_OP(subq, 32, ., d)
 	uint dst = *r_dst;
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_X = FLAG_C = CFLAG_SUB_32(src, dst, res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
+	m68ki_set_sub_flags_32(src, dst, res);
 
-	*r_dst = FLAG_Z;
+	*r_dst = MASK_OUT_ABOVE_32(res);
 }
 
 
@@ -9945,12 +9168,9 @@ M68KMAKE_OP(subq, 32, ., .)
 	uint dst = m68ki_read_32(ea);
 	uint res = dst - src;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = MASK_OUT_ABOVE_32(res);
-	FLAG_X = FLAG_C = CFLAG_SUB_32(src, dst, res);
-	FLAG_V = VFLAG_SUB_32(src, dst, res);
+	m68ki_set_sub_flags_32(src, dst, res);
 
-	m68ki_write_32(ea, FLAG_Z);
+	m68ki_write_32(ea, MASK_OUT_ABOVE_32(res));
 }
 
 
@@ -10148,10 +9368,7 @@ M68KMAKE_OP(tas, 8, ., .)
 	uint dst = m68ki_read_8(ea);
 	uint allow_writeback;
 
-	FLAG_Z = dst;
-	FLAG_N = NFLAG_8(dst);
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(dst);
 
 	/* The Genesis/Megadrive games Gargoyles and Ex-Mutants need the TAS writeback
        disabled in order to function properly.  Some Amiga software may also rely
@@ -10296,10 +9513,7 @@ M68KMAKE_OP(tst, 8, ., d)
 {
 	uint res = MASK_OUT_ABOVE_8(DY);
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -10307,10 +9521,7 @@ M68KMAKE_OP(tst, 8, ., .)
 {
 	uint res = M68KMAKE_GET_OPER_AY_8;
 
-	FLAG_N = NFLAG_8(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_8(res);
 }
 
 
@@ -10320,10 +9531,7 @@ M68KMAKE_OP(tst, 8, ., pcdi)
 	{
 		uint res = OPER_PCDI_8();
 
-		FLAG_N = NFLAG_8(res);
-		FLAG_Z = res;
-		FLAG_V = VFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
+		m68ki_set_logic_flags_8(res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -10336,10 +9544,7 @@ M68KMAKE_OP(tst, 8, ., pcix)
 	{
 		uint res = OPER_PCIX_8();
 
-		FLAG_N = NFLAG_8(res);
-		FLAG_Z = res;
-		FLAG_V = VFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
+		m68ki_set_logic_flags_8(res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -10352,10 +9557,7 @@ M68KMAKE_OP(tst, 8, ., i)
 	{
 		uint res = OPER_I_8();
 
-		FLAG_N = NFLAG_8(res);
-		FLAG_Z = res;
-		FLAG_V = VFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
+		m68ki_set_logic_flags_8(res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -10366,10 +9568,7 @@ M68KMAKE_OP(tst, 16, ., d)
 {
 	uint res = MASK_OUT_ABOVE_16(DY);
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -10379,10 +9578,7 @@ M68KMAKE_OP(tst, 16, ., a)
 	{
 		uint res = MAKE_INT_16(AY);
 
-		FLAG_N = NFLAG_16(res);
-		FLAG_Z = res;
-		FLAG_V = VFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
+		m68ki_set_logic_flags_16(res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -10393,10 +9589,7 @@ M68KMAKE_OP(tst, 16, ., .)
 {
 	uint res = M68KMAKE_GET_OPER_AY_16;
 
-	FLAG_N = NFLAG_16(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_16(res);
 }
 
 
@@ -10406,10 +9599,7 @@ M68KMAKE_OP(tst, 16, ., pcdi)
 	{
 		uint res = OPER_PCDI_16();
 
-		FLAG_N = NFLAG_16(res);
-		FLAG_Z = res;
-		FLAG_V = VFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
+		m68ki_set_logic_flags_16(res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -10422,10 +9612,7 @@ M68KMAKE_OP(tst, 16, ., pcix)
 	{
 		uint res = OPER_PCIX_16();
 
-		FLAG_N = NFLAG_16(res);
-		FLAG_Z = res;
-		FLAG_V = VFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
+		m68ki_set_logic_flags_16(res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -10438,10 +9625,7 @@ M68KMAKE_OP(tst, 16, ., i)
 	{
 		uint res = OPER_I_16();
 
-		FLAG_N = NFLAG_16(res);
-		FLAG_Z = res;
-		FLAG_V = VFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
+		m68ki_set_logic_flags_16(res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -10452,10 +9636,7 @@ M68KMAKE_OP(tst, 32, ., d)
 {
 	uint res = DY;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -10465,10 +9646,7 @@ M68KMAKE_OP(tst, 32, ., a)
 	{
 		uint res = AY;
 
-		FLAG_N = NFLAG_32(res);
-		FLAG_Z = res;
-		FLAG_V = VFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
+		m68ki_set_logic_flags_32(res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -10479,10 +9657,7 @@ M68KMAKE_OP(tst, 32, ., .)
 {
 	uint res = M68KMAKE_GET_OPER_AY_32;
 
-	FLAG_N = NFLAG_32(res);
-	FLAG_Z = res;
-	FLAG_V = VFLAG_CLEAR;
-	FLAG_C = CFLAG_CLEAR;
+	m68ki_set_logic_flags_32(res);
 }
 
 
@@ -10492,10 +9667,7 @@ M68KMAKE_OP(tst, 32, ., pcdi)
 	{
 		uint res = OPER_PCDI_32();
 
-		FLAG_N = NFLAG_32(res);
-		FLAG_Z = res;
-		FLAG_V = VFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
+		m68ki_set_logic_flags_32(res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -10508,10 +9680,7 @@ M68KMAKE_OP(tst, 32, ., pcix)
 	{
 		uint res = OPER_PCIX_32();
 
-		FLAG_N = NFLAG_32(res);
-		FLAG_Z = res;
-		FLAG_V = VFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
+		m68ki_set_logic_flags_32(res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -10524,10 +9693,7 @@ M68KMAKE_OP(tst, 32, ., i)
 	{
 		uint res = OPER_I_32();
 
-		FLAG_N = NFLAG_32(res);
-		FLAG_Z = res;
-		FLAG_V = VFLAG_CLEAR;
-		FLAG_C = CFLAG_CLEAR;
+		m68ki_set_logic_flags_32(res);
 		return;
 	}
 	m68ki_exception_illegal();
@@ -10544,6 +9710,7 @@ M68KMAKE_OP(unlk, 32, ., .)
 {
 	uint* r_dst = &AY;
 
+	m68ki_save_sp();
 	REG_A[7] = *r_dst;
 	*r_dst = m68ki_pull_32();
 }
@@ -10640,5 +9807,76 @@ M68KMAKE_OP(unpk, 16, mm, .)
 
 
 
+XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+M68KMAKE_FUSED_PAIRS
+
+# Opcode handler pairs that run back to back without going through dispatch
+# when M68K_FUSED_PAIRS is on (see print_fused_handlers() in m68kmake.c).
+# Each line has the names of the two handlers, without the m68k_op_ prefix.
+# Neither handler may depend on the CPU type.  A pairs file given to m68kmake,
+# for example one made from a profile of the instruction pairs a program runs,
+# is used instead of this list.
+
+# Test and compare, then branch
+tst_8_d         beq_8
+tst_8_d         bne_8
+tst_16_d        beq_8
+tst_16_d        bne_8
+tst_32_d        beq_8
+tst_32_d        bne_8
+tst_32_d        bmi_8
+tst_32_d        bpl_8
+cmp_8_d         beq_8
+cmp_8_d         bne_8
+cmp_16_d        beq_8
+cmp_16_d        bne_8
+cmp_16_d        bcs_8
+cmp_16_d        bcc_8
+cmp_16_d        bhi_8
+cmp_16_d        bls_8
+cmp_16_d        bge_8
+cmp_16_d        blt_8
+cmp_16_d        bgt_8
+cmp_16_d        ble_8
+cmp_32_d        beq_8
+cmp_32_d        bne_8
+cmp_32_d        bcs_8
+cmp_32_d        bcc_8
+cmp_32_d        bhi_8
+cmp_32_d        bls_8
+cmp_32_d        bge_8
+cmp_32_d        blt_8
+cmp_32_d        bgt_8
+cmp_32_d        ble_8
+cmpi_8_d        beq_8
+cmpi_8_d        bne_8
+cmpi_16_d       beq_8
+cmpi_16_d       bne_8
+cmpi_32_d       beq_8
+cmpi_32_d       bne_8
+cmpa_32_a       beq_8
+cmpa_32_a       bne_8
+cmpa_32_a       bcs_8
+cmpa_32_a       bcc_8
+btst_32_s_d     beq_8
+btst_32_s_d     bne_8
+
+# Count down loops
+subq_16_d       bne_8
+subq_32_d       bne_8
+move_8_pi_pi    dbf_16
+move_16_pi_pi   dbf_16
+move_32_pi_pi   dbf_16
+dbf_16          move_8_pi_pi
+dbf_16          move_16_pi_pi
+dbf_16          move_32_pi_pi
+
+# Register setup, where the flags of the first are dead
+moveq_32        moveq_32
+moveq_32        move_32_d_d
+move_32_d_d     moveq_32
+move_32_d_d     move_32_d_d
+
+
 XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 M68KMAKE_END
@@ -102,6 +102,16 @@
 #define M68K_SIMULATE_PD_WRITES     M68K_OPT_OFF
 #endif
 
+/* If ON, the CPU will call m68k_read_memory_block() and
+ * m68k_write_memory_block() for transfers of several consecutive words:
+ * movem, move16, fmovem of extended registers, bitfields and exception stack
+ * frames.  The host may decline a block, and the CPU then falls back to the
+ * m68k_read_memory_xx() / m68k_write_memory_xx() functions.
+ */
+#ifndef M68K_MEMORY_BLOCKS
+#define M68K_MEMORY_BLOCKS          M68K_OPT_OFF
+#endif
+
 /* If ON, CPU will call the interrupt acknowledge callback when it services an
  * interrupt.
  * If off, all interrupts will be autovectored and all interrupt requests will
@@ -220,6 +230,79 @@
 #endif
 
 
+/* If ON, each CPU instance counts the instructions run by each opcode
+ * handler and the cycles they took, the FPU operations by type and the
+ * exceptions taken by vector (see m68k_profile_snapshot() in m68k.h).
+ * This turns off M68K_JIT.
+ */
+#ifndef M68K_PROFILE
+#define M68K_PROFILE                M68K_OPT_OFF
+#endif
+
+
+/* If ON, each CPU instance keeps a shadow call stack from JSR, BSR, RTS,
+ * RTD, RTR, RTE and exceptions, and counts the calls, inclusive cycles and
+ * exclusive cycles of each guest function (see m68k_dump_call_graph() in
+ * m68k.h).  M68K_CALL_DEPTH is the most frames kept and M68K_CALL_FUNCTIONS
+ * the most functions counted.  Frames on a different stack register (USP,
+ * ISP or MSP) or a different 2^M68K_CALL_STACK_SHIFT byte region of memory
+ * are taken to be another task's, and are not dropped by a new call.  This
+ * turns off M68K_JIT.
+ */
+#ifndef M68K_CALL_GRAPH
+#define M68K_CALL_GRAPH             M68K_OPT_OFF
+#endif
+#ifndef M68K_CALL_DEPTH
+#define M68K_CALL_DEPTH             128
+#endif
+#ifndef M68K_CALL_FUNCTIONS
+#define M68K_CALL_FUNCTIONS         1024
+#endif
+#ifndef M68K_CALL_STACK_SHIFT
+#define M68K_CALL_STACK_SHIFT       12
+#endif
+
+
+/* If ON, each CPU instance keeps the PC, opcode word and cycles of the last
+ * M68K_FLIGHT_RECORDS instructions (a power of 2) in a ring buffer, for
+ * m68k_get_flight_records() to fetch after a crash.  With
+ * M68K_FLIGHT_ADDRESSES, each record also holds the last data address
+ * the instruction read or wrote (opcode and extension word fetches and
+ * PC-relative operands are program space and are left out).  This turns off M68K_JIT.
+ */
+#ifndef M68K_FLIGHT_RECORDER
+#define M68K_FLIGHT_RECORDER        M68K_OPT_OFF
+#endif
+#ifndef M68K_FLIGHT_RECORDS
+#define M68K_FLIGHT_RECORDS         4096
+#endif
+#ifndef M68K_FLIGHT_ADDRESSES
+#define M68K_FLIGHT_ADDRESSES       M68K_OPT_OFF
+#endif
+
+
+/* If ON, m68k_start_trace() can record every instruction, register change
+ * and memory access to a file.  Records are compressed into
+ * M68K_TRACE_BUFFERS buffers of M68K_TRACE_BUFFER_SIZE bytes, which a
+ * thread writes out.  A checkpoint of the memory written goes in every
+ * M68K_TRACE_CHECKPOINT instructions; fewer make queries faster and files
+ * bigger.  This needs a POSIX host (link with -pthread) and turns off
+ * M68K_JIT, M68K_FAST_FORWARD_LOOPS and M68K_MEMORY_BLOCKS.
+ */
+#ifndef M68K_TRACE
+#define M68K_TRACE                  M68K_OPT_OFF
+#endif
+#ifndef M68K_TRACE_BUFFER_SIZE
+#define M68K_TRACE_BUFFER_SIZE      65536
+#endif
+#ifndef M68K_TRACE_BUFFERS
+#define M68K_TRACE_BUFFERS          16
+#endif
+#ifndef M68K_TRACE_CHECKPOINT
+#define M68K_TRACE_CHECKPOINT       262144
+#endif
+
+
 /* If ON, the CPU will emulate the 4-byte prefetch queue of a real 68000 */
 #ifndef M68K_EMULATE_PREFETCH
 #define M68K_EMULATE_PREFETCH       M68K_OPT_OFF
@@ -235,6 +318,18 @@
 #endif
 
 
+/* If ON, bus errors and address errors are flagged as pending and taken at
+ * the end of the instruction, instead of longjmp()ing out of it.  Memory
+ * accesses after the fault are dropped (reads give 0) and the CPU state is
+ * put back as it was at the fault.  m68k_execute() then needs no setjmp(),
+ * which pays off when it is called for a few cycles at a time.
+ * Ignored with M68K_JIT, which keeps the longjmp() path.
+ */
+#ifndef M68K_PENDING_FAULTS
+#define M68K_PENDING_FAULTS         M68K_OPT_OFF
+#endif
+
+
 /* Turn ON to enable logging of illegal instruction calls.
  * M68K_LOG_FILEHANDLE must be #defined to a stdio file stream.
  * Turn on M68K_LOG_1010_1111 to log all 1010 and 1111 calls.
@@ -255,6 +350,141 @@
 #define M68K_EMULATE_PMMU           M68K_OPT_ON
 #endif
 
+/* Number of entries in the PMMU address translation cache (a power of two).
+ * Translations are cached per function code and page, and are only dropped
+ * by PFLUSH/PFLUSHA/PFLUSHR, PMOVE to TC/CRP/SRP and reset, as on the real
+ * chips.  See m68k_get_pmmu_atc_stats() in m68k.h to size it.
+ */
+#ifndef M68K_PMMU_ATC_ENTRIES
+#define M68K_PMMU_ATC_ENTRIES       256
+#endif
+
+/* If ON, the host can map RAM and ROM regions by host pointer using
+ * m68k_map_memory().  Accesses to mapped pages are done inline, and the
+ * m68k_read_memory_xx() / m68k_write_memory_xx() functions are then only
+ * called for unmapped pages (e.g. memory-mapped I/O).
+ */
+#ifndef M68K_FAST_MEMORY_MAP
+#define M68K_FAST_MEMORY_MAP        M68K_OPT_OFF
+#endif
+
+/* If ON, instruction words are read straight from host memory for the code
+ * page the PC is in, found through the fast memory map or the fetch window
+ * callback, and m68k_read_immediate_xx() is only called for other pages.
+ * Not used while the PMMU is enabled.  See m68k_set_fetch_window_callback()
+ * in m68k.h.
+ */
+#ifndef M68K_FETCH_WINDOW
+#define M68K_FETCH_WINDOW           M68K_OPT_OFF
+#endif
+
+/* If ON, m68k_execute() runs the threaded core generated by m68kmake, where
+ * each opcode handler fetches and dispatches the next instruction itself
+ * instead of returning to a central loop.  This needs computed goto support
+ * (GCC or Clang) and is ignored by other compilers.
+ */
+#ifndef M68K_THREADED_DISPATCH
+#define M68K_THREADED_DISPATCH      M68K_OPT_OFF
+#endif
+
+/* If ON, the handler tables use the fused handlers that m68kmake generates
+ * for the opcode handler pairs listed in m68k_in.c (or in a pairs file given
+ * to m68kmake).  After the first instruction of a pair, the second one runs
+ * without going back through dispatch, and the first one skips its flags
+ * when the second overwrites them.  Needs M68K_EMULATE_PREFETCH or
+ * M68K_FETCH_WINDOW, and is not used with the block cache.
+ */
+#ifndef M68K_FUSED_PAIRS
+#define M68K_FUSED_PAIRS            M68K_OPT_OFF
+#endif
+
+/* If ON, the opcode handlers that check the CPU type (including every handler
+ * using the indexed addressing modes) are also built once per emulated CPU
+ * family with the type as a constant, and m68k_set_cpu_type() selects the
+ * matching handler table.  Faster, but adds code for each family turned on
+ * above.
+ */
+#ifndef M68K_SPECIALIZED_HANDLERS
+#define M68K_SPECIALIZED_HANDLERS   M68K_OPT_OFF
+#endif
+
+/* If ON, moves, logical operations, add, sub and cmp only record their
+ * operands and result, and the condition codes are worked out from them when
+ * an instruction, an exception or the host reads them.
+ */
+#ifndef M68K_LAZY_FLAGS
+#define M68K_LAZY_FLAGS             M68K_OPT_OFF
+#endif
+
+/* If ON, m68k_execute() records straight runs of instructions into a block
+ * cache and replays them later without fetching and decoding each opcode
+ * again.  Takes precedence over M68K_THREADED_DISPATCH, and is not used with
+ * M68K_EMULATE_PREFETCH or while the PMMU is enabled.  See
+ * m68k_invalidate_code() in m68k.h for memory changed by the host.
+ */
+#ifndef M68K_BLOCK_CACHE
+#define M68K_BLOCK_CACHE            M68K_OPT_OFF
+#endif
+
+/* If ON, blocks that the block cache replays often are compiled to x86-64
+ * code, and turns the block cache on.  Only built with GCC or Clang on x86-64
+ * Unix hosts, and not with M68K_EMULATE_TRACE, M68K_EMULATE_FC or
+ * M68K_INSTRUCTION_HOOK; otherwise the block cache runs alone.
+ */
+#ifndef M68K_JIT
+#define M68K_JIT                    M68K_OPT_OFF
+#endif
+
+/* If ON, every compiled block is run again by the interpreter from the same
+ * state and the results are compared (see m68k_jit_lockstep_mismatches()).
+ * Slow; meant for debugging the JIT.
+ */
+#ifndef M68K_JIT_LOCKSTEP
+#define M68K_JIT_LOCKSTEP           M68K_OPT_OFF
+#endif
+
+/* If ON, hosts can schedule callbacks at absolute cycle counts with
+ * m68k_schedule_event(), and m68k_execute() stops at each of them in turn.
+ * M68K_MAX_EVENTS is the most events pending at once per CPU instance.
+ */
+#ifndef M68K_EVENT_QUEUE
+#define M68K_EVENT_QUEUE            M68K_OPT_OFF
+#endif
+#ifndef M68K_MAX_EVENTS
+#define M68K_MAX_EVENTS             32
+#endif
+
+/* If ON, idle loops are skipped in one step with the same cycle count and
+ * final state as running them: "dbcc dn,*" and "subq #q,dn / bne.s" delay
+ * loops, and tst or btst polling loops on plain memory given to
+ * m68k_map_memory() (which can only change at an event or the end of the
+ * timeslice).  "move (as)+,(ad)+ / dbf" and "clr (ad)+ / dbf" style copy and
+ * fill loops between such memory are done as host block copies, as long as
+ * the ranges do not overlap.  Loops whose code is not in the fetch window or
+ * the memory map are run as usual.  Not used with M68K_INSTRUCTION_HOOK,
+ * M68K_EMULATE_FC or M68K_MONITOR_PC.
+ */
+#ifndef M68K_FAST_FORWARD_LOOPS
+#define M68K_FAST_FORWARD_LOOPS     M68K_OPT_OFF
+#endif
+
+/* If ON, m68k_start_sampling() records the PC every so many cycles, along
+ * with the callers found by following the A6 frame chain, for
+ * m68k_dump_samples() to print as flame graph input.  The samples are taken
+ * by an event, so this needs M68K_EVENT_QUEUE.  M68K_SAMPLE_SLOTS is the
+ * number of different stacks kept per CPU instance and M68K_SAMPLE_DEPTH the
+ * most frames in a stack.
+ */
+#ifndef M68K_SAMPLE_PROFILER
+#define M68K_SAMPLE_PROFILER        M68K_OPT_OFF
+#endif
+#ifndef M68K_SAMPLE_SLOTS
+#define M68K_SAMPLE_SLOTS           4096
+#endif
+#ifndef M68K_SAMPLE_DEPTH
+#define M68K_SAMPLE_DEPTH           8
+#endif
+
 /* ----------------------------- COMPATIBILITY ---------------------------- */
 
 /* The following options set optimizations that violate the current ANSI
@@ -38,28 +38,34 @@
 /* ================================ INCLUDES ============================== */
 /* ======================================================================== */
 
+/* 64-bit file offsets on 32-bit hosts, for trace files (see m68ktrace.c) */
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 extern void m68040_fpu_op0(void);
 extern void m68040_fpu_op1(void);
 extern void m68881_mmu_ops(void);
-extern unsigned char m68ki_cycles[][0x10000];
-extern void (*m68ki_instruction_jump_table[0x10000])(void); /* opcode handler jump table */
-extern void m68ki_build_opcode_table(void);
 
 #include "m68kops.h"
 #include "m68kcpu.h"
 
 #include "m68kfpu.c"
 #include "m68kmmu.h" // uses some functions from m68kfpu.c which are static !
+#if M68KI_JIT
+#include "m68kjit.c"
+#endif
+#include "m68ktrace.c"
 
 /* ======================================================================== */
 /* ================================= DATA ================================= */
 /* ======================================================================== */
 
-int  m68ki_initial_cycles;
-int  m68ki_remaining_cycles = 0;                     /* Number of clocks remaining */
-uint m68ki_tracing = 0;
-uint m68ki_address_space;
-
 #ifdef M68K_LOG_ENABLE
 const char *const m68ki_cpu_names[] =
 {
@@ -77,22 +83,11 @@ const char *const m68ki_cpu_names[] =
 };
 #endif /* M68K_LOG_ENABLE */
 
-/* The CPU core */
-m68ki_cpu_core m68ki_cpu = {0};
-
-#if M68K_EMULATE_ADDRESS_ERROR
-#ifdef _BSD_SETJMP_H
-sigjmp_buf m68ki_aerr_trap;
-#else
-jmp_buf m68ki_aerr_trap;
-#endif
-#endif /* M68K_EMULATE_ADDRESS_ERROR */
-
-uint    m68ki_aerr_address;
-uint    m68ki_aerr_write_mode;
-uint    m68ki_aerr_fc;
+/* The CPU core used by the single-CPU API */
+static m68ki_cpu_core m68ki_default_cpu = {0};
 
-jmp_buf m68ki_bus_error_jmp_buf;
+/* The CPU core the calling thread is operating on */
+M68K_THREAD_LOCAL m68ki_cpu_core* m68ki_cpu_ptr = &m68ki_default_cpu;
 
 /* Used by shift & rotate instructions */
 const uint8 m68ki_shift_8_table[65] =
@@ -530,23 +525,21 @@ const uint8 m68ki_ea_idx_cycle_table[64] =
 /* ======================================================================== */
 
 /* Default callbacks used if the callback hasn't been set yet, or if the
- * callback is set to NULL
+ * callback is set to NULL.  What they record is kept in the CPU instance.
  */
 
 /* Interrupt acknowledge */
-static int default_int_ack_callback_data;
 static int default_int_ack_callback(int int_level)
 {
-	default_int_ack_callback_data = int_level;
+	m68ki_cpu.default_int_ack_data = int_level;
 	CPU_INT_LEVEL = 0;
 	return M68K_INT_ACK_AUTOVECTOR;
 }
 
 /* Breakpoint acknowledge */
-static unsigned int default_bkpt_ack_callback_data;
 static void default_bkpt_ack_callback(unsigned int data)
 {
-	default_bkpt_ack_callback_data = data;
+	m68ki_cpu.default_bkpt_ack_data = data;
 }
 
 /* Called when a reset instruction is executed */
@@ -587,17 +580,15 @@ static int default_trap_instr_callback(int trap)
 }
 
 /* Called when the program counter changed by a large value */
-static unsigned int default_pc_changed_callback_data;
 static void default_pc_changed_callback(unsigned int new_pc)
 {
-	default_pc_changed_callback_data = new_pc;
+	m68ki_cpu.default_pc_changed_data = new_pc;
 }
 
 /* Called every time there's bus activity (read/write to/from memory */
-static unsigned int default_set_fc_callback_data;
 static void default_set_fc_callback(unsigned int new_fc)
 {
-	default_set_fc_callback_data = new_fc;
+	m68ki_cpu.default_set_fc_data = new_fc;
 }
 
 /* Called every instruction cycle prior to execution */
@@ -606,15 +597,84 @@ static void default_instr_hook_callback(unsigned int pc)
 	(void)pc;
 }
 
+/* Called when opcode fetches reach a page outside the fetch window */
+static const void* default_fetch_window_callback(unsigned int page)
+{
+	(void)page;
+	return NULL;
+}
+
+#if M68K_LAZY_FLAGS
+/* Work out the flags recorded by the last ALU handler (see m68ki_flags_sync()).
+ * The expressions are the ones the handlers use without M68K_LAZY_FLAGS.
+ */
+void m68ki_flags_update(m68ki_cpu_core* cpu)
+{
+	uint src = cpu->flags_src;
+	uint dst = cpu->flags_dst;
+	uint res = cpu->flags_res;
+
+	switch(cpu->flags_op)
+	{
+		case M68KI_FLAGS_LOGIC_8:
+			cpu->n_flag = NFLAG_8(res);
+			cpu->not_z_flag = res;
+			cpu->v_flag = VFLAG_CLEAR;
+			cpu->c_flag = CFLAG_CLEAR;
+			break;
+		case M68KI_FLAGS_LOGIC_16:
+			cpu->n_flag = NFLAG_16(res);
+			cpu->not_z_flag = res;
+			cpu->v_flag = VFLAG_CLEAR;
+			cpu->c_flag = CFLAG_CLEAR;
+			break;
+		case M68KI_FLAGS_LOGIC_32:
+			cpu->n_flag = NFLAG_32(res);
+			cpu->not_z_flag = res;
+			cpu->v_flag = VFLAG_CLEAR;
+			cpu->c_flag = CFLAG_CLEAR;
+			break;
+		case M68KI_FLAGS_ADD_8:
+			cpu->n_flag = NFLAG_8(res);
+			cpu->not_z_flag = MASK_OUT_ABOVE_8(res);
+			cpu->v_flag = VFLAG_ADD_8(src, dst, res);
+			cpu->c_flag = CFLAG_8(res);
+			break;
+		case M68KI_FLAGS_ADD_16:
+			cpu->n_flag = NFLAG_16(res);
+			cpu->not_z_flag = MASK_OUT_ABOVE_16(res);
+			cpu->v_flag = VFLAG_ADD_16(src, dst, res);
+			cpu->c_flag = CFLAG_16(res);
+			break;
+		case M68KI_FLAGS_ADD_32:
+			cpu->n_flag = NFLAG_32(res);
+			cpu->not_z_flag = MASK_OUT_ABOVE_32(res);
+			cpu->v_flag = VFLAG_ADD_32(src, dst, res);
+			cpu->c_flag = CFLAG_ADD_32(src, dst, res);
+			break;
+		case M68KI_FLAGS_SUB_8:
+			cpu->n_flag = NFLAG_8(res);
+			cpu->not_z_flag = MASK_OUT_ABOVE_8(res);
+			cpu->v_flag = VFLAG_SUB_8(src, dst, res);
+			cpu->c_flag = CFLAG_8(res);
+			break;
+		case M68KI_FLAGS_SUB_16:
+			cpu->n_flag = NFLAG_16(res);
+			cpu->not_z_flag = MASK_OUT_ABOVE_16(res);
+			cpu->v_flag = VFLAG_SUB_16(src, dst, res);
+			cpu->c_flag = CFLAG_16(res);
+			break;
+		case M68KI_FLAGS_SUB_32:
+			cpu->n_flag = NFLAG_32(res);
+			cpu->not_z_flag = MASK_OUT_ABOVE_32(res);
+			cpu->v_flag = VFLAG_SUB_32(src, dst, res);
+			cpu->c_flag = CFLAG_SUB_32(src, dst, res);
+			break;
+	}
+	cpu->flags_op = M68KI_FLAGS_DONE;
+}
+#endif /* M68K_LAZY_FLAGS */
 
-#if M68K_EMULATE_ADDRESS_ERROR
-	#include <setjmp.h>
-	#ifdef _BSD_SETJMP_H
-	sigjmp_buf m68ki_aerr_trap;
-	#else
-	jmp_buf m68ki_aerr_trap;
-	#endif
-#endif /* M68K_EMULATE_ADDRESS_ERROR */
 
 /* ======================================================================== */
 /* ================================= API ================================== */
@@ -625,6 +685,11 @@ unsigned int m68k_get_reg(void* context, m68k_register_t regnum)
 {
 	m68ki_cpu_core* cpu = context != NULL ?(m68ki_cpu_core*)context : &m68ki_cpu;
 
+#if M68K_LAZY_FLAGS
+	if(cpu->flags_op != M68KI_FLAGS_DONE)
+		m68ki_flags_update(cpu);
+#endif
+
 	switch(regnum)
 	{
 		case M68K_REG_D0:	return cpu->dar[0];
@@ -684,6 +749,7 @@ unsigned int m68k_get_reg(void* context, m68k_register_t regnum)
 
 void m68k_set_reg(m68k_register_t regnum, unsigned int value)
 {
+	m68ki_jit_host_change();
 	switch(regnum)
 	{
 		case M68K_REG_D0:	REG_D[0] = MASK_OUT_ABOVE_32(value); return;
@@ -788,9 +854,18 @@ void m68k_set_instr_hook_callback(void  (*callback)(unsigned int pc))
 	CALLBACK_INSTR_HOOK = callback ? callback : default_instr_hook_callback;
 }
 
+void m68k_set_fetch_window_callback(const void* (*callback)(unsigned int page))
+{
+	CALLBACK_FETCH_WINDOW = callback ? callback : default_fetch_window_callback;
+	m68ki_fetch_invalidate();
+}
+
 /* Set the CPU type. */
 void m68k_set_cpu_type(unsigned int cpu_type)
 {
+	/* Cached blocks hold the cycle counts of the previous CPU type */
+	m68k_flush_code_cache();
+
 	switch(cpu_type)
 	{
 		case M68K_CPU_TYPE_68000:
@@ -798,6 +873,7 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 			CPU_ADDRESS_MASK = 0x00ffffff;
 			CPU_SR_MASK      = 0xa71f; /* T1 -- S  -- -- I2 I1 I0 -- -- -- X  N  Z  V  C  */
 			CYC_INSTRUCTION  = m68ki_cycles[0];
+			CPU_HANDLER_TABLE = M68KI_HANDLERS_000;
 			CYC_EXCEPTION    = m68ki_exception_cycle_table[0];
 			CYC_BCC_NOTAKE_B = -2;
 			CYC_BCC_NOTAKE_W = 2;
@@ -814,12 +890,14 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 			m68k_set_cpu_type(M68K_CPU_TYPE_68010);
 			CPU_ADDRESS_MASK = 0xffffffff;
 			CPU_TYPE         = CPU_TYPE_SCC070;
+			CPU_HANDLER_TABLE = m68ki_instruction_handler_table;
 			return;
 		case M68K_CPU_TYPE_68010:
 			CPU_TYPE         = CPU_TYPE_010;
 			CPU_ADDRESS_MASK = 0x00ffffff;
 			CPU_SR_MASK      = 0xa71f; /* T1 -- S  -- -- I2 I1 I0 -- -- -- X  N  Z  V  C  */
 			CYC_INSTRUCTION  = m68ki_cycles[1];
+			CPU_HANDLER_TABLE = M68KI_HANDLERS_010;
 			CYC_EXCEPTION    = m68ki_exception_cycle_table[1];
 			CYC_BCC_NOTAKE_B = -4;
 			CYC_BCC_NOTAKE_W = 0;
@@ -837,6 +915,7 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 			CPU_ADDRESS_MASK = 0x00ffffff;
 			CPU_SR_MASK      = 0xf71f; /* T1 T0 S  M  -- I2 I1 I0 -- -- -- X  N  Z  V  C  */
 			CYC_INSTRUCTION  = m68ki_cycles[2];
+			CPU_HANDLER_TABLE = M68KI_HANDLERS_020;
 			CYC_EXCEPTION    = m68ki_exception_cycle_table[2];
 			CYC_BCC_NOTAKE_B = -2;
 			CYC_BCC_NOTAKE_W = 0;
@@ -854,6 +933,7 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 			CPU_ADDRESS_MASK = 0xffffffff;
 			CPU_SR_MASK      = 0xf71f; /* T1 T0 S  M  -- I2 I1 I0 -- -- -- X  N  Z  V  C  */
 			CYC_INSTRUCTION  = m68ki_cycles[2];
+			CPU_HANDLER_TABLE = M68KI_HANDLERS_020;
 			CYC_EXCEPTION    = m68ki_exception_cycle_table[2];
 			CYC_BCC_NOTAKE_B = -2;
 			CYC_BCC_NOTAKE_W = 0;
@@ -871,6 +951,7 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 			CPU_ADDRESS_MASK = 0xffffffff;
 			CPU_SR_MASK      = 0xf71f; /* T1 T0 S  M  -- I2 I1 I0 -- -- -- X  N  Z  V  C  */
 			CYC_INSTRUCTION  = m68ki_cycles[3];
+			CPU_HANDLER_TABLE = M68KI_HANDLERS_030;
 			CYC_EXCEPTION    = m68ki_exception_cycle_table[3];
 			CYC_BCC_NOTAKE_B = -2;
 			CYC_BCC_NOTAKE_W = 0;
@@ -888,6 +969,7 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 			CPU_ADDRESS_MASK = 0xffffffff;
 			CPU_SR_MASK          = 0xf71f; /* T1 T0 S  M  -- I2 I1 I0 -- -- -- X  N  Z  V  C  */
 			CYC_INSTRUCTION  = m68ki_cycles[3];
+			CPU_HANDLER_TABLE = M68KI_HANDLERS_030;
 			CYC_EXCEPTION    = m68ki_exception_cycle_table[3];
 			CYC_BCC_NOTAKE_B = -2;
 			CYC_BCC_NOTAKE_W = 0;
@@ -905,6 +987,7 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 			CPU_ADDRESS_MASK = 0xffffffff;
 			CPU_SR_MASK      = 0xf71f; /* T1 T0 S  M  -- I2 I1 I0 -- -- -- X  N  Z  V  C  */
 			CYC_INSTRUCTION  = m68ki_cycles[4];
+			CPU_HANDLER_TABLE = M68KI_HANDLERS_040;
 			CYC_EXCEPTION    = m68ki_exception_cycle_table[4];
 			CYC_BCC_NOTAKE_B = -2;
 			CYC_BCC_NOTAKE_W = 0;
@@ -922,6 +1005,7 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 			CPU_ADDRESS_MASK = 0xffffffff;
 			CPU_SR_MASK      = 0xf71f; /* T1 T0 S  M  -- I2 I1 I0 -- -- -- X  N  Z  V  C  */
 			CYC_INSTRUCTION  = m68ki_cycles[4];
+			CPU_HANDLER_TABLE = M68KI_HANDLERS_040;
 			CYC_EXCEPTION    = m68ki_exception_cycle_table[4];
 			CYC_BCC_NOTAKE_B = -2;
 			CYC_BCC_NOTAKE_W = 0;
@@ -938,6 +1022,7 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 			CPU_TYPE         = CPU_TYPE_LC040;
 			m68ki_cpu.sr_mask          = 0xf71f; /* T1 T0 S  M  -- I2 I1 I0 -- -- -- X  N  Z  V  C  */
 			m68ki_cpu.cyc_instruction  = m68ki_cycles[4];
+			m68ki_cpu.instruction_handlers = m68ki_instruction_handler_table;
 			m68ki_cpu.cyc_exception    = m68ki_exception_cycle_table[4];
 			m68ki_cpu.cyc_bcc_notake_b = -2;
 			m68ki_cpu.cyc_bcc_notake_w = 0;
@@ -953,231 +1038,1958 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 	}
 }
 
-/* Execute some instructions until we use up num_cycles clock cycles */
-/* ASG: removed per-instruction interrupt checks */
-int m68k_execute(int num_cycles)
+#if M68K_EVENT_QUEUE
+/* Check if event a is due before event b */
+static int m68ki_event_before(const m68ki_event* a, const m68ki_event* b)
 {
-	/* eat up any reset cycles */
-	if (RESET_CYCLES) {
-	    int rc = RESET_CYCLES;
-	    RESET_CYCLES = 0;
-	    num_cycles -= rc;
-	    if (num_cycles <= 0)
-		return rc;
-	}
-
-	/* Set our pool of clock cycles available */
-	SET_CYCLES(num_cycles);
-	m68ki_initial_cycles = num_cycles;
+	if(a->cycle != b->cycle)
+		return a->cycle < b->cycle;
+	return (sint)(a->seq - b->seq) < 0;
+}
 
-	/* See if interrupts came in */
-	m68ki_check_interrupts();
+/* Move the event at index i up or down the heap to its place */
+static void m68ki_event_sift(int i)
+{
+	m68ki_event* heap = m68ki_cpu.events;
+	m68ki_event event = heap[i];
+	int child;
 
-	/* Make sure we're not stopped */
-	if(!CPU_STOPPED)
+	while(i > 0 && m68ki_event_before(&event, &heap[(i - 1) / 2]))
 	{
-		/* Return point if we had an address error */
-		m68ki_set_address_error_trap(); /* auto-disable (see m68kcpu.h) */
-
-		m68ki_check_bus_error_trap();
-
-		/* Main loop.  Keep going until we run out of clock cycles */
-		do
-		{
-			int i;
-			/* Set tracing accodring to T1. (T0 is done inside instruction) */
-			m68ki_trace_t1(); /* auto-disable (see m68kcpu.h) */
-
-			/* Set the address space for reads */
-			m68ki_use_data_space(); /* auto-disable (see m68kcpu.h) */
-
-			/* Call external hook to peek at CPU */
-			m68ki_instr_hook(REG_PC); /* auto-disable (see m68kcpu.h) */
-
-			/* Record previous program counter */
-			REG_PPC = REG_PC;
-
-			/* Record previous D/A register state (in case of bus error) */
-			for (i = 15; i >= 0; i--){
-				REG_DA_SAVE[i] = REG_DA[i];
-			}
-
-			/* Read an instruction and call its handler */
-			REG_IR = m68ki_read_imm_16();
-			m68ki_instruction_jump_table[REG_IR]();
-			USE_CYCLES(CYC_INSTRUCTION[REG_IR]);
-
-			/* Trace m68k_exception, if necessary */
-			m68ki_exception_if_trace(); /* auto-disable (see m68kcpu.h) */
-		} while(GET_CYCLES() > 0);
-
-		/* set previous PC to current PC for the next entry into the loop */
-		REG_PPC = REG_PC;
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
 	}
-	else
-		SET_CYCLES(0);
-
-	/* return how many clocks we used */
-	return m68ki_initial_cycles - GET_CYCLES();
+	for(;(child = 2 * i + 1) < m68ki_cpu.event_count;i = child)
+	{
+		if(child + 1 < m68ki_cpu.event_count && m68ki_event_before(&heap[child + 1], &heap[child]))
+			child++;
+		if(!m68ki_event_before(&heap[child], &event))
+			break;
+		heap[i] = heap[child];
+	}
+	heap[i] = event;
 }
 
+static void m68ki_event_remove(int i)
+{
+	m68ki_cpu.event_count--;
+	if(i < m68ki_cpu.event_count)
+	{
+		m68ki_cpu.events[i] = m68ki_cpu.events[m68ki_cpu.event_count];
+		m68ki_event_sift(i);
+	}
+}
 
-int m68k_cycles_run(void)
+/* Stop the timeslice at the next event, putting the cycles after it aside */
+static void m68ki_events_clip(void)
 {
-	return m68ki_initial_cycles - GET_CYCLES();
+	unsigned long long diff;
+
+	if(m68ki_cpu.event_count == 0 || GET_CYCLES() <= 0 ||
+		m68ki_cpu.events[0].cycle >= m68ki_cpu.cycle_end)
+		return;
+	diff = m68ki_cpu.cycle_end - m68ki_cpu.events[0].cycle;
+	if(diff > (unsigned long long)GET_CYCLES())
+		diff = GET_CYCLES();
+	USE_CYCLES((sint)diff);
+	m68ki_cpu.cycle_end -= diff;
+	m68ki_cpu.event_slack += (sint)diff;
 }
 
-int m68k_cycles_remaining(void)
+/* Give back the cycles put aside by m68ki_events_clip() */
+static void m68ki_events_unclip(void)
 {
-	return GET_CYCLES();
+	ADD_CYCLES(m68ki_cpu.event_slack);
+	m68ki_cpu.cycle_end += m68ki_cpu.event_slack;
+	m68ki_cpu.event_slack = 0;
 }
 
-/* Change the timeslice */
-void m68k_modify_timeslice(int cycles)
+/* Call the events that are due, returning how many there were */
+static int m68ki_events_run(void)
 {
-	m68ki_initial_cycles += cycles;
-	ADD_CYCLES(cycles);
+	m68ki_event event;
+	int count = 0;
+
+	while(m68ki_cpu.event_count > 0 && m68ki_cpu.events[0].cycle <= m68k_get_cycle_count())
+	{
+		event = m68ki_cpu.events[0];
+		m68ki_event_remove(0);
+		event.callback(event.param, event.cycle);
+		count++;
+	}
+	return count;
 }
+#endif /* M68K_EVENT_QUEUE */
 
+unsigned long long m68k_get_cycle_count(void)
+{
+#if M68K_EVENT_QUEUE
+	return m68ki_cpu.cycle_end - GET_CYCLES();
+#else
+	return 0;
+#endif /* M68K_EVENT_QUEUE */
+}
 
-void m68k_end_timeslice(void)
+int m68k_schedule_event(unsigned long long cycle, void (*callback)(void* param, unsigned long long cycle), void* param)
 {
-	m68ki_initial_cycles -= GET_CYCLES();
-	SET_CYCLES(0);
+#if M68K_EVENT_QUEUE
+	m68ki_event* event;
+	uint id;
+
+	if(callback == NULL || m68ki_cpu.event_count >= M68K_MAX_EVENTS)
+		return -1;
+	m68ki_jit_host_change();
+	id = m68ki_cpu.event_seq++ & 0x7fffffff;
+	event = &m68ki_cpu.events[m68ki_cpu.event_count++];
+	event->cycle = cycle;
+	event->callback = callback;
+	event->param = param;
+	event->seq = id;
+	m68ki_event_sift(m68ki_cpu.event_count - 1);
+
+	/* Scheduled from a callback: stop the running timeslice in time */
+	m68ki_events_clip();
+	return (int)id;
+#else
+	(void)cycle;
+	(void)callback;
+	(void)param;
+	return -1;
+#endif /* M68K_EVENT_QUEUE */
 }
 
+int m68k_cancel_event(int id)
+{
+#if M68K_EVENT_QUEUE
+	int i;
 
-/* ASG: rewrote so that the int_level is a mask of the IPL0/IPL1/IPL2 bits */
-/* KS: Modified so that IPL* bits match with mask positions in the SR
- *     and cleaned out remenants of the interrupt controller.
+	for(i = 0;i < m68ki_cpu.event_count;i++)
+		if(m68ki_cpu.events[i].seq == (uint)id)
+		{
+			m68ki_jit_host_change();
+			m68ki_event_remove(i);
+			return 1;
+		}
+#else
+	(void)id;
+#endif /* M68K_EVENT_QUEUE */
+	return 0;
+}
+
+#if M68KI_SAMPLER
+/* Fill pc[] with the current PC and the return addresses of the LINK A6
+ * frames above it, as far as they are in the memory map.  The guest stack
+ * grows down, so each older frame must be at a higher address, and startup
+ * code clears A6 to end the chain.
  */
-void m68k_set_irq(unsigned int int_level)
+static uint m68ki_sample_stack(uint* pc, uint depth)
 {
-	uint old_level = CPU_INT_LEVEL;
-	CPU_INT_LEVEL = int_level << 8;
+	uint count = 1;
+#if M68K_FAST_MEMORY_MAP
+	uint fp = REG_A[6];
+	const uint8* mem;
+#endif
 
-	/* A transition from < 7 to 7 always interrupts (NMI) */
-	/* Note: Level 7 can also level trigger like a normal IRQ */
-	if(old_level != 0x0700 && CPU_INT_LEVEL == 0x0700)
-		m68ki_cpu.nmi_pending = TRUE;
+	pc[0] = ADDRESS_68K(REG_PC);
+#if M68K_FAST_MEMORY_MAP
+#if M68K_EMULATE_PMMU
+	if(PMMU_ENABLED)
+		return count;
+#endif
+	while(count < depth && fp != 0 && !(fp & 1) && (mem = m68ki_map_read(ADDRESS_68K(fp), 8)) != NULL)
+	{
+		pc[count++] = ADDRESS_68K(m68ki_get_mem_32(mem + 4));
+		if(m68ki_get_mem_32(mem) <= fp)
+			break;
+		fp = m68ki_get_mem_32(mem);
+	}
+#else
+	(void)depth;
+#endif /* M68K_FAST_MEMORY_MAP */
+	return count;
 }
 
-void m68k_set_virq(unsigned int level, unsigned int active)
+/* Count one sample of the current stack and schedule the next one */
+static void m68ki_sample_event(void* param, unsigned long long cycle)
 {
-	uint state = m68ki_cpu.virq_state;
-	uint blevel;
+	m68ki_sampler* sampler = m68ki_cpu.sampler;
+	uint pc[M68K_SAMPLE_DEPTH];
+	uint depth = m68ki_sample_stack(pc, sampler->depth);
+	uint hash = depth;
+	uint i;
+
+	for(i = 0; i < depth; i++)
+		hash = (hash ^ pc[i]) * 0x01000193;
+	for(i = 0; i < M68K_SAMPLE_SLOTS; i++)
+	{
+		m68ki_sample* slot = &sampler->slot[(hash + i) % M68K_SAMPLE_SLOTS];
 
-	if(active)
-		state |= 1 << level;
-	else
-		state &= ~(1 << level);
-	m68ki_cpu.virq_state = state;
+		if(slot->depth == 0)
+		{
+			slot->depth = depth;
+			memcpy(slot->pc, pc, depth * sizeof(uint));
+		}
+		else if(slot->depth != depth || memcmp(slot->pc, pc, depth * sizeof(uint)) != 0)
+			continue;
+		slot->count++;
+		break;
+	}
+	if(i == M68K_SAMPLE_SLOTS)
+		sampler->dropped++;
 
-	for(blevel = 7; blevel > 0; blevel--)
-		if(state & (1 << blevel))
-			break;
-	m68k_set_irq(blevel);
+	sampler->event = m68k_schedule_event(cycle + sampler->period, m68ki_sample_event, param);
 }
+#endif /* M68KI_SAMPLER */
 
-unsigned int m68k_get_virq(unsigned int level)
+int m68k_start_sampling(unsigned int period, unsigned int depth)
 {
-	return (m68ki_cpu.virq_state & (1 << level)) ? 1 : 0;
+#if M68KI_SAMPLER
+	if(period == 0)
+		return 0;
+	if(m68ki_cpu.sampler == NULL)
+	{
+		m68ki_cpu.sampler = calloc(1, sizeof(m68ki_sampler));
+		if(m68ki_cpu.sampler == NULL)
+			return 0;
+		m68ki_cpu.sampler->event = -1;
+	}
+	m68k_stop_sampling();
+	m68ki_cpu.sampler->period = period;
+	m68ki_cpu.sampler->depth = depth == 0 ? 1 : depth > M68K_SAMPLE_DEPTH ? M68K_SAMPLE_DEPTH : depth;
+	m68ki_cpu.sampler->event = m68k_schedule_event(m68k_get_cycle_count() + period, m68ki_sample_event, NULL);
+	return m68ki_cpu.sampler->event >= 0;
+#else
+	(void)period;
+	(void)depth;
+	return 0;
+#endif /* M68KI_SAMPLER */
 }
 
-void m68k_init(void)
+void m68k_stop_sampling(void)
 {
-	static uint emulation_initialized = 0;
+#if M68KI_SAMPLER
+	if(m68ki_cpu.sampler != NULL && m68ki_cpu.sampler->event >= 0)
+	{
+		m68k_cancel_event(m68ki_cpu.sampler->event);
+		m68ki_cpu.sampler->event = -1;
+	}
+#endif /* M68KI_SAMPLER */
+}
 
-	/* The first call to this function initializes the opcode handler jump table */
-	if(!emulation_initialized)
-		{
-		m68ki_build_opcode_table();
-		emulation_initialized = 1;
+void m68k_clear_samples(void)
+{
+#if M68KI_SAMPLER
+	if(m68ki_cpu.sampler != NULL)
+	{
+		memset(m68ki_cpu.sampler->slot, 0, sizeof(m68ki_cpu.sampler->slot));
+		m68ki_cpu.sampler->dropped = 0;
 	}
+#endif /* M68KI_SAMPLER */
+}
 
-	m68k_set_int_ack_callback(NULL);
-	m68k_set_bkpt_ack_callback(NULL);
-	m68k_set_reset_instr_callback(NULL);
-	m68k_set_cmpild_instr_callback(NULL);
-	m68k_set_rte_instr_callback(NULL);
-	m68k_set_tas_instr_callback(NULL);
-	m68k_set_illg_instr_callback(NULL);
-    m68k_set_trap_instr_callback(NULL);
-	m68k_set_pc_changed_callback(NULL);
-	m68k_set_fc_callback(NULL);
-	m68k_set_instr_hook_callback(NULL);
+unsigned int m68k_get_sample(unsigned int index, unsigned int* pc, unsigned long long* count)
+{
+#if M68KI_SAMPLER
+	m68ki_sample* slot;
+
+	if(m68ki_cpu.sampler == NULL || index >= M68K_SAMPLE_SLOTS)
+		return 0;
+	slot = &m68ki_cpu.sampler->slot[index];
+	if(pc != NULL)
+		memcpy(pc, slot->pc, slot->depth * sizeof(uint));
+	if(count != NULL)
+		*count = slot->count;
+	return slot->depth;
+#else
+	(void)index;
+	(void)pc;
+	(void)count;
+	return 0;
+#endif /* M68KI_SAMPLER */
 }
 
-/* Trigger a Bus Error exception */
-void m68k_pulse_bus_error(void)
+void m68k_dump_samples(void (*print)(const char* line), int annotate)
 {
-	m68ki_exception_bus_error();
+#if M68KI_SAMPLER
+	m68ki_sampler* sampler = m68ki_cpu.sampler;
+	char line[M68K_SAMPLE_DEPTH * 12 + 128];
+	char dasm[100];
+	uint i;
+	int j;
+
+	if(sampler == NULL)
+		return;
+	for(i = 0; i < M68K_SAMPLE_SLOTS; i++)
+	{
+		m68ki_sample* slot = &sampler->slot[i];
+		uint length = 0;
+
+		if(slot->depth == 0)
+			continue;
+		/* Outermost caller first, as flamegraph.pl expects */
+		for(j = slot->depth - 1; j >= 0; j--)
+			length += sprintf(line + length, j > 0 ? "%06x;" : "%06x", slot->pc[j]);
+		if(annotate)
+		{
+			m68k_disassemble(dasm, slot->pc[0], m68k_get_reg(NULL, M68K_REG_CPU_TYPE));
+			dasm[strcspn(dasm, ";")] = '\0';
+			length += sprintf(line + length, " %s", dasm);
+		}
+		sprintf(line + length, " %llu", slot->count);
+		print(line);
+	}
+	if(sampler->dropped != 0)
+	{
+		sprintf(line, "(dropped) %llu", sampler->dropped);
+		print(line);
+	}
+#else
+	(void)print;
+	(void)annotate;
+#endif /* M68KI_SAMPLER */
 }
 
-/* Pulse the RESET line on the CPU */
-void m68k_pulse_reset(void)
+#if M68K_CALL_GRAPH
+/* Slot of func in the table, claiming one if needed, or M68K_CALL_FUNCTIONS
+ * if the table is full
+ */
+static uint m68ki_call_find(uint func)
 {
-	/* Disable the PMMU on reset */
-	m68ki_cpu.pmmu_enabled = 0;
+	m68ki_call_stats* table = m68ki_cpu.calls.func;
+	uint hash = (func >> 1) * 0x9e3779b1;
+	uint i;
 
-	/* Clear all stop levels and eat up all remaining cycles */
-	CPU_STOPPED = 0;
-	SET_CYCLES(0);
+	for(i = 0; i < M68K_CALL_FUNCTIONS; i++)
+	{
+		m68ki_call_stats* stats = &table[(hash + i) % M68K_CALL_FUNCTIONS];
 
-	CPU_RUN_MODE = RUN_MODE_BERR_AERR_RESET;
-	CPU_INSTR_MODE = INSTRUCTION_YES;
+		if(!stats->used)
+		{
+			stats->used = TRUE;
+			stats->func = func;
+		}
+		else if(stats->func != func)
+			continue;
+		return (hash + i) % M68K_CALL_FUNCTIONS;
+	}
+	return M68K_CALL_FUNCTIONS;
+}
 
-	/* Turn off tracing */
-	FLAG_T1 = FLAG_T0 = 0;
-	m68ki_clear_trace();
-	/* Interrupt mask to level 7 */
-	FLAG_INT_MASK = 0x0700;
-	CPU_INT_LEVEL = 0;
-	m68ki_cpu.virq_state = 0;
-	/* Reset VBR */
-	REG_VBR = 0;
-	/* Go to supervisor mode */
-	m68ki_set_sm_flag(SFLAG_SET | MFLAG_CLEAR);
+/* Add frame[depth], which ran for inclusive cycles, to table.  Recursive
+ * calls only count towards the inclusive cycles of the outermost one.
+ */
+static void m68ki_call_credit(m68ki_call_stats* table, uint depth, unsigned long long inclusive)
+{
+	m68ki_call_frame* frame = &m68ki_cpu.calls.frame[depth];
+	uint i;
+
+	if(frame->stats == M68K_CALL_FUNCTIONS)
+		return;
+	table[frame->stats].exclusive += frame->self;
+	for(i = 1; i < depth; i++)
+		if(m68ki_cpu.calls.frame[i].func == frame->func)
+			return;
+	table[frame->stats].inclusive += inclusive;
+}
 
-	/* Invalidate the prefetch queue */
-#if M68K_EMULATE_PREFETCH
-	/* Set to arbitrary number since our first fetch is from 0 */
-	CPU_PREF_ADDR = 0x1000;
-#endif /* M68K_EMULATE_PREFETCH */
+/* Return from the frames above depth */
+static void m68ki_call_unwind(uint depth)
+{
+	m68ki_call_graph* calls = &m68ki_cpu.calls;
 
-	/* Read the initial stack pointer and program counter */
-	m68ki_jump(0);
-	REG_SP = m68ki_read_imm_32();
-	REG_PC = m68ki_read_imm_32();
-	m68ki_jump(REG_PC);
+	while(calls->depth > depth)
+	{
+		m68ki_call_frame* frame = &calls->frame[--calls->depth];
+		unsigned long long inclusive = frame->self + frame->children;
 
-	CPU_RUN_MODE = RUN_MODE_NORMAL;
+		m68ki_call_credit(calls->func, calls->depth, inclusive);
+		calls->frame[calls->depth - 1].children += inclusive;
+	}
+}
 
-	RESET_CYCLES = CYC_EXCEPTION[EXCEPTION_RESET];
+/* Enter the function at func, with the return address (or the exception
+ * frame) at sp.  Frames that can no longer be returned to are dropped
+ * first: calls whose return address is at or below sp were left by a
+ * longjmp, and so was an exception frame at or below a new one.  Only
+ * frames on the same stack are compared, those on another one belong to a
+ * task that has been switched out.
+ */
+void m68ki_call_push(uint func, uint sp, uint exception)
+{
+	m68ki_call_graph* calls = &m68ki_cpu.calls;
+	m68ki_call_frame* frame;
+	uint stack = ((sp >> M68K_CALL_STACK_SHIFT) << 3) | FLAG_S | FLAG_M;
+	uint i;
+
+	if(m68ki_fault_pending()) /* auto-disable (see m68kcpu.h) */
+		return;
+
+	if(exception)
+	{
+		for(i = calls->depth - 1; i > 0; i--)
+			if(calls->frame[i].exception)
+			{
+				if(calls->frame[i].stack == stack && calls->frame[i].sp <= sp)
+					m68ki_call_unwind(i);
+				break;
+			}
+	}
+	else
+		while(calls->depth > 1 && !calls->frame[calls->depth - 1].exception &&
+			calls->frame[calls->depth - 1].stack == stack &&
+			calls->frame[calls->depth - 1].sp <= sp)
+			m68ki_call_unwind(calls->depth - 1);
+
+	if(calls->depth == M68K_CALL_DEPTH)
+	{
+		calls->untracked++;
+		return;
+	}
+	frame = &calls->frame[calls->depth++];
+	frame->func = ADDRESS_68K(func);
+	frame->sp = sp;
+	frame->stack = stack;
+	frame->exception = exception;
+	frame->self = 0;
+	frame->children = 0;
+	frame->stats = m68ki_call_find(frame->func);
+	if(frame->stats == M68K_CALL_FUNCTIONS)
+		calls->untracked++;
+	else
+		calls->func[frame->stats].calls++;
 }
 
-/* Pulse the HALT line on the CPU */
-void m68k_pulse_halt(void)
+/* Return through the return address or exception frame at sp.  Returns
+ * that match no frame, such as a task switch to another stack, are ignored.
+ */
+void m68ki_call_pop(uint sp)
 {
-	CPU_STOPPED |= STOP_LEVEL_HALT;
+	uint i;
+
+	for(i = m68ki_cpu.calls.depth - 1; i > 0; i--)
+		if(m68ki_cpu.calls.frame[i].sp == sp)
+		{
+			m68ki_call_unwind(i);
+			return;
+		}
 }
 
-/* Get and set the current CPU context */
-/* This is to allow for multiple CPUs */
-unsigned int m68k_context_size(void)
+/* Most exclusive cycles first */
+static int m68ki_call_compare(const void* a, const void* b)
 {
-	return sizeof(m68ki_cpu_core);
+	unsigned long long ca = ((const m68ki_call_stats*)a)->exclusive;
+	unsigned long long cb = ((const m68ki_call_stats*)b)->exclusive;
+
+	return ca < cb ? 1 : ca > cb ? -1 : 0;
 }
+#endif /* M68K_CALL_GRAPH */
 
-unsigned int m68k_get_context(void* dst)
+void m68k_clear_call_graph(void)
 {
-	if(dst) *(m68ki_cpu_core*)dst = m68ki_cpu;
-	return sizeof(m68ki_cpu_core);
+#if M68K_CALL_GRAPH
+	m68ki_call_graph* calls = &m68ki_cpu.calls;
+	uint i;
+
+	memset(calls->func, 0, sizeof(calls->func));
+	calls->untracked = 0;
+	calls->frame[0].self = 0;
+	calls->frame[0].children = 0;
+	for(i = 1; i < calls->depth; i++)
+	{
+		calls->frame[i].self = 0;
+		calls->frame[i].children = 0;
+		calls->frame[i].stats = m68ki_call_find(calls->frame[i].func);
+	}
+#endif /* M68K_CALL_GRAPH */
 }
 
-void m68k_set_context(void* src)
+void m68k_dump_call_graph(void (*print)(const char* line), unsigned int top)
+{
+#if M68K_CALL_GRAPH
+	m68ki_call_graph* calls = &m68ki_cpu.calls;
+	m68ki_call_stats* table = malloc(sizeof(calls->func));
+	unsigned long long inclusive = 0;
+	char line[128];
+	uint used = 0;
+	uint i;
+
+	if(table == NULL)
+		return;
+
+	/* Count the calls still running as if they returned now */
+	memcpy(table, calls->func, sizeof(calls->func));
+	for(i = calls->depth - 1; i > 0; i--)
+	{
+		inclusive += calls->frame[i].self + calls->frame[i].children;
+		m68ki_call_credit(table, i, inclusive);
+	}
+	inclusive += calls->frame[0].self + calls->frame[0].children;
+
+	for(i = 0; i < M68K_CALL_FUNCTIONS; i++)
+		if(table[i].used)
+			table[used++] = table[i];
+	qsort(table, used, sizeof(m68ki_call_stats), m68ki_call_compare);
+
+	sprintf(line, "%llu cycles, %llu outside any call, %llu calls not tracked",
+		inclusive, calls->frame[0].self, calls->untracked);
+	print(line);
+	print("function calls inclusive exclusive");
+	for(i = 0; i < used && i < top; i++)
+	{
+		sprintf(line, "%06x %llu %llu %llu", table[i].func, table[i].calls,
+			table[i].inclusive, table[i].exclusive);
+		print(line);
+	}
+	free(table);
+#else
+	(void)print;
+	(void)top;
+#endif /* M68K_CALL_GRAPH */
+}
+
+#if M68KI_FAST_FORWARD
+/* Host memory holding size bytes of code at address, NULL if the host would
+ * have to be called to fetch them
+ */
+static const uint8* m68ki_peek_code(uint address, uint size)
+{
+	address = ADDRESS_68K(address);
+#if M68K_EMULATE_PMMU
+	if(PMMU_ENABLED)
+		return NULL;
+#endif
+#if M68KI_FETCH_WINDOW
+	if(address - m68ki_cpu.fetch_page < m68ki_cpu.fetch_limit &&
+		address - m68ki_cpu.fetch_page + size <= m68ki_cpu.fetch_limit)
+		return m68ki_cpu.fetch_mem + (address - m68ki_cpu.fetch_page);
+#endif
+#if M68K_FAST_MEMORY_MAP
+	return m68ki_map_read(address, size);
+#else
+	(void)size;
+	return NULL;
+#endif
+}
+
+/* Passes of a loop that would still be started before the cycles run out.
+ * The pass in progress ends with the branch, whose base cycles are not yet
+ * taken, and a pass is only started if its last instruction would be run.
+ */
+static uint m68ki_loop_passes(uint head, uint pass)
+{
+	sint left = GET_CYCLES() - (sint)CYC_OPCODE(REG_IR) - (sint)head;
+
+	if(left <= 0 || (sint)pass <= 0)
+		return 0;
+	return (left - 1) / pass + 1;
+}
+
+#if M68K_FAST_MEMORY_MAP
+/* move (as)+,(ad)+, move ds,(ad)+ or clr (ad)+ closed by dbcc dn: copy or
+ * fill straight between the host memory of both ranges.  Elements that the
+ * map does not cover, or that straddle two pages, are left to the loop.
+ */
+static void m68ki_fast_forward_block(uint* r_dst, uint dbcc)
+{
+	const uint8* code = m68ki_peek_code(REG_PC, 2);
+	const uint8* from;
+	uint8* to;
+	uint8* last = NULL;
+	uint* r_src = NULL;
+	uint* r_to;
+	uint op;
+	uint size;
+	uint value = 0;
+	uint pass;
+	uint count;
+	uint len;
+	uint done;
+	uint chunk;
+	uint d;
+	uint s = 0;
+	uint pc = ADDRESS_68K(REG_PC);
+
+	/* Only dbf: the body changes the flags */
+	if(code == NULL || (REG_IR & 0x0f00) != 0x0100)
+		return;
+	op = m68ki_get_mem_16(code);
+	if((op & 0xff38) == 0x4218 && (op & 0xc0) != 0xc0)
+	{
+		size = 1 << ((op >> 6) & 3);
+		r_to = &REG_A[op & 7];
+	}
+	else if((op & 0xc1c0) == 0x00c0 && (op & 0x3000) != 0 &&
+		((op & 0x38) == 0x18 || (op & 0x38) == 0x00))
+	{
+		size = (op & 0x3000) == 0x1000 ? 1 : (op & 0x3000) == 0x3000 ? 2 : 4;
+		r_to = &REG_A[(op >> 9) & 7];
+		if(op & 0x38)
+			r_src = &REG_A[op & 7];
+		else if(&REG_D[op & 7] != r_dst)
+			value = REG_D[op & 7] & (0xffffffff >> (32 - size * 8));
+		else
+			return;
+	}
+	else
+		return;
+
+	/* a7 keeps byte accesses word aligned */
+	if(r_to == &REG_A[7] || r_src == &REG_A[7] || r_src == r_to)
+		return;
+	pass = CYC_OPCODE(op) + dbcc;
+	count = m68ki_loop_passes(CYC_OPCODE(op), pass);
+	if(count > MASK_OUT_ABOVE_16(*r_dst))
+		count = MASK_OUT_ABOVE_16(*r_dst);
+	len = count * size;
+	if(len == 0)
+		return;
+
+	/* Both ranges must be aligned, not wrap, and not overlap each other or
+	 * the loop
+	 */
+	d = ADDRESS_68K(*r_to);
+	if((size > 1 && (*r_to & 1)) || CPU_ADDRESS_MASK - d < len - 1 ||
+		(d < pc + 6 && pc < d + len))
+		return;
+	if(r_src != NULL)
+	{
+		s = ADDRESS_68K(*r_src);
+		if((size > 1 && (*r_src & 1)) || CPU_ADDRESS_MASK - s < len - 1 ||
+			(d < s + len && s < d + len))
+			return;
+	}
+
+	for(done = 0;done < len;done += chunk)
+	{
+		chunk = len - done;
+		if(chunk > M68KI_MAP_PAGE_MASK + 1 - ((d + done) & M68KI_MAP_PAGE_MASK))
+			chunk = M68KI_MAP_PAGE_MASK + 1 - ((d + done) & M68KI_MAP_PAGE_MASK);
+		if(r_src != NULL && chunk > M68KI_MAP_PAGE_MASK + 1 - ((s + done) & M68KI_MAP_PAGE_MASK))
+			chunk = M68KI_MAP_PAGE_MASK + 1 - ((s + done) & M68KI_MAP_PAGE_MASK);
+		chunk -= chunk % size;
+		if(chunk == 0 || (to = m68ki_map_write(d + done, chunk)) == NULL)
+			break;
+		if(r_src != NULL)
+		{
+			/* The host may map one buffer at two addresses */
+			from = m68ki_map_read(s + done, chunk);
+			if(from == NULL || (from < to + chunk && to < from + chunk))
+				break;
+			memcpy(to, from, chunk);
+		}
+		else if(size == 1)
+			memset(to, value, chunk);
+		else
+		{
+			uint i;
+
+			for(i = 0;i < chunk;i += size)
+				if(size == 2)
+					m68ki_set_mem_16(to + i, value);
+				else
+					m68ki_set_mem_32(to + i, value);
+		}
+#if M68KI_BLOCK_CACHE
+		{
+			uint granule;
+
+			for(granule = (d + done) >> M68KI_BLOCK_GRANULE_SHIFT; granule <= (d + done + chunk - 1) >> M68KI_BLOCK_GRANULE_SHIFT; granule++)
+				m68ki_block_check_write(granule << M68KI_BLOCK_GRANULE_SHIFT);
+		}
+#endif /* M68KI_BLOCK_CACHE */
+		last = to + chunk - size;
+	}
+	if(done == 0)
+		return;
+
+	/* The flags are those of the last element moved */
+	if(r_src != NULL)
+	{
+		value = size == 1 ? *last : size == 2 ? m68ki_get_mem_16(last) : m68ki_get_mem_32(last);
+		*r_src += done;
+	}
+	*r_to += done;
+	*r_dst -= done / size;
+	if(size == 1)
+		m68ki_set_logic_flags_8(value);
+	else if(size == 2)
+		m68ki_set_logic_flags_16(value);
+	else
+		m68ki_set_logic_flags_32(value);
+	USE_CYCLES(done / size * pass);
+}
+#endif /* M68K_FAST_MEMORY_MAP */
+
+/* dbcc dn,* : the condition cannot change, so only dn counts the passes */
+void m68ki_fast_forward_dbcc(uint* r_dst)
+{
+	uint pass = CYC_OPCODE(REG_IR) + CYC_DBCC_F_NOEXP;
+	uint count;
+
+	if(REG_PC != REG_PPC)
+	{
+#if M68K_FAST_MEMORY_MAP
+		m68ki_fast_forward_block(r_dst, pass);
+#endif
+		return;
+	}
+	count = m68ki_loop_passes(0, pass);
+
+	/* Stop before the pass that takes dn to -1 */
+	if(count > MASK_OUT_ABOVE_16(*r_dst))
+		count = MASK_OUT_ABOVE_16(*r_dst);
+	*r_dst -= count;
+	USE_CYCLES(count * pass);
+}
+
+#if M68K_FAST_MEMORY_MAP
+/* Check condition cc (2 to 15) of a bcc */
+static int m68ki_branch_taken(uint cc)
+{
+	m68ki_flags_sync();
+	switch(cc & 0xf)
+	{
+		case 0x2: return COND_HI() != 0;
+		case 0x3: return COND_LS() != 0;
+		case 0x4: return COND_CC() != 0;
+		case 0x5: return COND_CS() != 0;
+		case 0x6: return COND_NE() != 0;
+		case 0x7: return COND_EQ() != 0;
+		case 0x8: return COND_VC() != 0;
+		case 0x9: return COND_VS() != 0;
+		case 0xa: return COND_PL() != 0;
+		case 0xb: return COND_MI() != 0;
+		case 0xc: return COND_GE() != 0;
+		case 0xd: return COND_LT() != 0;
+		case 0xe: return COND_GT() != 0;
+		default:  return COND_LE() != 0;
+	}
+}
+#endif /* M68K_FAST_MEMORY_MAP */
+
+/* bcc.s back to a register countdown or a test of unchanging memory */
+void m68ki_fast_forward_bcc(void)
+{
+	uint length = REG_PPC - REG_PC;
+	const uint8* code = m68ki_peek_code(REG_PC, length);
+	uint op;
+	uint pass;
+	uint count;
+
+	if(code == NULL)
+		return;
+	op = m68ki_get_mem_16(code);
+	pass = CYC_OPCODE(op) + CYC_OPCODE(REG_IR);
+	count = m68ki_loop_passes(CYC_OPCODE(op), pass);
+	if(count == 0)
+		return;
+
+	/* subq #q,dn / bne.s : run until dn reaches 0 */
+	if(length == 2 && (op & 0xf138) == 0x5100 && (op & 0xc0) != 0xc0 &&
+		(REG_IR & 0xff00) == 0x6600)
+	{
+		uint* r_dst = &REG_D[op & 7];
+		uint src = (((op >> 9) - 1) & 7) + 1;
+		uint mask = (op & 0xc0) == 0 ? 0xff : (op & 0xc0) == 0x40 ? 0xffff : 0xffffffff;
+		uint dst = *r_dst & mask;
+
+		/* The pass that reaches 0 (or would wrap) is run as usual */
+		if(count > ((dst - 1) & mask) / src)
+			count = ((dst - 1) & mask) / src;
+		if(count == 0)
+			return;
+		dst = (dst - (count - 1) * src) & mask;
+		switch(op & 0xc0)
+		{
+			case 0x00: m68ki_set_sub_flags_8(src, dst, dst - src); break;
+			case 0x40: m68ki_set_sub_flags_16(src, dst, dst - src); break;
+			default:   m68ki_set_sub_flags_32(src, dst, dst - src); break;
+		}
+		*r_dst = (*r_dst & ~mask) | ((dst - src) & mask);
+		USE_CYCLES(count * pass);
+		return;
+	}
+
+#if M68K_FAST_MEMORY_MAP
+	/* tst <ea> or btst #n,<ea> / bcc.s on plain memory: the outcome cannot
+	 * change until the host runs again.  The host may have run since the
+	 * last test, so it is done again here.
+	 */
+	{
+		const uint8* end = code + length;
+		const uint8* mem;
+		uint reg = op & 7;
+		uint size = 1;
+		uint bit = 0;
+		uint ea;
+
+		if((op & 0xff00) == 0x4a00 && (op & 0xc0) != 0xc0)
+			size = 1 << ((op >> 6) & 3);
+		else if((op & 0xffc0) == 0x0800 && length >= 4)
+		{
+			bit = 1 << (m68ki_get_mem_16(code + 2) & 7);
+			code += 2;
+		}
+		else
+			return;
+		code += 2;
+
+		/* The body must be exactly the one instruction */
+		switch((op >> 3) & 7)
+		{
+			case 2:
+				if(code != end)
+					return;
+				ea = REG_A[reg];
+				break;
+			case 5:
+				if(code + 2 != end)
+					return;
+				ea = REG_A[reg] + MAKE_INT_16(m68ki_get_mem_16(code));
+				break;
+			case 7:
+				if(reg == 0 && code + 2 == end)
+					ea = MAKE_INT_16(m68ki_get_mem_16(code));
+				else if(reg == 1 && code + 4 == end)
+					ea = m68ki_get_mem_32(code);
+				else
+					return;
+				break;
+			default:
+				return;
+		}
+		mem = m68ki_map_read(ADDRESS_68K(ea), size);
+		if(mem == NULL)
+			return;
+		if(bit != 0)
+		{
+			m68ki_flags_sync();
+			FLAG_Z = *mem & bit;
+		}
+		else if(size == 1)
+			m68ki_set_logic_flags_8(*mem);
+		else if(size == 2)
+			m68ki_set_logic_flags_16(m68ki_get_mem_16(mem));
+		else
+			m68ki_set_logic_flags_32(m68ki_get_mem_32(mem));
+		if(m68ki_branch_taken(REG_IR >> 8))
+			USE_CYCLES(count * pass);
+	}
+#endif /* M68K_FAST_MEMORY_MAP */
+}
+#endif /* M68KI_FAST_FORWARD */
+
+/* Execute some instructions until we use up num_cycles clock cycles */
+/* ASG: removed per-instruction interrupt checks */
+#if M68KI_BLOCK_CACHE
+static void m68ki_execute_blocks(void);
+#endif
+#if M68KI_PENDING_FAULTS
+/* CPU state at the pending fault, kept in the instance's fault_state: the
+ * registers up to the ATC counters and the execution state from
+ * remaining_cycles to berr_mmu
+ */
+#define M68KI_FAULT_REGS_SIZE (offsetof(m68ki_cpu_core, mmu_atc_hits) - offsetof(m68ki_cpu_core, dar))
+#define M68KI_FAULT_EXEC_SIZE (offsetof(m68ki_cpu_core, fault_pending) - offsetof(m68ki_cpu_core, remaining_cycles))
+
+static void m68ki_save_fault_state(void);
+#endif /* M68KI_PENDING_FAULTS */
+
+/* Run the remaining cycles, or burn them if the CPU is stopped */
+static int m68ki_execute_slice(void)
+{
+#if M68KI_PENDING_FAULTS
+	/* A bus error pulsed between calls to m68k_execute() or from an event.
+	 * No instruction is under way, and the host may have changed registers
+	 * or the timeslice since, so it is taken from the state as it is now.
+	 */
+	if(m68ki_cpu.fault_pending)
+	{
+		m68ki_save_fault_state();
+		m68ki_take_fault();
+	}
+#endif /* M68KI_PENDING_FAULTS */
+
+	/* Make sure we're not stopped */
+	if(!CPU_STOPPED)
+	{
+		/* Return point if we had an address error */
+		m68ki_set_address_error_trap(); /* auto-disable (see m68kcpu.h) */
+
+		m68ki_check_bus_error_trap();
+
+#if M68KI_BLOCK_CACHE
+		/* Main loop, replaying cached blocks where possible */
+		m68ki_execute_blocks();
+#elif M68KI_THREADED_DISPATCH
+		/* Main loop, with the dispatch done by the opcode handlers */
+		m68ki_execute_threaded();
+#else
+		/* Main loop.  Keep going until we run out of clock cycles */
+		do
+		{
+			m68ki_begin_instruction();
+
+			/* Read an instruction and call its handler */
+			REG_IR = m68ki_read_imm_16();
+			m68ki_instruction_handler(REG_IR)();
+
+			m68ki_end_instruction();
+		} while(GET_CYCLES() > 0);
+#endif /* M68KI_BLOCK_CACHE */
+
+		/* set previous PC to current PC for the next entry into the loop */
+		REG_PPC = REG_PC;
+	}
+	else
+		SET_CYCLES(0);
+
+	return m68ki_initial_cycles - GET_CYCLES();
+}
+
+int m68k_execute(int num_cycles)
+{
+#if M68K_EVENT_QUEUE
+	/* Fold in cycles put aside by m68k_modify_timeslice() between calls */
+	m68ki_events_unclip();
+#endif /* M68K_EVENT_QUEUE */
+
+	/* eat up any reset cycles */
+	if (RESET_CYCLES) {
+	    int rc = RESET_CYCLES;
+	    RESET_CYCLES = 0;
+	    num_cycles -= rc;
+#if M68K_EVENT_QUEUE
+	    m68ki_cpu.cycle_end += rc;
+#endif /* M68K_EVENT_QUEUE */
+	    if (num_cycles <= 0)
+		return rc;
+	}
+
+	/* Set our pool of clock cycles available */
+#if M68K_EVENT_QUEUE
+	m68ki_cpu.cycle_end += num_cycles - GET_CYCLES();
+#endif /* M68K_EVENT_QUEUE */
+	SET_CYCLES(num_cycles);
+	m68ki_initial_cycles = num_cycles;
+
+	/* See if interrupts came in */
+	m68ki_check_interrupts();
+
+#if M68K_EVENT_QUEUE
+	/* Run up to each event in turn, then the event itself */
+	for(;;)
+	{
+		/* The callbacks may have changed the interrupt level */
+		if(m68ki_events_run())
+			m68ki_check_interrupts();
+
+		/* Events they scheduled may have clipped to one that was still due */
+		m68ki_events_unclip();
+		if(GET_CYCLES() <= 0)
+			break;
+		m68ki_events_clip();
+		m68ki_execute_slice();
+		m68ki_events_unclip();
+	}
+#else
+	m68ki_execute_slice();
+#endif /* M68K_EVENT_QUEUE */
+
+	/* return how many clocks we used */
+	return m68ki_initial_cycles - GET_CYCLES();
+}
+
+int m68k_cycles_run(void)
+{
+#if M68K_EVENT_QUEUE
+	return m68ki_initial_cycles - GET_CYCLES() - m68ki_cpu.event_slack;
+#else
+	return m68ki_initial_cycles - GET_CYCLES();
+#endif /* M68K_EVENT_QUEUE */
+}
+
+int m68k_cycles_remaining(void)
+{
+#if M68K_EVENT_QUEUE
+	return GET_CYCLES() + m68ki_cpu.event_slack;
+#else
+	return GET_CYCLES();
+#endif /* M68K_EVENT_QUEUE */
+}
+
+/* Change the timeslice */
+void m68k_modify_timeslice(int cycles)
+{
+	m68ki_jit_host_change();
+	m68ki_initial_cycles += cycles;
+#if M68K_EVENT_QUEUE
+	/* Resize the whole timeslice, then stop at the next event again */
+	m68ki_cpu.event_slack += cycles;
+	m68ki_events_unclip();
+	m68ki_events_clip();
+#else
+	ADD_CYCLES(cycles);
+#endif /* M68K_EVENT_QUEUE */
+}
+
+
+void m68k_end_timeslice(void)
+{
+	m68ki_jit_host_change();
+#if M68K_EVENT_QUEUE
+	/* Including the cycles put aside past the next event */
+	m68ki_initial_cycles -= GET_CYCLES() + m68ki_cpu.event_slack;
+	m68ki_cpu.cycle_end -= GET_CYCLES();
+	m68ki_cpu.event_slack = 0;
+#else
+	m68ki_initial_cycles -= GET_CYCLES();
+#endif /* M68K_EVENT_QUEUE */
+	SET_CYCLES(0);
+}
+
+
+/* ASG: rewrote so that the int_level is a mask of the IPL0/IPL1/IPL2 bits */
+/* KS: Modified so that IPL* bits match with mask positions in the SR
+ *     and cleaned out remenants of the interrupt controller.
+ */
+void m68k_set_irq(unsigned int int_level)
+{
+	uint old_level = CPU_INT_LEVEL;
+
+	m68ki_jit_host_change();
+	CPU_INT_LEVEL = int_level << 8;
+
+	/* A transition from < 7 to 7 always interrupts (NMI) */
+	/* Note: Level 7 can also level trigger like a normal IRQ */
+	if(old_level != 0x0700 && CPU_INT_LEVEL == 0x0700)
+		m68ki_cpu.nmi_pending = TRUE;
+}
+
+void m68k_set_virq(unsigned int level, unsigned int active)
+{
+	uint state = m68ki_cpu.virq_state;
+	uint blevel;
+
+	if(active)
+		state |= 1 << level;
+	else
+		state &= ~(1 << level);
+	m68ki_cpu.virq_state = state;
+
+	for(blevel = 7; blevel > 0; blevel--)
+		if(state & (1 << blevel))
+			break;
+	m68k_set_irq(blevel);
+}
+
+unsigned int m68k_get_virq(unsigned int level)
+{
+	return (m68ki_cpu.virq_state & (1 << level)) ? 1 : 0;
+}
+
+void m68k_init(void)
+{
+	m68k_set_int_ack_callback(NULL);
+	m68k_set_bkpt_ack_callback(NULL);
+	m68k_set_reset_instr_callback(NULL);
+	m68k_set_cmpild_instr_callback(NULL);
+	m68k_set_rte_instr_callback(NULL);
+	m68k_set_tas_instr_callback(NULL);
+	m68k_set_illg_instr_callback(NULL);
+    m68k_set_trap_instr_callback(NULL);
+	m68k_set_pc_changed_callback(NULL);
+	m68k_set_fc_callback(NULL);
+	m68k_set_instr_hook_callback(NULL);
+	m68k_set_fetch_window_callback(NULL);
+
+	/* Until a CPU type is set */
+	if(CPU_HANDLER_TABLE == NULL)
+		CPU_HANDLER_TABLE = m68ki_instruction_handler_table;
+
+#if M68K_CALL_GRAPH
+	/* The root frame, for code outside any call */
+	if(m68ki_cpu.calls.depth == 0)
+		m68ki_cpu.calls.depth = 1;
+#endif /* M68K_CALL_GRAPH */
+
+#if M68KI_PENDING_FAULTS
+	/* Without it, a fault is taken from the state at the end of the
+	 * instruction
+	 */
+	if(m68ki_cpu.fault_state == NULL)
+		m68ki_cpu.fault_state = malloc(M68KI_FAULT_REGS_SIZE + M68KI_FAULT_EXEC_SIZE);
+#endif /* M68KI_PENDING_FAULTS */
+}
+
+#if M68KI_PENDING_FAULTS
+/* Record the state that m68ki_take_fault() goes back to */
+static void m68ki_save_fault_state(void)
+{
+	if(m68ki_cpu.fault_state == NULL)
+		return;
+	memcpy(m68ki_cpu.fault_state, m68ki_cpu.dar, M68KI_FAULT_REGS_SIZE);
+	memcpy(m68ki_cpu.fault_state + M68KI_FAULT_REGS_SIZE, &m68ki_cpu.remaining_cycles, M68KI_FAULT_EXEC_SIZE);
+}
+
+/* Flag a bus or address error, to be taken by m68ki_take_fault() at the end
+ * of the instruction.  Only the first fault of an instruction counts, later
+ * ones come from accesses that would never have been made.
+ */
+void m68ki_raise_fault(uint kind)
+{
+	if(m68ki_cpu.fault_pending)
+		return;
+	m68ki_save_fault_state();
+	m68ki_cpu.fault_pending = kind;
+}
+
+/* Put the CPU back as it was at the fault and take the exception.  A fault
+ * while writing its stack frame is raised again, and halts the CPU.
+ */
+void m68ki_take_fault(void)
+{
+	while(m68ki_cpu.fault_pending)
+	{
+		uint kind = m68ki_cpu.fault_pending;
+		/* The interrupt lines are the host's, keep any change to them */
+		uint int_level = CPU_INT_LEVEL;
+		uint virq_state = m68ki_cpu.virq_state;
+		uint nmi_pending = m68ki_cpu.nmi_pending;
+
+		m68ki_cpu.fault_pending = M68KI_FAULT_NONE;
+		if(m68ki_cpu.fault_state != NULL)
+		{
+			memcpy(m68ki_cpu.dar, m68ki_cpu.fault_state, M68KI_FAULT_REGS_SIZE);
+			memcpy(&m68ki_cpu.remaining_cycles, m68ki_cpu.fault_state + M68KI_FAULT_REGS_SIZE, M68KI_FAULT_EXEC_SIZE);
+		}
+		CPU_INT_LEVEL = int_level;
+		m68ki_cpu.virq_state = virq_state;
+		m68ki_cpu.nmi_pending = nmi_pending;
+
+		if(kind == M68KI_FAULT_BUS)
+			m68ki_exception_bus_error();
+		else
+			m68ki_exception_address_error();
+	}
+
+	if(CPU_STOPPED)
+		SET_CYCLES(0);
+}
+#endif /* M68KI_PENDING_FAULTS */
+
+/* Trigger a Bus Error exception */
+void m68k_pulse_bus_error(void)
+{
+	m68ki_cpu.berr_mmu = 0;
+	m68ki_bus_error();
+}
+
+/* Pulse the RESET line on the CPU */
+void m68k_pulse_reset(void)
+{
+	/* Disable the PMMU on reset and drop its translations */
+	m68ki_cpu.pmmu_enabled = 0;
+	m68ki_cpu.mmu_atc_shift = M68KI_ATC_MIN_SHIFT;
+	memset(m68ki_cpu.mmu_atc, 0, sizeof(m68ki_cpu.mmu_atc));
+	m68ki_cpu.mmu_itt0 &= ~0x8000;
+	m68ki_cpu.mmu_itt1 &= ~0x8000;
+	m68ki_cpu.mmu_dtt0 &= ~0x8000;
+	m68ki_cpu.mmu_dtt1 &= ~0x8000;
+
+	/* Drop cached code, the host may have changed memory */
+	m68k_flush_code_cache();
+
+	/* Clear all stop levels and eat up all remaining cycles */
+	CPU_STOPPED = 0;
+	SET_CYCLES(0);
+	m68ki_cpu.fault_pending = M68KI_FAULT_NONE;
+#if M68K_CALL_GRAPH
+	m68ki_call_unwind(1);
+#endif /* M68K_CALL_GRAPH */
+
+	CPU_RUN_MODE = RUN_MODE_BERR_AERR_RESET;
+	CPU_INSTR_MODE = INSTRUCTION_YES;
+
+	/* Turn off tracing */
+	FLAG_T1 = FLAG_T0 = 0;
+	m68ki_clear_trace();
+	/* Interrupt mask to level 7 */
+	FLAG_INT_MASK = 0x0700;
+	CPU_INT_LEVEL = 0;
+	m68ki_cpu.virq_state = 0;
+	/* Reset VBR */
+	REG_VBR = 0;
+	/* Go to supervisor mode */
+	m68ki_set_sm_flag(SFLAG_SET | MFLAG_CLEAR);
+
+	/* Invalidate the prefetch queue */
+#if M68K_EMULATE_PREFETCH
+	/* Set to arbitrary number since our first fetch is from 0 */
+	CPU_PREF_ADDR = 0x1000;
+#endif /* M68K_EMULATE_PREFETCH */
+
+	/* Read the initial stack pointer and program counter */
+	m68ki_jump(0);
+	REG_SP = m68ki_read_imm_32();
+	REG_PC = m68ki_read_imm_32();
+	m68ki_jump(REG_PC);
+
+	CPU_RUN_MODE = RUN_MODE_NORMAL;
+
+	RESET_CYCLES = CYC_EXCEPTION[EXCEPTION_RESET];
+}
+
+/* Pulse the HALT line on the CPU */
+void m68k_pulse_halt(void)
+{
+	m68ki_jit_host_change();
+	CPU_STOPPED |= STOP_LEVEL_HALT;
+}
+
+/* Fast memory map */
+static void m68ki_map_range(uint address, uint size, uint8* memory, uint flags)
+{
+	for(; size != 0; address += M68K_MAP_PAGE_SIZE, size -= M68K_MAP_PAGE_SIZE)
+	{
+		m68ki_map_page* block = m68ki_cpu.mem_map[address >> M68KI_MAP_BLOCK_SHIFT];
+		m68ki_map_page* page;
+
+		if(block == NULL)
+			continue;
+		page = &block[(address >> M68KI_MAP_PAGE_SHIFT) & (M68KI_MAP_BLOCK_PAGES - 1)];
+		page->read = (flags & M68K_MAP_READ) ? memory : NULL;
+		page->write = (flags & M68K_MAP_WRITE) ? memory : NULL;
+		if(memory != NULL)
+			memory += M68K_MAP_PAGE_SIZE;
+	}
+}
+
+#if M68K_FAST_MEMORY_MAP
+static int m68ki_map_alloc(uint address, uint size)
+{
+	uint i;
+
+	if(m68ki_cpu.mem_map == NULL)
+	{
+		m68ki_cpu.mem_map = calloc(M68KI_MAP_BLOCKS, sizeof(m68ki_map_page*));
+		if(m68ki_cpu.mem_map == NULL)
+			return 0;
+	}
+	for(i = address >> M68KI_MAP_BLOCK_SHIFT; i <= (address + size - 1) >> M68KI_MAP_BLOCK_SHIFT; i++)
+	{
+		if(m68ki_cpu.mem_map[i] == NULL)
+		{
+			m68ki_cpu.mem_map[i] = calloc(M68KI_MAP_BLOCK_PAGES, sizeof(m68ki_map_page));
+			if(m68ki_cpu.mem_map[i] == NULL)
+				return 0;
+		}
+	}
+	return 1;
+}
+#endif /* M68K_FAST_MEMORY_MAP */
+
+static void m68ki_map_free(m68ki_cpu_core* cpu)
+{
+	uint i;
+
+	if(cpu->mem_map == NULL)
+		return;
+	for(i = 0; i < M68KI_MAP_BLOCKS; i++)
+		free(cpu->mem_map[i]);
+	free(cpu->mem_map);
+	cpu->mem_map = NULL;
+}
+
+int m68k_map_memory(unsigned int address, unsigned int size, void* memory, unsigned int flags)
+{
+#if M68K_FAST_MEMORY_MAP
+	if(memory == NULL || size == 0 || ((address | size) & M68KI_MAP_PAGE_MASK) ||
+		MASK_OUT_ABOVE_32(address + size - 1) < address)
+		return 0;
+	if(!m68ki_map_alloc(address, size))
+		return 0;
+	m68ki_map_range(address, size, memory, flags);
+	m68k_invalidate_code(address, size);
+	return 1;
+#else
+	(void)address;
+	(void)size;
+	(void)memory;
+	(void)flags;
+	return 0;
+#endif /* M68K_FAST_MEMORY_MAP */
+}
+
+void m68k_unmap_memory(unsigned int address, unsigned int size)
+{
+	if(m68ki_cpu.mem_map == NULL || size == 0 || ((address | size) & M68KI_MAP_PAGE_MASK) ||
+		MASK_OUT_ABOVE_32(address + size - 1) < address)
+		return;
+	m68ki_map_range(address, size, NULL, 0);
+	m68k_invalidate_code(address, size);
+}
+
+/* Fetch window */
+
+#if M68KI_FETCH_WINDOW
+/* Called for fetches outside the fetch window: move the window to the page
+ * of address and return host memory for the size bytes there, or NULL when
+ * they have to be read with m68k_read_immediate_xx().  Pages without host
+ * memory are remembered too, so running from them costs no lookups.
+ */
+const uint8* m68ki_fetch_refill(uint address, uint size)
+{
+	uint page = address & ~M68KI_MAP_PAGE_MASK;
+	const uint8* mem = NULL;
+
+	if(page != m68ki_cpu.fetch_page)
+	{
+		/* Translated fetches stay on the slow path */
+		if(!PMMU_ENABLED)
+		{
+#if M68K_FAST_MEMORY_MAP
+			mem = m68ki_map_read(page, M68K_MAP_PAGE_SIZE);
+#endif /* M68K_FAST_MEMORY_MAP */
+			if(mem == NULL)
+				mem = CALLBACK_FETCH_WINDOW(page);
+		}
+		m68ki_cpu.fetch_page = page;
+		m68ki_cpu.fetch_mem = mem;
+		m68ki_cpu.fetch_limit = mem != NULL ? M68K_MAP_PAGE_SIZE - 3 : 0;
+	}
+	if(m68ki_cpu.fetch_mem == NULL || (address & M68KI_MAP_PAGE_MASK) + size > M68K_MAP_PAGE_SIZE)
+		return NULL;
+	return m68ki_cpu.fetch_mem + (address & M68KI_MAP_PAGE_MASK);
+}
+#endif /* M68KI_FETCH_WINDOW */
+
+/* Block cache */
+
+/* Empty a slot, unhooking any code the JIT compiled for it */
+static void m68ki_block_drop(m68ki_block_cache* cache, m68ki_block* blk)
+{
+	blk->key = M68KI_BLOCK_INVALID;
+	blk->hits = 0;
+	if(blk->jit_code != NULL)
+	{
+		cache->jit_entry[blk - cache->blocks] = cache->jit_exit;
+		blk->jit_code = NULL;
+	}
+}
+
+#if M68KI_BLOCK_CACHE
+static m68ki_block_cache* m68ki_block_alloc(void)
+{
+	uint i;
+
+	m68ki_cpu.block_cache = calloc(1, sizeof(m68ki_block_cache));
+	if(m68ki_cpu.block_cache != NULL)
+		for(i = 0; i < M68KI_BLOCK_SLOTS; i++)
+			m68ki_cpu.block_cache->blocks[i].key = M68KI_BLOCK_INVALID;
+	return m68ki_cpu.block_cache;
+}
+
+/* Flag the granules holding a block's code, from 3 bytes before its start so
+ * that the first byte of any overlapping write lands in a flagged granule.
+ */
+static int m68ki_block_mark(m68ki_block_cache* cache, uint address, uint size)
+{
+	uint granule = (address - 3) >> M68KI_BLOCK_GRANULE_SHIFT;
+	uint count = (size + 3 + ((address - 3) & ((1 << M68KI_BLOCK_GRANULE_SHIFT) - 1)) +
+				 (1 << M68KI_BLOCK_GRANULE_SHIFT) - 1) >> M68KI_BLOCK_GRANULE_SHIFT;
+
+	for(; count != 0; granule++, count--)
+	{
+		uint32** bitmap = &cache->code_map[(granule << M68KI_BLOCK_GRANULE_SHIFT) >> M68KI_MAP_BLOCK_SHIFT];
+		uint index = granule & ((1 << (M68KI_MAP_BLOCK_SHIFT - M68KI_BLOCK_GRANULE_SHIFT)) - 1);
+
+		if(*bitmap == NULL)
+		{
+			*bitmap = calloc(M68KI_BLOCK_BITMAP_WORDS, sizeof(uint32));
+			if(*bitmap == NULL)
+				return 0;
+		}
+		(*bitmap)[index >> 5] |= (uint32)1 << (index & 31);
+	}
+	return 1;
+}
+
+void m68ki_block_invalidate(uint address)
+{
+	m68ki_block_cache* cache = m68ki_cpu.block_cache;
+	uint granule = address & ~((1 << M68KI_BLOCK_GRANULE_SHIFT) - 1);
+	uint index = (granule & ((1 << M68KI_MAP_BLOCK_SHIFT) - 1)) >> M68KI_BLOCK_GRANULE_SHIFT;
+	uint slot = (granule - (M68KI_BLOCK_MAX_BYTES - 2)) >> 1;
+	uint i;
+
+	/* Every block flagging this granule starts within these slots */
+	for(i = 0; i <= (M68KI_BLOCK_MAX_BYTES + (1 << M68KI_BLOCK_GRANULE_SHIFT)) / 2; i++)
+	{
+		m68ki_block* blk = &cache->blocks[(slot + i) & (M68KI_BLOCK_SLOTS - 1)];
+		uint flagged = ADDRESS_68K(blk->pc) - 3;
+
+		if(blk->key == M68KI_BLOCK_INVALID)
+			continue;
+		if(granule - flagged < blk->len + 3 || flagged - granule < (1 << M68KI_BLOCK_GRANULE_SHIFT))
+		{
+			m68ki_block_drop(cache, blk);
+			/* Stop serving words if the running block wrote to itself */
+			if(m68ki_cpu.block_code == blk->code)
+				m68ki_cpu.block_len = 0;
+		}
+	}
+	cache->code_map[address >> M68KI_MAP_BLOCK_SHIFT][index >> 5] &= ~((uint32)1 << (index & 31));
+}
+
+/* Run instructions through the normal fetch and dispatch, recording them as a
+ * new block.  Recording stops at anything but a short forward step in the
+ * PC, so each block is a straight run of code whose words can be replayed.
+ */
+static void m68ki_block_record(m68ki_block_cache* cache)
+{
+	m68ki_block_insn insn[M68KI_BLOCK_MAX_INSNS];
+	uint16 ir[M68KI_BLOCK_MAX_INSNS];
+	int recording = cache != NULL && !PMMU_ENABLED;
+	uint key = FLAG_S;
+	uint start = 0;
+	uint next = 0;
+	uint count = 0;
+	uint end;
+	m68ki_block* blk;
+	uint i;
+
+	do
+	{
+		m68ki_begin_instruction();
+		if(count == 0)
+			start = next = REG_PPC;
+		if(REG_PPC != next || (start & 1))
+			recording = 0;
+
+		REG_IR = m68ki_read_imm_16();
+		ir[count] = REG_IR;
+		m68ki_instruction_handler(ir[count])();
+
+#if M68KI_PENDING_FAULTS
+		/* Leave a faulting instruction out, as a longjmp() would */
+		if(m68ki_cpu.fault_pending)
+		{
+			m68ki_take_fault();
+			m68ki_profile_end(); /* auto-disable (see m68kcpu.h) */
+			return;
+		}
+#endif /* M68KI_PENDING_FAULTS */
+
+		m68ki_end_instruction();
+
+		if(!recording)
+			return;
+		insn[count].handler = m68ki_instruction_handler(ir[count]);
+		insn[count].offset = (REG_PPC - start) >> 1;
+		insn[count].cycles = CYC_OPCODE(ir[count]);
+		next = REG_PC;
+		count++;
+
+		/* A-line and F-line opcodes (FPU, PMMU, cache control) end a block */
+		if((ir[count-1] >> 12) == 0xa || (ir[count-1] >> 12) == 0xf)
+			break;
+	} while(count < M68KI_BLOCK_MAX_INSNS && next > REG_PPC &&
+			next - REG_PPC <= M68KI_BLOCK_INSN_BYTES &&
+			next - start <= M68KI_BLOCK_MAX_BYTES - M68KI_BLOCK_INSN_BYTES &&
+			FLAG_S == key && GET_CYCLES() > 0);
+
+	if(FLAG_S != key)
+		return;
+
+	/* The last instruction's length is only known if it stepped forward */
+	end = next > REG_PPC && next - REG_PPC <= M68KI_BLOCK_INSN_BYTES ? next : REG_PPC + 2;
+
+	blk = &cache->blocks[(start >> 1) & (M68KI_BLOCK_SLOTS - 1)];
+	m68ki_block_drop(cache, blk);
+	for(i = 0; i < (end - start) >> 1; i++)
+		blk->code[i] = MASK_OUT_ABOVE_16(m68ki_fetch_16(ADDRESS_68K(start + (i << 1))));
+
+	/* Code changed under an instruction while recording */
+	for(i = 0; i < count; i++)
+		if(blk->code[insn[i].offset] != ir[i])
+			return;
+
+	if(!m68ki_block_mark(cache, ADDRESS_68K(start), end - start))
+		return;
+	memcpy(blk->insn, insn, count * sizeof(m68ki_block_insn));
+	blk->pc = start;
+	blk->len = end - start;
+	blk->count = count;
+	blk->key = key;
+}
+
+static void m68ki_block_run(m68ki_block* blk)
+{
+	const m68ki_block_insn* insn = blk->insn;
+	const m68ki_block_insn* end = insn + blk->count;
+
+	m68ki_cpu.block_pc = blk->pc;
+	m68ki_cpu.block_len = blk->len;
+	m68ki_cpu.block_code = blk->code;
+
+	do
+	{
+		m68ki_begin_instruction();
+
+#if M68K_INSTRUCTION_HOOK
+		/* The hook may have moved the PC */
+		if(REG_PC != blk->pc + (insn->offset << 1))
+		{
+			m68ki_cpu.block_len = 0;
+			REG_IR = m68ki_read_imm_16();
+			m68ki_instruction_handler(REG_IR)();
+			m68ki_end_instruction();
+			break;
+		}
+#endif /* M68K_INSTRUCTION_HOOK */
+
+		m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+		REG_IR = blk->code[insn->offset];
+		REG_PC += 2;
+		insn->handler();
+
+#if M68KI_PENDING_FAULTS
+		if(m68ki_cpu.fault_pending)
+		{
+			m68ki_take_fault();
+			m68ki_profile_end(); /* auto-disable (see m68kcpu.h) */
+			break;
+		}
+#endif /* M68KI_PENDING_FAULTS */
+
+		USE_CYCLES(insn->cycles);
+		m68ki_exception_if_trace(); /* auto-disable (see m68kcpu.h) */
+		m68ki_profile_end(); /* auto-disable (see m68kcpu.h) */
+
+		/* Leave on a change of flow, the end of the timeslice, a switch
+		 * to or from supervisor mode or a write to the block itself.
+		 */
+	} while(++insn < end && REG_PC == blk->pc + (insn->offset << 1) &&
+			GET_CYCLES() > 0 && FLAG_S == blk->key);
+
+	m68ki_cpu.block_len = 0;
+	m68ki_cpu.block_code = NULL;
+}
+
+static void m68ki_execute_blocks(void)
+{
+	m68ki_block_cache* cache = m68ki_cpu.block_cache;
+
+	if(cache == NULL)
+		cache = m68ki_block_alloc();
+
+	/* A bus error may have left a block running */
+	m68ki_cpu.block_len = 0;
+	m68ki_cpu.block_code = NULL;
+#if M68KI_JIT_LOCKSTEP
+	if(cache != NULL)
+		cache->jit_log.mode = M68KI_JIT_LOG_OFF;
+#endif /* M68KI_JIT_LOCKSTEP */
+
+	do
+	{
+		m68ki_block* blk = NULL;
+
+		if(cache != NULL && !PMMU_ENABLED)
+		{
+			blk = &cache->blocks[(REG_PC >> 1) & (M68KI_BLOCK_SLOTS - 1)];
+			if(blk->pc != REG_PC || blk->key != FLAG_S)
+				blk = NULL;
+		}
+		if(blk == NULL)
+			m68ki_block_record(cache);
+#if M68KI_JIT
+		else if(blk->jit_code != NULL ||
+				(++blk->hits >= M68KI_JIT_THRESHOLD && m68ki_jit_compile(cache, blk)))
+			m68ki_jit_run(cache, blk);
+#endif /* M68KI_JIT */
+		else
+			m68ki_block_run(blk);
+	} while(GET_CYCLES() > 0);
+}
+#endif /* M68KI_BLOCK_CACHE */
+
+static void m68ki_block_free(m68ki_cpu_core* cpu)
+{
+	uint i;
+
+	if(cpu->block_cache == NULL)
+		return;
+	for(i = 0; i < M68KI_MAP_BLOCKS; i++)
+		free(cpu->block_cache->code_map[i]);
+#if M68KI_JIT
+	m68ki_jit_free(cpu->block_cache);
+#endif
+	free(cpu->block_cache);
+	cpu->block_cache = NULL;
+}
+
+void m68k_invalidate_code(unsigned int address, unsigned int size)
+{
+#if M68KI_BLOCK_CACHE
+	uint count;
+#endif /* M68KI_BLOCK_CACHE */
+
+	/* The host memory behind the code may have moved (bank switching) */
+	m68ki_fetch_invalidate();
+
+#if M68KI_BLOCK_CACHE
+	if(m68ki_cpu.block_cache == NULL || size == 0)
+		return;
+	/* Large ranges are cheaper to drop wholesale */
+	if(size > M68KI_BLOCK_SLOTS * 2)
+	{
+		m68k_flush_code_cache();
+		return;
+	}
+	count = ((address & ((1 << M68KI_BLOCK_GRANULE_SHIFT) - 1)) + size +
+			 (1 << M68KI_BLOCK_GRANULE_SHIFT) - 1) >> M68KI_BLOCK_GRANULE_SHIFT;
+	for(; count != 0; count--, address += 1 << M68KI_BLOCK_GRANULE_SHIFT)
+		m68ki_block_check_write(address);
+#else
+	(void)address;
+	(void)size;
+#endif /* M68KI_BLOCK_CACHE */
+}
+
+void m68k_flush_code_cache(void)
+{
+	m68ki_block_cache* cache = m68ki_cpu.block_cache;
+	uint i;
+
+	m68ki_fetch_invalidate();
+	if(cache == NULL)
+		return;
+	for(i = 0; i < M68KI_BLOCK_SLOTS; i++)
+		m68ki_block_drop(cache, &cache->blocks[i]);
+	for(i = 0; i < M68KI_MAP_BLOCKS; i++)
+		if(cache->code_map[i] != NULL)
+			memset(cache->code_map[i], 0, M68KI_BLOCK_BITMAP_WORDS * sizeof(uint32));
+	m68ki_cpu.block_len = 0;
+}
+
+void m68k_set_jit_perf_map(int enable)
+{
+#if M68KI_JIT
+	m68ki_cpu.jit_perf_enabled = enable;
+	if(!enable && m68ki_cpu.jit_perf_file != NULL)
+	{
+		fclose(m68ki_cpu.jit_perf_file);
+		m68ki_cpu.jit_perf_file = NULL;
+	}
+#else
+	(void)enable;
+#endif /* M68KI_JIT */
+}
+
+unsigned int m68k_jit_lockstep_mismatches(void)
+{
+#if M68KI_JIT_LOCKSTEP
+	if(m68ki_cpu.block_cache != NULL)
+		return m68ki_cpu.block_cache->jit_mismatches;
+#endif /* M68KI_JIT_LOCKSTEP */
+	return 0;
+}
+
+void m68k_get_pmmu_atc_stats(unsigned long long* hits, unsigned long long* misses)
+{
+	if(hits != NULL)
+		*hits = m68ki_cpu.mmu_atc_hits;
+	if(misses != NULL)
+		*misses = m68ki_cpu.mmu_atc_misses;
+}
+
+void m68k_clear_pmmu_atc_stats(void)
+{
+	m68ki_cpu.mmu_atc_hits = 0;
+	m68ki_cpu.mmu_atc_misses = 0;
+}
+
+unsigned int m68k_profile_handlers(void)
+{
+#if M68K_PROFILE
+	return M68KI_HANDLER_COUNT;
+#else
+	return 0;
+#endif /* M68K_PROFILE */
+}
+
+const char* m68k_profile_handler_name(unsigned int index)
+{
+#if M68K_PROFILE
+	if(index < M68KI_HANDLER_COUNT)
+		return m68ki_instruction_handler_names[index];
+#else
+	(void)index;
+#endif /* M68K_PROFILE */
+	return NULL;
+}
+
+void m68k_profile_snapshot(unsigned long long* count, unsigned long long* cycles, m68k_profile* other)
+{
+#if M68K_PROFILE
+	m68ki_profile* profile = &m68ki_cpu.profile;
+
+	if(count != NULL)
+		memcpy(count, profile->count, sizeof(profile->count));
+	if(cycles != NULL)
+		memcpy(cycles, profile->cycles, sizeof(profile->cycles));
+	if(other != NULL)
+	{
+		memcpy(other->fpu_ops, profile->fpu_ops, sizeof(profile->fpu_ops));
+		memcpy(other->fpu_gen, profile->fpu_gen, sizeof(profile->fpu_gen));
+		memcpy(other->vectors, profile->vectors, sizeof(profile->vectors));
+	}
+#else
+	(void)count;
+	(void)cycles;
+	if(other != NULL)
+		memset(other, 0, sizeof(*other));
+#endif /* M68K_PROFILE */
+}
+
+void m68k_profile_reset(void)
+{
+#if M68K_PROFILE
+	memset(&m68ki_cpu.profile, 0, sizeof(m68ki_cpu.profile));
+#endif /* M68K_PROFILE */
+}
+
+unsigned int m68k_get_flight_records(m68k_flight_record* records, unsigned int max)
+{
+#if M68K_FLIGHT_RECORDER
+	uint count = m68ki_cpu.flight_next < M68K_FLIGHT_RECORDS ? m68ki_cpu.flight_next : M68K_FLIGHT_RECORDS;
+	uint first;
+	uint i;
+
+	if(count > max)
+		count = max;
+	first = m68ki_cpu.flight_next - count;
+	for(i = 0; i < count; i++)
+		records[i] = m68ki_cpu.flight[(first + i) % M68K_FLIGHT_RECORDS];
+	return count;
+#else
+	(void)records;
+	(void)max;
+	return 0;
+#endif /* M68K_FLIGHT_RECORDER */
+}
+
+void m68k_clear_flight_recorder(void)
+{
+#if M68K_FLIGHT_RECORDER
+	m68ki_cpu.flight_next = 0;
+#endif /* M68K_FLIGHT_RECORDER */
+}
+
+#if M68K_PROFILE
+/* Most cycles first */
+static int m68ki_profile_compare(const void* a, const void* b)
+{
+	unsigned long long ca = m68ki_cpu.profile.cycles[*(const uint*)a];
+	unsigned long long cb = m68ki_cpu.profile.cycles[*(const uint*)b];
+
+	return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+#endif /* M68K_PROFILE */
+
+void m68k_profile_dump(void (*print)(const char* line))
+{
+#if M68K_PROFILE
+	m68ki_profile* profile = &m68ki_cpu.profile;
+	uint* order = malloc(M68KI_HANDLER_COUNT * sizeof(uint));
+	char line[128];
+	uint used = 0;
+	uint i;
+
+	if(order == NULL)
+		return;
+	for(i = 0; i < M68KI_HANDLER_COUNT; i++)
+		if(profile->count[i] != 0)
+			order[used++] = i;
+	qsort(order, used, sizeof(uint), m68ki_profile_compare);
+
+	print("count cycles handler");
+	for(i = 0; i < used; i++)
+	{
+		snprintf(line, sizeof(line), "%llu %llu %s", profile->count[order[i]],
+			profile->cycles[order[i]], m68ki_instruction_handler_names[order[i]]);
+		print(line);
+	}
+	free(order);
+
+	for(i = 0; i < M68K_PROFILE_FPU_OPS; i++)
+		if(profile->fpu_ops[i] != 0)
+		{
+			snprintf(line, sizeof(line), "%llu fpu op %u", profile->fpu_ops[i], i);
+			print(line);
+		}
+	for(i = 0; i < M68K_PROFILE_FPU_GEN; i++)
+		if(profile->fpu_gen[i] != 0)
+		{
+			snprintf(line, sizeof(line), "%llu fpgen opmode $%02x", profile->fpu_gen[i], i);
+			print(line);
+		}
+	for(i = 0; i < M68K_PROFILE_VECTORS; i++)
+		if(profile->vectors[i] != 0)
+		{
+			snprintf(line, sizeof(line), "%llu vector %u", profile->vectors[i], i);
+			print(line);
+		}
+#else
+	(void)print;
+#endif /* M68K_PROFILE */
+}
+
+/* Get and set the current CPU context */
+/* This is to allow for multiple CPUs */
+unsigned int m68k_context_size(void)
+{
+	return sizeof(m68ki_cpu_core);
+}
+
+/* Copy the CPU state of src over dst.  What dst owns (its memory map, block
+ * cache, sampler, trace writer and so on) stays with dst, so two contexts
+ * never share it.
+ */
+static void m68ki_copy_context(m68ki_cpu_core* dst, const m68ki_cpu_core* src)
+{
+	m68ki_map_page** mem_map = dst->mem_map;
+	m68ki_block_cache* block_cache = dst->block_cache;
+#if M68KI_JIT
+	FILE* jit_perf_file = dst->jit_perf_file;
+#endif /* M68KI_JIT */
+#if M68KI_SAMPLER
+	m68ki_sampler* sampler = dst->sampler;
+#endif /* M68KI_SAMPLER */
+#if M68KI_TRACE
+	m68ki_trace* trace = dst->trace;
+#endif /* M68KI_TRACE */
+#if M68KI_PENDING_FAULTS
+	uint8* fault_state = dst->fault_state;
+#endif /* M68KI_PENDING_FAULTS */
+
+	if(dst == src)
+		return;
+	*dst = *src;
+
+	dst->mem_map = mem_map;
+	dst->block_cache = block_cache;
+#if M68KI_JIT
+	dst->jit_perf_file = jit_perf_file;
+#endif /* M68KI_JIT */
+#if M68KI_SAMPLER
+	dst->sampler = sampler;
+#endif /* M68KI_SAMPLER */
+#if M68KI_TRACE
+	dst->trace = trace;
+#endif /* M68KI_TRACE */
+#if M68KI_PENDING_FAULTS
+	dst->fault_state = fault_state;
+#endif /* M68KI_PENDING_FAULTS */
+
+	/* The fetch window and running block were found through src's memory */
+#if M68KI_FETCH_WINDOW
+	dst->fetch_page = M68KI_FETCH_NONE;
+	dst->fetch_mem = NULL;
+	dst->fetch_limit = 0;
+#endif /* M68KI_FETCH_WINDOW */
+	dst->block_len = 0;
+	dst->block_code = NULL;
+}
+
+unsigned int m68k_get_context(void* dst)
+{
+	if(dst) m68ki_copy_context(dst, &m68ki_cpu);
+	return sizeof(m68ki_cpu_core);
+}
+
+void m68k_set_context(void* src)
+{
+	m68ki_jit_host_change();
+	if(src) m68ki_copy_context(&m68ki_cpu, src);
+}
+
+/* Multiple CPU instances */
+void* m68k_create(unsigned int cpu_type, void* user_data)
+{
+	m68ki_cpu_core* cpu = calloc(1, sizeof(m68ki_cpu_core));
+	m68ki_cpu_core* prev;
+
+	if(cpu == NULL)
+		return NULL;
+
+	prev = m68k_select_context(cpu);
+	m68k_init();
+	m68k_set_cpu_type(cpu_type);
+	m68ki_cpu.user_data = user_data;
+	m68k_select_context(prev);
+	return cpu;
+}
+
+void m68k_destroy(void* cpu)
+{
+	if(cpu == NULL || cpu == &m68ki_default_cpu)
+		return;
+	if(m68ki_cpu_ptr == cpu)
+		m68ki_cpu_ptr = &m68ki_default_cpu;
+	m68ki_map_free(cpu);
+	m68ki_block_free(cpu);
+#if M68KI_TRACE
+	if(((m68ki_cpu_core*)cpu)->trace != NULL)
+	{
+		void* prev = m68k_select_context(cpu);
+		m68k_stop_trace();
+		m68k_select_context(prev);
+	}
+#endif /* M68KI_TRACE */
+#if M68KI_SAMPLER
+	free(((m68ki_cpu_core*)cpu)->sampler);
+#endif /* M68KI_SAMPLER */
+#if M68KI_PENDING_FAULTS
+	free(((m68ki_cpu_core*)cpu)->fault_state);
+#endif /* M68KI_PENDING_FAULTS */
+#if M68KI_JIT
+	if(((m68ki_cpu_core*)cpu)->jit_perf_file != NULL)
+		fclose(((m68ki_cpu_core*)cpu)->jit_perf_file);
+#endif /* M68KI_JIT */
+	free(cpu);
+}
+
+void* m68k_select_context(void* cpu)
+{
+	m68ki_cpu_core* prev = m68ki_cpu_ptr;
+	m68ki_cpu_ptr = cpu != NULL ? (m68ki_cpu_core*)cpu : &m68ki_default_cpu;
+	return prev;
+}
+
+void* m68k_get_current_context(void)
+{
+	return m68ki_cpu_ptr;
+}
+
+int m68k_execute_ctx(void* cpu, int num_cycles)
+{
+	void* prev = m68k_select_context(cpu);
+	int cycles = m68k_execute(num_cycles);
+	m68k_select_context(prev);
+	return cycles;
+}
+
+void* m68k_get_user_data(void)
+{
+	return m68ki_cpu.user_data;
+}
+
+void m68k_set_user_data(void* user_data)
 {
-	if(src) m68ki_cpu = *(m68ki_cpu_core*)src;
+	m68ki_cpu.user_data = user_data;
 }
 
 /* ======================================================================== */
@@ -41,6 +41,8 @@ extern "C" {
 
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
+#include <stdio.h>
 
 #include <setjmp.h>
 
@@ -48,6 +50,139 @@ extern "C" {
 /* ==================== ARCHITECTURE-DEPENDANT DEFINES ==================== */
 /* ======================================================================== */
 
+/* Helpers that must be inlined at every use, such as the per-instruction
+ * bookkeeping replicated in each handler of the threaded core.
+ */
+#ifdef __GNUC__
+	#define M68KI_FORCE_INLINE static inline __attribute__((always_inline))
+#else
+	#define M68KI_FORCE_INLINE static inline
+#endif
+
+/* The threaded core uses computed gotos */
+#if M68K_THREADED_DISPATCH && defined(__GNUC__)
+	#define M68KI_THREADED_DISPATCH 1
+#else
+	#define M68KI_THREADED_DISPATCH 0
+#endif
+
+/* Handler sets built with a constant CPU type.  Each set covers the CPU types
+ * that no opcode handler tells apart: 68EC020/68020, 68EC030/68030 and
+ * 68EC040/68040.  The 68LC040 and SCC68070 use the generic handlers.  In a
+ * 68000-only build the generic handlers already have the checks folded.
+ */
+#if M68K_SPECIALIZED_HANDLERS && (M68K_EMULATE_010 || M68K_EMULATE_EC020 || \
+	M68K_EMULATE_020 || M68K_EMULATE_030 || M68K_EMULATE_040)
+	#define M68KI_HANDLER_SETS    1
+	#define M68KI_HANDLER_SET_000 1
+	#define M68KI_HANDLER_SET_010 M68K_EMULATE_010
+	#define M68KI_HANDLER_SET_020 (M68K_EMULATE_020 || M68K_EMULATE_EC020)
+	#define M68KI_HANDLER_SET_030 M68K_EMULATE_030
+	#define M68KI_HANDLER_SET_040 M68K_EMULATE_040
+#else
+	#define M68KI_HANDLER_SETS    0
+	#define M68KI_HANDLER_SET_000 0
+	#define M68KI_HANDLER_SET_010 0
+	#define M68KI_HANDLER_SET_020 0
+	#define M68KI_HANDLER_SET_030 0
+	#define M68KI_HANDLER_SET_040 0
+#endif
+
+/* Cached host pointer for opcode fetches */
+#if M68K_FETCH_WINDOW
+	#define M68KI_FETCH_WINDOW 1
+#else
+	#define M68KI_FETCH_WINDOW 0
+#endif
+
+/* The block cache replays instruction words from its own copy, which does
+ * not mix with the emulated prefetch queue.
+ */
+#if (M68K_BLOCK_CACHE || M68K_JIT) && !M68K_EMULATE_PREFETCH
+	#define M68KI_BLOCK_CACHE 1
+#else
+	#define M68KI_BLOCK_CACHE 0
+#endif
+
+/* The trace file is written by a POSIX thread */
+#if M68K_TRACE && defined(__GNUC__) && (defined(__unix__) || defined(__APPLE__))
+	#define M68KI_TRACE 1
+#else
+	#define M68KI_TRACE 0
+#endif
+
+/* Features that are given the cycles of each instruction */
+#if M68K_PROFILE || M68K_CALL_GRAPH || M68K_FLIGHT_RECORDER || M68KI_TRACE
+	#define M68KI_PROFILE_CHARGE 1
+#else
+	#define M68KI_PROFILE_CHARGE 0
+#endif
+
+/* The JIT compiles blocks of the block cache to x86-64 code.  It does not
+ * emit the per-instruction trace, function code and hook callbacks, or the
+ * profile counters, call graph, flight recorder and trace file.
+ */
+#if M68K_JIT && M68KI_BLOCK_CACHE && defined(__GNUC__) && defined(__x86_64__) && \
+	(defined(__unix__) || defined(__APPLE__)) && \
+	!M68K_EMULATE_TRACE && !M68K_EMULATE_FC && !M68K_INSTRUCTION_HOOK && !M68KI_PROFILE_CHARGE
+	#define M68KI_JIT 1
+#else
+	#define M68KI_JIT 0
+#endif
+
+#if M68KI_JIT && M68K_JIT_LOCKSTEP
+	#define M68KI_JIT_LOCKSTEP 1
+#else
+	#define M68KI_JIT_LOCKSTEP 0
+#endif
+
+/* Fused handlers look at the next opcode word before fetching it, which needs
+ * the prefetch queue or the fetch window to be free of side effects, and the
+ * block cache records one handler per instruction.  Dropping dead flags also
+ * needs nothing to look at the flags in between: no instruction hook, and no
+ * prefetch of the word after the second instruction from the host.
+ */
+#if M68K_FUSED_PAIRS && !M68KI_BLOCK_CACHE && (M68K_EMULATE_PREFETCH || M68KI_FETCH_WINDOW)
+	#define M68KI_FUSED_PAIRS 1
+#else
+	#define M68KI_FUSED_PAIRS 0
+#endif
+
+#if M68KI_FUSED_PAIRS && !M68K_INSTRUCTION_HOOK && !M68K_EMULATE_PREFETCH
+	#define M68KI_FUSE_DEAD_FLAGS 1
+#else
+	#define M68KI_FUSE_DEAD_FLAGS 0
+#endif
+
+/* Skipping idle loops leaves out per-instruction callbacks and trace records */
+#if M68K_FAST_FORWARD_LOOPS && !M68K_INSTRUCTION_HOOK && !M68K_EMULATE_FC && !M68K_MONITOR_PC && \
+	!M68KI_TRACE
+	#define M68KI_FAST_FORWARD 1
+#else
+	#define M68KI_FAST_FORWARD 0
+#endif
+
+/* Block transfers would get past the JIT lockstep and trace access logs */
+#if M68K_MEMORY_BLOCKS && !M68KI_JIT_LOCKSTEP && !M68KI_TRACE
+	#define M68KI_MEMORY_BLOCKS 1
+#else
+	#define M68KI_MEMORY_BLOCKS 0
+#endif
+
+/* Compiled blocks have no instruction boundaries to take a pending fault at */
+#if M68K_PENDING_FAULTS && !M68KI_JIT
+	#define M68KI_PENDING_FAULTS 1
+#else
+	#define M68KI_PENDING_FAULTS 0
+#endif
+
+/* Samples are taken by an event between instructions */
+#if M68K_SAMPLE_PROFILER && M68K_EVENT_QUEUE
+	#define M68KI_SAMPLER 1
+#else
+	#define M68KI_SAMPLER 0
+#endif
+
 /* Check for > 32bit sizes */
 #if UINT_MAX > 0xffffffff
 	#define M68K_INT_GT_32_BIT  1
@@ -96,6 +231,26 @@ typedef uint32 uint64;
 #define S64(val) val
 #endif
 
+/* Storage class for per-thread state (the currently selected CPU instance) */
+#ifndef M68K_THREAD_LOCAL
+	#if defined(_MSC_VER)
+		#define M68K_THREAD_LOCAL __declspec(thread)
+	#elif defined(__GNUC__)
+		#define M68K_THREAD_LOCAL __thread
+	#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+		#define M68K_THREAD_LOCAL _Thread_local
+	#else
+		#define M68K_THREAD_LOCAL
+	#endif
+#endif
+
+/* Size of the PMMU address translation cache, for m68kconf.h files that
+ * predate it
+ */
+#ifndef M68K_PMMU_ATC_ENTRIES
+	#define M68K_PMMU_ATC_ENTRIES 256
+#endif
+
 #include "softfloat/milieu.h"
 #include "softfloat/softfloat.h"
 
@@ -203,6 +358,11 @@ typedef uint32 uint64;
 #define RUN_MODE_BERR_AERR_RESET_WSF 1 /* writing stack frame */
 #define RUN_MODE_BERR_AERR_RESET     2 /* stack frame done */
 
+/* Pending faults (M68K_PENDING_FAULTS) */
+#define M68KI_FAULT_NONE    0
+#define M68KI_FAULT_BUS     1
+#define M68KI_FAULT_ADDRESS 2
+
 #ifndef NULL
 #define NULL ((void*)0)
 #endif
@@ -325,6 +485,20 @@ typedef uint32 uint64;
 
 /* ------------------------------ CPU Access ------------------------------ */
 
+/* The CPU instance selected on the calling thread */
+#define m68ki_cpu        (*m68ki_cpu_ptr)
+
+/* Per-instance execution state */
+#define m68ki_remaining_cycles m68ki_cpu.remaining_cycles
+#define m68ki_initial_cycles   m68ki_cpu.initial_cycles
+#define m68ki_tracing          m68ki_cpu.tracing
+#define m68ki_address_space    m68ki_cpu.address_space
+#define m68ki_aerr_address     m68ki_cpu.aerr_address
+#define m68ki_aerr_write_mode  m68ki_cpu.aerr_write_mode
+#define m68ki_aerr_fc          m68ki_cpu.aerr_fc
+#define m68ki_aerr_trap        m68ki_cpu.aerr_trap
+#define m68ki_bus_error_jmp_buf m68ki_cpu.bus_error_jmp_buf
+
 /* Access the CPU registers */
 #define CPU_TYPE         m68ki_cpu.cpu_type
 
@@ -362,6 +536,11 @@ typedef uint32 uint64;
 #define FLAG_C           m68ki_cpu.c_flag
 #define FLAG_INT_MASK    m68ki_cpu.int_mask
 
+#define FLAGS_OP         m68ki_cpu.flags_op
+#define FLAGS_SRC        m68ki_cpu.flags_src
+#define FLAGS_DST        m68ki_cpu.flags_dst
+#define FLAGS_RES        m68ki_cpu.flags_res
+
 #define CPU_INT_LEVEL    m68ki_cpu.int_level /* ASG: changed from CPU_INTS_PENDING */
 #define CPU_STOPPED      m68ki_cpu.stopped
 #define CPU_PREF_ADDR    m68ki_cpu.pref_addr
@@ -371,7 +550,8 @@ typedef uint32 uint64;
 #define CPU_INSTR_MODE   m68ki_cpu.instr_mode
 #define CPU_RUN_MODE     m68ki_cpu.run_mode
 
-#define CYC_INSTRUCTION  m68ki_cpu.cyc_instruction
+#define CYC_INSTRUCTION  m68ki_cpu.cyc_instruction /* Indexed by handler */
+#define CYC_OPCODE(A)    CYC_INSTRUCTION[m68ki_instruction_index_table[A]]
 #define CYC_EXCEPTION    m68ki_cpu.cyc_exception
 #define CYC_BCC_NOTAKE_B m68ki_cpu.cyc_bcc_notake_b
 #define CYC_BCC_NOTAKE_W m68ki_cpu.cyc_bcc_notake_w
@@ -386,6 +566,43 @@ typedef uint32 uint64;
 #define PMMU_ENABLED	 m68ki_cpu.pmmu_enabled
 #define RESET_CYCLES	 m68ki_cpu.reset_cycles
 
+/* Opcode handler lookup (see m68ki_instruction_index_table in m68kops.h) */
+#define CPU_HANDLER_TABLE m68ki_cpu.instruction_handlers
+#if M68KI_HANDLER_SETS
+	#define m68ki_instruction_handler(A) CPU_HANDLER_TABLE[m68ki_instruction_index_table[A]]
+#else
+	#define m68ki_instruction_handler(A) m68ki_instruction_handler_table[m68ki_instruction_index_table[A]]
+#endif
+
+/* Handler table for each CPU family, falling back to the generic handlers
+ * for families without a handler set of their own
+ */
+#if M68KI_HANDLER_SET_000
+	#define M68KI_HANDLERS_000 m68ki_instruction_handler_table_000
+#else
+	#define M68KI_HANDLERS_000 m68ki_instruction_handler_table
+#endif
+#if M68KI_HANDLER_SET_010
+	#define M68KI_HANDLERS_010 m68ki_instruction_handler_table_010
+#else
+	#define M68KI_HANDLERS_010 m68ki_instruction_handler_table
+#endif
+#if M68KI_HANDLER_SET_020
+	#define M68KI_HANDLERS_020 m68ki_instruction_handler_table_020
+#else
+	#define M68KI_HANDLERS_020 m68ki_instruction_handler_table
+#endif
+#if M68KI_HANDLER_SET_030
+	#define M68KI_HANDLERS_030 m68ki_instruction_handler_table_030
+#else
+	#define M68KI_HANDLERS_030 m68ki_instruction_handler_table
+#endif
+#if M68KI_HANDLER_SET_040
+	#define M68KI_HANDLERS_040 m68ki_instruction_handler_table_040
+#else
+	#define M68KI_HANDLERS_040 m68ki_instruction_handler_table
+#endif
+
 
 #define CALLBACK_INT_ACK     m68ki_cpu.int_ack_callback
 #define CALLBACK_BKPT_ACK    m68ki_cpu.bkpt_ack_callback
@@ -398,6 +615,7 @@ typedef uint32 uint64;
 #define CALLBACK_PC_CHANGED  m68ki_cpu.pc_changed_callback
 #define CALLBACK_SET_FC      m68ki_cpu.set_fc_callback
 #define CALLBACK_INSTR_HOOK  m68ki_cpu.instr_hook_callback
+#define CALLBACK_FETCH_WINDOW m68ki_cpu.fetch_window_callback
 
 
 
@@ -471,12 +689,22 @@ typedef uint32 uint64;
 #endif /* M68K_SEPARATE_READS */
 
 
+/* With M68K_PENDING_FAULTS an instruction runs on after a fault, with its
+ * accesses dropped.  Nothing is passed to the host after the first fault of
+ * an instruction either: callbacks are skipped, and reads get 0 or a nop.
+ */
+#if M68KI_PENDING_FAULTS
+	#define m68ki_host_ok() (!m68ki_cpu.fault_pending)
+#else
+	#define m68ki_host_ok() 1
+#endif /* M68KI_PENDING_FAULTS */
+
 /* Enable or disable callback functions */
 #if M68K_EMULATE_INT_ACK
 	#if M68K_EMULATE_INT_ACK == M68K_OPT_SPECIFY_HANDLER
-		#define m68ki_int_ack(A) M68K_INT_ACK_CALLBACK(A)
+		#define m68ki_int_ack(A) (m68ki_host_ok() ? (uint)M68K_INT_ACK_CALLBACK(A) : M68K_INT_ACK_AUTOVECTOR)
 	#else
-		#define m68ki_int_ack(A) CALLBACK_INT_ACK(A)
+		#define m68ki_int_ack(A) (m68ki_host_ok() ? (uint)CALLBACK_INT_ACK(A) : M68K_INT_ACK_AUTOVECTOR)
 	#endif
 #else
 	/* Default action is to used autovector mode, which is most common */
@@ -485,9 +713,9 @@ typedef uint32 uint64;
 
 #if M68K_EMULATE_BKPT_ACK
 	#if M68K_EMULATE_BKPT_ACK == M68K_OPT_SPECIFY_HANDLER
-		#define m68ki_bkpt_ack(A) M68K_BKPT_ACK_CALLBACK(A)
+		#define m68ki_bkpt_ack(A) do{ if(m68ki_host_ok()) M68K_BKPT_ACK_CALLBACK(A); }while(0)
 	#else
-		#define m68ki_bkpt_ack(A) CALLBACK_BKPT_ACK(A)
+		#define m68ki_bkpt_ack(A) do{ if(m68ki_host_ok()) CALLBACK_BKPT_ACK(A); }while(0)
 	#endif
 #else
 	#define m68ki_bkpt_ack(A)
@@ -495,9 +723,9 @@ typedef uint32 uint64;
 
 #if M68K_EMULATE_RESET
 	#if M68K_EMULATE_RESET == M68K_OPT_SPECIFY_HANDLER
-		#define m68ki_output_reset() M68K_RESET_CALLBACK()
+		#define m68ki_output_reset() do{ if(m68ki_host_ok()) M68K_RESET_CALLBACK(); }while(0)
 	#else
-		#define m68ki_output_reset() CALLBACK_RESET_INSTR()
+		#define m68ki_output_reset() do{ if(m68ki_host_ok()) CALLBACK_RESET_INSTR(); }while(0)
 	#endif
 #else
 	#define m68ki_output_reset()
@@ -505,9 +733,9 @@ typedef uint32 uint64;
 
 #if M68K_CMPILD_HAS_CALLBACK
 	#if M68K_CMPILD_HAS_CALLBACK == M68K_OPT_SPECIFY_HANDLER
-		#define m68ki_cmpild_callback(v,r) M68K_CMPILD_CALLBACK(v,r)
+		#define m68ki_cmpild_callback(v,r) do{ if(m68ki_host_ok()) M68K_CMPILD_CALLBACK(v,r); }while(0)
 	#else
-		#define m68ki_cmpild_callback(v,r) CALLBACK_CMPILD_INSTR(v,r)
+		#define m68ki_cmpild_callback(v,r) do{ if(m68ki_host_ok()) CALLBACK_CMPILD_INSTR(v,r); }while(0)
 	#endif
 #else
 	#define m68ki_cmpild_callback(v,r)
@@ -515,9 +743,9 @@ typedef uint32 uint64;
 
 #if M68K_RTE_HAS_CALLBACK
 	#if M68K_RTE_HAS_CALLBACK == M68K_OPT_SPECIFY_HANDLER
-		#define m68ki_rte_callback() M68K_RTE_CALLBACK()
+		#define m68ki_rte_callback() do{ if(m68ki_host_ok()) M68K_RTE_CALLBACK(); }while(0)
 	#else
-		#define m68ki_rte_callback() CALLBACK_RTE_INSTR()
+		#define m68ki_rte_callback() do{ if(m68ki_host_ok()) CALLBACK_RTE_INSTR(); }while(0)
 	#endif
 #else
 	#define m68ki_rte_callback()
@@ -525,9 +753,9 @@ typedef uint32 uint64;
 
 #if M68K_TAS_HAS_CALLBACK
 	#if M68K_TAS_HAS_CALLBACK == M68K_OPT_SPECIFY_HANDLER
-		#define m68ki_tas_callback() M68K_TAS_CALLBACK()
+		#define m68ki_tas_callback() (m68ki_host_ok() ? M68K_TAS_CALLBACK() : 1)
 	#else
-		#define m68ki_tas_callback() CALLBACK_TAS_INSTR()
+		#define m68ki_tas_callback() (m68ki_host_ok() ? CALLBACK_TAS_INSTR() : 1)
 	#endif
 #else
 	#define m68ki_tas_callback() 1
@@ -535,9 +763,9 @@ typedef uint32 uint64;
 
 #if M68K_ILLG_HAS_CALLBACK
 	#if M68K_ILLG_HAS_CALLBACK == M68K_OPT_SPECIFY_HANDLER
-		#define m68ki_illg_callback(opcode) M68K_ILLG_CALLBACK(opcode)
+		#define m68ki_illg_callback(opcode) (m68ki_host_ok() ? M68K_ILLG_CALLBACK(opcode) : 0)
 	#else
-		#define m68ki_illg_callback(opcode) CALLBACK_ILLG_INSTR(opcode)
+		#define m68ki_illg_callback(opcode) (m68ki_host_ok() ? CALLBACK_ILLG_INSTR(opcode) : 0)
 	#endif
 #else
 	#define m68ki_illg_callback(opcode) 0 // Default is 0 = not handled, exception will occur
@@ -545,9 +773,9 @@ typedef uint32 uint64;
 
 #if M68K_TRAP_HAS_CALLBACK
 	#if M68K_TRAP_HAS_CALLBACK == M68K_OPT_SPECIFY_HANDLER
-		#define m68ki_trap_callback(trap) M68K_TRAP_CALLBACK(trap)
+		#define m68ki_trap_callback(trap) (m68ki_host_ok() ? M68K_TRAP_CALLBACK(trap) : 0)
 	#else
-		#define m68ki_trap_callback(trap) CALLBACK_TRAP_INSTR(trap)
+		#define m68ki_trap_callback(trap) (m68ki_host_ok() ? CALLBACK_TRAP_INSTR(trap) : 0)
 	#endif
 #else
 	#define m68ki_trap_callback(opcode) 0 // Default is 0 = not handled, exception will occur
@@ -555,19 +783,54 @@ typedef uint32 uint64;
 
 #if M68K_INSTRUCTION_HOOK
 	#if M68K_INSTRUCTION_HOOK == M68K_OPT_SPECIFY_HANDLER
-		#define m68ki_instr_hook(pc) M68K_INSTRUCTION_CALLBACK(pc)
+		#define m68ki_instr_hook(pc) do{ if(m68ki_host_ok()) M68K_INSTRUCTION_CALLBACK(pc); }while(0)
 	#else
-		#define m68ki_instr_hook(pc) CALLBACK_INSTR_HOOK(pc)
+		#define m68ki_instr_hook(pc) do{ if(m68ki_host_ok()) CALLBACK_INSTR_HOOK(pc); }while(0)
 	#endif
 #else
 	#define m68ki_instr_hook(pc)
 #endif /* M68K_INSTRUCTION_HOOK */
 
+#if M68KI_PROFILE_CHARGE
+	/* Charge the instruction's cycles (see m68ki_profile_charge()) */
+	#define m68ki_profile_begin() m68ki_cpu.instr_start = GET_CYCLES()
+	#define m68ki_profile_end() m68ki_profile_charge((sint)(m68ki_cpu.instr_start - GET_CYCLES()))
+#else
+	#define m68ki_profile_begin()
+	#define m68ki_profile_end()
+#endif /* M68KI_PROFILE_CHARGE */
+
+#if M68K_PROFILE
+	#define m68ki_profile_count(FIELD, INDEX) m68ki_cpu.profile.FIELD[INDEX]++
+#else
+	#define m68ki_profile_count(FIELD, INDEX)
+#endif /* M68K_PROFILE */
+
+#if M68K_FLIGHT_RECORDER && M68K_FLIGHT_ADDRESSES
+	/* Only data accesses are kept, not opcode and extension word fetches */
+	#define m68ki_flight_begin() m68ki_cpu.flight_address = 0
+	#define m68ki_flight_access(A, FC) if(((FC) & 3) != FUNCTION_CODE_USER_PROGRAM) m68ki_cpu.flight_address = (A)
+#else
+	#define m68ki_flight_begin()
+	#define m68ki_flight_access(A, FC)
+#endif /* M68K_FLIGHT_RECORDER && M68K_FLIGHT_ADDRESSES */
+
+#if M68K_CALL_GRAPH
+	/* Shadow call stack: push after the jump, pop given the return slot */
+	#define m68ki_call_enter() m68ki_call_push(REG_PC, REG_A[7], FALSE)
+	#define m68ki_call_exception() m68ki_call_push(REG_PC, REG_A[7], TRUE)
+	#define m68ki_call_return(SP) m68ki_call_pop(SP)
+#else
+	#define m68ki_call_enter()
+	#define m68ki_call_exception()
+	#define m68ki_call_return(SP)
+#endif /* M68K_CALL_GRAPH */
+
 #if M68K_MONITOR_PC
 	#if M68K_MONITOR_PC == M68K_OPT_SPECIFY_HANDLER
-		#define m68ki_pc_changed(A) M68K_SET_PC_CALLBACK(ADDRESS_68K(A))
+		#define m68ki_pc_changed(A) do{ if(m68ki_host_ok()) M68K_SET_PC_CALLBACK(ADDRESS_68K(A)); }while(0)
 	#else
-		#define m68ki_pc_changed(A) CALLBACK_PC_CHANGED(ADDRESS_68K(A))
+		#define m68ki_pc_changed(A) do{ if(m68ki_host_ok()) CALLBACK_PC_CHANGED(ADDRESS_68K(A)); }while(0)
 	#endif
 #else
 	#define m68ki_pc_changed(A)
@@ -577,9 +840,9 @@ typedef uint32 uint64;
 /* Enable or disable function code emulation */
 #if M68K_EMULATE_FC
 	#if M68K_EMULATE_FC == M68K_OPT_SPECIFY_HANDLER
-		#define m68ki_set_fc(A) M68K_SET_FC_CALLBACK(A)
+		#define m68ki_set_fc(A) do{ if(m68ki_host_ok()) M68K_SET_FC_CALLBACK(A); }while(0)
 	#else
-		#define m68ki_set_fc(A) CALLBACK_SET_FC(A)
+		#define m68ki_set_fc(A) do{ if(m68ki_host_ok()) CALLBACK_SET_FC(A); }while(0)
 	#endif
 	#define m68ki_use_data_space() m68ki_address_space = FUNCTION_CODE_USER_DATA
 	#define m68ki_use_program_space() m68ki_address_space = FUNCTION_CODE_USER_PROGRAM
@@ -609,19 +872,53 @@ typedef uint32 uint64;
 	#define m68ki_exception_if_trace()
 #endif /* M68K_EMULATE_TRACE */
 
+/* Skip the rest of an idle loop that a branch just closed */
+#if M68KI_FAST_FORWARD
+	void m68ki_fast_forward_dbcc(uint* r_dst);
+	void m68ki_fast_forward_bcc(void);
+	/* dbcc back to itself or over one instruction word */
+	#define m68ki_skip_loop_dbcc(R) if(REG_PPC - REG_PC <= 2 && !m68ki_tracing) m68ki_fast_forward_dbcc(R)
+	/* bcc.s back over 2 to 8 bytes */
+	#define m68ki_skip_loop_bcc() if(REG_PPC - REG_PC - 2 <= 6 && !m68ki_tracing) m68ki_fast_forward_bcc()
+#else
+	#define m68ki_skip_loop_dbcc(R)
+	#define m68ki_skip_loop_bcc()
+#endif /* M68KI_FAST_FORWARD */
+
+
 
+/* Pending faults */
+#if M68KI_PENDING_FAULTS
+	#define m68ki_fault_pending() m68ki_cpu.fault_pending
+	#define m68ki_bus_error() m68ki_raise_fault(M68KI_FAULT_BUS)
+#else
+	#define m68ki_fault_pending() 0
+	#define m68ki_bus_error() m68ki_exception_bus_error()
+#endif /* M68KI_PENDING_FAULTS */
 
 /* Address error */
 #if M68K_EMULATE_ADDRESS_ERROR
 	#include <setjmp.h>
 
+#if M68KI_PENDING_FAULTS
+	#define m68ki_set_address_error_trap()
+
+	#define m68ki_check_address_error(ADDR, WRITE_MODE, FC) \
+		if((ADDR)&1) \
+		{ \
+			m68ki_aerr_address = ADDR; \
+			m68ki_aerr_write_mode = WRITE_MODE; \
+			m68ki_aerr_fc = FC; \
+			m68ki_raise_fault(M68KI_FAULT_ADDRESS); \
+		}
+
 /* sigjmp() on Mac OS X and *BSD in general saves signal contexts and is super-slow, use sigsetjmp() to tell it not to */
-#ifdef _BSD_SETJMP_H
-extern sigjmp_buf m68ki_aerr_trap;
+#elif defined(_BSD_SETJMP_H)
 #define m68ki_set_address_error_trap(m68k) \
 	if(sigsetjmp(m68ki_aerr_trap, 0) != 0) \
 	{ \
 		m68ki_exception_address_error(m68k); \
+		m68ki_profile_end(); \
 		if(CPU_STOPPED) \
 		{ \
 			if (m68ki_remaining_cycles > 0) \
@@ -639,11 +936,12 @@ extern sigjmp_buf m68ki_aerr_trap;
 		siglongjmp(m68ki_aerr_trap, 1); \
 	}
 #else
-extern jmp_buf m68ki_aerr_trap;
 	#define m68ki_set_address_error_trap() \
 		if(setjmp(m68ki_aerr_trap) != 0) \
 		{ \
+			/* The longjmp skipped m68ki_end_instruction() */ \
 			m68ki_exception_address_error(); \
+			m68ki_profile_end(); \
 			if(CPU_STOPPED) \
 			{ \
 				SET_CYCLES(0); \
@@ -717,37 +1015,37 @@ extern jmp_buf m68ki_aerr_trap;
 #define EA_AY_AI_8()   AY                                    /* address register indirect */
 #define EA_AY_AI_16()  EA_AY_AI_8()
 #define EA_AY_AI_32()  EA_AY_AI_8()
-#define EA_AY_PI_8()   (AY++)                                /* postincrement (size = byte) */
-#define EA_AY_PI_16()  ((AY+=2)-2)                           /* postincrement (size = word) */
-#define EA_AY_PI_32()  ((AY+=4)-4)                           /* postincrement (size = long) */
-#define EA_AY_PD_8()   (--AY)                                /* predecrement (size = byte) */
-#define EA_AY_PD_16()  (AY-=2)                               /* predecrement (size = word) */
-#define EA_AY_PD_32()  (AY-=4)                               /* predecrement (size = long) */
+#define EA_AY_PI_8()   (m68ki_save_ay(), AY++)               /* postincrement (size = byte) */
+#define EA_AY_PI_16()  (m68ki_save_ay(), (AY+=2)-2)          /* postincrement (size = word) */
+#define EA_AY_PI_32()  (m68ki_save_ay(), (AY+=4)-4)          /* postincrement (size = long) */
+#define EA_AY_PD_8()   (m68ki_save_ay(), --AY)               /* predecrement (size = byte) */
+#define EA_AY_PD_16()  (m68ki_save_ay(), AY-=2)              /* predecrement (size = word) */
+#define EA_AY_PD_32()  (m68ki_save_ay(), AY-=4)              /* predecrement (size = long) */
 #define EA_AY_DI_8()   (AY+MAKE_INT_16(m68ki_read_imm_16())) /* displacement */
 #define EA_AY_DI_16()  EA_AY_DI_8()
 #define EA_AY_DI_32()  EA_AY_DI_8()
-#define EA_AY_IX_8()   m68ki_get_ea_ix(AY)                   /* indirect + index */
+#define EA_AY_IX_8()   m68ki_get_ea_ix(AY, CPU_TYPE)         /* indirect + index */
 #define EA_AY_IX_16()  EA_AY_IX_8()
 #define EA_AY_IX_32()  EA_AY_IX_8()
 
 #define EA_AX_AI_8()   AX
 #define EA_AX_AI_16()  EA_AX_AI_8()
 #define EA_AX_AI_32()  EA_AX_AI_8()
-#define EA_AX_PI_8()   (AX++)
-#define EA_AX_PI_16()  ((AX+=2)-2)
-#define EA_AX_PI_32()  ((AX+=4)-4)
-#define EA_AX_PD_8()   (--AX)
-#define EA_AX_PD_16()  (AX-=2)
-#define EA_AX_PD_32()  (AX-=4)
+#define EA_AX_PI_8()   (m68ki_save_ax(), AX++)
+#define EA_AX_PI_16()  (m68ki_save_ax(), (AX+=2)-2)
+#define EA_AX_PI_32()  (m68ki_save_ax(), (AX+=4)-4)
+#define EA_AX_PD_8()   (m68ki_save_ax(), --AX)
+#define EA_AX_PD_16()  (m68ki_save_ax(), AX-=2)
+#define EA_AX_PD_32()  (m68ki_save_ax(), AX-=4)
 #define EA_AX_DI_8()   (AX+MAKE_INT_16(m68ki_read_imm_16()))
 #define EA_AX_DI_16()  EA_AX_DI_8()
 #define EA_AX_DI_32()  EA_AX_DI_8()
-#define EA_AX_IX_8()   m68ki_get_ea_ix(AX)
+#define EA_AX_IX_8()   m68ki_get_ea_ix(AX, CPU_TYPE)
 #define EA_AX_IX_16()  EA_AX_IX_8()
 #define EA_AX_IX_32()  EA_AX_IX_8()
 
-#define EA_A7_PI_8()   ((REG_A[7]+=2)-2)
-#define EA_A7_PD_8()   (REG_A[7]-=2)
+#define EA_A7_PI_8()   (m68ki_save_sp(), (REG_A[7]+=2)-2)
+#define EA_A7_PD_8()   (m68ki_save_sp(), REG_A[7]-=2)
 
 #define EA_AW_8()      MAKE_INT_16(m68ki_read_imm_16())      /* absolute word */
 #define EA_AW_16()     EA_AW_8()
@@ -758,7 +1056,7 @@ extern jmp_buf m68ki_aerr_trap;
 #define EA_PCDI_8()    m68ki_get_ea_pcdi()                   /* pc indirect + displacement */
 #define EA_PCDI_16()   EA_PCDI_8()
 #define EA_PCDI_32()   EA_PCDI_8()
-#define EA_PCIX_8()    m68ki_get_ea_pcix()                   /* pc indirect + index */
+#define EA_PCIX_8()    m68ki_get_ea_pcix(CPU_TYPE)           /* pc indirect + index */
 #define EA_PCIX_16()   EA_PCIX_8()
 #define EA_PCIX_32()   EA_PCIX_8()
 
@@ -818,6 +1116,31 @@ extern jmp_buf m68ki_aerr_trap;
 #define MFLAG_SET   2
 #define MFLAG_CLEAR 0
 
+/* Lazy flag operations (see m68ki_flags_sync()) */
+#define M68KI_FLAGS_DONE     0
+#define M68KI_FLAGS_LOGIC_8  1
+#define M68KI_FLAGS_LOGIC_16 2
+#define M68KI_FLAGS_LOGIC_32 3
+#define M68KI_FLAGS_ADD_8    4
+#define M68KI_FLAGS_ADD_16   5
+#define M68KI_FLAGS_ADD_32   6
+#define M68KI_FLAGS_SUB_8    7
+#define M68KI_FLAGS_SUB_16   8
+#define M68KI_FLAGS_SUB_32   9
+
+/* Work out the flags left pending by the last ALU handler.  m68kmake puts
+ * this at the start of every handler that reads or changes the flags itself,
+ * or m68ki_flags_discard() just ahead of the assignments when a handler
+ * overwrites N, Z, V and C unconditionally.
+ */
+#if M68K_LAZY_FLAGS
+	#define m68ki_flags_sync() (FLAGS_OP != M68KI_FLAGS_DONE ? m68ki_flags_update(m68ki_cpu_ptr) : (void)0)
+	#define m68ki_flags_discard() (FLAGS_OP = M68KI_FLAGS_DONE)
+#else
+	#define m68ki_flags_sync() ((void)0)
+	#define m68ki_flags_discard() ((void)0)
+#endif
+
 /* Turn flag values into 1 or 0 */
 #define XFLAG_AS_1() ((FLAG_X>>8)&1)
 #define NFLAG_AS_1() ((FLAG_N>>7)&1)
@@ -864,7 +1187,8 @@ extern jmp_buf m68ki_aerr_trap;
 
 
 /* Get the condition code register */
-#define m68ki_get_ccr() ((COND_XS() >> 4) | \
+#define m68ki_get_ccr() (m68ki_flags_sync(), \
+						 (COND_XS() >> 4) | \
 						 (COND_MI() >> 4) | \
 						 (COND_EQ() << 2) | \
 						 (COND_VS() >> 6) | \
@@ -886,7 +1210,7 @@ extern jmp_buf m68ki_aerr_trap;
 #define USE_CYCLES(A)    m68ki_remaining_cycles -= (A)
 #define SET_CYCLES(A)    m68ki_remaining_cycles = A
 #define GET_CYCLES()     m68ki_remaining_cycles
-#define USE_ALL_CYCLES() m68ki_remaining_cycles %= CYC_INSTRUCTION[REG_IR]
+#define USE_ALL_CYCLES() m68ki_remaining_cycles %= CYC_OPCODE(REG_IR)
 
 
 
@@ -909,9 +1233,9 @@ extern jmp_buf m68ki_aerr_trap;
 #endif
 
 /* Map PC-relative reads */
-#define m68ki_read_pcrel_8(A) m68k_read_pcrelative_8(A)
-#define m68ki_read_pcrel_16(A) m68k_read_pcrelative_16(A)
-#define m68ki_read_pcrel_32(A) m68k_read_pcrelative_32(A)
+#define m68ki_read_pcrel_8(A) (m68ki_host_ok() ? m68k_read_pcrelative_8(A) : 0)
+#define m68ki_read_pcrel_16(A) (m68ki_host_ok() ? m68k_read_pcrelative_16(A) : 0)
+#define m68ki_read_pcrel_32(A) (m68ki_host_ok() ? m68k_read_pcrelative_32(A) : 0)
 
 /* Read from the program space */
 #define m68ki_read_program_8(A) 	m68ki_read_8_fc(A, FLAG_S | FUNCTION_CODE_USER_PROGRAM)
@@ -935,12 +1259,206 @@ typedef union
 	double f;
 } fp_reg;
 
+/* Fast memory map: a directory of 1024 blocks, each holding 1024 4K pages */
+#define M68KI_MAP_PAGE_SHIFT  12
+#define M68KI_MAP_PAGE_MASK   0xfff
+#define M68KI_MAP_BLOCK_SHIFT 22
+#define M68KI_MAP_BLOCKS      1024
+#define M68KI_MAP_BLOCK_PAGES 1024
+
+typedef struct
+{
+	uint8* read;       /* Host memory for reads, NULL if not mapped */
+	uint8* write;      /* Host memory for writes, NULL if not mapped */
+} m68ki_map_page;
+
+/* PMMU address translation caches for instruction and data accesses,
+ * direct-mapped by page and function code.  Pages are the size set in the
+ * TC register, at least 256 bytes, so the low bits of phys hold flags.
+ */
+#define M68KI_ATC_VALID     8    /* Set in the tag of used entries */
+#define M68KI_ATC_MIN_SHIFT 8
+#define M68KI_ATC_NOWRITE   1    /* Writes must go through the miss path */
+#define M68KI_ATC_GLOBAL    2    /* Kept by PFLUSHN/PFLUSHAN (68040) */
+#define M68KI_ATC_FLAGS     0xff
+
+#define M68KI_ATC_FOR(FC)   (((FC) & 3) == FUNCTION_CODE_USER_PROGRAM ? 0 : 1)
+
+typedef struct
+{
+	uint tag;          /* Page address | function code | M68KI_ATC_VALID */
+	uint root;         /* Root pointer used for the table walk */
+	uint phys;         /* Physical address of the page | M68KI_ATC_xxx flags */
+} m68ki_atc_entry;
+
+/* Block cache: straight-line runs of instructions, direct-mapped by start
+ * address.  A block never covers more than M68KI_BLOCK_MAX_BYTES of code, and
+ * every 32-byte granule holding cached code is flagged in a bitmap that
+ * writes are checked against.
+ */
+#define M68KI_BLOCK_SLOTS         2048
+#define M68KI_BLOCK_MAX_INSNS     16
+#define M68KI_BLOCK_MAX_BYTES     64
+#define M68KI_BLOCK_INSN_BYTES    22   /* Longest 68k instruction */
+#define M68KI_BLOCK_GRANULE_SHIFT 5
+#define M68KI_BLOCK_INVALID       0xffffffff
+#define M68KI_BLOCK_BITMAP_WORDS  ((1 << (M68KI_MAP_BLOCK_SHIFT - M68KI_BLOCK_GRANULE_SHIFT)) / 32)
+
+typedef struct
+{
+	void (*handler)(void); /* Opcode handler */
+	uint8 offset;          /* Word offset of the opcode within the block */
+	uint8 cycles;          /* Base cycles of the opcode */
+} m68ki_block_insn;
+
+typedef struct
+{
+	uint pc;           /* Address of the first instruction */
+	uint key;          /* FLAG_S when recorded, M68KI_BLOCK_INVALID if empty */
+	uint len;          /* Bytes of code held in code[] */
+	uint count;        /* Number of instructions */
+	uint hits;         /* Runs since recorded, until compiled by the JIT */
+	void* jit_code;    /* Compiled code (NULL if not compiled) */
+	m68ki_block_insn insn[M68KI_BLOCK_MAX_INSNS];
+	uint16 code[M68KI_BLOCK_MAX_BYTES / 2];
+} m68ki_block;
+
+/* JIT lockstep: the data accesses of a compiled block are logged and then
+ * replayed to the interpreter running the same block.
+ */
+#define M68KI_JIT_LOG_SIZE   256
+#define M68KI_JIT_LOG_OFF    0
+#define M68KI_JIT_LOG_RECORD 1
+#define M68KI_JIT_LOG_REPLAY 2
+#define M68KI_JIT_LOG_WRITE  0x100  /* Set in size for writes */
+
+typedef struct
+{
+	uint address;
+	uint value;
+	uint size;
+} m68ki_jit_access;
+
+typedef struct
+{
+	uint mode;
+	uint count;
+	uint pos;
+	uint overflow;     /* Too many accesses to log */
+	uint diverged;     /* Replayed accesses did not match */
+	uint host_changed; /* The host changed the core from a callback while recording */
+	m68ki_jit_access access[M68KI_JIT_LOG_SIZE];
+} m68ki_jit_log;
+
+typedef struct
+{
+	m68ki_block blocks[M68KI_BLOCK_SLOTS];
+	uint32* code_map[M68KI_MAP_BLOCKS]; /* Granule bitmap per 4MB (NULL if no code) */
+
+	void* jit_entry[M68KI_BLOCK_SLOTS]; /* Compiled code per slot, for chaining */
+	uint8* jit_buffer;                  /* Executable memory (NULL until used) */
+	uint jit_used;
+	void* jit_enter;                    /* Trampoline into compiled code */
+	void* jit_exit;                     /* Return from compiled code */
+#if M68KI_JIT_LOCKSTEP
+	m68ki_jit_log jit_log;
+	void* jit_state;                    /* Core snapshots for lockstep */
+	uint jit_mismatches;
+#endif /* M68KI_JIT_LOCKSTEP */
+} m68ki_block_cache;
+
+typedef struct
+{
+	unsigned long long cycle; /* Deadline */
+	void (*callback)(void* param, unsigned long long cycle);
+	void* param;
+	uint seq;                 /* Scheduling order, for ties */
+} m68ki_event;
+
+#if M68KI_SAMPLER
+typedef struct
+{
+	uint depth;                    /* 0 for a free slot */
+	uint pc[M68K_SAMPLE_DEPTH];    /* Innermost frame first */
+	unsigned long long count;
+} m68ki_sample;
+
+typedef struct
+{
+	uint period;                   /* Cycles between samples */
+	uint depth;                    /* Frames to record */
+	int event;                     /* Pending sample event, -1 if stopped */
+	unsigned long long dropped;    /* Samples with no free slot */
+	m68ki_sample slot[M68K_SAMPLE_SLOTS]; /* Open addressing on the stack */
+} m68ki_sampler;
+#endif /* M68KI_SAMPLER */
+
+#if M68KI_TRACE
+typedef struct m68ki_trace m68ki_trace; /* See m68ktrace.c */
+#endif /* M68KI_TRACE */
+
+#define M68KI_TRACE_WRITE 0x08 /* Trace access kind: size | M68KI_TRACE_WRITE */
+
+#define M68KI_FRAME_PUSHES 32  /* Pushes gathered for one block write */
+#define M68KI_FRAME_BYTES  96
+
+typedef struct
+{
+	uint address;
+	uint size;
+	uint value;
+} m68ki_frame_push;
+
+#if M68K_PROFILE
+#include "m68kops.h"
+
+typedef struct
+{
+	unsigned long long count[M68KI_HANDLER_COUNT];  /* By handler index */
+	unsigned long long cycles[M68KI_HANDLER_COUNT];
+	unsigned long long fpu_ops[M68K_PROFILE_FPU_OPS];
+	unsigned long long fpu_gen[M68K_PROFILE_FPU_GEN];
+	unsigned long long vectors[M68K_PROFILE_VECTORS];
+} m68ki_profile;
+#endif /* M68K_PROFILE */
+
+#if M68K_CALL_GRAPH
+typedef struct
+{
+	uint func;                   /* Entry point */
+	uint sp;                     /* Where the return address or exception frame is */
+	uint stack;                  /* Stack register and region of sp, see m68ki_call_push() */
+	uint exception;              /* Entered by an exception */
+	uint stats;                  /* Index in m68ki_call_graph.func, or M68K_CALL_FUNCTIONS */
+	unsigned long long self;     /* Cycles run in the function itself */
+	unsigned long long children; /* Cycles run in the functions it called */
+} m68ki_call_frame;
+
+typedef struct
+{
+	uint used;                   /* FALSE for a free slot */
+	uint func;
+	unsigned long long calls;
+	unsigned long long inclusive;
+	unsigned long long exclusive;
+} m68ki_call_stats;
+
+typedef struct
+{
+	uint depth;                  /* Frames in use, including the root frame */
+	unsigned long long untracked; /* Calls past M68K_CALL_DEPTH or M68K_CALL_FUNCTIONS */
+	m68ki_call_frame frame[M68K_CALL_DEPTH]; /* frame[0] is code outside any call */
+	m68ki_call_stats func[M68K_CALL_FUNCTIONS]; /* Open addressing on func */
+} m68ki_call_graph;
+#endif /* M68K_CALL_GRAPH */
+
 typedef struct
 {
 	uint cpu_type;     /* CPU Type: 68000, 68008, 68010, 68EC020, 68020, 68EC030, 68030, 68EC040, or 68040 */
 	uint dar[16];      /* Data and Address Registers */
-	uint dar_save[16];  /* Saved Data and Address Registers (pushed onto the
-						   stack when a bus error occurs)*/
+	uint dar_save[16];  /* Saved Data and Address Registers (restored when a
+						   bus error occurs) */
+	uint dar_save_mask; /* Registers in dar_save modified by this instruction */
 	uint ppc;		   /* Previous program counter */
 	uint pc;           /* Program Counter */
 	uint sp[7];        /* User, Interrupt, and Master Stack Pointers */
@@ -963,6 +1481,10 @@ typedef struct
 	uint not_z_flag;   /* Zero, inverted for speedups */
 	uint v_flag;       /* Overflow */
 	uint c_flag;       /* Carry */
+	uint flags_op;     /* Pending lazy flag operation (M68K_LAZY_FLAGS) */
+	uint flags_src;    /* and its operands and result */
+	uint flags_dst;
+	uint flags_res;
 	uint int_mask;     /* I0-I2 */
 	uint int_level;    /* State of interrupt pins IPL0-IPL2 -- ASG: changed from ints_pending */
 	uint stopped;      /* Stopped state */
@@ -997,9 +1519,18 @@ typedef struct
 	uint mmu_srp_aptr, mmu_srp_limit;
 	uint mmu_tc;
 	uint16 mmu_sr;
+	uint mmu_urp_aptr;      /* 68040 user root pointer */
+	uint mmu_itt0, mmu_itt1, mmu_dtt0, mmu_dtt1; /* 68040 transparent translation */
+	uint mmu_sr_040;        /* 68040 MMUSR */
+	uint mmu_atc_shift;     /* Page size of the ATC, from TC */
+	uint mmu_atc_root[2];   /* Root pointers for user and supervisor accesses */
+	unsigned long long mmu_atc_hits;
+	unsigned long long mmu_atc_misses;
+	m68ki_atc_entry mmu_atc[2][M68K_PMMU_ATC_ENTRIES];
 
 	const uint8* cyc_instruction;
 	const uint8* cyc_exception;
+	void (*const* instruction_handlers)(void); /* Handler set of the CPU type */
 
 	/* Callbacks to host */
 	int  (*int_ack_callback)(int int_line);           /* Interrupt Acknowledge */
@@ -1013,29 +1544,122 @@ typedef struct
 	void (*pc_changed_callback)(unsigned int new_pc); /* Called when the PC changes by a large amount */
 	void (*set_fc_callback)(unsigned int new_fc);     /* Called when the CPU function code changes */
 	void (*instr_hook_callback)(unsigned int pc);     /* Called every instruction cycle prior to execution */
-
+	const void* (*fetch_window_callback)(unsigned int page); /* Host memory holding code, for the fetch window */
+
+	/* Last values seen by the default callbacks */
+	int  default_int_ack_data;
+	uint default_bkpt_ack_data;
+	uint default_pc_changed_data;
+	uint default_set_fc_data;
+
+	/* Execution state */
+	sint remaining_cycles;  /* Number of clocks remaining */
+	sint initial_cycles;    /* Number of clocks requested by m68k_execute() */
+	uint tracing;           /* Trace exception pending for this instruction */
+	uint address_space;     /* Address space used for reads (FC emulation) */
+	uint aerr_address;      /* Address error details */
+	uint aerr_write_mode;
+	uint aerr_fc;
+	uint berr_address;      /* Bus error details (68020+ stack frames) */
+	uint berr_ssw;
+	uint berr_mmu;          /* The bus error is an MMU fault, with the above set */
+	uint fault_pending;     /* M68KI_FAULT_xxx to take at the end of the instruction */
+#if M68KI_PENDING_FAULTS
+	uint8* fault_state;     /* State at the pending fault (see m68ki_raise_fault()) */
+#endif /* M68KI_PENDING_FAULTS */
+#if M68K_EMULATE_ADDRESS_ERROR
+#ifdef _BSD_SETJMP_H
+	sigjmp_buf aerr_trap;   /* Return point for address errors */
+#else
+	jmp_buf aerr_trap;
+#endif
+#endif /* M68K_EMULATE_ADDRESS_ERROR */
+	jmp_buf bus_error_jmp_buf; /* Return point for bus errors */
+
+	void* user_data;        /* Host data passed to m68k_create() */
+
+	m68ki_map_page** mem_map; /* Fast memory map directory (NULL if empty) */
+
+	const uint8* fetch_mem;    /* Fetch window: host memory of fetch_page, */
+	uint fetch_page;           /* M68KI_FETCH_NONE when empty */
+	uint fetch_limit;          /* Offsets below this can be read 32 bits wide */
+
+	m68ki_block_cache* block_cache; /* Block cache (NULL until first used) */
+	uint block_pc;             /* Instruction words of the running block */
+	uint block_len;
+	const uint16* block_code;
+#if M68KI_JIT
+	uint jit_perf_enabled;     /* Name compiled blocks in jit_perf_file */
+	FILE* jit_perf_file;       /* perf map, opened on first use */
+#endif /* M68KI_JIT */
+
+#if M68K_EVENT_QUEUE
+	unsigned long long cycle_end; /* Clock when remaining_cycles reaches 0 */
+	sint event_slack;          /* Cycles put aside past the next event */
+	int event_count;
+	uint event_seq;            /* Next event id */
+	m68ki_event events[M68K_MAX_EVENTS]; /* Min-heap on (cycle, seq) */
+#endif /* M68K_EVENT_QUEUE */
+#if M68KI_SAMPLER
+	m68ki_sampler* sampler;    /* PC samples (NULL until sampling starts) */
+#endif /* M68KI_SAMPLER */
+#if M68KI_MEMORY_BLOCKS
+	uint frame_open;           /* Pushes go to frame[] (see m68ki_frame_begin()) */
+	uint frame_pushes;
+	uint frame_bytes;
+	m68ki_frame_push frame[M68KI_FRAME_PUSHES];
+#endif /* M68KI_MEMORY_BLOCKS */
+#if M68K_PROFILE
+	m68ki_profile profile;
+#endif /* M68K_PROFILE */
+#if M68KI_PROFILE_CHARGE
+	sint instr_start;          /* GET_CYCLES() when the instruction began */
+#endif /* M68KI_PROFILE_CHARGE */
+#if M68K_CALL_GRAPH
+	m68ki_call_graph calls;
+#endif /* M68K_CALL_GRAPH */
+#if M68K_FLIGHT_RECORDER
+	uint flight_next;          /* Records written, the next one at this modulo the size */
+	uint flight_address;       /* Last address read or written */
+	m68k_flight_record flight[M68K_FLIGHT_RECORDS];
+#endif /* M68K_FLIGHT_RECORDER */
+#if M68KI_TRACE
+	m68ki_trace* trace;        /* Trace file writer (NULL when not tracing) */
+#endif /* M68KI_TRACE */
 } m68ki_cpu_core;
 
 
-extern m68ki_cpu_core m68ki_cpu;
-extern sint           m68ki_remaining_cycles;
-extern uint           m68ki_tracing;
+extern M68K_THREAD_LOCAL m68ki_cpu_core* m68ki_cpu_ptr;
 extern const uint8    m68ki_shift_8_table[];
 extern const uint16   m68ki_shift_16_table[];
 extern const uint     m68ki_shift_32_table[];
 extern const uint8    m68ki_exception_cycle_table[][256];
-extern uint           m68ki_address_space;
 extern const uint8    m68ki_ea_idx_cycle_table[];
-
-extern uint           m68ki_aerr_address;
-extern uint           m68ki_aerr_write_mode;
-extern uint           m68ki_aerr_fc;
+extern const uint16   m68ki_instruction_index_table[]; /* From m68kops.c */
 
 /* Forward declarations to keep some of the macros happy */
+#if M68K_LAZY_FLAGS
+void m68ki_flags_update(m68ki_cpu_core* cpu);
+#endif
 static inline uint m68ki_read_16_fc (uint address, uint fc);
 static inline uint m68ki_read_32_fc (uint address, uint fc);
-static inline uint m68ki_get_ea_ix(uint An);
+static inline uint m68ki_get_ea_ix(uint An, uint cpu_type);
 static inline void m68ki_check_interrupts(void);            /* ASG: check for interrupts */
+#if M68KI_PENDING_FAULTS
+void m68ki_raise_fault(uint kind);
+void m68ki_take_fault(void);
+#endif
+#if M68KI_PROFILE_CHARGE
+static inline void m68ki_profile_charge(uint cycles);
+#endif
+#if M68K_CALL_GRAPH
+void m68ki_call_push(uint func, uint sp, uint exception);
+void m68ki_call_pop(uint sp);
+#endif
+#if M68KI_TRACE
+void m68ki_trace_access(uint address, uint kind, uint value);
+void m68ki_trace_instruction(uint cycles);
+#endif
 
 /* quick disassembly (used for logging) */
 char* m68ki_disassemble_quick(unsigned int pc, unsigned int cpu_type);
@@ -1046,22 +1670,142 @@ char* m68ki_disassemble_quick(unsigned int pc, unsigned int cpu_type);
 /* ======================================================================== */
 
 
+/* -------------------------- Bus Error Rollback -------------------------- */
+
+/* A bus error aborts the current instruction and must undo any changes it
+ * already made to the data and address registers.  Rather than copying all
+ * 16 registers before every instruction, the first change to a register
+ * that can be followed by a memory access records the old value here.
+ * The journal is cleared in m68ki_begin_instruction() and only read back by
+ * m68ki_exception_bus_error().
+ */
+static inline void m68ki_save_da(uint regnum)
+{
+	if(!(m68ki_cpu.dar_save_mask & (1 << regnum)))
+	{
+		m68ki_cpu.dar_save_mask |= 1 << regnum;
+		REG_DA_SAVE[regnum] = REG_DA[regnum];
+	}
+}
+
+#define m68ki_save_ax() m68ki_save_da(8 + ((REG_IR >> 9) & 7))
+#define m68ki_save_ay() m68ki_save_da(8 + (REG_IR & 7))
+#define m68ki_save_sp() m68ki_save_da(15)
+
+
+/* Big endian access to host memory */
+static inline uint m68ki_get_mem_16(const uint8* mem)
+{
+	return ((uint)mem[0] << 8) | mem[1];
+}
+
+static inline uint m68ki_get_mem_32(const uint8* mem)
+{
+	return ((uint)mem[0] << 24) | ((uint)mem[1] << 16) | ((uint)mem[2] << 8) | mem[3];
+}
+
+static inline void m68ki_set_mem_16(uint8* mem, uint value)
+{
+	mem[0] = (uint8)(value >> 8);
+	mem[1] = (uint8)value;
+}
+
+static inline void m68ki_set_mem_32(uint8* mem, uint value)
+{
+	mem[0] = (uint8)(value >> 24);
+	mem[1] = (uint8)(value >> 16);
+	mem[2] = (uint8)(value >> 8);
+	mem[3] = (uint8)value;
+}
+
+/* ------------------------------ Fetch Window ---------------------------- */
+
+#if M68KI_FETCH_WINDOW
+#define M68KI_FETCH_NONE 1 /* Not page aligned, never matches */
+
+const uint8* m68ki_fetch_refill(uint address, uint size);
+
+/* Drop the fetch window, the next fetch looks the page up again */
+static inline void m68ki_fetch_invalidate(void)
+{
+	m68ki_cpu.fetch_page = M68KI_FETCH_NONE;
+	m68ki_cpu.fetch_limit = 0;
+}
+
+/* Instruction words at address (after ADDRESS_68K()), from the fetch window
+ * when the page is in host memory.
+ */
+M68KI_FORCE_INLINE uint m68ki_fetch_16(uint address)
+{
+	const uint8* mem;
+
+	if(address - m68ki_cpu.fetch_page < m68ki_cpu.fetch_limit)
+		return m68ki_get_mem_16(m68ki_cpu.fetch_mem + (address - m68ki_cpu.fetch_page));
+	if(!m68ki_host_ok())
+		return 0x4e71;
+	mem = m68ki_fetch_refill(address, 2);
+	return mem != NULL ? m68ki_get_mem_16(mem) : m68k_read_immediate_16(address);
+}
+
+M68KI_FORCE_INLINE uint m68ki_fetch_32(uint address)
+{
+	const uint8* mem;
+
+	if(address - m68ki_cpu.fetch_page < m68ki_cpu.fetch_limit)
+		return m68ki_get_mem_32(m68ki_cpu.fetch_mem + (address - m68ki_cpu.fetch_page));
+	if(!m68ki_host_ok())
+		return 0x4e714e71;
+	mem = m68ki_fetch_refill(address, 4);
+	return mem != NULL ? m68ki_get_mem_32(mem) : m68k_read_immediate_32(address);
+}
+#else
+#define m68ki_fetch_invalidate()
+#define m68ki_fetch_16(A) (m68ki_host_ok() ? m68k_read_immediate_16(A) : 0x4e71)
+#define m68ki_fetch_32(A) (m68ki_host_ok() ? m68k_read_immediate_32(A) : 0x4e714e71)
+#endif /* M68KI_FETCH_WINDOW */
+
+
 /* ---------------------------- Read Immediate ---------------------------- */
 
-extern uint pmmu_translate_addr(uint addr_in);
+extern uint pmmu_translate_addr(uint addr_in, uint fc, uint write, uint size);
+
+#if M68K_EMULATE_PMMU
+/* Translate a logical address with the PMMU.  ATC hits are handled here,
+ * misses and faults go through pmmu_translate_addr().
+ */
+static inline uint m68ki_pmmu_translate(uint address, uint fc, uint write, uint size)
+{
+	uint shift = m68ki_cpu.mmu_atc_shift;
+	uint page = (address >> shift) << shift;
+	m68ki_atc_entry* entry = &m68ki_cpu.mmu_atc[M68KI_ATC_FOR(fc)][((address >> shift) ^ fc) & (M68K_PMMU_ATC_ENTRIES - 1)];
+
+	if(entry->tag == (page | (fc & 7) | M68KI_ATC_VALID) && entry->root == m68ki_cpu.mmu_atc_root[(fc >> 2) & 1] &&
+	   !(write && (entry->phys & M68KI_ATC_NOWRITE)))
+	{
+		m68ki_cpu.mmu_atc_hits++;
+		return (entry->phys & ~M68KI_ATC_FLAGS) + (address - page);
+	}
+	return pmmu_translate_addr(address, fc, write, size);
+}
+#endif /* M68K_EMULATE_PMMU */
 
 /* Handles all immediate reads, does address error check, function code setting,
  * and prefetching if they are enabled in m68kconf.h
  */
-static inline uint m68ki_read_imm_16(void)
+M68KI_FORCE_INLINE uint m68ki_read_imm_16(void)
 {
 	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
 	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+#if M68K_EMULATE_ADDRESS_ERROR
+	/* Run a nop rather than whatever is at the odd PC (M68K_PENDING_FAULTS) */
+	if(m68ki_fault_pending())
+		return 0x4e71;
+#endif
 
 #if M68K_SEPARATE_READS
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address);
+	    address = m68ki_pmmu_translate(address, FLAG_S | FUNCTION_CODE_USER_PROGRAM, 0, 2);
 #endif
 #endif
 
@@ -1071,17 +1815,28 @@ static inline uint m68ki_read_imm_16(void)
 	if(REG_PC != CPU_PREF_ADDR)
 	{
 		CPU_PREF_ADDR = REG_PC;
-		CPU_PREF_DATA = m68k_read_immediate_16(ADDRESS_68K(CPU_PREF_ADDR));
+		CPU_PREF_DATA = m68ki_fetch_16(ADDRESS_68K(CPU_PREF_ADDR));
 	}
 	result = MASK_OUT_ABOVE_16(CPU_PREF_DATA);
 	REG_PC += 2;
 	CPU_PREF_ADDR = REG_PC;
-	CPU_PREF_DATA = m68k_read_immediate_16(ADDRESS_68K(CPU_PREF_ADDR));
+	CPU_PREF_DATA = m68ki_fetch_16(ADDRESS_68K(CPU_PREF_ADDR));
 	return result;
 }
 #else
+#if M68KI_BLOCK_CACHE
+	{
+		/* Serve instruction words of the running block from its copy */
+		uint offset = REG_PC - m68ki_cpu.block_pc;
+		if(offset < m68ki_cpu.block_len)
+		{
+			REG_PC += 2;
+			return m68ki_cpu.block_code[offset >> 1];
+		}
+	}
+#endif /* M68KI_BLOCK_CACHE */
 	REG_PC += 2;
-	return m68k_read_immediate_16(ADDRESS_68K(REG_PC-2));
+	return m68ki_fetch_16(ADDRESS_68K(REG_PC-2));
 #endif /* M68K_EMULATE_PREFETCH */
 }
 
@@ -1096,7 +1851,7 @@ static inline uint m68ki_read_imm_32(void)
 #if M68K_SEPARATE_READS
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address);
+	    address = m68ki_pmmu_translate(address, FLAG_S | FUNCTION_CODE_USER_PROGRAM, 0, 4);
 #endif
 #endif
 
@@ -1109,27 +1864,95 @@ static inline uint m68ki_read_imm_32(void)
 	if(REG_PC != CPU_PREF_ADDR)
 	{
 		CPU_PREF_ADDR = REG_PC;
-		CPU_PREF_DATA = m68k_read_immediate_16(ADDRESS_68K(CPU_PREF_ADDR));
+		CPU_PREF_DATA = m68ki_fetch_16(ADDRESS_68K(CPU_PREF_ADDR));
 	}
 	temp_val = MASK_OUT_ABOVE_16(CPU_PREF_DATA);
 	REG_PC += 2;
 	CPU_PREF_ADDR = REG_PC;
-	CPU_PREF_DATA = m68k_read_immediate_16(ADDRESS_68K(CPU_PREF_ADDR));
+	CPU_PREF_DATA = m68ki_fetch_16(ADDRESS_68K(CPU_PREF_ADDR));
 
 	temp_val = MASK_OUT_ABOVE_32((temp_val << 16) | MASK_OUT_ABOVE_16(CPU_PREF_DATA));
 	REG_PC += 2;
 	CPU_PREF_ADDR = REG_PC;
-	CPU_PREF_DATA = m68k_read_immediate_16(ADDRESS_68K(CPU_PREF_ADDR));
+	CPU_PREF_DATA = m68ki_fetch_16(ADDRESS_68K(CPU_PREF_ADDR));
 
 	return temp_val;
 #else
 	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
 	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+#if M68KI_BLOCK_CACHE
+	{
+		/* All 4 bytes must lie in the block; offset may have wrapped */
+		uint offset = REG_PC - m68ki_cpu.block_pc;
+		if(offset < m68ki_cpu.block_len && m68ki_cpu.block_len - offset >= 4)
+		{
+			REG_PC += 4;
+			return ((uint)m68ki_cpu.block_code[offset >> 1] << 16) | m68ki_cpu.block_code[(offset >> 1) + 1];
+		}
+	}
+#endif /* M68KI_BLOCK_CACHE */
 	REG_PC += 4;
-	return m68k_read_immediate_32(ADDRESS_68K(REG_PC-4));
+	return m68ki_fetch_32(ADDRESS_68K(REG_PC-4));
 #endif /* M68K_EMULATE_PREFETCH */
 }
 
+/* ---------------------------- Fast Memory Map --------------------------- */
+
+#if M68K_FAST_MEMORY_MAP
+/* Find the page entry for an access of size bytes, NULL if the access is not
+ * contained in a single page of a populated block.
+ */
+static inline m68ki_map_page* m68ki_map_find(uint address, uint size)
+{
+	m68ki_map_page* block;
+
+	if(m68ki_cpu.mem_map == NULL || (address & M68KI_MAP_PAGE_MASK) + size > M68KI_MAP_PAGE_MASK + 1)
+		return NULL;
+	block = m68ki_cpu.mem_map[address >> M68KI_MAP_BLOCK_SHIFT];
+	if(block == NULL)
+		return NULL;
+	return &block[(address >> M68KI_MAP_PAGE_SHIFT) & (M68KI_MAP_BLOCK_PAGES - 1)];
+}
+
+/* Host memory for reading/writing size bytes at address, or NULL */
+static inline uint8* m68ki_map_read(uint address, uint size)
+{
+	m68ki_map_page* page = m68ki_map_find(address, size);
+	return page != NULL && page->read != NULL ? page->read + (address & M68KI_MAP_PAGE_MASK) : NULL;
+}
+
+static inline uint8* m68ki_map_write(uint address, uint size)
+{
+	m68ki_map_page* page = m68ki_map_find(address, size);
+	return page != NULL && page->write != NULL ? page->write + (address & M68KI_MAP_PAGE_MASK) : NULL;
+}
+#endif /* M68K_FAST_MEMORY_MAP */
+
+/* ------------------------------ Block Cache ----------------------------- */
+
+#if M68KI_BLOCK_CACHE
+void m68ki_block_invalidate(uint address);
+
+/* Drop any cached blocks near a written address.  Blocks flag the granules
+ * from 3 bytes before their first instruction, so checking the first byte
+ * of a write is enough to catch any overlap.
+ */
+static inline void m68ki_block_check_write(uint address)
+{
+	m68ki_block_cache* cache = m68ki_cpu.block_cache;
+	uint32* bitmap;
+	uint granule;
+
+	if(cache == NULL)
+		return;
+	bitmap = cache->code_map[address >> M68KI_MAP_BLOCK_SHIFT];
+	granule = (address & ((1 << M68KI_MAP_BLOCK_SHIFT) - 1)) >> M68KI_BLOCK_GRANULE_SHIFT;
+	if(bitmap != NULL && (bitmap[granule >> 5] & ((uint32)1 << (granule & 31))))
+		m68ki_block_invalidate(address);
+}
+#endif /* M68KI_BLOCK_CACHE */
+
+
 /* ------------------------- Top level read/write ------------------------- */
 
 /* Handles all memory accesses (except for immediate reads if they are
@@ -1142,10 +1965,22 @@ static inline uint m68ki_read_8_fc(uint address, uint fc)
 {
 	(void)fc;
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
+	m68ki_flight_access(address, fc); /* auto-disable (see m68kcpu.h) */
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address);
+	    address = m68ki_pmmu_translate(address, fc, 0, 1);
+#endif
+
+	if(m68ki_fault_pending()) /* auto-disable (see m68kcpu.h) */
+		return 0;
+
+#if M68K_FAST_MEMORY_MAP
+	{
+		const uint8* mem = m68ki_map_read(ADDRESS_68K(address), 1);
+		if(mem != NULL)
+			return *mem;
+	}
 #endif
 
 	return m68k_read_memory_8(ADDRESS_68K(address));
@@ -1154,11 +1989,23 @@ static inline uint m68ki_read_16_fc(uint address, uint fc)
 {
 	(void)fc;
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
+	m68ki_flight_access(address, fc); /* auto-disable (see m68kcpu.h) */
 	m68ki_check_address_error_010_less(address, MODE_READ, fc); /* auto-disable (see m68kcpu.h) */
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address);
+	    address = m68ki_pmmu_translate(address, fc, 0, 2);
+#endif
+
+	if(m68ki_fault_pending()) /* auto-disable (see m68kcpu.h) */
+		return 0;
+
+#if M68K_FAST_MEMORY_MAP
+	{
+		const uint8* mem = m68ki_map_read(ADDRESS_68K(address), 2);
+		if(mem != NULL)
+			return m68ki_get_mem_16(mem);
+	}
 #endif
 
 	return m68k_read_memory_16(ADDRESS_68K(address));
@@ -1167,24 +2014,55 @@ static inline uint m68ki_read_32_fc(uint address, uint fc)
 {
 	(void)fc;
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
+	m68ki_flight_access(address, fc); /* auto-disable (see m68kcpu.h) */
 	m68ki_check_address_error_010_less(address, MODE_READ, fc); /* auto-disable (see m68kcpu.h) */
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address);
+	    address = m68ki_pmmu_translate(address, fc, 0, 4);
 #endif
 
-	return m68k_read_memory_32(ADDRESS_68K(address));
+	if(m68ki_fault_pending()) /* auto-disable (see m68kcpu.h) */
+		return 0;
+
+#if M68K_FAST_MEMORY_MAP
+	{
+		const uint8* mem = m68ki_map_read(ADDRESS_68K(address), 4);
+		if(mem != NULL)
+			return m68ki_get_mem_32(mem);
+	}
+#endif
+
+	return m68k_read_memory_32(ADDRESS_68K(address));
 }
 
 static inline void m68ki_write_8_fc(uint address, uint fc, uint value)
 {
 	(void)fc;
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
+	m68ki_flight_access(address, fc); /* auto-disable (see m68kcpu.h) */
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address);
+	    address = m68ki_pmmu_translate(address, fc, 1, 1);
+#endif
+
+	if(m68ki_fault_pending()) /* auto-disable (see m68kcpu.h) */
+		return;
+
+#if M68KI_BLOCK_CACHE
+	m68ki_block_check_write(ADDRESS_68K(address));
+#endif
+
+#if M68K_FAST_MEMORY_MAP
+	{
+		uint8* mem = m68ki_map_write(ADDRESS_68K(address), 1);
+		if(mem != NULL)
+		{
+			*mem = (uint8)value;
+			return;
+		}
+	}
 #endif
 
 	m68k_write_memory_8(ADDRESS_68K(address), value);
@@ -1193,11 +2071,30 @@ static inline void m68ki_write_16_fc(uint address, uint fc, uint value)
 {
 	(void)fc;
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
+	m68ki_flight_access(address, fc); /* auto-disable (see m68kcpu.h) */
 	m68ki_check_address_error_010_less(address, MODE_WRITE, fc); /* auto-disable (see m68kcpu.h) */
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address);
+	    address = m68ki_pmmu_translate(address, fc, 1, 2);
+#endif
+
+	if(m68ki_fault_pending()) /* auto-disable (see m68kcpu.h) */
+		return;
+
+#if M68KI_BLOCK_CACHE
+	m68ki_block_check_write(ADDRESS_68K(address));
+#endif
+
+#if M68K_FAST_MEMORY_MAP
+	{
+		uint8* mem = m68ki_map_write(ADDRESS_68K(address), 2);
+		if(mem != NULL)
+		{
+			m68ki_set_mem_16(mem, value);
+			return;
+		}
+	}
 #endif
 
 	m68k_write_memory_16(ADDRESS_68K(address), value);
@@ -1206,11 +2103,30 @@ static inline void m68ki_write_32_fc(uint address, uint fc, uint value)
 {
 	(void)fc;
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
+	m68ki_flight_access(address, fc); /* auto-disable (see m68kcpu.h) */
 	m68ki_check_address_error_010_less(address, MODE_WRITE, fc); /* auto-disable (see m68kcpu.h) */
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address);
+	    address = m68ki_pmmu_translate(address, fc, 1, 4);
+#endif
+
+	if(m68ki_fault_pending()) /* auto-disable (see m68kcpu.h) */
+		return;
+
+#if M68KI_BLOCK_CACHE
+	m68ki_block_check_write(ADDRESS_68K(address));
+#endif
+
+#if M68K_FAST_MEMORY_MAP
+	{
+		uint8* mem = m68ki_map_write(ADDRESS_68K(address), 4);
+		if(mem != NULL)
+		{
+			m68ki_set_mem_32(mem, value);
+			return;
+		}
+	}
 #endif
 
 	m68k_write_memory_32(ADDRESS_68K(address), value);
@@ -1221,17 +2137,324 @@ static inline void m68ki_write_32_pd_fc(uint address, uint fc, uint value)
 {
 	(void)fc;
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
+	m68ki_flight_access(address, fc); /* auto-disable (see m68kcpu.h) */
 	m68ki_check_address_error_010_less(address, MODE_WRITE, fc); /* auto-disable (see m68kcpu.h) */
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address);
+	    address = m68ki_pmmu_translate(address, fc, 1, 4);
+#endif
+
+	if(m68ki_fault_pending()) /* auto-disable (see m68kcpu.h) */
+		return;
+
+#if M68KI_BLOCK_CACHE
+	m68ki_block_check_write(ADDRESS_68K(address));
+#endif
+
+#if M68K_FAST_MEMORY_MAP
+	{
+		uint8* mem = m68ki_map_write(ADDRESS_68K(address), 4);
+		if(mem != NULL)
+		{
+			m68ki_set_mem_32(mem, value);
+			return;
+		}
+	}
 #endif
 
 	m68k_write_memory_32_pd(ADDRESS_68K(address), value);
 }
 #endif
 
+#if M68KI_JIT_LOCKSTEP
+/* JIT lockstep: while a compiled block runs, data accesses are done and
+ * logged.  While the interpreter reruns it, reads are answered from the log
+ * and writes are checked against it instead of reaching memory again.
+ */
+static inline m68ki_jit_log* m68ki_jit_log_active(void)
+{
+	m68ki_block_cache* cache = m68ki_cpu.block_cache;
+	return cache != NULL && cache->jit_log.mode != M68KI_JIT_LOG_OFF ? &cache->jit_log : NULL;
+}
+
+static inline uint m68ki_jit_log_access(m68ki_jit_log* log, uint address, uint size, uint value)
+{
+	m68ki_jit_access* access;
+
+	if(log->mode == M68KI_JIT_LOG_REPLAY)
+	{
+		access = &log->access[log->pos];
+		if(log->pos >= log->count || access->address != address || access->size != size ||
+			((size & M68KI_JIT_LOG_WRITE) && access->value != value))
+		{
+			log->diverged = 1;
+			return 0;
+		}
+		log->pos++;
+		return access->value;
+	}
+	if(log->count == M68KI_JIT_LOG_SIZE)
+	{
+		log->overflow = 1;
+		return value;
+	}
+	access = &log->access[log->count++];
+	access->address = address;
+	access->size = size;
+	access->value = value;
+	return value;
+}
+
+static inline uint m68ki_jit_log_read(uint address, uint fc, uint size)
+{
+	m68ki_jit_log* log = m68ki_jit_log_active();
+	uint value;
+
+	if(log != NULL && log->mode == M68KI_JIT_LOG_REPLAY)
+		return m68ki_jit_log_access(log, address, size, 0);
+	/* The parentheses keep these from expanding to the wrappers below */
+	value = size == 1 ? (m68ki_read_8_fc)(address, fc) :
+			size == 2 ? (m68ki_read_16_fc)(address, fc) : (m68ki_read_32_fc)(address, fc);
+	return log != NULL ? m68ki_jit_log_access(log, address, size, value) : value;
+}
+
+static inline void m68ki_jit_log_write(uint address, uint fc, uint size, uint value)
+{
+	m68ki_jit_log* log = m68ki_jit_log_active();
+
+	if(log != NULL)
+	{
+		m68ki_jit_log_access(log, address, size | M68KI_JIT_LOG_WRITE, value);
+		if(log->mode == M68KI_JIT_LOG_REPLAY)
+			return;
+	}
+	if(size == 1)
+		(m68ki_write_8_fc)(address, fc, value);
+	else if(size == 2)
+		(m68ki_write_16_fc)(address, fc, value);
+#if M68K_SIMULATE_PD_WRITES
+	else if(size == 5)
+		(m68ki_write_32_pd_fc)(address, fc, value);
+#endif
+	else
+		(m68ki_write_32_fc)(address, fc, value);
+}
+
+#define m68ki_read_8_fc(A, FC)         m68ki_jit_log_read(A, FC, 1)
+#define m68ki_read_16_fc(A, FC)        m68ki_jit_log_read(A, FC, 2)
+#define m68ki_read_32_fc(A, FC)        m68ki_jit_log_read(A, FC, 4)
+#define m68ki_write_8_fc(A, FC, V)     m68ki_jit_log_write(A, FC, 1, V)
+#define m68ki_write_16_fc(A, FC, V)    m68ki_jit_log_write(A, FC, 2, V)
+#define m68ki_write_32_fc(A, FC, V)    m68ki_jit_log_write(A, FC, 4, V)
+#define m68ki_write_32_pd_fc(A, FC, V) m68ki_jit_log_write(A, FC, 5, V)
+
+/* Called by the API functions that change the core.  From a callback of a
+ * compiled block, the change is kept and the block is not checked, as the
+ * rerun would start from the state before it.
+ */
+static inline void m68ki_jit_host_change(void)
+{
+	m68ki_block_cache* cache = m68ki_cpu.block_cache;
+
+	if(cache != NULL && cache->jit_log.mode == M68KI_JIT_LOG_RECORD)
+		cache->jit_log.host_changed = 1;
+}
+#else
+#define m68ki_jit_host_change()
+#endif /* M68KI_JIT_LOCKSTEP */
+
+#if M68KI_TRACE
+/* Trace file: data accesses are added to the record of the instruction */
+static inline uint m68ki_trace_read(uint address, uint fc, uint size)
+{
+	/* The parentheses keep these from expanding to the wrappers below */
+	uint value = size == 1 ? (m68ki_read_8_fc)(address, fc) :
+				size == 2 ? (m68ki_read_16_fc)(address, fc) : (m68ki_read_32_fc)(address, fc);
+
+	/* A faulting access is left out, a longjmp() skips this too */
+	if(m68ki_cpu.trace != NULL && !m68ki_fault_pending())
+		m68ki_trace_access(address, size, value);
+	return value;
+}
+
+static inline void m68ki_trace_write(uint address, uint fc, uint size, uint value)
+{
+	if(size == 1)
+		(m68ki_write_8_fc)(address, fc, value);
+	else if(size == 2)
+		(m68ki_write_16_fc)(address, fc, value);
+#if M68K_SIMULATE_PD_WRITES
+	else if(size == 5)
+		(m68ki_write_32_pd_fc)(address, fc, value);
+#endif
+	else
+		(m68ki_write_32_fc)(address, fc, value);
+
+	if(m68ki_cpu.trace != NULL && !m68ki_fault_pending())
+		m68ki_trace_access(address, (size == 5 ? 4 : size) | M68KI_TRACE_WRITE, value);
+}
+
+#define m68ki_read_8_fc(A, FC)         m68ki_trace_read(A, FC, 1)
+#define m68ki_read_16_fc(A, FC)        m68ki_trace_read(A, FC, 2)
+#define m68ki_read_32_fc(A, FC)        m68ki_trace_read(A, FC, 4)
+#define m68ki_write_8_fc(A, FC, V)     m68ki_trace_write(A, FC, 1, V)
+#define m68ki_write_16_fc(A, FC, V)    m68ki_trace_write(A, FC, 2, V)
+#define m68ki_write_32_fc(A, FC, V)    m68ki_trace_write(A, FC, 4, V)
+#define m68ki_write_32_pd_fc(A, FC, V) m68ki_trace_write(A, FC, 5, V)
+#endif /* M68KI_TRACE */
+
+/* ---------------------------- Block Transfers --------------------------- */
+
+#if M68KI_MEMORY_BLOCKS
+/* Check that size bytes at address can go as one block: no translation, no
+ * address error, no wrap, and not partly in the fast memory map.
+ */
+static inline int m68ki_block_ok(uint address, uint size)
+{
+	if(m68ki_fault_pending()) /* auto-disable (see m68kcpu.h) */
+		return FALSE;
+#if M68K_EMULATE_PMMU
+	if(PMMU_ENABLED)
+		return FALSE;
+#endif
+	if((address & 1) && CPU_TYPE_IS_010_LESS(CPU_TYPE))
+		return FALSE;
+	return ADDRESS_68K(address) <= CPU_ADDRESS_MASK - (size - 1);
+}
+
+/* Read/write size bytes at address in one go, through the fast memory map
+ * or the host's block functions.  Returns FALSE if neither took them, and
+ * the caller then goes word by word.
+ */
+static inline int m68ki_read_block_fc(uint address, uint fc, uint8* data, uint size)
+{
+	(void)fc;
+	if(!m68ki_block_ok(address, size))
+		return FALSE;
+	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
+	m68ki_flight_access(address, fc); /* auto-disable (see m68kcpu.h) */
+	address = ADDRESS_68K(address);
+
+#if M68K_FAST_MEMORY_MAP
+	{
+		const uint8* mem = m68ki_map_read(address, size);
+		if(mem != NULL)
+		{
+			memcpy(data, mem, size);
+			return TRUE;
+		}
+		if(m68ki_map_read(address, 1) != NULL || m68ki_map_read(address + size - 1, 1) != NULL)
+			return FALSE;
+	}
+#endif
+
+	return m68k_read_memory_block(address, data, size) != 0;
+}
+
+static inline int m68ki_write_block_fc(uint address, uint fc, const uint8* data, uint size)
+{
+	(void)fc;
+	if(!m68ki_block_ok(address, size))
+		return FALSE;
+	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
+	m68ki_flight_access(address, fc); /* auto-disable (see m68kcpu.h) */
+	address = ADDRESS_68K(address);
+
+#if M68KI_BLOCK_CACHE
+	{
+		uint granule;
+
+		for(granule = address >> M68KI_BLOCK_GRANULE_SHIFT; granule <= (address + size - 1) >> M68KI_BLOCK_GRANULE_SHIFT; granule++)
+			m68ki_block_check_write(granule << M68KI_BLOCK_GRANULE_SHIFT);
+	}
+#endif
+
+#if M68K_FAST_MEMORY_MAP
+	{
+		uint8* mem = m68ki_map_write(address, size);
+		if(mem != NULL)
+		{
+			memcpy(mem, data, size);
+			return TRUE;
+		}
+		if(m68ki_map_write(address, 1) != NULL || m68ki_map_write(address + size - 1, 1) != NULL)
+			return FALSE;
+	}
+#endif
+
+	return m68k_write_memory_block(address, data, size) != 0;
+}
+
+#define m68ki_read_block(A, D, S)  m68ki_read_block_fc (A, FLAG_S | m68ki_get_address_space(), D, S)
+#define m68ki_write_block(A, D, S) m68ki_write_block_fc(A, FLAG_S | FUNCTION_CODE_USER_DATA, D, S)
+
+/* Movem as one block.  Registers in list (reversed for the predecrement
+ * form) go to or come from consecutive size-byte slots from *ea up, or
+ * from *ea down for predecrement, and *ea is moved past them.  Returns the
+ * number of registers moved, 0 if the caller must do them one by one.
+ */
+static inline uint m68ki_movem_write_block(uint* ea, uint list, uint size, int predec)
+{
+	uint8 data[64];
+	uint count = 0;
+	uint i;
+
+	for(i = 0; i < 16; i++)
+		if(list & (1 << (predec ? 15 - i : i)))
+		{
+			if(size == 2)
+				m68ki_set_mem_16(data + (count << 1), REG_DA[i]);
+			else
+				m68ki_set_mem_32(data + (count << 2), REG_DA[i]);
+			count++;
+		}
+	if(count == 0)
+		return 0;
+	if(predec)
+	{
+		if(!m68ki_write_block(*ea - count * size, data, count * size))
+			return 0;
+		*ea -= count * size;
+	}
+	else
+	{
+		if(!m68ki_write_block(*ea, data, count * size))
+			return 0;
+		*ea += count * size;
+	}
+	return count;
+}
+
+static inline uint m68ki_movem_read_block(uint* ea, uint list, uint size)
+{
+	uint8 data[64];
+	uint count = 0;
+	uint i;
+
+	for(i = 0; i < 16; i++)
+		count += (list >> i) & 1;
+	if(count == 0 || !m68ki_read_block(*ea, data, count * size))
+		return 0;
+	count = 0;
+	for(i = 0; i < 16; i++)
+		if(list & (1 << i))
+		{
+			m68ki_save_da(i);
+			if(size == 2)
+				REG_DA[i] = MAKE_INT_16(m68ki_get_mem_16(data + (count << 1)));
+			else
+				REG_DA[i] = m68ki_get_mem_32(data + (count << 2));
+			count++;
+		}
+	*ea += count * size;
+	return count;
+}
+#else
+#define m68ki_movem_write_block(EA, LIST, SIZE, PREDEC) 0 /* auto-disable (see m68kcpu.h) */
+#define m68ki_movem_read_block(EA, LIST, SIZE)          0 /* auto-disable (see m68kcpu.h) */
+#endif /* M68KI_MEMORY_BLOCKS */
+
 /* --------------------- Effective Address Calculation -------------------- */
 
 /* The program counter relative addressing modes cause operands to be
@@ -1245,10 +2468,10 @@ static inline uint m68ki_get_ea_pcdi(void)
 }
 
 
-static inline uint m68ki_get_ea_pcix(void)
+static inline uint m68ki_get_ea_pcix(uint cpu_type)
 {
 	m68ki_use_program_space(); /* auto-disable */
-	return m68ki_get_ea_ix(REG_PC);
+	return m68ki_get_ea_ix(REG_PC, cpu_type);
 }
 
 /* Indexed addressing modes are encoded as follows:
@@ -1292,8 +2515,11 @@ static inline uint m68ki_get_ea_pcix(void)
  * 1  010  mem indir with word outer
  * 1  011  mem indir with long outer
  * 1  100-111  reserved
+ *
+ * The CPU type is passed in so that handlers built for a single CPU type
+ * (see M68K_SPECIALIZED_HANDLERS) only keep the formats it decodes.
  */
-static inline uint m68ki_get_ea_ix(uint An)
+static inline uint m68ki_get_ea_ix(uint An, uint cpu_type)
 {
 	/* An = base register */
 	uint extension = m68ki_read_imm_16();
@@ -1301,7 +2527,7 @@ static inline uint m68ki_get_ea_ix(uint An)
 	uint bd = 0;                        /* Base Displacement */
 	uint od = 0;                        /* Outer Displacement */
 
-	if(CPU_TYPE_IS_010_LESS(CPU_TYPE))
+	if(CPU_TYPE_IS_010_LESS(cpu_type))
 	{
 		/* Calculate index */
 		Xn = REG_DA[extension>>12];     /* Xn */
@@ -1320,7 +2546,7 @@ static inline uint m68ki_get_ea_ix(uint An)
 		if(!BIT_B(extension))           /* W/L */
 			Xn = MAKE_INT_16(Xn);
 		/* Add scale if proper CPU type */
-		if(CPU_TYPE_IS_EC020_PLUS(CPU_TYPE))
+		if(CPU_TYPE_IS_EC020_PLUS(cpu_type))
 			Xn <<= (extension>>9) & 3;  /* SCALE */
 
 		/* Add base register and displacement and return */
@@ -1378,9 +2604,12 @@ static inline uint OPER_AY_PD_32(void) {uint ea = EA_AY_PD_32(); return m68ki_re
 static inline uint OPER_AY_DI_8(void)  {uint ea = EA_AY_DI_8();  return m68ki_read_8(ea); }
 static inline uint OPER_AY_DI_16(void) {uint ea = EA_AY_DI_16(); return m68ki_read_16(ea);}
 static inline uint OPER_AY_DI_32(void) {uint ea = EA_AY_DI_32(); return m68ki_read_32(ea);}
-static inline uint OPER_AY_IX_8(void)  {uint ea = EA_AY_IX_8();  return m68ki_read_8(ea); }
-static inline uint OPER_AY_IX_16(void) {uint ea = EA_AY_IX_16(); return m68ki_read_16(ea);}
-static inline uint OPER_AY_IX_32(void) {uint ea = EA_AY_IX_32(); return m68ki_read_32(ea);}
+static inline uint m68ki_oper_ay_ix_8(uint cpu_type)  {uint ea = m68ki_get_ea_ix(AY, cpu_type); return m68ki_read_8(ea); }
+static inline uint m68ki_oper_ay_ix_16(uint cpu_type) {uint ea = m68ki_get_ea_ix(AY, cpu_type); return m68ki_read_16(ea);}
+static inline uint m68ki_oper_ay_ix_32(uint cpu_type) {uint ea = m68ki_get_ea_ix(AY, cpu_type); return m68ki_read_32(ea);}
+#define OPER_AY_IX_8()  m68ki_oper_ay_ix_8(CPU_TYPE)
+#define OPER_AY_IX_16() m68ki_oper_ay_ix_16(CPU_TYPE)
+#define OPER_AY_IX_32() m68ki_oper_ay_ix_32(CPU_TYPE)
 
 static inline uint OPER_AX_AI_8(void)  {uint ea = EA_AX_AI_8();  return m68ki_read_8(ea); }
 static inline uint OPER_AX_AI_16(void) {uint ea = EA_AX_AI_16(); return m68ki_read_16(ea);}
@@ -1394,9 +2623,12 @@ static inline uint OPER_AX_PD_32(void) {uint ea = EA_AX_PD_32(); return m68ki_re
 static inline uint OPER_AX_DI_8(void)  {uint ea = EA_AX_DI_8();  return m68ki_read_8(ea); }
 static inline uint OPER_AX_DI_16(void) {uint ea = EA_AX_DI_16(); return m68ki_read_16(ea);}
 static inline uint OPER_AX_DI_32(void) {uint ea = EA_AX_DI_32(); return m68ki_read_32(ea);}
-static inline uint OPER_AX_IX_8(void)  {uint ea = EA_AX_IX_8();  return m68ki_read_8(ea); }
-static inline uint OPER_AX_IX_16(void) {uint ea = EA_AX_IX_16(); return m68ki_read_16(ea);}
-static inline uint OPER_AX_IX_32(void) {uint ea = EA_AX_IX_32(); return m68ki_read_32(ea);}
+static inline uint m68ki_oper_ax_ix_8(uint cpu_type)  {uint ea = m68ki_get_ea_ix(AX, cpu_type); return m68ki_read_8(ea); }
+static inline uint m68ki_oper_ax_ix_16(uint cpu_type) {uint ea = m68ki_get_ea_ix(AX, cpu_type); return m68ki_read_16(ea);}
+static inline uint m68ki_oper_ax_ix_32(uint cpu_type) {uint ea = m68ki_get_ea_ix(AX, cpu_type); return m68ki_read_32(ea);}
+#define OPER_AX_IX_8()  m68ki_oper_ax_ix_8(CPU_TYPE)
+#define OPER_AX_IX_16() m68ki_oper_ax_ix_16(CPU_TYPE)
+#define OPER_AX_IX_32() m68ki_oper_ax_ix_32(CPU_TYPE)
 
 static inline uint OPER_A7_PI_8(void)  {uint ea = EA_A7_PI_8();  return m68ki_read_8(ea); }
 static inline uint OPER_A7_PD_8(void)  {uint ea = EA_A7_PD_8();  return m68ki_read_8(ea); }
@@ -1410,35 +2642,136 @@ static inline uint OPER_AL_32(void)    {uint ea = EA_AL_32();    return m68ki_re
 static inline uint OPER_PCDI_8(void)   {uint ea = EA_PCDI_8();   return m68ki_read_pcrel_8(ea); }
 static inline uint OPER_PCDI_16(void)  {uint ea = EA_PCDI_16();  return m68ki_read_pcrel_16(ea);}
 static inline uint OPER_PCDI_32(void)  {uint ea = EA_PCDI_32();  return m68ki_read_pcrel_32(ea);}
-static inline uint OPER_PCIX_8(void)   {uint ea = EA_PCIX_8();   return m68ki_read_pcrel_8(ea); }
-static inline uint OPER_PCIX_16(void)  {uint ea = EA_PCIX_16();  return m68ki_read_pcrel_16(ea);}
-static inline uint OPER_PCIX_32(void)  {uint ea = EA_PCIX_32();  return m68ki_read_pcrel_32(ea);}
+static inline uint m68ki_oper_pcix_8(uint cpu_type)  {uint ea = m68ki_get_ea_pcix(cpu_type); return m68ki_read_pcrel_8(ea); }
+static inline uint m68ki_oper_pcix_16(uint cpu_type) {uint ea = m68ki_get_ea_pcix(cpu_type); return m68ki_read_pcrel_16(ea);}
+static inline uint m68ki_oper_pcix_32(uint cpu_type) {uint ea = m68ki_get_ea_pcix(cpu_type); return m68ki_read_pcrel_32(ea);}
+#define OPER_PCIX_8()   m68ki_oper_pcix_8(CPU_TYPE)
+#define OPER_PCIX_16()  m68ki_oper_pcix_16(CPU_TYPE)
+#define OPER_PCIX_32()  m68ki_oper_pcix_32(CPU_TYPE)
 
 
 
 /* ---------------------------- Stack Functions --------------------------- */
 
+#if M68KI_MEMORY_BLOCKS
+/* Exception stack frames are gathered while they are built and then stored
+ * with one block write, or push by push in the original order if the block
+ * is declined.  Not with an odd SP or the PMMU on, so that any address or
+ * bus error still comes from the first push with SP where it was.
+ */
+static inline void m68ki_frame_flush(void)
+{
+	m68ki_frame_push* frame = m68ki_cpu.frame;
+	uint count = m68ki_cpu.frame_pushes;
+	uint open = m68ki_cpu.frame_open;
+	uint8 data[M68KI_FRAME_BYTES];
+	uint size = 0;
+	uint i;
+
+	if(count == 0)
+		return;
+	m68ki_cpu.frame_pushes = 0;
+	m68ki_cpu.frame_bytes = 0;
+	for(i = count; i-- > 0;)
+	{
+		if(frame[i].size == 2)
+			m68ki_set_mem_16(data + size, frame[i].value);
+		else
+			m68ki_set_mem_32(data + size, frame[i].value);
+		size += frame[i].size;
+	}
+	if(count > 1 && m68ki_write_block(frame[count-1].address, data, size))
+		return;
+	/* Nothing is gathered while the pushes are written */
+	m68ki_cpu.frame_open = 0;
+	for(i = 0; i < count; i++)
+	{
+		if(frame[i].size == 2)
+			m68ki_write_16(frame[i].address, frame[i].value);
+		else
+			m68ki_write_32(frame[i].address, frame[i].value);
+	}
+	m68ki_cpu.frame_open = open;
+}
+
+static inline void m68ki_frame_begin(void)
+{
+	m68ki_cpu.frame_pushes = 0;
+	m68ki_cpu.frame_bytes = 0;
+	m68ki_cpu.frame_open = !(REG_SP & 1);
+#if M68K_EMULATE_PMMU
+	if(PMMU_ENABLED)
+		m68ki_cpu.frame_open = 0;
+#endif
+}
+
+static inline void m68ki_frame_end(void)
+{
+	m68ki_cpu.frame_open = 0;
+	m68ki_frame_flush();
+}
+
+/* Gather a push that was already taken off SP.  A gap left by a fake push
+ * or a full buffer stores what was gathered so far.
+ */
+static inline void m68ki_frame_add(uint size, uint value)
+{
+	m68ki_frame_push* push;
+
+	if(m68ki_cpu.frame_pushes != 0 &&
+		(m68ki_cpu.frame_bytes + size > M68KI_FRAME_BYTES || m68ki_cpu.frame_pushes == M68KI_FRAME_PUSHES ||
+		m68ki_cpu.frame[m68ki_cpu.frame_pushes-1].address != MASK_OUT_ABOVE_32(REG_SP + size)))
+		m68ki_frame_flush();
+	push = &m68ki_cpu.frame[m68ki_cpu.frame_pushes++];
+	push->address = REG_SP;
+	push->size = size;
+	push->value = value;
+	m68ki_cpu.frame_bytes += size;
+}
+#else
+#define m68ki_frame_begin() /* auto-disable (see m68kcpu.h) */
+#define m68ki_frame_end()   /* auto-disable (see m68kcpu.h) */
+#endif /* M68KI_MEMORY_BLOCKS */
+
 /* Push/pull data from the stack */
 static inline void m68ki_push_16(uint value)
 {
+	m68ki_save_sp();
 	REG_SP = MASK_OUT_ABOVE_32(REG_SP - 2);
+#if M68KI_MEMORY_BLOCKS
+	if(m68ki_cpu.frame_open)
+	{
+		m68ki_frame_add(2, value);
+		return;
+	}
+#endif
 	m68ki_write_16(REG_SP, value);
 }
 
 static inline void m68ki_push_32(uint value)
 {
+	m68ki_save_sp();
 	REG_SP = MASK_OUT_ABOVE_32(REG_SP - 4);
+#if M68KI_MEMORY_BLOCKS
+	if(m68ki_cpu.frame_open)
+	{
+		m68ki_frame_add(4, value);
+		return;
+	}
+#endif
 	m68ki_write_32(REG_SP, value);
 }
 
 static inline uint m68ki_pull_16(void)
 {
+	m68ki_save_sp();
 	REG_SP = MASK_OUT_ABOVE_32(REG_SP + 2);
 	return m68ki_read_16(REG_SP-2);
 }
 
 static inline uint m68ki_pull_32(void)
 {
+	m68ki_save_sp();
 	REG_SP = MASK_OUT_ABOVE_32(REG_SP + 4);
 	return m68ki_read_32(REG_SP-4);
 }
@@ -1449,21 +2782,25 @@ static inline uint m68ki_pull_32(void)
  */
 static inline void m68ki_fake_push_16(void)
 {
+	m68ki_save_sp();
 	REG_SP = MASK_OUT_ABOVE_32(REG_SP - 2);
 }
 
 static inline void m68ki_fake_push_32(void)
 {
+	m68ki_save_sp();
 	REG_SP = MASK_OUT_ABOVE_32(REG_SP - 4);
 }
 
 static inline void m68ki_fake_pull_16(void)
 {
+	m68ki_save_sp();
 	REG_SP = MASK_OUT_ABOVE_32(REG_SP + 2);
 }
 
 static inline void m68ki_fake_pull_32(void)
 {
+	m68ki_save_sp();
 	REG_SP = MASK_OUT_ABOVE_32(REG_SP + 4);
 }
 
@@ -1482,9 +2819,11 @@ static inline void m68ki_jump(uint new_pc)
 
 static inline void m68ki_jump_vector(uint vector)
 {
+	m68ki_profile_count(vectors, vector); /* auto-disable (see m68kcpu.h) */
 	REG_PC = (vector<<2) + REG_VBR;
 	REG_PC = m68ki_read_data_32(REG_PC);
 	m68ki_pc_changed(REG_PC);
+	m68ki_call_exception(); /* auto-disable (see m68kcpu.h) */
 }
 
 
@@ -1521,6 +2860,7 @@ static inline void m68ki_set_s_flag(uint value)
 	/* Set the S flag */
 	FLAG_S = value;
 	/* Set the new stack pointer */
+	m68ki_save_sp();
 	REG_SP = REG_SP_BASE[FLAG_S | ((FLAG_S>>1) & FLAG_M)];
 }
 
@@ -1535,6 +2875,7 @@ static inline void m68ki_set_sm_flag(uint value)
 	FLAG_S = value & SFLAG_SET;
 	FLAG_M = value & MFLAG_SET;
 	/* Set the new stack pointer */
+	m68ki_save_sp();
 	REG_SP = REG_SP_BASE[FLAG_S | ((FLAG_S>>1) & FLAG_M)];
 }
 
@@ -1555,8 +2896,115 @@ static inline void m68ki_set_ccr(uint value)
 	FLAG_Z = !BIT_2(value);
 	FLAG_V = BIT_1(value)  << 6;
 	FLAG_C = BIT_0(value)  << 8;
+#if M68K_LAZY_FLAGS
+	FLAGS_OP = M68KI_FLAGS_DONE;
+#endif
+}
+
+/* Set the flags of a move or logical operation: N and Z from the result,
+ * V and C clear.  X is not affected.
+ */
+static inline void m68ki_set_logic_flags(uint op, uint res)
+{
+#if M68K_LAZY_FLAGS
+	FLAGS_OP  = op;
+	FLAGS_RES = res;
+#else
+	FLAG_N = op == M68KI_FLAGS_LOGIC_8 ? NFLAG_8(res) : op == M68KI_FLAGS_LOGIC_16 ? NFLAG_16(res) : NFLAG_32(res);
+	FLAG_Z = res;
+	FLAG_V = VFLAG_CLEAR;
+	FLAG_C = CFLAG_CLEAR;
+#endif
+}
+
+#define m68ki_set_logic_flags_8(R)  m68ki_set_logic_flags(M68KI_FLAGS_LOGIC_8, R)
+#define m68ki_set_logic_flags_16(R) m68ki_set_logic_flags(M68KI_FLAGS_LOGIC_16, R)
+#define m68ki_set_logic_flags_32(R) m68ki_set_logic_flags(M68KI_FLAGS_LOGIC_32, R)
+
+/* Set the flags of an add.  X is set right away, as it outlives the other
+ * flags.
+ */
+static inline void m68ki_set_add_flags(uint op, uint src, uint dst, uint res)
+{
+	uint carry = op == M68KI_FLAGS_ADD_8 ? CFLAG_8(res) : op == M68KI_FLAGS_ADD_16 ? CFLAG_16(res) : CFLAG_ADD_32(src, dst, res);
+
+#if M68K_LAZY_FLAGS
+	FLAG_X    = carry;
+	FLAGS_OP  = op;
+	FLAGS_SRC = src;
+	FLAGS_DST = dst;
+	FLAGS_RES = res;
+#else
+	switch(op)
+	{
+		case M68KI_FLAGS_ADD_8:
+			FLAG_N = NFLAG_8(res);
+			FLAG_V = VFLAG_ADD_8(src, dst, res);
+			FLAG_Z = MASK_OUT_ABOVE_8(res);
+			break;
+		case M68KI_FLAGS_ADD_16:
+			FLAG_N = NFLAG_16(res);
+			FLAG_V = VFLAG_ADD_16(src, dst, res);
+			FLAG_Z = MASK_OUT_ABOVE_16(res);
+			break;
+		default:
+			FLAG_N = NFLAG_32(res);
+			FLAG_V = VFLAG_ADD_32(src, dst, res);
+			FLAG_Z = MASK_OUT_ABOVE_32(res);
+			break;
+	}
+	FLAG_X = FLAG_C = carry;
+#endif
 }
 
+#define m68ki_set_add_flags_8(S, D, R)  m68ki_set_add_flags(M68KI_FLAGS_ADD_8, S, D, R)
+#define m68ki_set_add_flags_16(S, D, R) m68ki_set_add_flags(M68KI_FLAGS_ADD_16, S, D, R)
+#define m68ki_set_add_flags_32(S, D, R) m68ki_set_add_flags(M68KI_FLAGS_ADD_32, S, D, R)
+
+/* Set the flags of a compare (without X) or a subtract (with X) */
+static inline void m68ki_set_sub_flags(uint op, uint src, uint dst, uint res, uint set_x)
+{
+#if M68K_LAZY_FLAGS
+	if(set_x)
+		FLAG_X = op == M68KI_FLAGS_SUB_8 ? CFLAG_8(res) : op == M68KI_FLAGS_SUB_16 ? CFLAG_16(res) : CFLAG_SUB_32(src, dst, res);
+	FLAGS_OP  = op;
+	FLAGS_SRC = src;
+	FLAGS_DST = dst;
+	FLAGS_RES = res;
+#else
+	switch(op)
+	{
+		case M68KI_FLAGS_SUB_8:
+			FLAG_N = NFLAG_8(res);
+			FLAG_V = VFLAG_SUB_8(src, dst, res);
+			FLAG_C = CFLAG_8(res);
+			FLAG_Z = MASK_OUT_ABOVE_8(res);
+			break;
+		case M68KI_FLAGS_SUB_16:
+			FLAG_N = NFLAG_16(res);
+			FLAG_V = VFLAG_SUB_16(src, dst, res);
+			FLAG_C = CFLAG_16(res);
+			FLAG_Z = MASK_OUT_ABOVE_16(res);
+			break;
+		default:
+			FLAG_N = NFLAG_32(res);
+			FLAG_V = VFLAG_SUB_32(src, dst, res);
+			FLAG_C = CFLAG_SUB_32(src, dst, res);
+			FLAG_Z = MASK_OUT_ABOVE_32(res);
+			break;
+	}
+	if(set_x)
+		FLAG_X = FLAG_C;
+#endif
+}
+
+#define m68ki_set_sub_flags_8(S, D, R)  m68ki_set_sub_flags(M68KI_FLAGS_SUB_8, S, D, R, 1)
+#define m68ki_set_sub_flags_16(S, D, R) m68ki_set_sub_flags(M68KI_FLAGS_SUB_16, S, D, R, 1)
+#define m68ki_set_sub_flags_32(S, D, R) m68ki_set_sub_flags(M68KI_FLAGS_SUB_32, S, D, R, 1)
+#define m68ki_set_cmp_flags_8(S, D, R)  m68ki_set_sub_flags(M68KI_FLAGS_SUB_8, S, D, R, 0)
+#define m68ki_set_cmp_flags_16(S, D, R) m68ki_set_sub_flags(M68KI_FLAGS_SUB_16, S, D, R, 0)
+#define m68ki_set_cmp_flags_32(S, D, R) m68ki_set_sub_flags(M68KI_FLAGS_SUB_32, S, D, R, 0)
+
 /* Set the status register but don't check for interrupts */
 static inline void m68ki_set_sr_noint(uint value)
 {
@@ -1615,8 +3063,10 @@ static inline uint m68ki_init_exception(void)
 /* 3 word stack frame (68000 only) */
 static inline void m68ki_stack_frame_3word(uint pc, uint sr)
 {
+	m68ki_frame_begin();
 	m68ki_push_32(pc);
 	m68ki_push_16(sr);
+	m68ki_frame_end();
 }
 
 /* Format 0 stack frame.
@@ -1630,9 +3080,11 @@ static inline void m68ki_stack_frame_0000(uint pc, uint sr, uint vector)
 		m68ki_stack_frame_3word(pc, sr);
 		return;
 	}
+	m68ki_frame_begin();
 	m68ki_push_16(vector<<2);
 	m68ki_push_32(pc);
 	m68ki_push_16(sr);
+	m68ki_frame_end();
 }
 
 /* Format 1 stack frame (68020).
@@ -1640,9 +3092,11 @@ static inline void m68ki_stack_frame_0000(uint pc, uint sr, uint vector)
  */
 static inline void m68ki_stack_frame_0001(uint pc, uint sr, uint vector)
 {
+	m68ki_frame_begin();
 	m68ki_push_16(0x1000 | (vector<<2));
 	m68ki_push_32(pc);
 	m68ki_push_16(sr);
+	m68ki_frame_end();
 }
 
 /* Format 2 stack frame.
@@ -1650,10 +3104,12 @@ static inline void m68ki_stack_frame_0001(uint pc, uint sr, uint vector)
  */
 static inline void m68ki_stack_frame_0010(uint sr, uint vector)
 {
+	m68ki_frame_begin();
 	m68ki_push_32(REG_PPC);
 	m68ki_push_16(0x2000 | (vector<<2));
 	m68ki_push_32(REG_PC);
 	m68ki_push_16(sr);
+	m68ki_frame_end();
 }
 
 
@@ -1661,6 +3117,7 @@ static inline void m68ki_stack_frame_0010(uint sr, uint vector)
  */
 static inline void m68ki_stack_frame_buserr(uint sr)
 {
+	m68ki_frame_begin();
 	m68ki_push_32(REG_PC);
 	m68ki_push_16(sr);
 	m68ki_push_16(REG_IR);
@@ -1671,6 +3128,7 @@ static inline void m68ki_stack_frame_buserr(uint sr)
 	 * FC   3-bit function code
 	 */
 	m68ki_push_16(m68ki_aerr_write_mode | CPU_INSTR_MODE | m68ki_aerr_fc);
+	m68ki_frame_end();
 }
 
 /* Format 8 stack frame (68010).
@@ -1678,6 +3136,7 @@ static inline void m68ki_stack_frame_buserr(uint sr)
  */
 static inline void m68ki_stack_frame_1000(uint pc, uint sr, uint vector)
 {
+	m68ki_frame_begin();
 	/* VERSION
 	 * NUMBER
 	 * INTERNAL INFORMATION, 16 WORDS
@@ -1723,6 +3182,7 @@ static inline void m68ki_stack_frame_1000(uint pc, uint sr, uint vector)
 
 	/* STATUS REGISTER */
 	m68ki_push_16(sr);
+	m68ki_frame_end();
 }
 
 /* Format A stack frame (short bus fault).
@@ -1732,6 +3192,7 @@ static inline void m68ki_stack_frame_1000(uint pc, uint sr, uint vector)
  */
 static inline void m68ki_stack_frame_1010(uint sr, uint vector, uint pc)
 {
+	m68ki_frame_begin();
 	/* INTERNAL REGISTER */
 	m68ki_push_16(0);
 
@@ -1770,6 +3231,7 @@ static inline void m68ki_stack_frame_1010(uint sr, uint vector, uint pc)
 
 	/* STATUS REGISTER */
 	m68ki_push_16(sr);
+	m68ki_frame_end();
 }
 
 /* Format B stack frame (long bus fault).
@@ -1777,8 +3239,9 @@ static inline void m68ki_stack_frame_1010(uint sr, uint vector, uint pc)
  * if the error happens during instruction execution.
  * PC stacked is address of instruction in progress.
  */
-static inline void m68ki_stack_frame_1011(uint sr, uint vector, uint pc)
+static inline void m68ki_stack_frame_1011(uint sr, uint vector, uint pc, uint fault_address, uint ssw)
 {
+	m68ki_frame_begin();
 	/* INTERNAL REGISTERS (18 words) */
 	m68ki_push_32(0);
 	m68ki_push_32(0);
@@ -1804,7 +3267,7 @@ static inline void m68ki_stack_frame_1011(uint sr, uint vector, uint pc)
 	m68ki_push_32(0);
 
 	/* STAGE B ADDRESS (2 words) */
-	m68ki_push_32(0);
+	m68ki_push_32(fault_address);
 
 	/* INTERNAL REGISTER (4 words) */
 	m68ki_push_32(0);
@@ -1820,7 +3283,7 @@ static inline void m68ki_stack_frame_1011(uint sr, uint vector, uint pc)
 	m68ki_push_16(0);
 
 	/* DATA CYCLE FAULT ADDRESS (2 words) */
-	m68ki_push_32(0);
+	m68ki_push_32(fault_address);
 
 	/* INSTRUCTION PIPE STAGE B */
 	m68ki_push_16(0);
@@ -1829,7 +3292,7 @@ static inline void m68ki_stack_frame_1011(uint sr, uint vector, uint pc)
 	m68ki_push_16(0);
 
 	/* SPECIAL STATUS REGISTER */
-	m68ki_push_16(0);
+	m68ki_push_16(ssw);
 
 	/* INTERNAL REGISTER */
 	m68ki_push_16(0);
@@ -1842,6 +3305,53 @@ static inline void m68ki_stack_frame_1011(uint sr, uint vector, uint pc)
 
 	/* STATUS REGISTER */
 	m68ki_push_16(sr);
+	m68ki_frame_end();
+}
+
+
+/* Format 7 stack frame (access error).
+ * 68040 only.  The write-back slots are always left empty: the faulting
+ * instruction is restarted from the stacked PC after RTE.
+ */
+static inline void m68ki_stack_frame_0111(uint sr, uint vector, uint pc, uint fault_address, uint ssw)
+{
+	m68ki_frame_begin();
+	/* PUSH DATA LW 3-1, WRITE-BACK 1 DATA/PUSH DATA LW 0 */
+	m68ki_push_32(0);
+	m68ki_push_32(0);
+	m68ki_push_32(0);
+	m68ki_push_32(0);
+
+	/* WRITE-BACK 1-3 ADDRESS AND DATA */
+	m68ki_push_32(0);
+	m68ki_push_32(0);
+	m68ki_push_32(0);
+	m68ki_push_32(0);
+	m68ki_push_32(0);
+
+	/* FAULT ADDRESS */
+	m68ki_push_32(fault_address);
+
+	/* WRITE-BACK 1-3 STATUS */
+	m68ki_push_16(0);
+	m68ki_push_16(0);
+	m68ki_push_16(0);
+
+	/* SPECIAL STATUS WORD */
+	m68ki_push_16(ssw);
+
+	/* EFFECTIVE ADDRESS */
+	m68ki_push_32(fault_address);
+
+	/* 0111, VECTOR OFFSET */
+	m68ki_push_16(0x7000 | (vector<<2));
+
+	/* PROGRAM COUNTER */
+	m68ki_push_32(pc);
+
+	/* STATUS REGISTER */
+	m68ki_push_16(sr);
+	m68ki_frame_end();
 }
 
 
@@ -1860,7 +3370,7 @@ static inline void m68ki_exception_trap(uint vector)
 	m68ki_jump_vector(vector);
 
 	/* Use up some clock cycles and undo the instruction's cycles */
-	USE_CYCLES(CYC_EXCEPTION[vector] - CYC_INSTRUCTION[REG_IR]);
+	USE_CYCLES(CYC_EXCEPTION[vector] - CYC_OPCODE(REG_IR));
 }
 
 /* Trap#n stacks a 0 frame but behaves like group2 otherwise */
@@ -1880,7 +3390,7 @@ static inline void m68ki_exception_trapN(uint vector)
 	m68ki_jump_vector(vector);
 
 	/* Use up some clock cycles and undo the instruction's cycles */
-	USE_CYCLES(CYC_EXCEPTION[vector] - CYC_INSTRUCTION[REG_IR]);
+	USE_CYCLES(CYC_EXCEPTION[vector] - CYC_OPCODE(REG_IR));
 }
 
 /* Exception for trace mode */
@@ -1926,12 +3436,14 @@ static inline void m68ki_exception_privilege_violation(void)
 	m68ki_jump_vector(EXCEPTION_PRIVILEGE_VIOLATION);
 
 	/* Use up some clock cycles and undo the instruction's cycles */
-	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_PRIVILEGE_VIOLATION] - CYC_INSTRUCTION[REG_IR]);
+	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_PRIVILEGE_VIOLATION] - CYC_OPCODE(REG_IR));
 }
 
-extern jmp_buf m68ki_bus_error_jmp_buf;
-
+#if M68KI_PENDING_FAULTS
+#define m68ki_check_bus_error_trap()
+#else
 #define m68ki_check_bus_error_trap() setjmp(m68ki_bus_error_jmp_buf)
+#endif
 
 /* Exception for bus error */
 static inline void m68ki_exception_bus_error(void)
@@ -1951,22 +3463,36 @@ static inline void m68ki_exception_bus_error(void)
 	CPU_RUN_MODE = RUN_MODE_BERR_AERR_RESET_WSF;
 
 	/* Use up some clock cycles and undo the instruction's cycles */
-	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_BUS_ERROR] - CYC_INSTRUCTION[REG_IR]);
+	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_BUS_ERROR] - CYC_OPCODE(REG_IR));
 
-	for (i = 15; i >= 0; i--){
-		REG_DA[i] = REG_DA_SAVE[i];
-	}
+	/* Undo any register changes made by the faulting instruction */
+	for (i = 15; i >= 0; i--)
+		if(m68ki_cpu.dar_save_mask & (1 << i))
+			REG_DA[i] = REG_DA_SAVE[i];
+	m68ki_cpu.dar_save_mask = 0;
 
 	uint sr = m68ki_init_exception();
 
-	/* Note: This is implemented for 68010 only! */
-	m68ki_stack_frame_1000(REG_PPC, sr, EXCEPTION_BUS_ERROR);
+	/* MMU faults know their access, and restart the instruction after RTE.
+	 * A bus error from the host does not say which access it was for.
+	 */
+	if(m68ki_cpu.berr_mmu && CPU_TYPE_IS_040_PLUS(CPU_TYPE))
+		m68ki_stack_frame_0111(sr, EXCEPTION_BUS_ERROR, REG_PPC, m68ki_cpu.berr_address, m68ki_cpu.berr_ssw);
+	else if(m68ki_cpu.berr_mmu && CPU_TYPE_IS_EC020_PLUS(CPU_TYPE))
+		m68ki_stack_frame_1011(sr, EXCEPTION_BUS_ERROR, REG_PPC, m68ki_cpu.berr_address, m68ki_cpu.berr_ssw);
+	else
+		m68ki_stack_frame_1000(REG_PPC, sr, EXCEPTION_BUS_ERROR);
+	m68ki_cpu.berr_mmu = 0;
 
 	m68ki_jump_vector(EXCEPTION_BUS_ERROR);
 
 	CPU_RUN_MODE = RUN_MODE_BERR_AERR_RESET;
 
+#if !M68KI_PENDING_FAULTS
+	/* The longjmp skips m68ki_end_instruction(), charge the instruction here */
+	m68ki_profile_end(); /* auto-disable (see m68kcpu.h) */
 	longjmp(m68ki_bus_error_jmp_buf, 1);
+#endif
 }
 
 extern int cpu_log_enabled;
@@ -1986,7 +3512,7 @@ static inline void m68ki_exception_1010(void)
 	m68ki_jump_vector(EXCEPTION_1010);
 
 	/* Use up some clock cycles and undo the instruction's cycles */
-	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_1010] - CYC_INSTRUCTION[REG_IR]);
+	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_1010] - CYC_OPCODE(REG_IR));
 }
 
 /* Exception for F-Line instructions */
@@ -2005,7 +3531,7 @@ static inline void m68ki_exception_1111(void)
 	m68ki_jump_vector(EXCEPTION_1111);
 
 	/* Use up some clock cycles and undo the instruction's cycles */
-	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_1111] - CYC_INSTRUCTION[REG_IR]);
+	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_1111] - CYC_OPCODE(REG_IR));
 }
 
 #if M68K_ILLG_HAS_CALLBACK == M68K_OPT_SPECIFY_HANDLER
@@ -2040,7 +3566,7 @@ static inline void m68ki_exception_illegal(void)
 	m68ki_jump_vector(EXCEPTION_ILLEGAL_INSTRUCTION);
 
 	/* Use up some clock cycles and undo the instruction's cycles */
-	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_ILLEGAL_INSTRUCTION] - CYC_INSTRUCTION[REG_IR]);
+	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_ILLEGAL_INSTRUCTION] - CYC_OPCODE(REG_IR));
 }
 
 /* Exception for format errror in RTE */
@@ -2051,7 +3577,7 @@ static inline void m68ki_exception_format_error(void)
 	m68ki_jump_vector(EXCEPTION_FORMAT_ERROR);
 
 	/* Use up some clock cycles and undo the instruction's cycles */
-	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_FORMAT_ERROR] - CYC_INSTRUCTION[REG_IR]);
+	USE_CYCLES(CYC_EXCEPTION[EXCEPTION_FORMAT_ERROR] - CYC_OPCODE(REG_IR));
 }
 
 /* Exception for address error */
@@ -2126,6 +3652,7 @@ static inline void m68ki_exception_interrupt(uint int_level)
 
 	/* Start exception processing */
 	sr = m68ki_init_exception();
+	m68ki_profile_count(vectors, vector); /* auto-disable (see m68kcpu.h) */
 
 	/* Set the interrupt mask to the level of the one being serviced */
 	FLAG_INT_MASK = int_level<<8;
@@ -2148,6 +3675,7 @@ static inline void m68ki_exception_interrupt(uint int_level)
 	}
 
 	m68ki_jump(new_pc);
+	m68ki_call_exception(); /* auto-disable (see m68kcpu.h) */
 
 	/* Defer cycle counting until later */
 	USE_CYCLES(CYC_EXCEPTION[vector]);
@@ -2171,6 +3699,85 @@ static inline void m68ki_check_interrupts(void)
 		m68ki_exception_interrupt(CPU_INT_LEVEL>>8);
 }
 
+
+/* ------------------------- Instruction Sequencing ----------------------- */
+
+#if M68KI_PROFILE_CHARGE
+/* Charge an instruction to the handler of REG_IR and the running function */
+static inline void m68ki_profile_charge(uint cycles)
+{
+#if M68K_PROFILE
+	uint index = m68ki_instruction_index_table[MASK_OUT_ABOVE_16(REG_IR)];
+
+	m68ki_cpu.profile.count[index]++;
+	m68ki_cpu.profile.cycles[index] += cycles;
+#endif /* M68K_PROFILE */
+#if M68K_CALL_GRAPH
+	m68ki_cpu.calls.frame[m68ki_cpu.calls.depth - 1].self += cycles;
+#endif /* M68K_CALL_GRAPH */
+#if M68K_FLIGHT_RECORDER
+	{
+		m68k_flight_record* record = &m68ki_cpu.flight[m68ki_cpu.flight_next++ % M68K_FLIGHT_RECORDS];
+
+		record->pc = REG_PPC;
+		record->ir = REG_IR;
+		record->cycles = cycles;
+#if M68K_FLIGHT_ADDRESSES
+		record->address = m68ki_cpu.flight_address;
+#endif /* M68K_FLIGHT_ADDRESSES */
+	}
+#endif /* M68K_FLIGHT_RECORDER */
+#if M68KI_TRACE
+	if(m68ki_cpu.trace != NULL)
+		m68ki_trace_instruction(cycles);
+#endif /* M68KI_TRACE */
+}
+#endif /* M68KI_PROFILE_CHARGE */
+
+/* Bookkeeping done around every instruction, shared by m68k_execute() and
+ * the threaded core.
+ */
+M68KI_FORCE_INLINE void m68ki_begin_instruction(void)
+{
+	/* Set tracing accodring to T1. (T0 is done inside instruction) */
+	m68ki_trace_t1(); /* auto-disable (see m68kcpu.h) */
+
+	/* Set the address space for reads */
+	m68ki_use_data_space(); /* auto-disable (see m68kcpu.h) */
+
+	/* Call external hook to peek at CPU */
+	m68ki_instr_hook(REG_PC); /* auto-disable (see m68kcpu.h) */
+
+	m68ki_profile_begin(); /* auto-disable (see m68kcpu.h) */
+	m68ki_flight_begin(); /* auto-disable (see m68kcpu.h) */
+
+	/* Record previous program counter */
+	REG_PPC = REG_PC;
+
+	/* Start a new register journal (in case of bus error) */
+	m68ki_cpu.dar_save_mask = 0;
+}
+
+M68KI_FORCE_INLINE void m68ki_end_instruction(void)
+{
+#if M68KI_PENDING_FAULTS
+	/* The faulting instruction's cycles are not charged */
+	if(m68ki_cpu.fault_pending)
+	{
+		m68ki_take_fault();
+		m68ki_profile_end(); /* auto-disable (see m68kcpu.h) */
+		return;
+	}
+#endif /* M68KI_PENDING_FAULTS */
+
+	USE_CYCLES(CYC_OPCODE(REG_IR));
+
+	/* Trace m68k_exception, if necessary */
+	m68ki_exception_if_trace(); /* auto-disable (see m68kcpu.h) */
+
+	m68ki_profile_end(); /* auto-disable (see m68kcpu.h) */
+}
+
 /* Helper to load a bitfield from EA */
 typedef struct {
 	uint32 field;
@@ -2202,6 +3809,15 @@ static inline m68ki_bitfield_t m68ki_load_bitfield(uint32 addr, unsigned offset,
 	unsigned bcount = (offset + width + 7) / 8;
 	assert(bcount <= 5 && bcount > 0);
 
+#if M68KI_MEMORY_BLOCKS
+	/* Odd sizes take two reads otherwise */
+	if (bcount == 3 || bcount == 5) {
+		uint8 data[5] = {0};
+		if (m68ki_read_block(addr, data, bcount))
+			return m68ki_make_bf(m68ki_get_mem_32(data), data[4], offset);
+	}
+#endif
+
 	if (bcount == 1) {
 		uint8 lo = m68ki_read_8(addr);
 		return m68ki_make_bf(((uint32)lo) << 24, 0, offset);
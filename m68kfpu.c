@@ -66,6 +66,16 @@ static inline floatx80 load_extended_float80(uint32 ea)
 	uint32 d1,d2;
 	uint16 d3;
 	floatx80 fp;
+#if M68KI_MEMORY_BLOCKS
+	uint8 data[12];
+
+	if (m68ki_read_block(ea, data, 12))
+	{
+		fp.high = m68ki_get_mem_16(data);
+		fp.low = ((uint64)m68ki_get_mem_32(data + 4)<<32) | m68ki_get_mem_32(data + 8);
+		return fp;
+	}
+#endif
 
 	d3 = m68ki_read_16(ea);
 	d1 = m68ki_read_32(ea+4);
@@ -79,6 +89,17 @@ static inline floatx80 load_extended_float80(uint32 ea)
 
 static inline void store_extended_float80(uint32 ea, floatx80 fpr)
 {
+#if M68KI_MEMORY_BLOCKS
+	uint8 data[12];
+
+	m68ki_set_mem_16(data, fpr.high);
+	m68ki_set_mem_16(data + 2, 0);
+	m68ki_set_mem_32(data + 4, (fpr.low>>32)&0xffffffff);
+	m68ki_set_mem_32(data + 8, fpr.low&0xffffffff);
+	if (m68ki_write_block(ea, data, 12))
+		return;
+#endif
+
 	m68ki_write_16(ea+0, fpr.high);
 	m68ki_write_16(ea+2, 0);
 	m68ki_write_32(ea+4, (fpr.low>>32)&0xffffffff);
@@ -580,6 +601,7 @@ static uint64 READ_EA_64(int ea)
 		case 3:		// (An)+
 		{
 			uint32 ea = REG_A[reg];
+			m68ki_save_da(8 + reg);
 			REG_A[reg] += 8;
 			h1 = m68ki_read_32(ea+0);
 			h2 = m68ki_read_32(ea+4);
@@ -587,6 +609,7 @@ static uint64 READ_EA_64(int ea)
 		}
 		case 4:		// -(An)
 		{
+			m68ki_save_da(8 + reg);
 			REG_A[reg] -= 8;
 			uint32 ea = REG_A[reg];
 			h1 = m68ki_read_32(ea+0);
@@ -659,12 +682,14 @@ static floatx80 READ_EA_FPE(int mode, int reg, uint32 di_mode_ea)
 		case 3:		// (An)+
 		{
 			uint32 ea = REG_A[reg];
+			m68ki_save_da(8 + reg);
 			REG_A[reg] += 12;
 			fpr = load_extended_float80(ea);
 			break;
 		}
 		case 4:		// -(An)
 		{
+			m68ki_save_da(8 + reg);
 			REG_A[reg] -= 12;
 			uint32 ea = REG_A[reg];
 			fpr = load_extended_float80(ea);
@@ -743,12 +768,14 @@ static floatx80 READ_EA_PACK(int ea)
 		case 3:		// (An)+
 		{
 			uint32 ea = REG_A[reg];
+			m68ki_save_da(8 + reg);
 			REG_A[reg] += 12;
 			fpr = load_pack_float80(ea);
 			break;
 		}
 		case 4:		// -(An)
 		{
+			m68ki_save_da(8 + reg);
 			REG_A[reg] -= 12;
 			uint32 ea = REG_A[reg];
 			fpr = load_pack_float80(ea);
@@ -1006,6 +1033,7 @@ static void WRITE_EA_64(int ea, uint64 data)
 		{
 			uint32 ea;
 			ea = REG_A[reg];
+			m68ki_save_da(8 + reg);
 			REG_A[reg] += 8;
 			m68ki_write_32(ea+0, (uint32)(data >> 32));
 			m68ki_write_32(ea+4, (uint32)(data));
@@ -1014,6 +1042,7 @@ static void WRITE_EA_64(int ea, uint64 data)
 		case 4:		// -(An)
 		{
 			uint32 ea;
+			m68ki_save_da(8 + reg);
 			REG_A[reg] -= 8;
 			ea = REG_A[reg];
 			m68ki_write_32(ea+0, (uint32)(data >> 32));
@@ -1082,6 +1111,7 @@ static void WRITE_EA_FPE(int mode, int reg, floatx80 fpr, uint32 di_mode_ea)
 			uint32 ea;
 			ea = REG_A[reg];
 			store_extended_float80(ea, fpr);
+			m68ki_save_da(8 + reg);
 			REG_A[reg] += 12;
 			break;
 		}
@@ -1089,6 +1119,7 @@ static void WRITE_EA_FPE(int mode, int reg, floatx80 fpr, uint32 di_mode_ea)
 		case 4:		// -(An)
 		{
 			uint32 ea;
+			m68ki_save_da(8 + reg);
 			REG_A[reg] -= 12;
 			ea = REG_A[reg];
 			store_extended_float80(ea, fpr);
@@ -1144,6 +1175,7 @@ static void WRITE_EA_PACK(int ea, int k, floatx80 fpr)
 			uint32 ea;
 			ea = REG_A[reg];
 			store_pack_float80(ea, k, fpr);
+			m68ki_save_da(8 + reg);
 			REG_A[reg] += 12;
 			break;
 		}
@@ -1151,6 +1183,7 @@ static void WRITE_EA_PACK(int ea, int k, floatx80 fpr)
 		case 4:		// -(An)
 		{
 			uint32 ea;
+			m68ki_save_da(8 + reg);
 			REG_A[reg] -= 12;
 			ea = REG_A[reg];
 			store_pack_float80(ea, k, fpr);
@@ -1185,6 +1218,8 @@ static void fpgen_rm_reg(uint16 w2)
 	floatx80 source;
 	int round;
 
+	m68ki_profile_count(fpu_gen, opmode);
+
 	// fmovecr #$f, fp0	f200 5c0f
 
 	if (rm)
@@ -1828,6 +1863,7 @@ void m68040_fpu_op0(void)
 		case 0:
 		{
 			uint16 w2 = OPER_I_16();
+			m68ki_profile_count(fpu_ops, (w2 >> 13) & 0x7);
 			switch ((w2 >> 13) & 0x7)
 			{
 				case 0x0:	// FPU ALU FP, FP
@@ -0,0 +1,505 @@
+/* ======================================================================== */
+/* ========================= LICENSING & COPYRIGHT ======================== */
+/* ======================================================================== */
+/*
+ *                                  MUSASHI
+ *                                Version 3.32
+ *
+ * A portable Motorola M680x0 processor emulation engine.
+ * Copyright Karl Stenerud.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ======================================================================== */
+/* ================================== JIT ================================= */
+/* ======================================================================== */
+/*
+ * x86-64 code for hot blocks of the block cache.  Included by m68kcpu.c.
+ *
+ * A block is compiled once it has been replayed M68KI_JIT_THRESHOLD times.
+ * The compiled code does what m68ki_block_run() does, with the PC, IR and
+ * cycle counts of each instruction as constants and a direct call to its
+ * opcode handler, so instructions keep the exact behaviour of m68k_in.c
+ * including exceptions, bus errors and memory callbacks.  A few opcodes that
+ * only touch registers are emitted inline.  Guest registers stay in the core
+ * structure, where the handlers expect them.
+ *
+ * At the end of a block the next one is entered through jit_entry[] while
+ * cycles remain.  Every compiled block checks on entry that it is the block
+ * for the current PC and S flag, and between instructions that it has not
+ * been invalidated, so slots that were dropped or recompiled are harmless.
+ *
+ * Registers in compiled code: rbx = the core, r12 = the running m68ki_block,
+ * r13 = jit_entry[].
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define M68KI_JIT_BUFFER_SIZE (4 << 20)
+#define M68KI_JIT_BLOCK_MAX   4096  /* Upper bound on the code of one block */
+#define M68KI_JIT_THRESHOLD   32    /* Replays of a block before it is compiled */
+#define M68KI_JIT_EXIT_SIZE   6     /* Bytes in the exit stub */
+
+/* x86-64 condition codes for jcc rel32 */
+#define M68KI_JIT_JNE 0x85
+#define M68KI_JIT_JLE 0x8e
+
+#define M68KI_JIT_CORE(FIELD) ((uint)offsetof(m68ki_cpu_core, FIELD))
+#define M68KI_JIT_REG(REGNUM) (M68KI_JIT_CORE(dar) + (REGNUM) * 4)
+
+typedef void (*m68ki_jit_enter_fn)(m68ki_cpu_core* cpu, void* code, void** entry);
+
+static void m68ki_block_run(m68ki_block* blk);
+
+
+/* ------------------------------- Emitters ------------------------------- */
+
+static uint8* m68ki_jit_imm32(uint8* p, uint value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+	return p + 4;
+}
+
+static uint8* m68ki_jit_imm64(uint8* p, const void* value)
+{
+	memcpy(p, value, 8);
+	return p + 8;
+}
+
+/* opcode with a [rbx + disp32] operand */
+static uint8* m68ki_jit_core(uint8* p, uint opcode, uint reg, uint offset)
+{
+	*p++ = opcode;
+	*p++ = 0x80 | (reg << 3) | 3;
+	return m68ki_jit_imm32(p, offset);
+}
+
+/* mov dword [rbx + offset], value */
+static uint8* m68ki_jit_store(uint8* p, uint offset, uint value)
+{
+	return m68ki_jit_imm32(m68ki_jit_core(p, 0xc7, 0, offset), value);
+}
+
+/* cmp dword [rbx + offset], value */
+static uint8* m68ki_jit_compare(uint8* p, uint offset, uint value)
+{
+	return m68ki_jit_imm32(m68ki_jit_core(p, 0x81, 7, offset), value);
+}
+
+/* mov eax, [rbx + offset] */
+static uint8* m68ki_jit_load_eax(uint8* p, uint offset)
+{
+	return m68ki_jit_core(p, 0x8b, 0, offset);
+}
+
+/* mov [rbx + offset], eax */
+static uint8* m68ki_jit_store_eax(uint8* p, uint offset)
+{
+	return m68ki_jit_core(p, 0x89, 0, offset);
+}
+
+/* jcc/jmp rel32 to target, or to be patched by m68ki_jit_patch() */
+static uint8* m68ki_jit_jump(uint8* p, uint condition, const uint8* target)
+{
+	if(condition)
+	{
+		*p++ = 0x0f;
+		*p++ = condition;
+	}
+	else
+		*p++ = 0xe9;
+	return m68ki_jit_imm32(p, target != NULL ? (uint)(target - (p + 4)) : 0);
+}
+
+/* Point the jump ending at p to target */
+static void m68ki_jit_patch(uint8* p, const uint8* target)
+{
+	m68ki_jit_imm32(p - 4, (uint)(target - p));
+}
+
+/* Compare the S flag with the block's key: mov eax, [rbx + s_flag];
+ * cmp eax, [r12 + key]
+ */
+static uint8* m68ki_jit_check_key(uint8* p)
+{
+	p = m68ki_jit_load_eax(p, M68KI_JIT_CORE(s_flag));
+	*p++ = 0x41;
+	*p++ = 0x3b;
+	*p++ = 0x84;
+	*p++ = 0x24;
+	return m68ki_jit_imm32(p, (uint)offsetof(m68ki_block, key));
+}
+
+/* Code for register-only opcodes, or NULL to call the handler */
+static uint8* m68ki_jit_inline(uint8* p, const m68ki_block* blk, uint offset, uint pc)
+{
+	uint ir = blk->code[offset];
+	uint length = 2;
+	int clear_vc = 1;
+
+	if((ir & 0xf100) == 0x7000)                                   /* moveq #<data>, Dx */
+	{
+		uint res = MASK_OUT_ABOVE_32(MAKE_INT_8(MASK_OUT_ABOVE_8(ir)));
+
+		p = m68ki_jit_store(p, M68KI_JIT_REG((ir >> 9) & 7), res);
+#if M68K_LAZY_FLAGS
+		p = m68ki_jit_store(p, M68KI_JIT_CORE(flags_op), M68KI_FLAGS_LOGIC_32);
+		p = m68ki_jit_store(p, M68KI_JIT_CORE(flags_res), res);
+		clear_vc = 0;
+#else
+		p = m68ki_jit_store(p, M68KI_JIT_CORE(n_flag), NFLAG_32(res));
+		p = m68ki_jit_store(p, M68KI_JIT_CORE(not_z_flag), res);
+#endif
+	}
+	else if((ir & 0xf1f8) == 0x2000)                              /* move.l Dy, Dx */
+	{
+		p = m68ki_jit_load_eax(p, M68KI_JIT_REG(ir & 7));
+		p = m68ki_jit_store_eax(p, M68KI_JIT_REG((ir >> 9) & 7));
+#if M68K_LAZY_FLAGS
+		p = m68ki_jit_store_eax(p, M68KI_JIT_CORE(flags_res));
+		p = m68ki_jit_store(p, M68KI_JIT_CORE(flags_op), M68KI_FLAGS_LOGIC_32);
+		clear_vc = 0;
+#else
+		p = m68ki_jit_store_eax(p, M68KI_JIT_CORE(not_z_flag));
+		*p++ = 0xc1;                                               /* shr eax, 24 */
+		*p++ = 0xe8;
+		*p++ = 24;
+		p = m68ki_jit_store_eax(p, M68KI_JIT_CORE(n_flag));
+#endif
+	}
+	else if((ir & 0xf0f8) == 0x5048 || (ir & 0xf0f8) == 0x5088)   /* addq/subq.w/.l #<data>, Ay */
+	{
+		/* add/sub dword [rbx + Ay], data */
+		p = m68ki_jit_core(p, 0x81, (ir & 0x0100) ? 5 : 0, M68KI_JIT_REG(8 + (ir & 7)));
+		p = m68ki_jit_imm32(p, (((ir >> 9) - 1) & 7) + 1);
+		clear_vc = 0;
+	}
+	else if((ir & 0xf1f8) == 0x41e8 && offset + 1 < blk->len >> 1) /* lea (d16, Ay), Ax */
+	{
+		p = m68ki_jit_load_eax(p, M68KI_JIT_REG(8 + (ir & 7)));
+		*p++ = 0x05;                                               /* add eax, d16 */
+		p = m68ki_jit_imm32(p, MAKE_INT_16(blk->code[offset + 1]));
+		p = m68ki_jit_store_eax(p, M68KI_JIT_REG(8 + ((ir >> 9) & 7)));
+		length = 4;
+		clear_vc = 0;
+	}
+	else
+		return NULL;
+
+	if(clear_vc)
+	{
+		p = m68ki_jit_store(p, M68KI_JIT_CORE(v_flag), VFLAG_CLEAR);
+		p = m68ki_jit_store(p, M68KI_JIT_CORE(c_flag), CFLAG_CLEAR);
+	}
+	p = m68ki_jit_store(p, M68KI_JIT_CORE(pc), pc + length);
+	return m68ki_jit_store(p, M68KI_JIT_CORE(ir), ir);
+}
+
+
+/* ---------------------------- Code Management --------------------------- */
+
+/* The code buffer is never writable and executable at once: it is made
+ * writable while a block is emitted, and executable again before it runs.
+ */
+static int m68ki_jit_protect(m68ki_block_cache* cache, int writable)
+{
+	return mprotect(cache->jit_buffer, M68KI_JIT_BUFFER_SIZE,
+					writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+}
+
+static int m68ki_jit_init(m68ki_block_cache* cache)
+{
+	void* buffer = mmap(NULL, M68KI_JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+						MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	uint8* p;
+	uint i;
+
+	if(buffer == MAP_FAILED)
+		return 0;
+#if M68KI_JIT_LOCKSTEP
+	cache->jit_state = malloc(2 * sizeof(m68ki_cpu_core));
+	if(cache->jit_state == NULL)
+	{
+		munmap(buffer, M68KI_JIT_BUFFER_SIZE);
+		return 0;
+	}
+#endif /* M68KI_JIT_LOCKSTEP */
+	p = cache->jit_buffer = buffer;
+
+	/* Entry from C: m68ki_jit_enter_fn(cpu, code, entry) */
+	cache->jit_enter = p;
+	*p++ = 0x53;                                                   /* push rbx */
+	*p++ = 0x41; *p++ = 0x54;                                      /* push r12 */
+	*p++ = 0x41; *p++ = 0x55;                                      /* push r13 */
+	*p++ = 0x48; *p++ = 0x89; *p++ = 0xfb;                         /* mov rbx, rdi */
+	*p++ = 0x49; *p++ = 0x89; *p++ = 0xd5;                         /* mov r13, rdx */
+	*p++ = 0xff; *p++ = 0xe6;                                      /* jmp rsi */
+
+	cache->jit_exit = p;
+	*p++ = 0x41; *p++ = 0x5d;                                      /* pop r13 */
+	*p++ = 0x41; *p++ = 0x5c;                                      /* pop r12 */
+	*p++ = 0x5b;                                                   /* pop rbx */
+	*p++ = 0xc3;                                                   /* ret */
+
+	cache->jit_used = p - cache->jit_buffer;
+	for(i = 0; i < M68KI_BLOCK_SLOTS; i++)
+		cache->jit_entry[i] = cache->jit_exit;
+	return 1;
+}
+
+/* Throw away all compiled code when the buffer is full */
+static void m68ki_jit_reset(m68ki_block_cache* cache)
+{
+	uint i;
+
+	for(i = 0; i < M68KI_BLOCK_SLOTS; i++)
+	{
+		cache->blocks[i].jit_code = NULL;
+		cache->blocks[i].hits = 0;
+		cache->jit_entry[i] = cache->jit_exit;
+	}
+	cache->jit_used = (uint8*)cache->jit_exit + M68KI_JIT_EXIT_SIZE - cache->jit_buffer;
+}
+
+static void m68ki_jit_free(m68ki_block_cache* cache)
+{
+	if(cache->jit_buffer != NULL)
+		munmap(cache->jit_buffer, M68KI_JIT_BUFFER_SIZE);
+#if M68KI_JIT_LOCKSTEP
+	free(cache->jit_state);
+#endif /* M68KI_JIT_LOCKSTEP */
+}
+
+/* Name compiled code for perf (see m68k_set_jit_perf_map()).  Each CPU
+ * instance has its own handle on the process's map file, opened for append
+ * and flushed after every line, so instances on other threads do not mix
+ * their lines.
+ */
+static void m68ki_jit_perf_map(const void* code, uint size, uint pc)
+{
+	if(!m68ki_cpu.jit_perf_enabled)
+		return;
+	if(m68ki_cpu.jit_perf_file == NULL)
+	{
+		char name[64];
+
+		sprintf(name, "/tmp/perf-%d.map", (int)getpid());
+		m68ki_cpu.jit_perf_file = fopen(name, "a");
+		if(m68ki_cpu.jit_perf_file == NULL)
+		{
+			m68ki_cpu.jit_perf_enabled = 0;
+			return;
+		}
+	}
+	fprintf(m68ki_cpu.jit_perf_file, "%lx %x m68k_%08x\n", (unsigned long)(size_t)code, size, pc);
+	fflush(m68ki_cpu.jit_perf_file);
+}
+
+static int m68ki_jit_compile(m68ki_block_cache* cache, m68ki_block* blk)
+{
+	uint8* fixup[M68KI_BLOCK_MAX_INSNS * 2];
+	uint fixups = 0;
+	uint8* exit_stub;
+	uint8* start;
+	uint8* p;
+	uint i;
+
+	if(cache->jit_buffer == NULL && !m68ki_jit_init(cache))
+		return 0;
+	if(!m68ki_jit_protect(cache, 1))
+		return 0;
+	if(M68KI_JIT_BUFFER_SIZE - cache->jit_used < M68KI_JIT_BLOCK_MAX)
+		m68ki_jit_reset(cache);
+	exit_stub = cache->jit_exit;
+	p = start = cache->jit_buffer + cache->jit_used;
+
+	/* mov r12, blk */
+	*p++ = 0x49;
+	*p++ = 0xbc;
+	p = m68ki_jit_imm64(p, &blk);
+
+	/* Only run for the PC and S flag the block was recorded with */
+	p = m68ki_jit_compare(p, M68KI_JIT_CORE(pc), blk->pc);
+	p = m68ki_jit_jump(p, M68KI_JIT_JNE, exit_stub);
+	p = m68ki_jit_check_key(p);
+	p = m68ki_jit_jump(p, M68KI_JIT_JNE, exit_stub);
+
+	/* Serve the block's words to the handlers' immediate reads */
+	p = m68ki_jit_store(p, M68KI_JIT_CORE(block_pc), blk->pc);
+	p = m68ki_jit_store(p, M68KI_JIT_CORE(block_len), blk->len);
+	*p++ = 0x48;                                                   /* mov rax, blk->code */
+	*p++ = 0xb8;
+	{
+		const uint16* code = blk->code;
+		p = m68ki_jit_imm64(p, &code);
+	}
+	*p++ = 0x48;                                                   /* mov [rbx + block_code], rax */
+	p = m68ki_jit_core(p, 0x89, 0, M68KI_JIT_CORE(block_code));
+
+	for(i = 0; i < blk->count; i++)
+	{
+		const m68ki_block_insn* insn = &blk->insn[i];
+		uint pc = blk->pc + (insn->offset << 1);
+		uint8* next;
+
+		if(i > 0)
+		{
+			/* Leave on a change of flow, the end of the timeslice, a switch
+			 * to or from supervisor mode or a write to the block itself.
+			 */
+			p = m68ki_jit_compare(p, M68KI_JIT_CORE(pc), pc);
+			fixup[fixups++] = p = m68ki_jit_jump(p, M68KI_JIT_JNE, NULL);
+			p = m68ki_jit_core(p, 0x83, 7, M68KI_JIT_CORE(remaining_cycles)); /* cmp dword, 0 */
+			*p++ = 0;
+			p = m68ki_jit_jump(p, M68KI_JIT_JLE, exit_stub);
+			p = m68ki_jit_check_key(p);
+			fixup[fixups++] = p = m68ki_jit_jump(p, M68KI_JIT_JNE, NULL);
+		}
+
+		p = m68ki_jit_store(p, M68KI_JIT_CORE(ppc), pc);
+		next = m68ki_jit_inline(p, blk, insn->offset, pc);
+		if(next != NULL)
+			p = next;
+		else
+		{
+			p = m68ki_jit_store(p, M68KI_JIT_CORE(pc), pc + 2);
+			p = m68ki_jit_store(p, M68KI_JIT_CORE(ir), blk->code[insn->offset]);
+			p = m68ki_jit_store(p, M68KI_JIT_CORE(dar_save_mask), 0);
+			*p++ = 0x48;                                           /* mov rax, handler */
+			*p++ = 0xb8;
+			p = m68ki_jit_imm64(p, &insn->handler);
+			*p++ = 0xff;                                           /* call rax */
+			*p++ = 0xd0;
+		}
+		p = m68ki_jit_imm32(m68ki_jit_core(p, 0x81, 5, M68KI_JIT_CORE(remaining_cycles)), insn->cycles);
+	}
+
+	/* Go on to the block for the new PC */
+	for(i = 0; i < fixups; i++)
+		m68ki_jit_patch(fixup[i], p);
+#if M68KI_JIT_LOCKSTEP
+	/* Each block is checked on its own */
+	p = m68ki_jit_jump(p, 0, exit_stub);
+#else
+	p = m68ki_jit_core(p, 0x83, 7, M68KI_JIT_CORE(remaining_cycles));
+	*p++ = 0;
+	p = m68ki_jit_jump(p, M68KI_JIT_JLE, exit_stub);
+	p = m68ki_jit_load_eax(p, M68KI_JIT_CORE(pc));
+	*p++ = 0xd1;                                                   /* shr eax, 1 */
+	*p++ = 0xe8;
+	*p++ = 0x25;                                                   /* and eax, slots - 1 */
+	p = m68ki_jit_imm32(p, M68KI_BLOCK_SLOTS - 1);
+	*p++ = 0x41;                                                   /* jmp [r13 + rax * 8] */
+	*p++ = 0xff;
+	*p++ = 0x64;
+	*p++ = 0xc5;
+	*p++ = 0x00;
+#endif /* M68KI_JIT_LOCKSTEP */
+
+	cache->jit_used += p - start;
+	if(!m68ki_jit_protect(cache, 0))
+	{
+		/* Nothing in the buffer can run */
+		m68ki_jit_reset(cache);
+		return 0;
+	}
+	blk->jit_code = start;
+	cache->jit_entry[blk - cache->blocks] = start;
+	m68ki_jit_perf_map(start, p - start, blk->pc);
+	return 1;
+}
+
+
+/* ------------------------------- Execution ------------------------------ */
+
+#if M68KI_JIT_LOCKSTEP
+/* Run the compiled block, then rerun it in the interpreter from the same
+ * state and with the same memory accesses, and compare the results.
+ */
+static void m68ki_jit_lockstep(m68ki_block_cache* cache, m68ki_block* blk, m68ki_jit_enter_fn enter)
+{
+	m68ki_cpu_core* state = cache->jit_state; /* Before and after the compiled code */
+	m68ki_jit_log* log = &cache->jit_log;
+	uint sr;
+	int mismatch;
+	uint i;
+
+	state[0] = m68ki_cpu;
+	log->mode = M68KI_JIT_LOG_RECORD;
+	log->count = log->pos = log->overflow = log->diverged = log->host_changed = 0;
+	enter(m68ki_cpu_ptr, blk->jit_code, cache->jit_entry);
+	log->mode = M68KI_JIT_LOG_OFF;
+	m68ki_cpu.block_len = 0;
+	m68ki_cpu.block_code = NULL;
+
+	/* The block changed under the compiled code, too much to replay, or
+	 * the host changed registers, cycles or interrupts from a callback,
+	 * which going back to state[0] would lose.
+	 */
+	if(blk->jit_code == NULL || log->overflow || log->host_changed)
+		return;
+	state[1] = m68ki_cpu;
+	sr = m68ki_get_sr();
+
+	m68ki_cpu = state[0];
+	log->mode = M68KI_JIT_LOG_REPLAY;
+	m68ki_block_run(blk);
+	log->mode = M68KI_JIT_LOG_OFF;
+
+	mismatch = log->diverged || log->pos != log->count || m68ki_get_sr() != sr ||
+			   REG_PC != state[1].pc || REG_PPC != state[1].ppc || REG_IR != state[1].ir ||
+			   GET_CYCLES() != state[1].remaining_cycles || CPU_STOPPED != state[1].stopped;
+	for(i = 0; i < 16; i++)
+		mismatch |= REG_DA[i] != state[1].dar[i];
+	for(i = 0; i < 7; i++)
+		mismatch |= REG_SP_BASE[i] != state[1].sp[i];
+	if(!mismatch)
+		return;
+
+	cache->jit_mismatches++;
+	fprintf(stderr, "m68k JIT lockstep mismatch in block %08x: pc %08x/%08x sr %04x/%04x cycles %d/%d%s\n",
+			blk->pc, state[1].pc, REG_PC, sr, m68ki_get_sr(), state[1].remaining_cycles, GET_CYCLES(),
+			log->diverged || log->pos != log->count ? ", memory accesses differ" : "");
+	for(i = 0; i < 16; i++)
+		if(REG_DA[i] != state[1].dar[i])
+			fprintf(stderr, "  %c%u %08x/%08x\n", i < 8 ? 'D' : 'A', i & 7, state[1].dar[i], REG_DA[i]);
+}
+#endif /* M68KI_JIT_LOCKSTEP */
+
+static void m68ki_jit_run(m68ki_block_cache* cache, m68ki_block* blk)
+{
+	m68ki_jit_enter_fn enter;
+
+	memcpy(&enter, &cache->jit_enter, sizeof(enter));
+#if M68KI_JIT_LOCKSTEP
+	m68ki_jit_lockstep(cache, blk, enter);
+#else
+	enter(m68ki_cpu_ptr, blk->jit_code, cache->jit_entry);
+	m68ki_cpu.block_len = 0;
+	m68ki_cpu.block_code = NULL;
+#endif /* M68KI_JIT_LOCKSTEP */
+}
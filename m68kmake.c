@@ -40,10 +40,12 @@
  * It requires an input file to function (default m68k_in.c), but you can
  * specify your own like so:
  *
- * m68kmake <output path> <input file>
+ * m68kmake <output path> <input file> <pairs file>
  *
  * where output path is the path where the output files should be placed, and
- * input file is the file to use for input.
+ * input file is the file to use for input.  The optional pairs file lists the
+ * opcode handler pairs to fuse, in the format of the M68KMAKE_FUSED_PAIRS
+ * section of the input file, and is used instead of that section.
  *
  * If you modify the input file greatly from its released form, you may have
  * to tweak the configuration section a bit since I'm using static allocation
@@ -89,6 +91,7 @@ static const char g_version[] = "4.60";
 #define EA_ALLOWED_LENGTH                11	/* Max length of ea allowed str */
 #define MAX_OPCODE_INPUT_TABLE_LENGTH  1000	/* Max length of opcode handler tbl */
 #define MAX_OPCODE_OUTPUT_TABLE_LENGTH 3000	/* Max length of opcode handler tbl */
+#define MAX_FUSED_PAIRS                 256	/* Max number of fused handler pairs */
 
 /* Default filenames */
 #define FILENAME_INPUT      "m68k_in.c"
@@ -110,6 +113,7 @@ static const char g_version[] = "4.60";
 #define ID_OPHANDLER_HEADER     ID_BASE "_OPCODE_HANDLER_HEADER"
 #define ID_OPHANDLER_FOOTER     ID_BASE "_OPCODE_HANDLER_FOOTER"
 #define ID_OPHANDLER_BODY       ID_BASE "_OPCODE_HANDLER_BODY"
+#define ID_FUSED_PAIRS          ID_BASE "_FUSED_PAIRS"
 #define ID_END                  ID_BASE "_END"
 
 #define ID_OPHANDLER_NAME       ID_BASE "_OP"
@@ -122,6 +126,12 @@ static const char g_version[] = "4.60";
 #define ID_OPHANDLER_CC         ID_BASE "_CC"
 #define ID_OPHANDLER_NOT_CC     ID_BASE "_NOT_CC"
 
+/* Inserted at the start of handlers that use the flags directly, or ahead
+ * of the flag assignments in handlers that overwrite all of them.
+ */
+#define ID_FLAGS_SYNC           "\tm68ki_flags_sync();\n"
+#define ID_FLAGS_DISCARD        "\tm68ki_flags_discard();\n"
+
 
 #ifndef DECL_SPEC
 #define DECL_SPEC
@@ -189,6 +199,8 @@ typedef struct
 	char cpu_mode[NUM_CPUS];              /* User or supervisor mode */
 	char cpus[NUM_CPUS+1];                /* Allowed CPUs */
 	unsigned char cycles[NUM_CPUS];       /* cycles for 000, 010, 020, 030, 040 */
+	char* cpu_body;                       /* Handler body if it checks the CPU type */
+	char* body;                           /* Handler body */
 } opcode_struct;
 
 
@@ -218,6 +230,23 @@ typedef struct
 } replace_struct;
 
 
+/* Two opcode handlers to run back to back without going through dispatch */
+typedef struct
+{
+	char first[MAX_NAME_LENGTH];
+	char second[MAX_NAME_LENGTH];
+} fused_pair_struct;
+
+
+/* A set of handlers built for one CPU family (see M68K_SPECIALIZED_HANDLERS) */
+typedef struct
+{
+	char* suffix;   /* Added to handler names and the set guard */
+	char* cpu_type; /* CPU type the handlers are built for */
+	char* cpu_name; /* For comments */
+} handler_set_struct;
+
+
 /* Function Prototypes */
 void error_exit(const char* fmt, ...);
 void perror_exit(const char* fmt, ...);
@@ -232,13 +261,26 @@ opcode_struct* find_opcode(char* name, int size, char* spec_proc, char* spec_ea)
 opcode_struct* find_illegal_opcode(void);
 int extract_opcode_info(char* src, char* name, int* size, char* spec_proc, char* spec_ea);
 void add_replace_string(replace_struct* replace, char* search_str, char* replace_str);
-void write_body(FILE* filep, body_struct* body, replace_struct* replace);
+void expand_body(char* text, body_struct* body, replace_struct* replace);
+int is_cpu_dependent(char* text);
+int uses_flags(char* text);
+char* find_flags_overwrite(char* text);
 void get_base_name(char* base_name, opcode_struct* op);
 void write_function_name(FILE* filep, char* base_name);
 void add_opcode_output_table_entry(opcode_struct* op, char* name);
 static int DECL_SPEC compare_nof_true_bits(const void* aptr, const void* bptr);
-void print_opcode_output_table(FILE* filep);
-void write_table_entry(FILE* filep, opcode_struct* op);
+void get_set_handler_name(char* name, opcode_struct* op, int set);
+void print_handler_sets(FILE* filep);
+void resolve_opcode_tables(void);
+void print_opcode_tables(FILE* filep);
+void print_handler_count(FILE* filep);
+int find_output_entry(char* name);
+int is_register_only(char* text);
+char* find_flags_setter(char* text, int nzvc_only);
+int is_fused(int index);
+void print_fused_handlers(FILE* filep);
+void print_threaded_function(FILE* filep, int set);
+void print_threaded_core(FILE* filep);
 void set_opcode_struct(opcode_struct* src, opcode_struct* dst, int ea_mode);
 void generate_opcode_handler(FILE* filep, body_struct* body, replace_struct* replace, opcode_struct* opinfo, int ea_mode);
 void generate_opcode_ea_variants(FILE* filep, body_struct* body, replace_struct* replace, opcode_struct* op);
@@ -246,6 +288,7 @@ void generate_opcode_cc_variants(FILE* filep, body_struct* body, replace_struct*
 void process_opcode_handlers(FILE* filep);
 void populate_table(void);
 void read_insert(char* insert);
+void read_fused_pairs(FILE* file, int keep);
 
 
 
@@ -271,6 +314,25 @@ opcode_struct g_opcode_input_table[MAX_OPCODE_INPUT_TABLE_LENGTH];
 opcode_struct g_opcode_output_table[MAX_OPCODE_OUTPUT_TABLE_LENGTH];
 int g_opcode_output_table_length = 0;
 
+/* Output table entry of each opcode, set up by resolve_opcode_tables() */
+int g_index_table[0x10000];
+
+/* Opcode handler pairs to fuse */
+fused_pair_struct g_fused_pairs[MAX_FUSED_PAIRS];
+int g_fused_pairs_length = 0;
+
+/* Handler sets, one per family of CPU types that the handlers tell apart */
+const handler_set_struct g_handler_set_table[] =
+{/* suffix  CPU type        name */
+	{"000", "CPU_TYPE_000", "68000"},
+	{"010", "CPU_TYPE_010", "68010"},
+	{"020", "CPU_TYPE_020", "68EC020 and 68020"},
+	{"030", "CPU_TYPE_030", "68EC030 and 68030"},
+	{"040", "CPU_TYPE_040", "68EC040 and 68040"},
+};
+
+#define NUM_HANDLER_SETS ((int)(sizeof(g_handler_set_table) / sizeof(g_handler_set_table[0])))
+
 const ea_info_struct g_ea_info_table[13] =
 {/* fname    ea        mask  match */
 	{"",     "",       0x00, 0x00}, /* EA_MODE_NONE */
@@ -732,16 +794,17 @@ void add_replace_string(replace_struct* replace, char* search_str, char* replace
 	strcpy(replace->replace[replace->length++][1], replace_str);
 }
 
-/* Write a function body while replacing any selected strings */
-void write_body(FILE* filep, body_struct* body, replace_struct* replace)
+/* Expand a function body into text while replacing any selected strings */
+void expand_body(char* text, body_struct* body, replace_struct* replace)
 {
 	int i;
 	int j;
 	char* ptr;
-	char output[MAX_LINE_LENGTH+1];
+	char output[MAX_LINE_LENGTH+2];
 	char temp_buff[MAX_LINE_LENGTH+1];
 	int found;
 
+	text[0] = 0;
 	for(i=0;i<body->length;i++)
 	{
 		strcpy(output, body->body[i]);
@@ -757,6 +820,8 @@ void write_body(FILE* filep, body_struct* body, replace_struct* replace)
 				{
 					/* We found something to replace */
 					found = 1;
+					if(strlen(output) - strlen(replace->replace[j][0]) + strlen(replace->replace[j][1]) > MAX_LINE_LENGTH)
+						error_exit("Line too long after replacing [%s]", replace->replace[j][0]);
 					strcpy(temp_buff, ptr+strlen(replace->replace[j][0]));
 					strcpy(ptr, replace->replace[j][1]);
 					strcat(ptr, temp_buff);
@@ -766,9 +831,86 @@ void write_body(FILE* filep, body_struct* body, replace_struct* replace)
 			if(!found)
 				error_exit("Unknown " ID_BASE " directive [%s]", output);
 		}
-		fprintf(filep, "%s\n", output);
+		strcat(output, "\n");
+		text = strcpy(text + strlen(text), output);
 	}
-	fprintf(filep, "\n\n");
+	strcat(text, "\n\n");
+}
+
+/* Check if a function body reads or changes the condition codes directly,
+ * rather than through the m68ki_set_xxx_flags() helpers.
+ */
+int uses_flags(char* text)
+{
+	return strstr(text, "FLAG_") != NULL || strstr(text, "COND_") != NULL;
+}
+
+/* Find where a function body overwrites N, Z, V and C together.  Only
+ * handlers that assign each of them exactly once, in one run of lines at the
+ * top level of the body, and touch no other flag but X qualify.  Returns the
+ * start of that run, or NULL.
+ */
+char* find_flags_overwrite(char* text)
+{
+	char* run = NULL;
+	char* line;
+	char* ptr;
+	int depth = 0;
+	int assigned = 0;
+	int total = 0;
+	int in_run = 0;
+
+	if(strstr(text, "COND_") != NULL)
+		return NULL;
+
+	for(ptr = text;(ptr = strstr(ptr, "FLAG_")) != NULL;ptr += 5)
+		if(strchr("NZVC", ptr[5]) != NULL && (ptr == text || !isalnum((unsigned char)ptr[-1])))
+			total++;
+	if(total != 4)
+		return NULL;
+
+	for(line = text;*line != '\0';line = ptr)
+	{
+		if(depth == 1 && strncmp(line, "\tFLAG_", 6) == 0)
+		{
+			if(!in_run)
+			{
+				if(run != NULL)
+					return NULL;
+				run = line;
+				in_run = 1;
+			}
+			for(ptr = line;(ptr = strstr(ptr, "FLAG_")) != NULL && ptr < line + strcspn(line, "\n");ptr += 5)
+			{
+				if(ptr[5] == 'X' || (ptr > line && isalnum((unsigned char)ptr[-1])))
+					continue;
+				if(strchr("NZVC", ptr[5]) == NULL || strncmp(ptr + 6, " = ", 3) != 0)
+					return NULL;
+				assigned |= 1 << (strchr("NZVC", ptr[5]) - "NZVC");
+			}
+		}
+		else
+			in_run = 0;
+
+		for(ptr = line;*ptr != '\0' && *ptr != '\n';ptr++)
+		{
+			if(*ptr == '{')
+				depth++;
+			else if(*ptr == '}')
+				depth--;
+		}
+		if(*ptr == '\n')
+			ptr++;
+	}
+	return assigned == 15 ? run : NULL;
+}
+
+/* Check if a function body depends on the CPU type.  The indexed addressing
+ * modes do too, through m68ki_get_ea_ix().
+ */
+int is_cpu_dependent(char* text)
+{
+	return strstr(text, "CPU_TYPE") != NULL || strstr(text, "_IX_") != NULL || strstr(text, "PCIX") != NULL;
 }
 
 /* Generate a base function name from an opcode struct */
@@ -817,31 +959,441 @@ static int DECL_SPEC compare_nof_true_bits(const void* aptr, const void* bptr)
 	return a->op_match - b->op_match;
 }
 
-void print_opcode_output_table(FILE* filep)
+/* Get the name of a handler in a handler set (-1 for the generic handlers) */
+void get_set_handler_name(char* name, opcode_struct* op, int set)
+{
+	if(set < 0 || op->cpu_body == NULL)
+		strcpy(name, op->name);
+	else
+		sprintf(name, "%s_%s", op->name, g_handler_set_table[set].suffix);
+}
+
+/* Write the handler sets.  Each set has its own copy of the handlers that
+ * check the CPU type, built with CPU_TYPE defined as a constant so that the
+ * compiler folds the checks away, and shares all the other handlers.
+ */
+void print_handler_sets(FILE* filep)
+{
+	char name[MAX_LINE_LENGTH+1];
+	int i;
+	int set;
+
+	for(set=0;set<NUM_HANDLER_SETS;set++)
+	{
+		fprintf(filep, "#if M68KI_HANDLER_SET_%s\n\n", g_handler_set_table[set].suffix);
+		fprintf(filep, "/* Handlers for the %s */\n", g_handler_set_table[set].cpu_name);
+		fprintf(filep, "#undef CPU_TYPE\n");
+		fprintf(filep, "#define CPU_TYPE %s\n\n", g_handler_set_table[set].cpu_type);
+		for(i=0;i<g_opcode_output_table_length;i++)
+		{
+			if(g_opcode_output_table[i].cpu_body == NULL)
+				continue;
+			get_set_handler_name(name, g_opcode_output_table + i, set);
+			write_function_name(filep, name);
+			fputs(g_opcode_output_table[i].cpu_body, filep);
+		}
+		fprintf(filep, "#undef CPU_TYPE\n");
+		fprintf(filep, "#define CPU_TYPE m68ki_cpu.cpu_type\n\n");
+		fprintf(filep, "#endif /* M68KI_HANDLER_SET_%s */\n\n\n", g_handler_set_table[set].suffix);
+	}
+}
+
+/* Resolve the handler for every opcode into g_index_table.  Entries are
+ * sorted by the number of bits in their mask, so later (more specific)
+ * entries override earlier ones.  Opcodes that match nothing use an extra
+ * entry at the end.
+ */
+void resolve_opcode_tables(void)
 {
 	int i;
+	int j;
+
 	qsort((void *)g_opcode_output_table, g_opcode_output_table_length, sizeof(g_opcode_output_table[0]), compare_nof_true_bits);
 
+	for(j=0;j<0x10000;j++)
+		g_index_table[j] = g_opcode_output_table_length;
 	for(i=0;i<g_opcode_output_table_length;i++)
-		write_table_entry(filep, g_opcode_output_table+i);
+		for(j=0;j<0x10000;j++)
+			if((j & g_opcode_output_table[i].op_mask) == g_opcode_output_table[i].op_match)
+				g_index_table[j] = i;
 }
 
-/* Write an entry in the opcode handler table */
-void write_table_entry(FILE* filep, opcode_struct* op)
+/* Write out the dense handler table, the per-opcode index into it and the
+ * per-handler cycle tables.  The extra entry for opcodes that match nothing
+ * is the illegal handler, taking 0 cycles.  Handlers that start fused pairs
+ * go in through M68KI_FUSE().
+ */
+void print_opcode_tables(FILE* filep)
 {
+	char name[MAX_LINE_LENGTH+1];
+	int unmatched = g_opcode_output_table_length;
+	int illegal_index = -1;
+	int set;
 	int i;
+	int j;
 
-	fprintf(filep, "\t{%-28s, 0x%04x, 0x%04x, {",
-		op->name, op->op_mask, op->op_match);
+	for(i=0;i<g_opcode_output_table_length;i++)
+		if(strcmp(g_opcode_output_table[i].name, "m68k_op_illegal") == 0)
+			illegal_index = i;
+	if(illegal_index < 0)
+		error_exit("No illegal opcode handler");
+
+	fprintf(filep, "/* Opcode handlers, indexed by m68ki_instruction_index_table */\n");
+	fprintf(filep, "void (*const m68ki_instruction_handler_table[M68KI_HANDLER_COUNT])(void) =\n{\n");
+	for(i=0;i<g_opcode_output_table_length;i++)
+		fprintf(filep, is_fused(i) ? "\tM68KI_FUSE(%s),\n" : "\t%s,\n", g_opcode_output_table[i].name);
+	fprintf(filep, "\t%s  /* unmatched opcodes */\n", g_opcode_output_table[illegal_index].name);
+	fprintf(filep, "};\n\n");
+
+	fprintf(filep, "#if M68K_PROFILE\n");
+	fprintf(filep, "/* Names of the opcode handlers */\n");
+	fprintf(filep, "const char* const m68ki_instruction_handler_names[M68KI_HANDLER_COUNT] =\n{\n");
+	for(i=0;i<g_opcode_output_table_length;i++)
+		fprintf(filep, "\t\"%s\",\n", g_opcode_output_table[i].name);
+	fprintf(filep, "\t\"%s\"\n", g_opcode_output_table[illegal_index].name);
+	fprintf(filep, "};\n");
+	fprintf(filep, "#endif /* M68K_PROFILE */\n\n");
+
+	for(set=0;set<NUM_HANDLER_SETS;set++)
+	{
+		fprintf(filep, "#if M68KI_HANDLER_SET_%s\n", g_handler_set_table[set].suffix);
+		fprintf(filep, "/* Opcode handlers for the %s */\n", g_handler_set_table[set].cpu_name);
+		fprintf(filep, "void (*const m68ki_instruction_handler_table_%s[M68KI_HANDLER_COUNT])(void) =\n{\n", g_handler_set_table[set].suffix);
+		for(i=0;i<g_opcode_output_table_length;i++)
+		{
+			get_set_handler_name(name, g_opcode_output_table + i, set);
+			fprintf(filep, is_fused(i) ? "\tM68KI_FUSE(%s),\n" : "\t%s,\n", name);
+		}
+		get_set_handler_name(name, g_opcode_output_table + illegal_index, set);
+		fprintf(filep, "\t%s  /* unmatched opcodes */\n", name);
+		fprintf(filep, "};\n");
+		fprintf(filep, "#endif /* M68KI_HANDLER_SET_%s */\n\n", g_handler_set_table[set].suffix);
+	}
+
+	fprintf(filep, "/* Handler of each opcode */\n");
+	fprintf(filep, "const unsigned short m68ki_instruction_index_table[0x10000] =\n{\n");
+	for(j=0;j<0x10000;j++)
+		fprintf(filep, "%s%4d,%s", (j & 15) == 0 ? "\t" : "", g_index_table[j], (j & 15) == 15 ? "\n" : "");
+	fprintf(filep, "};\n\n");
 
+	fprintf(filep, "/* Cycles used by each handler, by CPU type */\n");
+	fprintf(filep, "const unsigned char m68ki_cycles[%d][M68KI_HANDLER_COUNT] =\n{\n", NUM_CPUS);
 	for(i=0;i<NUM_CPUS;i++)
 	{
-		fprintf(filep, "%3d", op->cycles[i]);
-		if(i < NUM_CPUS-1)
-			fprintf(filep, ", ");
+		fprintf(filep, "\t{\n");
+		for(j=0;j<=g_opcode_output_table_length;j++)
+			fprintf(filep, "%s%3d,%s", (j & 15) == 0 ? "\t\t" : "",
+				j == unmatched ? 0 : g_opcode_output_table[j].cycles[i],
+				(j & 15) == 15 || j == unmatched ? "\n" : "");
+		fprintf(filep, "\t},\n");
 	}
+	fprintf(filep, "};\n\n");
+}
 
-	fprintf(filep, "}},\n");
+/* Write the size of the handler table into the prototype file */
+void print_handler_count(FILE* filep)
+{
+	fprintf(filep, "/* Entries in m68ki_instruction_handler_table */\n");
+	fprintf(filep, "#define M68KI_HANDLER_COUNT %d\n\n", g_opcode_output_table_length + 1);
+}
+
+/* Write the threaded core of a handler set (-1 for the generic handlers).
+ * Each opcode handler gets a label that calls it and then dispatches the
+ * next instruction with its own indirect jump.  Labels are in output table
+ * order so that m68ki_instruction_index_table can be used to find them.
+ */
+void print_threaded_function(FILE* filep, int set)
+{
+	char name[MAX_LINE_LENGTH+1];
+	int i;
+
+	if(set < 0)
+	{
+		fprintf(filep, "void m68ki_execute_threaded(void)\n{\n");
+	}
+	else
+	{
+		fprintf(filep, "#if M68KI_HANDLER_SET_%s\n", g_handler_set_table[set].suffix);
+		fprintf(filep, "static void m68ki_execute_threaded_%s(void)\n{\n", g_handler_set_table[set].suffix);
+	}
+	fprintf(filep, "\tstatic const void* const handlers[] =\n\t{\n");
+	for(i=0;i<g_opcode_output_table_length;i++)
+		fprintf(filep, "\t\t&&%s,\n", g_opcode_output_table[i].name);
+	fprintf(filep, "\t\t&&m68k_op_illegal,\n");
+	fprintf(filep, "\t};\n");
+	fprintf(filep, "\tconst unsigned short* index_table = m68ki_instruction_index_table;\n\n");
+	if(set < 0)
+	{
+		/* The generic core hands over to the core of the selected set */
+		for(i=0;i<NUM_HANDLER_SETS;i++)
+		{
+			fprintf(filep, "#if M68KI_HANDLER_SET_%s\n", g_handler_set_table[i].suffix);
+			fprintf(filep, "\tif(CPU_HANDLER_TABLE == m68ki_instruction_handler_table_%s)\n", g_handler_set_table[i].suffix);
+			fprintf(filep, "\t{\n");
+			fprintf(filep, "\t\tm68ki_execute_threaded_%s();\n", g_handler_set_table[i].suffix);
+			fprintf(filep, "\t\treturn;\n");
+			fprintf(filep, "\t}\n");
+			fprintf(filep, "#endif\n");
+		}
+		fprintf(filep, "\n");
+	}
+	fprintf(filep, "\tM68KI_DISPATCH();\n\n");
+	for(i=0;i<g_opcode_output_table_length;i++)
+	{
+		get_set_handler_name(name, g_opcode_output_table + i, set);
+		fprintf(filep, "%s:\n", g_opcode_output_table[i].name);
+		fprintf(filep, is_fused(i) ? "\tM68KI_FUSE(%s)();\n" : "\t%s();\n", name);
+		fprintf(filep, "\tM68KI_NEXT();\n");
+	}
+	fprintf(filep, "}\n");
+	if(set >= 0)
+		fprintf(filep, "#endif /* M68KI_HANDLER_SET_%s */\n", g_handler_set_table[set].suffix);
+	fprintf(filep, "\n");
+}
+
+/* Write the threaded core, with one function per handler set */
+void print_threaded_core(FILE* filep)
+{
+	int set;
+
+	fprintf(filep, "/* ======================================================================== */\n");
+	fprintf(filep, "/* ============================= THREADED CORE ============================ */\n");
+	fprintf(filep, "/* ======================================================================== */\n\n");
+	fprintf(filep, "#if M68KI_THREADED_DISPATCH\n\n");
+	fprintf(filep, "/* Fetch the next instruction and jump straight to its handler */\n");
+	fprintf(filep, "#define M68KI_DISPATCH() \\\n");
+	fprintf(filep, "\tm68ki_begin_instruction(); \\\n");
+	fprintf(filep, "\tREG_IR = m68ki_read_imm_16(); \\\n");
+	fprintf(filep, "\tgoto *handlers[index_table[REG_IR]]\n\n");
+	fprintf(filep, "/* Finish the current instruction and dispatch the next one */\n");
+	fprintf(filep, "#define M68KI_NEXT() \\\n");
+	fprintf(filep, "\tm68ki_end_instruction(); \\\n");
+	fprintf(filep, "\tif(GET_CYCLES() <= 0) \\\n");
+	fprintf(filep, "\t\treturn; \\\n");
+	fprintf(filep, "\tM68KI_DISPATCH()\n\n");
+	fprintf(filep, "#pragma GCC diagnostic push\n");
+	fprintf(filep, "#pragma GCC diagnostic ignored \"-Wpedantic\"\n\n");
+	for(set=0;set<NUM_HANDLER_SETS;set++)
+		print_threaded_function(filep, set);
+	print_threaded_function(filep, -1);
+	fprintf(filep, "#pragma GCC diagnostic pop\n\n");
+	fprintf(filep, "#undef M68KI_DISPATCH\n");
+	fprintf(filep, "#undef M68KI_NEXT\n\n");
+	fprintf(filep, "#endif /* M68KI_THREADED_DISPATCH */\n\n\n");
+}
+
+/* Find an opcode handler in the output table by name */
+int find_output_entry(char* name)
+{
+	int i;
+
+	for(i=0;i<g_opcode_output_table_length;i++)
+		if(strcmp(g_opcode_output_table[i].name, name) == 0)
+			return i;
+	return -1;
+}
+
+/* Check if a function body only works on the data and address registers: it
+ * reads no extension words, touches no memory, takes no exceptions, leaves
+ * the PC, the status register and the cycles alone and only goes through the
+ * m68ki_set_xxx_flags() helpers for the condition codes.
+ */
+int is_register_only(char* text)
+{
+	static const char* const tokens[] =
+	{
+		"EA_", "OPER_", "REG_PC", "REG_SP", "CPU_", "CYCLES", "FLAG_", "COND_", "return"
+	};
+	static const char* const helpers[] =
+	{
+		"m68ki_set_logic_flags_", "m68ki_set_cmp_flags_", "m68ki_set_add_flags_", "m68ki_set_sub_flags_"
+	};
+	char* ptr;
+	unsigned int i;
+
+	for(i=0;i<sizeof(tokens)/sizeof(tokens[0]);i++)
+		if(strstr(text, tokens[i]) != NULL)
+			return 0;
+
+	/* Anything else that calls into the core or the host could fault or
+	 * look at the flags.
+	 */
+	for(ptr = text;(ptr = strstr(ptr, "m68k")) != NULL;ptr++)
+	{
+		for(i=0;i<sizeof(helpers)/sizeof(helpers[0]);i++)
+			if(strncmp(ptr, helpers[i], strlen(helpers[i])) == 0)
+				break;
+		if(i == sizeof(helpers)/sizeof(helpers[0]))
+			return 0;
+	}
+	return 1;
+}
+
+/* Find the line where a function body hands its result to the flags helper,
+ * if it calls exactly one, at the top level.  With nzvc_only set, only the
+ * helpers that leave X alone (logic and cmp) count.  Returns the start of the
+ * line, or NULL.
+ */
+char* find_flags_setter(char* text, int nzvc_only)
+{
+	char* found = NULL;
+	char* ptr;
+
+	for(ptr = text;(ptr = strstr(ptr, "m68ki_set_")) != NULL;ptr++)
+	{
+		if(found != NULL || ptr < text + 2 || strncmp(ptr - 2, "\n\t", 2) != 0)
+			return NULL;
+		if(strncmp(ptr, "m68ki_set_logic_flags_", 22) != 0 && strncmp(ptr, "m68ki_set_cmp_flags_", 20) != 0 &&
+		   (nzvc_only || (strncmp(ptr, "m68ki_set_add_flags_", 20) != 0 && strncmp(ptr, "m68ki_set_sub_flags_", 20) != 0)))
+			return NULL;
+		found = ptr - 1;
+	}
+	return found;
+}
+
+/* Check if an output table entry starts any fused pair */
+int is_fused(int index)
+{
+	int i;
+
+	for(i=0;i<g_fused_pairs_length;i++)
+		if(strcmp(g_fused_pairs[i].first, g_opcode_output_table[index].name) == 0)
+			return 1;
+	return 0;
+}
+
+/* Write the fused handlers.  Each handler that starts a fused pair gets a
+ * _fused version for the handler table, which runs it and then checks the
+ * next opcode word with m68ki_fuse_peek().  If the word belongs to the second
+ * handler of a pair, it finishes the instruction and calls that handler
+ * directly instead of going back through dispatch.  The second handler is
+ * always the plain one, so a run of pairs never nests.
+ *
+ * When both handlers only work on registers and the second one overwrites
+ * N, Z, V and C, the flags of the first are dead.  The check is then done
+ * first, and the pair runs a _noflags copy of the first handler that leaves
+ * out its m68ki_set_xxx_flags() call.  In between, m68ki_fuse_continue()
+ * does what the main loop would, so cycles, tracing and exceptions are the
+ * same as without fusing.
+ */
+void print_fused_handlers(FILE* filep)
+{
+	int dead[MAX_FUSED_PAIRS];
+	int live[MAX_FUSED_PAIRS];
+	int num_dead;
+	int num_live;
+	int first;
+	int second;
+	int depth;
+	char* name;
+	char* body;
+	char* setter;
+	char* ptr;
+	char* end;
+	int i;
+	int j;
+
+	for(i=0;i<g_fused_pairs_length;i++)
+	{
+		first = find_output_entry(g_fused_pairs[i].first);
+		second = find_output_entry(g_fused_pairs[i].second);
+		if(first < 0)
+			error_exit("Unknown opcode handler in fused pair: %s", g_fused_pairs[i].first);
+		if(second < 0)
+			error_exit("Unknown opcode handler in fused pair: %s", g_fused_pairs[i].second);
+		if(g_opcode_output_table[first].cpu_body != NULL)
+			error_exit("Fused opcode handler depends on the CPU type: %s", g_fused_pairs[i].first);
+		if(g_opcode_output_table[second].cpu_body != NULL)
+			error_exit("Fused opcode handler depends on the CPU type: %s", g_fused_pairs[i].second);
+		for(j=0;j<i;j++)
+			if(strcmp(g_fused_pairs[i].first, g_fused_pairs[j].first) == 0 && strcmp(g_fused_pairs[i].second, g_fused_pairs[j].second) == 0)
+				error_exit("Duplicate fused pair: %s %s", g_fused_pairs[i].first, g_fused_pairs[i].second);
+	}
+
+	fprintf(filep, "/* ======================================================================== */\n");
+	fprintf(filep, "/* ============================ FUSED HANDLERS ============================ */\n");
+	fprintf(filep, "/* ======================================================================== */\n\n");
+	fprintf(filep, "#if M68KI_FUSED_PAIRS\n\n");
+
+	for(first=0;first<g_opcode_output_table_length;first++)
+	{
+		if(!is_fused(first))
+			continue;
+		name = g_opcode_output_table[first].name;
+		body = g_opcode_output_table[first].body;
+		setter = is_register_only(body) ? find_flags_setter(body, 1) : NULL;
+
+		num_dead = 0;
+		num_live = 0;
+		for(i=0;i<g_fused_pairs_length;i++)
+		{
+			if(strcmp(g_fused_pairs[i].first, name) != 0)
+				continue;
+			second = find_output_entry(g_fused_pairs[i].second);
+			if(setter != NULL && is_register_only(g_opcode_output_table[second].body) &&
+			   find_flags_setter(g_opcode_output_table[second].body, 0) != NULL)
+				dead[num_dead++] = second;
+			else
+				live[num_live++] = second;
+		}
+
+		if(num_dead > 0)
+		{
+			/* Same body, with the helper's arguments kept in use */
+			fprintf(filep, "#if M68KI_FUSE_DEAD_FLAGS\n");
+			fprintf(filep, "static void %s_noflags(void)\n", name);
+			fwrite(body, 1, setter - body, filep);
+			for(ptr = strchr(setter, '(') + 1;;ptr = end + 1)
+			{
+				ptr += skip_spaces(ptr);
+				for(end = ptr, depth = 0;depth > 0 || (*end != ',' && *end != ')');end++)
+					depth += *end == '(' ? 1 : *end == ')' ? -1 : 0;
+				fprintf(filep, "\t(void)(%.*s);\n", (int)(end - ptr), ptr);
+				if(*end == ')')
+					break;
+			}
+			ptr = strchr(setter, '\n') + 1;
+			fprintf(filep, "%.*s\n", (int)(strrchr(ptr, '}') - ptr + 1), ptr);
+			fprintf(filep, "#endif /* M68KI_FUSE_DEAD_FLAGS */\n\n");
+		}
+
+		fprintf(filep, "static void %s_fused(void)\n{\n", name);
+		if(num_dead > 0)
+		{
+			fprintf(filep, "#if M68KI_FUSE_DEAD_FLAGS\n");
+			fprintf(filep, "\tswitch(m68ki_fuse_peek(%d))\n\t{\n", first);
+			for(i=0;i<num_dead;i++)
+			{
+				fprintf(filep, "\t\tcase %d: /* %s, flags dead */\n", dead[i], g_opcode_output_table[dead[i]].name);
+				fprintf(filep, "\t\t\t%s_noflags();\n", name);
+				fprintf(filep, "\t\t\tm68ki_fuse_continue(%d);\n", first);
+				fprintf(filep, "\t\t\t%s();\n", g_opcode_output_table[dead[i]].name);
+				fprintf(filep, "\t\t\treturn;\n");
+			}
+			fprintf(filep, "\t}\n");
+			fprintf(filep, "#endif /* M68KI_FUSE_DEAD_FLAGS */\n");
+		}
+		fprintf(filep, "\t%s();\n", name);
+		if(num_live > 0)
+		{
+			fprintf(filep, "\tswitch(m68ki_fuse_peek(%d))\n\t{\n", first);
+			for(i=0;i<num_live;i++)
+			{
+				fprintf(filep, "\t\tcase %d: /* %s */\n", live[i], g_opcode_output_table[live[i]].name);
+				fprintf(filep, "\t\t\tm68ki_fuse_continue(%d);\n", first);
+				fprintf(filep, "\t\t\t%s();\n", g_opcode_output_table[live[i]].name);
+				fprintf(filep, "\t\t\tbreak;\n");
+			}
+			fprintf(filep, "\t}\n");
+		}
+		fprintf(filep, "}\n\n");
+	}
+
+	fprintf(filep, "/* Handler table entry of a handler that starts fused pairs */\n");
+	fprintf(filep, "#define M68KI_FUSE(H) H##_fused\n\n");
+	fprintf(filep, "#else\n\n");
+	fprintf(filep, "#define M68KI_FUSE(H) H\n\n");
+	fprintf(filep, "#endif /* M68KI_FUSED_PAIRS */\n\n\n");
 }
 
 /* Fill out an opcode struct with a specific addressing mode of the source opcode struct */
@@ -863,13 +1415,17 @@ void set_opcode_struct(opcode_struct* src, opcode_struct* dst, int ea_mode)
 /* Generate a final opcode handler from the provided data */
 void generate_opcode_handler(FILE* filep, body_struct* body, replace_struct* replace, opcode_struct* opinfo, int ea_mode)
 {
+	static char text[MAX_BODY_LENGTH * (MAX_LINE_LENGTH+1) + 3 + sizeof(ID_FLAGS_DISCARD)];
 	char str[MAX_LINE_LENGTH+1];
+	char* ptr;
 	opcode_struct* op = malloc(sizeof(opcode_struct));
+	opcode_struct* entry;
 
 	/* Set the opcode structure and write the tables, prototypes, etc */
 	set_opcode_struct(opinfo, op, ea_mode);
 	get_base_name(str, op);
 	add_opcode_output_table_entry(op, str);
+	entry = g_opcode_output_table + g_opcode_output_table_length - 1;
 	write_function_name(filep, str);
 
 	/* Add any replace strings needed */
@@ -889,9 +1445,32 @@ void generate_opcode_handler(FILE* filep, body_struct* body, replace_struct* rep
 		add_replace_string(replace, ID_OPHANDLER_OPER_AY_32, str);
 	}
 
-	/* Now write the function body with the selected replace strings */
-	write_body(filep, body, replace);
+	/* Now write the function body with the selected replace strings.  Bring
+	 * any lazily evaluated flags up to date first if the body uses them.
+	 */
+	expand_body(text, body, replace);
+	if((ptr = find_flags_overwrite(text)) != NULL)
+	{
+		memmove(ptr + strlen(ID_FLAGS_DISCARD), ptr, strlen(ptr) + 1);
+		memcpy(ptr, ID_FLAGS_DISCARD, strlen(ID_FLAGS_DISCARD));
+	}
+	else if(uses_flags(text) && text[0] == '{' && text[1] == '\n')
+	{
+		memmove(text + 2 + strlen(ID_FLAGS_SYNC), text + 2, strlen(text + 2) + 1);
+		memcpy(text + 2, ID_FLAGS_SYNC, strlen(ID_FLAGS_SYNC));
+	}
+	fputs(text, filep);
 	g_num_functions++;
+
+	/* Keep the body for the fused handlers, and for the handler sets if they
+	 * need their own copies of it.
+	 */
+	entry->body = malloc(strlen(text) + 1);
+	if(entry->body == NULL)
+		error_exit("Out of memory");
+	strcpy(entry->body, text);
+	if(is_cpu_dependent(text))
+		entry->cpu_body = entry->body;
 	free(op);
 }
 
@@ -1208,6 +1787,50 @@ void read_insert(char* insert)
 	*ptr++ = 0;
 }
 
+/* Read a list of opcode handler pairs to fuse: the names of the two handlers
+ * (without the m68k_op_ prefix) on each line, separated by spaces.  Anything
+ * after the names, such as a count from a profile, is ignored, and so are
+ * blank lines and lines starting with '#'.  Reads up to the next separator
+ * in the input file, or to the end of a pairs file.  Nothing is kept unless
+ * keep is set.
+ */
+void read_fused_pairs(FILE* file, int keep)
+{
+	char buff[MAX_LINE_LENGTH+1];
+	char first[MAX_LINE_LENGTH+1];
+	char second[MAX_LINE_LENGTH+1];
+	fused_pair_struct* pair;
+	int fields;
+
+	for(;;)
+	{
+		if(fgetline(buff, MAX_LINE_LENGTH, file) == (size_t)-1)
+		{
+			if(file == g_input_file)
+				error_exit("Premature EOF while reading fused pairs");
+			return;
+		}
+		if(file == g_input_file && strcmp(buff, ID_INPUT_SEPARATOR) == 0)
+			return;
+
+		fields = sscanf(buff, "%s %s", first, second);
+		if(fields < 1 || first[0] == '#')
+			continue;
+		if(fields < 2)
+			error_exit("Missing second handler in fused pair: %s", buff);
+		if(!keep)
+			continue;
+
+		if(g_fused_pairs_length >= MAX_FUSED_PAIRS)
+			error_exit("Too many fused pairs");
+		if(strlen(first) + 8 >= MAX_NAME_LENGTH || strlen(second) + 8 >= MAX_NAME_LENGTH)
+			error_exit("Opcode handler name too long in fused pair: %s", buff);
+		pair = g_fused_pairs + g_fused_pairs_length++;
+		sprintf(pair->first, "m68k_op_%.*s", MAX_NAME_LENGTH - 9, first);
+		sprintf(pair->second, "m68k_op_%.*s", MAX_NAME_LENGTH - 9, second);
+	}
+}
+
 
 
 /* ======================================================================== */
@@ -1219,6 +1842,7 @@ int main(int argc, char **argv)
 	/* File stuff */
 	char output_path[M68K_MAX_DIR] = "";
 	char filename[M68K_MAX_PATH*2];
+	FILE* pairs_file;
 	/* Section identifier */
 	char section_id[MAX_LINE_LENGTH+1];
 	/* Inserts */
@@ -1237,6 +1861,7 @@ int main(int argc, char **argv)
 	int ophandler_footer_read = 0;
 	int table_body_read = 0;
 	int ophandler_body_read = 0;
+	int fused_pairs_read = 0;
 
 	printf("\n\tMusashi v%s 68000, 68008, 68010, 68EC020, 68020, 68EC030, 68030, 68EC040, 68040 emulator\n", g_version);
 	printf("\t\tCopyright Karl Stenerud (kstenerud@gmail.com)\n\n");
@@ -1255,6 +1880,15 @@ int main(int argc, char **argv)
 			strcpy(g_input_filename, argv[2]);
 	}
 
+	/* A pairs file replaces the fused pairs of the input file */
+	if(argc > 3)
+	{
+		if((pairs_file = fopen(argv[3], "rt")) == NULL)
+			perror_exit("can't open %s for input", argv[3]);
+		read_fused_pairs(pairs_file, 1);
+		fclose(pairs_file);
+	}
+
 
 	/* Open the files we need */
 	sprintf(filename, "%s%s", output_path, FILENAME_PROTOTYPE);
@@ -1354,10 +1988,19 @@ int main(int argc, char **argv)
 
 			fprintf(g_table_file, "%s\n\n", ophandler_header_insert);
 			process_opcode_handlers(g_table_file);
+			print_handler_sets(g_table_file);
 			fprintf(g_table_file, "%s\n\n", ophandler_footer_insert);
 
 			ophandler_body_read = 1;
 		}
+		else if(strcmp(section_id, ID_FUSED_PAIRS) == 0)
+		{
+			if(fused_pairs_read)
+				error_exit("Duplicate fused pairs section");
+
+			read_fused_pairs(g_input_file, argc <= 3);
+			fused_pairs_read = 1;
+		}
 		else if(strcmp(section_id, ID_END) == 0)
 		{
 			/* End of input file.  Do a sanity check and then write footers */
@@ -1378,10 +2021,14 @@ int main(int argc, char **argv)
 			if(!ophandler_body_read)
 				error_exit("Missing opcode handler body");
 
+			resolve_opcode_tables();
+			print_fused_handlers(g_table_file);
 			fprintf(g_table_file, "%s\n\n", table_header_insert);
-			print_opcode_output_table(g_table_file);
+			print_opcode_tables(g_table_file);
 			fprintf(g_table_file, "%s\n\n", table_footer_insert);
+			print_threaded_core(g_table_file);
 
+			print_handler_count(g_prototype_file);
 			fprintf(g_prototype_file, "%s\n\n", prototype_footer_insert);
 
 			break;
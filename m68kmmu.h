@@ -8,9 +8,11 @@
 */
 
 /*
-	pmmu_translate_addr: perform 68851/68030-style PMMU address translation
+	pmmu_walk: perform 68851/68030-style PMMU address translation, returns
+	in *bits the number of low address bits passed through unchanged
+	(0 if the address could not be translated)
 */
-uint pmmu_translate_addr(uint addr_in)
+static uint pmmu_walk(uint addr_in, uint fc, uint *bits)
 {
 	uint32 addr_out, tbl_entry = 0, tbl_entry2, tamode = 0, tbmode = 0, tcmode = 0;
 	uint root_aptr, root_limit, tofs, is, abits, bbits, cbits;
@@ -19,8 +21,10 @@ uint pmmu_translate_addr(uint addr_in)
 	resolved = 0;
 	addr_out = addr_in;
 
-	// if SRP is enabled and we're in supervisor mode, use it
-	if ((m68ki_cpu.mmu_tc & 0x02000000) && (m68ki_get_sr() & 0x2000))
+	*bits = 0;
+
+	// if SRP is enabled and this is a supervisor access, use it
+	if ((m68ki_cpu.mmu_tc & 0x02000000) && (fc & 4))
 	{
 		root_aptr = m68ki_cpu.mmu_srp_aptr;
 		root_limit = m68ki_cpu.mmu_srp_limit;
@@ -45,10 +49,12 @@ uint pmmu_translate_addr(uint addr_in)
 	// find out what format table A is
 	switch (root_limit & 3)
 	{
-		case 0:	// invalid, should cause MMU exception
-		case 1:	// page descriptor, should cause direct mapping
-			fatalerror("680x0 PMMU: Unhandled root mode\n");
-			break;
+		case 0:	// invalid
+			return addr_in;
+
+		case 1:	// page descriptor, direct mapping
+			*bits = 32 - is;
+			return ((addr_in<<is)>>is) + (root_aptr & 0xffffff00);
 
 		case 2:	// valid 4 byte descriptors
 			tofs *= 4;
@@ -75,9 +81,8 @@ uint pmmu_translate_addr(uint addr_in)
 	// find out what format table B is, if any
 	switch (tamode)
 	{
-		case 0: // invalid, should cause MMU exception
-			fatalerror("680x0 PMMU: Unhandled Table A mode %d (addr_in %08x)\n", tamode, addr_in);
-			break;
+		case 0: // invalid
+			return addr_in;
 
 		case 2: // 4-byte table B descriptor
 			tofs *= 4;
@@ -114,9 +119,8 @@ uint pmmu_translate_addr(uint addr_in)
 
 		switch (tbmode)
 		{
-			case 0:	// invalid, should cause MMU exception
-				fatalerror("680x0 PMMU: Unhandled Table B mode %d (addr_in %08x PC %x)\n", tbmode, addr_in, REG_PC);
-				break;
+			case 0:	// invalid
+				return addr_in;
 
 			case 2: // 4-byte table C descriptor
 				tofs *= 4;
@@ -149,11 +153,10 @@ uint pmmu_translate_addr(uint addr_in)
 	{
 		switch (tcmode)
 		{
-			case 0:	// invalid, should cause MMU exception
-			case 2: // 4-byte ??? descriptor
-			case 3: // 8-byte ??? descriptor
-				fatalerror("680x0 PMMU: Unhandled Table B mode %d (addr_in %08x PC %x)\n", tbmode, addr_in, REG_PC);
-				break;
+			case 0:	// invalid
+			case 2: // 4-byte table D descriptor, not supported
+			case 3: // 8-byte table D descriptor, not supported
+				return addr_in;
 
 			case 1: // termination descriptor
 				tbl_entry &= 0xffffff00;
@@ -168,9 +171,329 @@ uint pmmu_translate_addr(uint addr_in)
 
 //	fprintf(stderr,"PMMU: [%08x] => [%08x]\n", addr_in, addr_out);
 
+	*bits = resolved && shift < 32 ? 32 - shift : 0;
 	return addr_out;
 }
 
+/*
+	pmmu_tt_match_040: check the 68040 transparent translation registers,
+	returns 1 and sets *wp to the write protect bit on a match
+*/
+static int pmmu_tt_match_040(uint addr_in, uint fc, uint *wp)
+{
+	uint tt[2];
+	int i;
+
+	if (M68KI_ATC_FOR(fc) == 0)
+	{
+		tt[0] = m68ki_cpu.mmu_itt0;
+		tt[1] = m68ki_cpu.mmu_itt1;
+	}
+	else
+	{
+		tt[0] = m68ki_cpu.mmu_dtt0;
+		tt[1] = m68ki_cpu.mmu_dtt1;
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		// enabled, S field matches (or is ignored), and base matches outside the mask
+		if ((tt[i] & 0x8000) &&
+			(((tt[i]>>13) & 3) >= 2 || ((tt[i]>>13) & 1) == ((fc>>2) & 1)) &&
+			((((addr_in ^ tt[i])>>24) & ~(tt[i]>>16)) & 0xff) == 0)
+		{
+			*wp = tt[i] & 4;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+	pmmu_walk_040: perform 68040-style table search, updating the used and
+	modified bits.  Returns the physical address and sets *bits like
+	pmmu_walk(), *flags to M68KI_ATC_xxx flags and *status to the MMUSR
+	value PTEST would report.
+*/
+static uint pmmu_walk_040(uint addr_in, uint fc, uint write, uint *bits, uint *flags, uint *status)
+{
+	uint root = (fc & 4) ? m68ki_cpu.mmu_srp_aptr : m68ki_cpu.mmu_urp_aptr;
+	uint big = m68ki_cpu.mmu_tc & 0x4000;	// 8K pages
+	uint dptr, desc, wp, page;
+
+	*bits = 0;
+	*flags = 0;
+	*status = 0;
+
+	// root level, indexed by bits 31-25
+	dptr = (root & 0xfffffe00) + ((addr_in>>25) << 2);
+	desc = m68k_read_memory_32(dptr);
+	if (!(desc & 2))
+		return addr_in;
+	if (!(desc & 8))
+		m68k_write_memory_32(dptr, desc | 8);
+	wp = desc & 4;
+
+	// pointer level, indexed by bits 24-18
+	dptr = (desc & 0xfffffe00) + (((addr_in>>18) & 0x7f) << 2);
+	desc = m68k_read_memory_32(dptr);
+	if (!(desc & 2))
+		return addr_in;
+	if (!(desc & 8))
+		m68k_write_memory_32(dptr, desc | 8);
+	wp |= desc & 4;
+
+	// page level, indexed by bits 17-12 (4K) or 17-13 (8K)
+	if (big)
+		dptr = (desc & 0xffffff80) + (((addr_in>>13) & 0x1f) << 2);
+	else
+		dptr = (desc & 0xffffff00) + (((addr_in>>12) & 0x3f) << 2);
+	desc = m68k_read_memory_32(dptr);
+	if ((desc & 3) == 2)	// indirect
+	{
+		dptr = desc & 0xfffffffc;
+		desc = m68k_read_memory_32(dptr);
+		if ((desc & 3) == 2)
+			return addr_in;
+	}
+	if ((desc & 3) == 0)
+		return addr_in;
+	wp |= desc & 4;
+	page = desc & (big ? 0xffffe000 : 0xfffff000);
+	*status = page | (desc & 0x7f0) | (wp ? 4 : 0) | 1;
+
+	// supervisor only page, or write protected
+	if (((desc & 0x80) && !(fc & 4)) || (write && wp))
+		return addr_in;
+
+	if (!(desc & 8) || (write && !(desc & 0x10)))
+	{
+		desc |= write ? 0x18 : 8;
+		m68k_write_memory_32(dptr, desc);
+	}
+
+	*status |= desc & 0x10;
+	*bits = big ? 13 : 12;
+	*flags = (wp || !(desc & 0x10) ? M68KI_ATC_NOWRITE : 0) | (desc & 0x400 ? M68KI_ATC_GLOBAL : 0);
+	return page | (addr_in & ((1 << *bits) - 1));
+}
+
+/*
+	pmmu_atc_fill: keep a translation in the ATC if it covers a whole ATC
+	page
+*/
+static void pmmu_atc_fill(uint addr_in, uint fc, uint addr_out, uint bits, uint flags)
+{
+	uint shift = m68ki_cpu.mmu_atc_shift;
+	uint page = (addr_in >> shift) << shift;
+	m68ki_atc_entry *entry;
+
+	if (bits >= shift)
+	{
+		entry = &m68ki_cpu.mmu_atc[M68KI_ATC_FOR(fc)][((addr_in >> shift) ^ fc) & (M68K_PMMU_ATC_ENTRIES - 1)];
+		entry->tag = page | (fc & 7) | M68KI_ATC_VALID;
+		entry->root = m68ki_cpu.mmu_atc_root[(fc >> 2) & 1];
+		entry->phys = (addr_out - (addr_in - page)) | flags;
+	}
+}
+
+/*
+	pmmu_atc_load: translate an address, and keep the result in the ATC.
+	Returns 0 and sets *addr_out, or returns 1 if the access faults.
+*/
+static int pmmu_atc_load(uint addr_in, uint fc, uint write, uint *addr_out)
+{
+	uint bits, flags, status, wp;
+
+	if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
+	{
+		// transparent translation takes precedence over the tables
+		if (pmmu_tt_match_040(addr_in, fc, &wp))
+		{
+			if (write && wp)
+				return 1;
+			*addr_out = addr_in;
+			bits = 24;
+			flags = wp ? M68KI_ATC_NOWRITE : 0;
+		}
+		else
+		{
+			*addr_out = pmmu_walk_040(addr_in, fc, write, &bits, &flags, &status);
+		}
+	}
+	else
+	{
+		*addr_out = pmmu_walk(addr_in, fc, &bits);
+		flags = 0;
+	}
+
+	if (bits == 0)
+		return 1;
+	pmmu_atc_fill(addr_in, fc, *addr_out, bits, flags);
+	return 0;
+}
+
+/*
+	pmmu_fault: raise an access fault for a failed translation
+*/
+static void pmmu_fault(uint addr_in, uint fc, uint write, uint size)
+{
+	m68ki_cpu.berr_address = addr_in;
+	m68ki_cpu.berr_mmu = 1;
+
+	if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
+	{
+		// ATC fault, R/W, size (long, byte, word) and transfer modifier
+		m68ki_cpu.berr_ssw = 0x0400 | (write ? 0 : 0x0100) | (size == 1 ? 0x20 : size == 2 ? 0x40 : 0) | (fc & 7);
+	}
+	else if (M68KI_ATC_FOR(fc) == 0)
+	{
+		// fault on instruction stage B, rerun
+		m68ki_cpu.berr_ssw = 0x5000 | (fc & 7);
+	}
+	else
+	{
+		// data fault, R/W, size (long, byte, word)
+		m68ki_cpu.berr_ssw = 0x0100 | (write ? 0 : 0x40) | (size == 1 ? 0x10 : size == 2 ? 0x20 : 0) | (fc & 7);
+	}
+	m68ki_bus_error();
+}
+
+/*
+	pmmu_translate_addr: ATC miss, called from m68ki_pmmu_translate()
+*/
+uint pmmu_translate_addr(uint addr_in, uint fc, uint write, uint size)
+{
+	uint addr_out;
+
+	/* No table walks once the instruction has faulted */
+	if (m68ki_fault_pending())
+		return addr_in;
+
+	m68ki_cpu.mmu_atc_misses++;
+	if (pmmu_atc_load(addr_in, fc, write, &addr_out))
+	{
+		pmmu_fault(addr_in, fc, write, size);
+		return addr_in;
+	}
+	return addr_out;
+}
+
+/*
+	pmmu_atc_flush: drop the ATC entries whose function code matches fc in
+	the bits set in fc_mask, and with PMMU_FLUSH_ADDR, that map addr.
+	PMMU_FLUSH_NONGLOBAL keeps global (68040) entries.
+*/
+#define PMMU_FLUSH_ADDR      1
+#define PMMU_FLUSH_NONGLOBAL 2
+
+static void pmmu_atc_flush(uint fc, uint fc_mask, uint addr, int mode)
+{
+	uint shift = m68ki_cpu.mmu_atc_shift;
+	int i, j;
+
+	for (i = 0; i < 2; i++)
+	{
+		for (j = 0; j < M68K_PMMU_ATC_ENTRIES; j++)
+		{
+			m68ki_atc_entry *entry = &m68ki_cpu.mmu_atc[i][j];
+
+			if ((entry->tag & M68KI_ATC_VALID) && ((entry->tag ^ fc) & fc_mask & 7) == 0 &&
+				(!(mode & PMMU_FLUSH_ADDR) || (entry->tag >> shift) == (addr >> shift)) &&
+				(!(mode & PMMU_FLUSH_NONGLOBAL) || !(entry->phys & M68KI_ATC_GLOBAL)))
+			{
+				entry->tag = 0;
+			}
+		}
+	}
+}
+
+/*
+	pmmu_update_roots: work out the root pointers the ATC entries are tagged with
+*/
+static void pmmu_update_roots(void)
+{
+	if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
+	{
+		m68ki_cpu.mmu_atc_root[0] = m68ki_cpu.mmu_urp_aptr;
+		m68ki_cpu.mmu_atc_root[1] = m68ki_cpu.mmu_srp_aptr;
+	}
+	else
+	{
+		m68ki_cpu.mmu_atc_root[0] = m68ki_cpu.mmu_crp_aptr;
+		m68ki_cpu.mmu_atc_root[1] = (m68ki_cpu.mmu_tc & 0x02000000) ? m68ki_cpu.mmu_srp_aptr : m68ki_cpu.mmu_crp_aptr;
+	}
+}
+
+/*
+	pmmu_set_tc: write TC, which also drops all of the ATC
+*/
+static void pmmu_set_tc(uint tc)
+{
+	m68ki_cpu.mmu_tc = tc;
+	m68ki_cpu.pmmu_enabled = (tc & 0x80000000) ? 1 : 0;
+
+	// the ATC works on pages of the size in the PS field
+	m68ki_cpu.mmu_atc_shift = (tc >> 20) & 0xf;
+	if (m68ki_cpu.mmu_atc_shift < M68KI_ATC_MIN_SHIFT)
+		m68ki_cpu.mmu_atc_shift = M68KI_ATC_MIN_SHIFT;
+	memset(m68ki_cpu.mmu_atc, 0, sizeof(m68ki_cpu.mmu_atc));
+	pmmu_update_roots();
+
+	// opcode fetches from host memory assume untranslated addresses
+	m68ki_fetch_invalidate();
+}
+
+/*
+	pmmu_get_fc: decode the FC field of PFLUSH/PLOAD
+*/
+static uint pmmu_get_fc(uint modes)
+{
+	if ((modes & 0x18) == 0x10)		// immediate
+		return modes & 7;
+	if ((modes & 0x18) == 0x08)		// data register
+		return REG_D[modes & 7] & 7;
+	if ((modes & 0x1f) == 0)		// SFC
+		return REG_SFC;
+	if ((modes & 0x1f) == 1)		// DFC
+		return REG_DFC;
+
+	fprintf(stderr,"680x0: PMMU unknown function code field %x, PC %x\n", modes & 0x1f, REG_PC);
+	return 0;
+}
+
+/*
+	pmmu_get_ea: get the address of a control addressing mode operand
+*/
+static uint pmmu_get_ea(uint ea)
+{
+	switch ((ea >> 3) & 7)
+	{
+		case 2:		// (An)
+			return REG_A[ea & 7];
+
+		case 5:		// (d16, An)
+			return EA_AY_DI_32();
+
+		case 6:		// (An) + (Xn) + d8
+			return EA_AY_IX_32();
+
+		case 7:
+			switch (ea & 7)
+			{
+				case 0:		// (xxx).W
+					return EA_AW_32();
+
+				case 1:		// (xxx).L
+					return EA_AL_32();
+			}
+			break;
+	}
+
+	fprintf(stderr,"680x0: PMMU unhandled EA mode %x, PC %x\n", ea, REG_PC);
+	return 0;
+}
+
 /*
 
 	m68881_mmu_ops: COP 0 MMU opcode handling
@@ -203,17 +526,41 @@ void m68881_mmu_ops(void)
 
 				if ((modes & 0xfde0) == 0x2000)	// PLOAD
 				{
-					fprintf(stderr,"680x0: unhandled PLOAD\n");
+					if (m68ki_cpu.pmmu_enabled)
+					{
+						uint addr_out;
+
+						pmmu_atc_load(pmmu_get_ea(ea), pmmu_get_fc(modes), !(modes & 0x200), &addr_out);
+					}
 					return;
 				}
 				else if ((modes & 0xe200) == 0x2000)	// PFLUSH
 				{
-					fprintf(stderr,"680x0: unhandled PFLUSH PC=%x\n", REG_PC);
+					switch ((modes>>10) & 7)
+					{
+						case 1:	// PFLUSHA
+							pmmu_atc_flush(0, 0, 0, 0);
+							break;
+
+						case 4:	// by function code
+							pmmu_atc_flush(pmmu_get_fc(modes), (modes>>5) & 7, 0, 0);
+							break;
+
+						case 6:	// by function code and address
+							pmmu_atc_flush(pmmu_get_fc(modes), (modes>>5) & 7, pmmu_get_ea(ea), PMMU_FLUSH_ADDR);
+							break;
+
+						default:
+							fprintf(stderr,"680x0: unknown PFLUSH mode %x, PC %x\n", (modes>>10) & 7, REG_PC);
+							break;
+					}
 					return;
 				}
 				else if (modes == 0xa000)	// PFLUSHR
 				{
-					fprintf(stderr,"680x0: unhandled PFLUSHR\n");
+					// the ATC is not tagged with the root pointer's task, drop it all
+					READ_EA_64(ea);
+					pmmu_atc_flush(0, 0, 0, 0);
 					return;
 				}
 				else if (modes == 0x2800)	// PVALID (FORMAT 1)
@@ -263,28 +610,23 @@ void m68881_mmu_ops(void)
 							 	switch ((modes>>10) & 7)
 								{
 									case 0:	// translation control register
-										m68ki_cpu.mmu_tc = READ_EA_32(ea);
-
-										if (m68ki_cpu.mmu_tc & 0x80000000)
-										{
-											m68ki_cpu.pmmu_enabled = 1;
-										}
-										else
-										{
-											m68ki_cpu.pmmu_enabled = 0;
-										}
+										pmmu_set_tc(READ_EA_32(ea));
 										break;
 
 									case 2:	// supervisor root pointer
 										temp64 = READ_EA_64(ea);
 										m68ki_cpu.mmu_srp_limit = (temp64>>32) & 0xffffffff;
 										m68ki_cpu.mmu_srp_aptr = temp64 & 0xffffffff;
+										pmmu_update_roots();
+										pmmu_atc_flush(0, 0, 0, 0);
 										break;
 
 									case 3:	// CPU root pointer
 										temp64 = READ_EA_64(ea);
 										m68ki_cpu.mmu_crp_limit = (temp64>>32) & 0xffffffff;
 										m68ki_cpu.mmu_crp_aptr = temp64 & 0xffffffff;
+										pmmu_update_roots();
+										pmmu_atc_flush(0, 0, 0, 0);
 										break;
 
 									default:
@@ -319,3 +661,120 @@ void m68881_mmu_ops(void)
 	}
 }
 
+
+/*
+
+	m68040_mmu_movec_from/to: 68040 MMU control registers
+
+*/
+
+uint m68040_mmu_movec_from(uint reg)
+{
+	switch (reg)
+	{
+		case 0x003:	return m68ki_cpu.mmu_tc;
+		case 0x004:	return m68ki_cpu.mmu_itt0;
+		case 0x005:	return m68ki_cpu.mmu_itt1;
+		case 0x006:	return m68ki_cpu.mmu_dtt0;
+		case 0x007:	return m68ki_cpu.mmu_dtt1;
+		case 0x805:	return m68ki_cpu.mmu_sr_040;
+		case 0x806:	return m68ki_cpu.mmu_urp_aptr;
+		case 0x807:	return m68ki_cpu.mmu_srp_aptr;
+	}
+	return 0;
+}
+
+void m68040_mmu_movec_to(uint reg, uint value)
+{
+	switch (reg)
+	{
+		case 0x003:	// TC: enable and 8K pages
+			m68ki_cpu.mmu_tc = value & 0xc000;
+			m68ki_cpu.pmmu_enabled = (value & 0x8000) && HAS_PMMU;
+			m68ki_cpu.mmu_atc_shift = (value & 0x4000) ? 13 : 12;
+			memset(m68ki_cpu.mmu_atc, 0, sizeof(m68ki_cpu.mmu_atc));
+			m68ki_fetch_invalidate();
+			break;
+
+		// the ATC also holds transparent translations, drop them
+		case 0x004:
+			m68ki_cpu.mmu_itt0 = value & 0xffffe364;
+			pmmu_atc_flush(0, 0, 0, 0);
+			break;
+		case 0x005:
+			m68ki_cpu.mmu_itt1 = value & 0xffffe364;
+			pmmu_atc_flush(0, 0, 0, 0);
+			break;
+		case 0x006:
+			m68ki_cpu.mmu_dtt0 = value & 0xffffe364;
+			pmmu_atc_flush(0, 0, 0, 0);
+			break;
+		case 0x007:
+			m68ki_cpu.mmu_dtt1 = value & 0xffffe364;
+			pmmu_atc_flush(0, 0, 0, 0);
+			break;
+
+		case 0x805:	// MMUSR
+			m68ki_cpu.mmu_sr_040 = value;
+			break;
+
+		// entries of the old tables stay in the ATC until flushed, as on the chip
+		case 0x806:	// URP
+			m68ki_cpu.mmu_urp_aptr = value & 0xfffffe00;
+			break;
+		case 0x807:	// SRP
+			m68ki_cpu.mmu_srp_aptr = value & 0xfffffe00;
+			break;
+	}
+	pmmu_update_roots();
+}
+
+/*
+
+	m68040_mmu_ops: PFLUSH and PTEST, 68040 encodings
+
+*/
+
+void m68040_mmu_ops(void)
+{
+	uint addr = REG_A[m68ki_cpu.ir & 7];
+	uint fc = REG_DFC;
+	uint bits, flags, status, wp, addr_out;
+
+	if ((m68ki_cpu.ir & 0xffe0) == 0xf500)
+	{
+		switch ((m68ki_cpu.ir>>3) & 3)
+		{
+			case 0:	// PFLUSHN (An)
+				pmmu_atc_flush(fc, 4, addr, PMMU_FLUSH_ADDR | PMMU_FLUSH_NONGLOBAL);
+				break;
+			case 1:	// PFLUSH (An)
+				pmmu_atc_flush(fc, 4, addr, PMMU_FLUSH_ADDR);
+				break;
+			case 2:	// PFLUSHAN
+				pmmu_atc_flush(0, 0, 0, PMMU_FLUSH_NONGLOBAL);
+				break;
+			case 3:	// PFLUSHA
+				pmmu_atc_flush(0, 0, 0, 0);
+				break;
+		}
+	}
+	else	// PTESTW (An), PTESTR (An)
+	{
+		uint write = !(m68ki_cpu.ir & 0x20);
+
+		if (pmmu_tt_match_040(addr, fc, &wp))
+		{
+			m68ki_cpu.mmu_sr_040 = (wp ? 4 : 0) | 3;
+			return;
+		}
+
+		// search the tables, and load the ATC as an access would
+		addr_out = pmmu_walk_040(addr, fc, write, &bits, &flags, &status);
+		m68ki_cpu.mmu_sr_040 = status;
+		if (bits != 0)
+		{
+			pmmu_atc_fill(addr, fc, addr_out, bits, flags);
+		}
+	}
+}
@@ -0,0 +1,1319 @@
+/* ======================================================================== */
+/* ========================= LICENSING & COPYRIGHT ======================== */
+/* ======================================================================== */
+/*
+ *                                  MUSASHI
+ *                                Version 3.32
+ *
+ * A portable Motorola M680x0 processor emulation engine.
+ * Copyright Karl Stenerud.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ======================================================================== */
+/* ============================ EXECUTION TRACE =========================== */
+/* ======================================================================== */
+/*
+ * Execution trace files.  Included by m68kcpu.c.
+ *
+ * The CPU encodes records into one of M68K_TRACE_BUFFERS buffers of
+ * M68K_TRACE_BUFFER_SIZE bytes.  A full buffer is handed to a writer thread
+ * by bumping a counter; the writer hands it back the same way once it is on
+ * disk, so the CPU only waits when the disk falls behind by every buffer.
+ *
+ * File layout, all integers little endian:
+ *   "M68KTRC1"
+ *   chunks: u32 payload length, u64 number of the first instruction, payload
+ *   index:  for each record chunk and then each checkpoint chunk, u64 file
+ *           offset, u64 first instruction, u64 masks of the pages written
+ *           and run (see M68KI_TRACE_PAGE_BIT(), 0 for checkpoints)
+ *   trailer: u64 index offset, u64 record chunks, u64 checkpoints, "M68KIDX1"
+ * The index and trailer are written by m68k_stop_trace(); without them a
+ * reader can still walk the chunks from the start.
+ *
+ * A record chunk is a sequence of records, each starting with a tag byte.
+ * Numbers are LEB128 varints; signed ones are zigzag encoded first.
+ *   KEY    number, PC, then the M68K_TRACE_REGS registers.  Starts each
+ *          chunk, so that chunks decode on their own.
+ *   ACCESS (tag holds the size and M68KI_TRACE_WRITE) address - previous
+ *          address (signed), value.  The accesses of an instruction come
+ *          before it.
+ *   INSN   (tag holds M68KI_TRACE_TRUNCATED) PC - previous PC (signed), IR,
+ *          cycles, mask of the registers that changed, then new ^ old for
+ *          each of them.
+ * The last chunk holds just a key with the state at the end of the trace.
+ *
+ * A checkpoint chunk (M68KI_TRACE_CHECKPOINT set in its length) is written
+ * at the start of the trace, every M68K_TRACE_CHECKPOINT instructions after
+ * that and at the end; its first instruction is the number of instructions
+ * run so far.  Its payload holds the number of memory pages written and of
+ * pages run since the previous checkpoint, both lists of pages as ascending
+ * deltas, then the shadow of each written page: every byte written since
+ * the trace started.  The registers are in the key of the record chunk
+ * starting at the same instruction.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Trace files can pass 2 GB, so seek with 64-bit offsets.  m68kcpu.c sets
+ * _FILE_OFFSET_BITS for a 64-bit off_t on 32-bit hosts.
+ */
+#if defined(_MSC_VER)
+	#define m68ki_trace_seek(F, OFFSET, WHENCE) _fseeki64(F, (__int64)(OFFSET), WHENCE)
+#elif defined(__unix__) || defined(__APPLE__)
+	#include <sys/types.h>
+	#define m68ki_trace_seek(F, OFFSET, WHENCE) fseeko(F, (off_t)(OFFSET), WHENCE)
+#else
+	#define m68ki_trace_seek(F, OFFSET, WHENCE) fseek(F, (long)(OFFSET), WHENCE)
+#endif
+
+#define M68KI_TRACE_KEY       0x10
+#define M68KI_TRACE_ACCESS    0x20    /* | access kind */
+#define M68KI_TRACE_INSN      0x40    /* | M68KI_TRACE_TRUNCATED */
+#define M68KI_TRACE_TRUNCATED 0x01
+
+#define M68KI_TRACE_CHECKPOINT 0x80000000 /* In the length of checkpoint chunks */
+
+#define M68KI_TRACE_MAGIC       "M68KTRC1"
+#define M68KI_TRACE_INDEX_MAGIC "M68KIDX1"
+
+#define M68KI_TRACE_PAGE_SHIFT 12
+#define M68KI_TRACE_PAGE_SIZE  (1 << M68KI_TRACE_PAGE_SHIFT)
+#define M68KI_TRACE_PAGES      (1 << (32 - M68KI_TRACE_PAGE_SHIFT))
+
+/* Bit of a page in the 64-bit page masks of the index */
+#define M68KI_TRACE_PAGE_BIT(P) (1ULL << (MASK_OUT_ABOVE_32((P) * 0x9e3779b1) >> 26))
+
+#define M68KI_TRACE_COLUMNS 4  /* Of the index */
+#define M68KI_TRACE_WRITTEN 2  /* Column of the pages written */
+#define M68KI_TRACE_RUN     3  /* Column of the pages run */
+
+/* Largest records, with 5 bytes per 32-bit varint and 10 per 64-bit one */
+#define M68KI_TRACE_ACCESS_MAX 11
+#define M68KI_TRACE_INSN_MAX   (1 + 5 + 3 + 5 + 3 + M68K_TRACE_REGS * 5)
+#define M68KI_TRACE_KEY_MAX    (1 + 10 + 5 + M68K_TRACE_REGS * 5)
+
+/* Room left in a buffer for one more instruction */
+#define M68KI_TRACE_RESERVE \
+	(M68K_TRACE_ACCESSES * M68KI_TRACE_ACCESS_MAX + M68KI_TRACE_INSN_MAX + M68KI_TRACE_KEY_MAX)
+
+/* The bytes of a memory page written since the trace started */
+typedef struct
+{
+	uint8 data[M68KI_TRACE_PAGE_SIZE];
+	uint8 known[M68KI_TRACE_PAGE_SIZE / 8]; /* Bit per byte of data */
+} m68ki_trace_page;
+
+static int m68ki_trace_page_compare(const void* a, const void* b)
+{
+	uint x = *(const uint*)a;
+	uint y = *(const uint*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+#if M68KI_TRACE
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+/* Set of pages, as a bitmap and a list */
+typedef struct
+{
+	uint* page;
+	uint count;
+	uint size;
+	uint8 map[M68KI_TRACE_PAGES / 8];
+} m68ki_trace_pages;
+
+struct m68ki_trace
+{
+	/* Owned by the CPU */
+	uint8* pos;                       /* Next byte of the buffer being filled */
+	uint8* full;                      /* Hand the buffer over once pos passes this */
+	unsigned long long count;         /* Instructions traced */
+	unsigned long long checkpoint;    /* Instruction count of the next checkpoint */
+	uint pc;                          /* PC of the last instruction */
+	uint regs[M68K_TRACE_REGS];       /* Registers after the last instruction */
+	uint address;                     /* Address of the last access */
+	uint accesses;                    /* Accesses of the instruction running */
+	unsigned long long chunk_written; /* Page masks of the buffer being filled */
+	unsigned long long chunk_run;
+	int lost;                         /* Out of memory for the checkpoints */
+	m68ki_trace_page** shadow[M68KI_TRACE_PAGES >> 10]; /* By page >> 10, then page & 1023 */
+	m68ki_trace_pages written;        /* Pages written since the last checkpoint */
+	m68ki_trace_pages run;            /* Pages run since the last checkpoint */
+
+	/* Shared: buffer n % M68K_TRACE_BUFFERS is the CPU's while
+	 * produced <= n < consumed + M68K_TRACE_BUFFERS, and the writer's
+	 * while consumed <= n < produced.  A checkpoint goes with its buffer.
+	 */
+	unsigned long long produced;
+	unsigned long long consumed;
+	int stop;
+	uint8* buffer[M68K_TRACE_BUFFERS];
+	uint length[M68K_TRACE_BUFFERS];
+	unsigned long long first[M68K_TRACE_BUFFERS];
+	unsigned long long written_mask[M68K_TRACE_BUFFERS];
+	unsigned long long run_mask[M68K_TRACE_BUFFERS];
+	uint8* checkpoint_data[M68K_TRACE_BUFFERS]; /* Written after the buffer, or NULL */
+	uint checkpoint_length[M68K_TRACE_BUFFERS];
+	unsigned long long checkpoint_first[M68K_TRACE_BUFFERS];
+
+	/* Owned by the writer */
+	FILE* file;
+	int failed;
+	unsigned long long offset;
+	unsigned long long chunks;
+	unsigned long long* index;        /* M68KI_TRACE_COLUMNS for each chunk */
+	unsigned long long checkpoints;
+	unsigned long long* checkpoint_index;
+	pthread_t writer;
+};
+
+static uint8* m68ki_trace_put_varint(uint8* p, unsigned long long value)
+{
+	while(value >= 0x80)
+	{
+		*p++ = (uint8)(value | 0x80);
+		value >>= 7;
+	}
+	*p++ = (uint8)value;
+	return p;
+}
+
+static uint m68ki_trace_zigzag(uint delta)
+{
+	return (delta << 1) ^ (uint)-(sint)(delta >> 31);
+}
+
+static void m68ki_trace_put_u32(uint8* p, uint value)
+{
+	int i;
+
+	for(i = 0; i < 4; i++)
+		p[i] = (uint8)(value >> (i * 8));
+}
+
+static void m68ki_trace_put_u64(uint8* p, unsigned long long value)
+{
+	int i;
+
+	for(i = 0; i < 8; i++)
+		p[i] = (uint8)(value >> (i * 8));
+}
+
+static void m68ki_trace_write_file(m68ki_trace* trace, const void* data, size_t size)
+{
+	if(fwrite(data, 1, size, trace->file) != size)
+		trace->failed = 1;
+	trace->offset += size;
+}
+
+/* Write a chunk and add it to an index */
+static void m68ki_trace_write_chunk(m68ki_trace* trace, unsigned long long** index, unsigned long long* count,
+	const uint8* payload, uint length, unsigned long long first, unsigned long long written, unsigned long long run)
+{
+	unsigned long long* entry;
+	uint8 header[12];
+
+	if((*count & (*count - 1)) == 0)
+	{
+		unsigned long long* grown = realloc(*index, M68KI_TRACE_COLUMNS * sizeof(*grown) * (*count ? *count * 2 : 1));
+		if(grown == NULL)
+		{
+			trace->failed = 1;
+			return;
+		}
+		*index = grown;
+	}
+	entry = *index + *count * M68KI_TRACE_COLUMNS;
+	entry[0] = trace->offset;
+	entry[1] = first;
+	entry[2] = written;
+	entry[3] = run;
+	(*count)++;
+
+	m68ki_trace_put_u32(header, length);
+	m68ki_trace_put_u64(header + 4, first);
+	m68ki_trace_write_file(trace, header, sizeof(header));
+	m68ki_trace_write_file(trace, payload, length & ~M68KI_TRACE_CHECKPOINT);
+}
+
+static void* m68ki_trace_writer(void* param)
+{
+	m68ki_trace* trace = param;
+	struct timespec idle = {0, 100000};
+
+	for(;;)
+	{
+		int stop = __atomic_load_n(&trace->stop, __ATOMIC_ACQUIRE);
+		unsigned long long n = trace->consumed;
+
+		if(n < __atomic_load_n(&trace->produced, __ATOMIC_ACQUIRE))
+		{
+			uint slot = n % M68K_TRACE_BUFFERS;
+
+			m68ki_trace_write_chunk(trace, &trace->index, &trace->chunks,
+				trace->buffer[slot], trace->length[slot], trace->first[slot], trace->written_mask[slot], trace->run_mask[slot]);
+			if(trace->checkpoint_data[slot] != NULL)
+			{
+				m68ki_trace_write_chunk(trace, &trace->checkpoint_index, &trace->checkpoints, trace->checkpoint_data[slot],
+					trace->checkpoint_length[slot] | M68KI_TRACE_CHECKPOINT, trace->checkpoint_first[slot], 0, 0);
+				free(trace->checkpoint_data[slot]);
+			}
+			__atomic_store_n(&trace->consumed, n + 1, __ATOMIC_RELEASE);
+			continue;
+		}
+		if(stop)
+			return NULL;
+		nanosleep(&idle, NULL);
+	}
+}
+
+static void m68ki_trace_add_page(m68ki_trace* trace, m68ki_trace_pages* set, uint page)
+{
+	if(set->map[page >> 3] & (1 << (page & 7)))
+		return;
+	if(set->count == set->size)
+	{
+		uint size = set->size ? set->size * 2 : 64;
+		uint* grown = realloc(set->page, size * sizeof(uint));
+
+		if(grown == NULL)
+		{
+			trace->lost = 1;
+			return;
+		}
+		set->page = grown;
+		set->size = size;
+	}
+	set->map[page >> 3] |= 1 << (page & 7);
+	set->page[set->count++] = page;
+}
+
+/* Sort the list for the checkpoint and empty the set */
+static uint8* m68ki_trace_put_pages(uint8* p, m68ki_trace_pages* set)
+{
+	uint previous = 0;
+	uint i;
+
+	if(set->count > 1)
+		qsort(set->page, set->count, sizeof(uint), m68ki_trace_page_compare);
+	for(i = 0; i < set->count; i++)
+	{
+		p = m68ki_trace_put_varint(p, set->page[i] - previous);
+		previous = set->page[i];
+		set->map[previous >> 3] &= ~(1 << (previous & 7));
+	}
+	return p;
+}
+
+/* Update the shadow of memory with a write */
+static void m68ki_trace_shadow(m68ki_trace* trace, uint address, uint size, uint value)
+{
+	while(size-- > 0)
+	{
+		uint byte = MASK_OUT_ABOVE_32(address + size);
+		uint page = byte >> M68KI_TRACE_PAGE_SHIFT;
+		uint offset = byte & (M68KI_TRACE_PAGE_SIZE - 1);
+		m68ki_trace_page** table = trace->shadow[page >> 10];
+
+		if(table == NULL && (table = trace->shadow[page >> 10] = calloc(1024, sizeof(*table))) == NULL)
+		{
+			trace->lost = 1;
+			return;
+		}
+		if(table[page & 1023] == NULL && (table[page & 1023] = calloc(1, sizeof(m68ki_trace_page))) == NULL)
+		{
+			trace->lost = 1;
+			return;
+		}
+		table[page & 1023]->data[offset] = (uint8)value;
+		table[page & 1023]->known[offset >> 3] |= 1 << (offset & 7);
+		m68ki_trace_add_page(trace, &trace->written, page);
+		trace->chunk_written |= M68KI_TRACE_PAGE_BIT(page);
+		value >>= 8;
+	}
+}
+
+/* Build a checkpoint of the pages written and run since the last one */
+static uint8* m68ki_trace_build_checkpoint(m68ki_trace* trace, uint* length)
+{
+	size_t size = 20 + (size_t)(trace->written.count + trace->run.count) * 5 +
+					(size_t)trace->written.count * sizeof(m68ki_trace_page);
+	uint8* checkpoint = size < M68KI_TRACE_CHECKPOINT ? malloc(size) : NULL;
+	uint8* p = checkpoint;
+	uint i;
+
+	/* Without one the pages are kept for the next checkpoint */
+	if(checkpoint == NULL)
+		return NULL;
+	p = m68ki_trace_put_varint(p, trace->written.count);
+	p = m68ki_trace_put_varint(p, trace->run.count);
+	p = m68ki_trace_put_pages(p, &trace->written);
+	p = m68ki_trace_put_pages(p, &trace->run);
+	for(i = 0; i < trace->written.count; i++)
+	{
+		uint page = trace->written.page[i];
+
+		memcpy(p, trace->shadow[page >> 10][page & 1023], sizeof(m68ki_trace_page));
+		p += sizeof(m68ki_trace_page);
+	}
+	trace->written.count = 0;
+	trace->run.count = 0;
+	*length = (uint)(p - checkpoint);
+	return checkpoint;
+}
+
+static void m68ki_trace_get_regs(uint* regs)
+{
+	memcpy(regs, REG_DA, 16 * sizeof(uint));
+	regs[16] = m68ki_get_sr();
+}
+
+/* Start a buffer with a key record of the current state */
+static void m68ki_trace_begin_chunk(m68ki_trace* trace)
+{
+	uint8* buffer = trace->buffer[trace->produced % M68K_TRACE_BUFFERS];
+	uint8* p = buffer;
+	int i;
+
+	trace->first[trace->produced % M68K_TRACE_BUFFERS] = trace->count;
+	trace->full = buffer + M68K_TRACE_BUFFER_SIZE - M68KI_TRACE_RESERVE;
+	m68ki_trace_get_regs(trace->regs);
+	trace->pc = REG_PC;
+	trace->address = 0;
+	trace->chunk_written = 0;
+	trace->chunk_run = 0;
+
+	*p++ = M68KI_TRACE_KEY;
+	p = m68ki_trace_put_varint(p, trace->count);
+	p = m68ki_trace_put_varint(p, trace->pc);
+	for(i = 0; i < M68K_TRACE_REGS; i++)
+		p = m68ki_trace_put_varint(p, trace->regs[i]);
+	trace->pos = p;
+}
+
+/* Hand the buffer being filled to the writer, with a checkpoint after it if
+ * asked.
+ */
+static void m68ki_trace_end_chunk(m68ki_trace* trace, int checkpoint)
+{
+	uint slot = trace->produced % M68K_TRACE_BUFFERS;
+
+	trace->checkpoint_data[slot] = NULL;
+	if(checkpoint)
+	{
+		trace->checkpoint_data[slot] = m68ki_trace_build_checkpoint(trace, &trace->checkpoint_length[slot]);
+		trace->checkpoint_first[slot] = trace->count;
+		trace->checkpoint = trace->count + M68K_TRACE_CHECKPOINT;
+	}
+	trace->length[slot] = (uint)(trace->pos - trace->buffer[slot]);
+	trace->written_mask[slot] = trace->chunk_written;
+	trace->run_mask[slot] = trace->chunk_run;
+	__atomic_store_n(&trace->produced, trace->produced + 1, __ATOMIC_RELEASE);
+}
+
+/* Wait for the writer only when it has every buffer */
+static void m68ki_trace_next_chunk(m68ki_trace* trace, int checkpoint)
+{
+	m68ki_trace_end_chunk(trace, checkpoint);
+	while(trace->produced - __atomic_load_n(&trace->consumed, __ATOMIC_ACQUIRE) >= M68K_TRACE_BUFFERS)
+		sched_yield();
+	m68ki_trace_begin_chunk(trace);
+}
+
+void m68ki_trace_access(uint address, uint kind, uint value)
+{
+	m68ki_trace* trace = m68ki_cpu.trace;
+	uint8* p = trace->pos;
+
+	address = ADDRESS_68K(address);
+	if(kind & M68KI_TRACE_WRITE)
+		m68ki_trace_shadow(trace, address, kind & 7, value);
+	if(trace->accesses++ >= M68K_TRACE_ACCESSES)
+		return;
+	*p++ = (uint8)(M68KI_TRACE_ACCESS | kind);
+	p = m68ki_trace_put_varint(p, m68ki_trace_zigzag(address - trace->address));
+	p = m68ki_trace_put_varint(p, value);
+	trace->address = address;
+	trace->pos = p;
+}
+
+void m68ki_trace_instruction(uint cycles)
+{
+	m68ki_trace* trace = m68ki_cpu.trace;
+	uint regs[M68K_TRACE_REGS];
+	uint changed = 0;
+	uint8* p = trace->pos;
+	int i;
+
+	m68ki_trace_get_regs(regs);
+	for(i = 0; i < M68K_TRACE_REGS; i++)
+		if(regs[i] != trace->regs[i])
+			changed |= 1 << i;
+
+	*p++ = (uint8)(M68KI_TRACE_INSN | (trace->accesses > M68K_TRACE_ACCESSES ? M68KI_TRACE_TRUNCATED : 0));
+	p = m68ki_trace_put_varint(p, m68ki_trace_zigzag(REG_PPC - trace->pc));
+	p = m68ki_trace_put_varint(p, MASK_OUT_ABOVE_16(REG_IR));
+	p = m68ki_trace_put_varint(p, cycles);
+	p = m68ki_trace_put_varint(p, changed);
+	for(i = 0; i < M68K_TRACE_REGS; i++)
+		if(changed & (1 << i))
+		{
+			p = m68ki_trace_put_varint(p, regs[i] ^ trace->regs[i]);
+			trace->regs[i] = regs[i];
+		}
+	trace->pos = p;
+	trace->pc = REG_PPC;
+	trace->accesses = 0;
+	m68ki_trace_add_page(trace, &trace->run, REG_PPC >> M68KI_TRACE_PAGE_SHIFT);
+	trace->chunk_run |= M68KI_TRACE_PAGE_BIT(REG_PPC >> M68KI_TRACE_PAGE_SHIFT);
+
+	if(++trace->count < trace->checkpoint && p < trace->full)
+		return;
+	m68ki_trace_next_chunk(trace, trace->count >= trace->checkpoint);
+}
+
+static void m68ki_trace_free(m68ki_trace* trace)
+{
+	uint i;
+	uint j;
+
+	for(i = 0; i < M68KI_TRACE_PAGES >> 10; i++)
+		if(trace->shadow[i] != NULL)
+		{
+			for(j = 0; j < 1024; j++)
+				free(trace->shadow[i][j]);
+			free(trace->shadow[i]);
+		}
+	free(trace->written.page);
+	free(trace->run.page);
+	free(trace->index);
+	free(trace->checkpoint_index);
+	free(trace->buffer[0]);
+	free(trace);
+}
+
+int m68k_start_trace(const char* path)
+{
+	m68ki_trace* trace;
+	uint8* checkpoint;
+	uint length;
+	uint i;
+
+	m68k_stop_trace();
+	trace = calloc(1, sizeof(m68ki_trace));
+	if(trace == NULL)
+		return 0;
+	trace->buffer[0] = malloc((size_t)M68K_TRACE_BUFFERS * M68K_TRACE_BUFFER_SIZE);
+	checkpoint = m68ki_trace_build_checkpoint(trace, &length);
+	trace->file = fopen(path, "wb");
+	if(trace->buffer[0] == NULL || checkpoint == NULL || trace->file == NULL)
+	{
+		if(trace->file != NULL)
+			fclose(trace->file);
+		free(checkpoint);
+		m68ki_trace_free(trace);
+		return 0;
+	}
+	for(i = 1; i < M68K_TRACE_BUFFERS; i++)
+		trace->buffer[i] = trace->buffer[0] + (size_t)i * M68K_TRACE_BUFFER_SIZE;
+	trace->checkpoint = M68K_TRACE_CHECKPOINT;
+
+	/* The writer takes the file over after the first checkpoint */
+	m68ki_trace_write_file(trace, M68KI_TRACE_MAGIC, 8);
+	m68ki_trace_write_chunk(trace, &trace->checkpoint_index, &trace->checkpoints,
+		checkpoint, length | M68KI_TRACE_CHECKPOINT, 0, 0, 0);
+	free(checkpoint);
+	if(pthread_create(&trace->writer, NULL, m68ki_trace_writer, trace) != 0)
+	{
+		fclose(trace->file);
+		m68ki_trace_free(trace);
+		return 0;
+	}
+	m68ki_trace_begin_chunk(trace);
+	m68ki_cpu.trace = trace;
+	return 1;
+}
+
+int m68k_stop_trace(void)
+{
+	m68ki_trace* trace = m68ki_cpu.trace;
+	uint8 trailer[32];
+	unsigned long long index_offset;
+	unsigned long long i;
+	int ok;
+
+	if(trace == NULL)
+		return 0;
+	m68ki_cpu.trace = NULL;
+
+	/* Finish with a checkpoint and a key of the final state */
+	m68ki_trace_next_chunk(trace, TRUE);
+	m68ki_trace_end_chunk(trace, FALSE);
+	__atomic_store_n(&trace->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(trace->writer, NULL);
+
+	index_offset = trace->offset;
+	for(i = 0; i < (trace->chunks + trace->checkpoints) * M68KI_TRACE_COLUMNS; i++)
+	{
+		uint8 entry[8];
+		unsigned long long columns = trace->chunks * M68KI_TRACE_COLUMNS;
+
+		m68ki_trace_put_u64(entry, i < columns ? trace->index[i] : trace->checkpoint_index[i - columns]);
+		m68ki_trace_write_file(trace, entry, sizeof(entry));
+	}
+	m68ki_trace_put_u64(trailer, index_offset);
+	m68ki_trace_put_u64(trailer + 8, trace->chunks);
+	m68ki_trace_put_u64(trailer + 16, trace->checkpoints);
+	memcpy(trailer + 24, M68KI_TRACE_INDEX_MAGIC, 8);
+	m68ki_trace_write_file(trace, trailer, sizeof(trailer));
+
+	ok = !trace->failed && !trace->lost;
+	if(fclose(trace->file) != 0)
+		ok = 0;
+	m68ki_trace_free(trace);
+	return ok;
+}
+
+#else
+
+int m68k_start_trace(const char* path)
+{
+	(void)path;
+	return 0;
+}
+
+int m68k_stop_trace(void)
+{
+	return 0;
+}
+
+#endif /* M68KI_TRACE */
+
+/* ------------------------------ Trace Reader ---------------------------- */
+
+static uint m68ki_trace_unzigzag(uint value)
+{
+	return (value >> 1) ^ (uint)-(sint)(value & 1);
+}
+
+static uint m68ki_trace_get_u32(const uint8* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint)p[3] << 24);
+}
+
+static unsigned long long m68ki_trace_get_u64(const uint8* p)
+{
+	unsigned long long value = 0;
+	int i;
+
+	for(i = 7; i >= 0; i--)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+/* Read a varint, or return FALSE at the end of the payload */
+static int m68ki_trace_get_varint(const uint8** p, const uint8* end, unsigned long long* value)
+{
+	uint shift = 0;
+
+	*value = 0;
+	while(*p < end && shift < 64)
+	{
+		uint8 byte = *(*p)++;
+
+		*value |= (unsigned long long)(byte & 0x7f) << shift;
+		if(!(byte & 0x80))
+			return TRUE;
+		shift += 7;
+	}
+	return FALSE;
+}
+
+/* Read the key at the start of a chunk into record */
+static int m68ki_trace_read_key(const uint8** p, const uint8* end, m68k_trace_record* record)
+{
+	unsigned long long value;
+	uint i;
+
+	if(*p >= end || *(*p)++ != M68KI_TRACE_KEY || !m68ki_trace_get_varint(p, end, &record->number))
+		return FALSE;
+	if(!m68ki_trace_get_varint(p, end, &value))
+		return FALSE;
+	record->pc = (uint)value;
+	for(i = 0; i < M68K_TRACE_REGS; i++)
+	{
+		if(!m68ki_trace_get_varint(p, end, &value))
+			return FALSE;
+		record->regs[i] = (uint)value;
+	}
+	record->accesses = 0;
+	return TRUE;
+}
+
+/* Decode one chunk, calling callback for instructions from first on.
+ * Returns -1 for a bad chunk, 1 if callback asked to stop and 0 otherwise.
+ */
+static int m68ki_trace_read_chunk(const uint8* p, const uint8* end, unsigned long long first,
+	int (*callback)(const m68k_trace_record* record, void* param), void* param, m68k_trace_record* record)
+{
+	unsigned long long value;
+	unsigned long long number;
+	uint address = 0;
+	uint pc;
+	uint i;
+
+	if(!m68ki_trace_read_key(&p, end, record))
+		return -1;
+	number = record->number;
+	pc = record->pc;
+
+	while(p < end)
+	{
+		uint tag = *p++;
+
+		if((tag & 0xf0) == M68KI_TRACE_ACCESS)
+		{
+			unsigned long long delta;
+
+			if(!m68ki_trace_get_varint(&p, end, &delta) || !m68ki_trace_get_varint(&p, end, &value))
+				return -1;
+			address += m68ki_trace_unzigzag((uint)delta);
+			if(record->accesses < M68K_TRACE_ACCESSES)
+			{
+				m68k_trace_access* access = &record->access[record->accesses++];
+
+				access->address = address;
+				access->value = (uint)value;
+				access->size = tag & 7;
+				access->write = (tag & M68KI_TRACE_WRITE) != 0;
+			}
+		}
+		else if((tag & 0xf0) == M68KI_TRACE_INSN)
+		{
+			unsigned long long ir;
+			unsigned long long cycles;
+			unsigned long long changed;
+
+			if(!m68ki_trace_get_varint(&p, end, &value) || !m68ki_trace_get_varint(&p, end, &ir) ||
+				!m68ki_trace_get_varint(&p, end, &cycles) || !m68ki_trace_get_varint(&p, end, &changed))
+				return -1;
+			pc += m68ki_trace_unzigzag((uint)value);
+			for(i = 0; i < M68K_TRACE_REGS; i++)
+				if(changed & (1 << i))
+				{
+					if(!m68ki_trace_get_varint(&p, end, &value))
+						return -1;
+					record->regs[i] ^= (uint)value;
+				}
+			if(number >= first)
+			{
+				record->number = number;
+				record->pc = pc;
+				record->ir = (uint)ir;
+				record->cycles = (uint)cycles;
+				record->truncated = tag & M68KI_TRACE_TRUNCATED;
+				if(callback(record, param))
+					return 1;
+			}
+			number++;
+			record->accesses = 0;
+		}
+		else
+			return -1;
+	}
+	return 0;
+}
+
+/* Make room for a chunk payload */
+static int m68ki_trace_reserve(uint8** payload, uint* capacity, uint length)
+{
+	if(length <= *capacity)
+		return TRUE;
+	/* Chunks are the size of the writer's buffers, so this is rare */
+	free(*payload);
+	*payload = length <= 0x10000000 ? malloc(length) : NULL;
+	*capacity = *payload != NULL ? length : 0;
+	return *payload != NULL;
+}
+
+int m68k_read_trace(const char* path, unsigned long long first,
+	int (*callback)(const m68k_trace_record* record, void* param), void* param)
+{
+	FILE* file = fopen(path, "rb");
+	m68k_trace_record* record = malloc(sizeof(m68k_trace_record));
+	uint8* payload = NULL;
+	uint capacity = 0;
+	uint8 buffer[32];
+	unsigned long long offset = 8;
+	unsigned long long end = ~0ULL;
+	int result = 0;
+
+	if(file == NULL || record == NULL)
+		goto done;
+	if(fread(buffer, 1, 8, file) != 8 || memcmp(buffer, M68KI_TRACE_MAGIC, 8) != 0)
+		goto done;
+
+	/* Find the last chunk starting at or before first in the index */
+	if(m68ki_trace_seek(file, -32, SEEK_END) == 0 && fread(buffer, 1, 32, file) == 32 &&
+		memcmp(buffer + 24, M68KI_TRACE_INDEX_MAGIC, 8) == 0)
+	{
+		unsigned long long index_offset = m68ki_trace_get_u64(buffer);
+		unsigned long long low = 0;
+		unsigned long long high = m68ki_trace_get_u64(buffer + 8);
+
+		end = index_offset;
+		while(low + 1 < high)
+		{
+			unsigned long long mid = (low + high) / 2;
+
+			if(m68ki_trace_seek(file, index_offset + mid * M68KI_TRACE_COLUMNS * 8, SEEK_SET) != 0 || fread(buffer, 1, 16, file) != 16)
+				goto done;
+			if(m68ki_trace_get_u64(buffer + 8) <= first)
+				low = mid;
+			else
+				high = mid;
+		}
+		if(high > 0)
+		{
+			if(m68ki_trace_seek(file, index_offset + low * M68KI_TRACE_COLUMNS * 8, SEEK_SET) != 0 || fread(buffer, 1, 16, file) != 16)
+				goto done;
+			offset = m68ki_trace_get_u64(buffer);
+		}
+	}
+
+	/* Without an index, stop at the first incomplete chunk */
+	while(offset < end)
+	{
+		uint length;
+		int status;
+
+		if(m68ki_trace_seek(file, offset, SEEK_SET) != 0 || fread(buffer, 1, 12, file) != 12)
+			break;
+		length = m68ki_trace_get_u32(buffer);
+		offset += 12 + (length & ~M68KI_TRACE_CHECKPOINT);
+		if(length & M68KI_TRACE_CHECKPOINT)
+			continue;
+		if(!m68ki_trace_reserve(&payload, &capacity, length))
+			goto done;
+		if(fread(payload, 1, length, file) != length)
+			break;
+		status = m68ki_trace_read_chunk(payload, payload + length, first, callback, param, record);
+		if(status < 0)
+			goto done;
+		if(status > 0)
+			break;
+	}
+	result = 1;
+
+done:
+	if(file != NULL)
+		fclose(file);
+	free(payload);
+	free(record);
+	return result;
+}
+
+/* ------------------------------ Trace Queries --------------------------- */
+
+typedef struct
+{
+	unsigned long long number;     /* Instructions run before it */
+	unsigned long long shadow;     /* File offset of the page shadows */
+	uint written;
+	uint run;
+	uint* page;                    /* Pages written, then pages run, ascending */
+} m68ki_trace_checkpoint;
+
+struct m68k_trace_query
+{
+	FILE* file;
+	unsigned long long length;     /* Instructions in the trace */
+	unsigned long long chunks;
+	unsigned long long* chunk;     /* Index entry of each record chunk */
+	unsigned long long checkpoints;
+	m68ki_trace_checkpoint* checkpoint;
+	uint8* payload;
+	uint capacity;
+	m68k_trace_record record;
+	m68ki_trace_page page;
+};
+
+/* Passes the instructions before last on to callback */
+typedef struct
+{
+	unsigned long long last;
+	int (*callback)(const m68k_trace_record* record, void* param);
+	void* param;
+} m68ki_trace_range;
+
+static int m68ki_trace_range_callback(const m68k_trace_record* record, void* param)
+{
+	m68ki_trace_range* range = param;
+
+	return record->number >= range->last || range->callback(record, range->param);
+}
+
+/* Last record chunk starting at or before number */
+static unsigned long long m68ki_trace_find_chunk(m68k_trace_query* query, unsigned long long number)
+{
+	unsigned long long low = 0;
+	unsigned long long high = query->chunks;
+
+	while(low + 1 < high)
+	{
+		unsigned long long mid = (low + high) / 2;
+
+		if(query->chunk[mid * M68KI_TRACE_COLUMNS + 1] <= number)
+			low = mid;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+/* Last checkpoint at or before number */
+static unsigned long long m68ki_trace_find_checkpoint(m68k_trace_query* query, unsigned long long number)
+{
+	unsigned long long low = 0;
+	unsigned long long high = query->checkpoints;
+
+	while(low + 1 < high)
+	{
+		unsigned long long mid = (low + high) / 2;
+
+		if(query->checkpoint[mid].number <= number)
+			low = mid;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+static int m68ki_trace_has_page(const uint* page, uint count, uint find)
+{
+	return bsearch(&find, page, count, sizeof(uint), m68ki_trace_page_compare) != NULL;
+}
+
+/* Load a record chunk into query->payload and return its length, or -1 */
+static long m68ki_trace_load_chunk(m68k_trace_query* query, unsigned long long chunk)
+{
+	uint8 header[12];
+	uint length;
+
+	if(m68ki_trace_seek(query->file, query->chunk[chunk * M68KI_TRACE_COLUMNS], SEEK_SET) != 0 ||
+		fread(header, 1, sizeof(header), query->file) != sizeof(header))
+		return -1;
+	length = m68ki_trace_get_u32(header);
+	if(!m68ki_trace_reserve(&query->payload, &query->capacity, length) ||
+		fread(query->payload, 1, length, query->file) != length)
+		return -1;
+	return (long)length;
+}
+
+/* Call callback with the instructions from first to before last, skipping
+ * chunks with none of the pages in mask in the index column, if not 0.
+ * Returns -1 for a bad file, 1 if stopped and 0 otherwise.
+ */
+static int m68ki_trace_scan(m68k_trace_query* query, unsigned long long first, unsigned long long last,
+	uint column, unsigned long long mask, int (*callback)(const m68k_trace_record* record, void* param), void* param)
+{
+	m68ki_trace_range range;
+	unsigned long long chunk;
+
+	range.last = last;
+	range.callback = callback;
+	range.param = param;
+	for(chunk = m68ki_trace_find_chunk(query, first); chunk < query->chunks; chunk++)
+	{
+		const unsigned long long* entry = query->chunk + chunk * M68KI_TRACE_COLUMNS;
+		long length;
+		int status;
+
+		if(entry[1] >= last)
+			break;
+		if(column != 0 && !(entry[column] & mask))
+			continue;
+		length = m68ki_trace_load_chunk(query, chunk);
+		if(length < 0)
+			return -1;
+		status = m68ki_trace_read_chunk(query->payload, query->payload + length, first,
+					m68ki_trace_range_callback, &range, &query->record);
+		if(status != 0)
+			return status;
+	}
+	return 0;
+}
+
+/* Read the page lists of a checkpoint */
+static int m68ki_trace_load_checkpoint(m68k_trace_query* query, m68ki_trace_checkpoint* checkpoint, unsigned long long offset)
+{
+	uint8 header[12 + 20];
+	const uint8* p = header + 12;
+	const uint8* end;
+	unsigned long long value;
+	size_t size;
+	uint length;
+	uint i;
+
+	if(m68ki_trace_seek(query->file, offset, SEEK_SET) != 0 || fread(header, 1, 12, query->file) != 12)
+		return FALSE;
+	length = m68ki_trace_get_u32(header) & ~M68KI_TRACE_CHECKPOINT;
+	if(length > 20)
+		length = 20;
+	if(fread(header + 12, 1, length, query->file) != length)
+		return FALSE;
+	end = header + 12 + length;
+	if(!m68ki_trace_get_varint(&p, end, &value) || value >= M68KI_TRACE_PAGES)
+		return FALSE;
+	checkpoint->written = (uint)value;
+	if(!m68ki_trace_get_varint(&p, end, &value) || value >= M68KI_TRACE_PAGES)
+		return FALSE;
+	checkpoint->run = (uint)value;
+
+	/* The lists are at most 5 bytes a page */
+	offset += 12 + (p - (header + 12));
+	size = (size_t)(checkpoint->written + checkpoint->run) * 5;
+	if(!m68ki_trace_reserve(&query->payload, &query->capacity, (uint)size + 1) ||
+		m68ki_trace_seek(query->file, offset, SEEK_SET) != 0)
+		return FALSE;
+	size = fread(query->payload, 1, size, query->file);
+	checkpoint->page = malloc((checkpoint->written + checkpoint->run + 1) * sizeof(uint));
+	if(checkpoint->page == NULL)
+		return FALSE;
+	p = query->payload;
+	end = query->payload + size;
+	for(i = 0; i < checkpoint->written + checkpoint->run; i++)
+	{
+		if(!m68ki_trace_get_varint(&p, end, &value))
+			return FALSE;
+		checkpoint->page[i] = (i == 0 || i == checkpoint->written ? 0 : checkpoint->page[i - 1]) + (uint)value;
+	}
+	checkpoint->shadow = offset + (p - query->payload);
+	return TRUE;
+}
+
+m68k_trace_query* m68k_open_trace_query(const char* path)
+{
+	m68k_trace_query* query = calloc(1, sizeof(m68k_trace_query));
+	uint8 buffer[32];
+	unsigned long long index_offset;
+	unsigned long long i;
+
+	if(query == NULL)
+		return NULL;
+	query->file = fopen(path, "rb");
+	if(query->file == NULL || fread(buffer, 1, 8, query->file) != 8 || memcmp(buffer, M68KI_TRACE_MAGIC, 8) != 0)
+		goto fail;
+	if(m68ki_trace_seek(query->file, -32, SEEK_END) != 0 || fread(buffer, 1, 32, query->file) != 32 ||
+		memcmp(buffer + 24, M68KI_TRACE_INDEX_MAGIC, 8) != 0)
+		goto fail;
+	index_offset = m68ki_trace_get_u64(buffer);
+	query->chunks = m68ki_trace_get_u64(buffer + 8);
+	query->checkpoints = m68ki_trace_get_u64(buffer + 16);
+	if(query->chunks == 0 || query->checkpoints == 0 || query->chunks + query->checkpoints > index_offset / 12)
+		goto fail;
+
+	query->chunk = malloc(query->chunks * M68KI_TRACE_COLUMNS * sizeof(unsigned long long));
+	query->checkpoint = calloc(query->checkpoints, sizeof(m68ki_trace_checkpoint));
+	if(query->chunk == NULL || query->checkpoint == NULL || m68ki_trace_seek(query->file, index_offset, SEEK_SET) != 0)
+		goto fail;
+	for(i = 0; i < query->chunks * M68KI_TRACE_COLUMNS; i++)
+	{
+		if(fread(buffer, 1, 8, query->file) != 8)
+			goto fail;
+		query->chunk[i] = m68ki_trace_get_u64(buffer);
+	}
+	/* shadow holds the offset of the chunk until its lists are read */
+	for(i = 0; i < query->checkpoints; i++)
+	{
+		if(fread(buffer, 1, M68KI_TRACE_COLUMNS * 8, query->file) != M68KI_TRACE_COLUMNS * 8)
+			goto fail;
+		query->checkpoint[i].number = m68ki_trace_get_u64(buffer + 8);
+		query->checkpoint[i].shadow = m68ki_trace_get_u64(buffer);
+	}
+	for(i = 0; i < query->checkpoints; i++)
+		if(!m68ki_trace_load_checkpoint(query, &query->checkpoint[i], query->checkpoint[i].shadow))
+			goto fail;
+	query->length = query->chunk[(query->chunks - 1) * M68KI_TRACE_COLUMNS + 1];
+	return query;
+
+fail:
+	m68k_close_trace_query(query);
+	return NULL;
+}
+
+void m68k_close_trace_query(m68k_trace_query* query)
+{
+	unsigned long long i;
+
+	if(query == NULL)
+		return;
+	if(query->file != NULL)
+		fclose(query->file);
+	for(i = 0; query->checkpoint != NULL && i < query->checkpoints; i++)
+		free(query->checkpoint[i].page);
+	free(query->checkpoint);
+	free(query->chunk);
+	free(query->payload);
+	free(query);
+}
+
+unsigned long long m68k_trace_length(m68k_trace_query* query)
+{
+	return query->length;
+}
+
+typedef struct
+{
+	unsigned long long number;
+	unsigned int* pc;
+	unsigned int* regs;
+	int found;
+} m68ki_trace_state;
+
+static int m68ki_trace_state_callback(const m68k_trace_record* record, void* param)
+{
+	m68ki_trace_state* state = param;
+
+	if(record->number < state->number)
+	{
+		memcpy(state->regs, record->regs, sizeof(record->regs));
+		return FALSE;
+	}
+	*state->pc = record->pc;
+	state->found = TRUE;
+	return TRUE;
+}
+
+int m68k_query_state(m68k_trace_query* query, unsigned long long number, unsigned int* pc, unsigned int* regs)
+{
+	unsigned long long chunk = m68ki_trace_find_chunk(query, number);
+	m68ki_trace_state state;
+
+	if(number > query->length)
+		return 0;
+
+	/* A chunk starts with the state before its first instruction */
+	if(query->chunk[chunk * M68KI_TRACE_COLUMNS + 1] == number)
+	{
+		long length = m68ki_trace_load_chunk(query, chunk);
+		const uint8* p = query->payload;
+
+		if(length < 0 || !m68ki_trace_read_key(&p, query->payload + length, &query->record))
+			return 0;
+		*pc = query->record.pc;
+		memcpy(regs, query->record.regs, sizeof(query->record.regs));
+		return 1;
+	}
+	state.number = number;
+	state.pc = pc;
+	state.regs = regs;
+	state.found = FALSE;
+	return m68ki_trace_scan(query, number - 1, number + 1, 0, 0, m68ki_trace_state_callback, &state) >= 0 && state.found;
+}
+
+typedef struct
+{
+	uint address;
+	uint size;
+	unsigned char* data;
+	unsigned char* known;
+} m68ki_trace_memory;
+
+static int m68ki_trace_memory_callback(const m68k_trace_record* record, void* param)
+{
+	m68ki_trace_memory* memory = param;
+	uint i;
+	uint j;
+
+	for(i = 0; i < record->accesses; i++)
+		if(record->access[i].write)
+		{
+			const m68k_trace_access* access = &record->access[i];
+
+			for(j = 0; j < access->size; j++)
+			{
+				uint offset = MASK_OUT_ABOVE_32(access->address + j - memory->address);
+
+				if(offset < memory->size)
+				{
+					memory->data[offset] = (unsigned char)(access->value >> ((access->size - 1 - j) * 8));
+					memory->known[offset] = 1;
+				}
+			}
+		}
+	return FALSE;
+}
+
+int m68k_query_memory(m68k_trace_query* query, unsigned long long number, unsigned int address,
+	unsigned int size, unsigned char* data, unsigned char* known)
+{
+	unsigned long long checkpoint;
+	m68ki_trace_memory memory;
+	unsigned long long mask = 0;
+	uint loaded = M68KI_TRACE_PAGES;
+	uint i;
+
+	if(number > query->length)
+		return 0;
+	checkpoint = m68ki_trace_find_checkpoint(query, number);
+	memset(known, 0, size);
+
+	/* Each page as of the last checkpoint that has it */
+	for(i = 0; i < size; i++)
+	{
+		uint byte = MASK_OUT_ABOVE_32(address + i);
+		uint page = byte >> M68KI_TRACE_PAGE_SHIFT;
+		uint offset = byte & (M68KI_TRACE_PAGE_SIZE - 1);
+
+		if(page != loaded)
+		{
+			unsigned long long j = checkpoint + 1;
+			m68ki_trace_checkpoint* found = NULL;
+			long index;
+
+			while(j-- > 0 && found == NULL)
+				if(m68ki_trace_has_page(query->checkpoint[j].page, query->checkpoint[j].written, page))
+					found = &query->checkpoint[j];
+			loaded = page;
+			mask |= M68KI_TRACE_PAGE_BIT(page);
+			memset(&query->page, 0, sizeof(query->page));
+			if(found != NULL)
+			{
+				index = (uint*)bsearch(&page, found->page, found->written, sizeof(uint), m68ki_trace_page_compare) - found->page;
+				if(m68ki_trace_seek(query->file, found->shadow + index * sizeof(m68ki_trace_page), SEEK_SET) != 0 ||
+					fread(&query->page, 1, sizeof(query->page), query->file) != sizeof(query->page))
+					return 0;
+			}
+		}
+		data[i] = query->page.data[offset];
+		known[i] = (query->page.known[offset >> 3] >> (offset & 7)) & 1;
+	}
+
+	/* Then the writes since that checkpoint */
+	memory.address = address;
+	memory.size = size;
+	memory.data = data;
+	memory.known = known;
+	return m68ki_trace_scan(query, query->checkpoint[checkpoint].number, number, M68KI_TRACE_WRITTEN, mask,
+				m68ki_trace_memory_callback, &memory) >= 0;
+}
+
+typedef struct
+{
+	uint address;
+	unsigned long long* number;
+	m68k_trace_access* access;
+	int found;
+} m68ki_trace_last_write;
+
+static int m68ki_trace_last_write_callback(const m68k_trace_record* record, void* param)
+{
+	m68ki_trace_last_write* write = param;
+	uint i;
+
+	for(i = 0; i < record->accesses; i++)
+		if(record->access[i].write && MASK_OUT_ABOVE_32(write->address - record->access[i].address) < record->access[i].size)
+		{
+			*write->number = record->number;
+			*write->access = record->access[i];
+			write->found = TRUE;
+		}
+	return FALSE;
+}
+
+int m68k_query_last_write(m68k_trace_query* query, unsigned long long number, unsigned int address,
+	unsigned long long* found, m68k_trace_access* access)
+{
+	uint page = address >> M68KI_TRACE_PAGE_SHIFT;
+	unsigned long long checkpoint;
+	m68ki_trace_last_write write;
+
+	if(number > query->length)
+		number = query->length;
+	checkpoint = m68ki_trace_find_checkpoint(query, number);
+	write.address = address;
+	write.number = found;
+	write.access = access;
+	write.found = FALSE;
+	if(m68ki_trace_scan(query, query->checkpoint[checkpoint].number, number, M68KI_TRACE_WRITTEN,
+			M68KI_TRACE_PAGE_BIT(page), m68ki_trace_last_write_callback, &write) < 0)
+		return 0;
+
+	/* Earlier, only the stretches that wrote the page */
+	for(; !write.found && checkpoint > 0; checkpoint--)
+		if(m68ki_trace_has_page(query->checkpoint[checkpoint].page, query->checkpoint[checkpoint].written, page) &&
+			m68ki_trace_scan(query, query->checkpoint[checkpoint - 1].number, query->checkpoint[checkpoint].number,
+				M68KI_TRACE_WRITTEN, M68KI_TRACE_PAGE_BIT(page), m68ki_trace_last_write_callback, &write) < 0)
+			return 0;
+	return write.found;
+}
+
+typedef struct
+{
+	uint pc;
+	unsigned long long* number;
+	int found;
+} m68ki_trace_pc;
+
+static int m68ki_trace_pc_callback(const m68k_trace_record* record, void* param)
+{
+	m68ki_trace_pc* find = param;
+
+	if(record->pc != find->pc)
+		return FALSE;
+	*find->number = record->number;
+	find->found = TRUE;
+	return TRUE;
+}
+
+int m68k_query_next_pc(m68k_trace_query* query, unsigned long long number, unsigned int pc, unsigned long long* found)
+{
+	uint page = pc >> M68KI_TRACE_PAGE_SHIFT;
+	unsigned long long checkpoint;
+	m68ki_trace_pc find;
+	int status;
+
+	if(number >= query->length)
+		return 0;
+	checkpoint = m68ki_trace_find_checkpoint(query, number) + 1;
+	find.pc = pc;
+	find.number = found;
+	find.found = FALSE;
+	status = m68ki_trace_scan(query, number, checkpoint < query->checkpoints ? query->checkpoint[checkpoint].number :
+				query->length, M68KI_TRACE_RUN, M68KI_TRACE_PAGE_BIT(page), m68ki_trace_pc_callback, &find);
+
+	/* Later, only the stretches that ran the page */
+	for(checkpoint++; status >= 0 && !find.found && checkpoint < query->checkpoints; checkpoint++)
+	{
+		m68ki_trace_checkpoint* next = &query->checkpoint[checkpoint];
+
+		if(m68ki_trace_has_page(next->page + next->written, next->run, page))
+			status = m68ki_trace_scan(query, query->checkpoint[checkpoint - 1].number, next->number,
+						M68KI_TRACE_RUN, M68KI_TRACE_PAGE_BIT(page), m68ki_trace_pc_callback, &find);
+	}
+	return status >= 0 && find.found;
+}
@@ -0,0 +1,184 @@
+/* Dispatch benchmark: runs a long loop of register-only instructions with
+ * random opcodes so that instruction dispatch, not memory access, dominates.
+ * Reports emulated cycles per second and, where Linux exposes hardware
+ * counters, cache misses per million host instructions.
+ *
+ * usage: bench_dispatch [cycles] [instructions in loop] [seed] [timeslice]
+ */
+#include "m68k.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define RAM_SIZE 0x20000
+#define CODE_START 0x1000
+
+static uint8_t ram[RAM_SIZE];
+
+unsigned int m68k_read_memory_8(unsigned int address) {
+    return ram[address % RAM_SIZE];
+}
+unsigned int m68k_read_memory_16(unsigned int address) {
+    return (m68k_read_memory_8(address) << 8) | m68k_read_memory_8(address + 1);
+}
+unsigned int m68k_read_memory_32(unsigned int address) {
+    return (m68k_read_memory_16(address) << 16) | m68k_read_memory_16(address + 2);
+}
+unsigned int m68k_read_disassembler_16(unsigned int address) {
+    return m68k_read_memory_16(address);
+}
+unsigned int m68k_read_disassembler_32(unsigned int address) {
+    return m68k_read_memory_32(address);
+}
+void m68k_write_memory_8(unsigned int address, unsigned int value) {
+    ram[address % RAM_SIZE] = value;
+}
+void m68k_write_memory_16(unsigned int address, unsigned int value) {
+    m68k_write_memory_8(address, value >> 8);
+    m68k_write_memory_8(address + 1, value);
+}
+void m68k_write_memory_32(unsigned int address, unsigned int value) {
+    m68k_write_memory_16(address, value >> 16);
+    m68k_write_memory_16(address + 2, value);
+}
+
+/* Opcodes taking a source register in bits 0-2 and a destination register or
+ * quick value in bits 9-11.  All of them are valid for any register contents.
+ */
+static const uint16_t templates[] = {
+    0xd000, 0xd040, 0xd080,         /* add.b/w/l Dy, Dx */
+    0x9000, 0x9040, 0x9080,         /* sub.b/w/l Dy, Dx */
+    0xc000, 0xc040, 0xc080,         /* and.b/w/l Dy, Dx */
+    0x8000, 0x8040, 0x8080,         /* or.b/w/l Dy, Dx */
+    0xb100, 0xb140, 0xb180,         /* eor.b/w/l Dx, Dy */
+    0xb000, 0xb040, 0xb080,         /* cmp.b/w/l Dy, Dx */
+    0x1000, 0x3000, 0x2000,         /* move.b/w/l Dy, Dx */
+    0x5000, 0x5040, 0x5080,         /* addq.b/w/l #q, Dy */
+    0x5100, 0x5140, 0x5180,         /* subq.b/w/l #q, Dy */
+    0xe008, 0xe048, 0xe088,         /* lsr.b/w/l #q, Dy */
+    0xe108, 0xe148, 0xe188,         /* lsl.b/w/l #q, Dy */
+    0xe000, 0xe040, 0xe080,         /* asr.b/w/l #q, Dy */
+    0xe018, 0xe058, 0xe098,         /* ror.b/w/l #q, Dy */
+    0xe118, 0xe158, 0xe198,         /* rol.b/w/l #q, Dy */
+    0xc140,                         /* exg Dx, Dy */
+    0xd1c8,                         /* adda.l Ay, Ax */
+    0x2048,                         /* movea.l Ay, Ax */
+};
+
+/* Opcodes with a register in bits 0-2 only */
+static const uint16_t singles[] = {
+    0x4840,                         /* swap Dy */
+    0x4880, 0x48c0,                 /* ext.w/l Dy */
+    0x4600, 0x4640, 0x4680,         /* not.b/w/l Dy */
+    0x4400, 0x4440, 0x4480,         /* neg.b/w/l Dy */
+    0x4a00, 0x4a40, 0x4a80,         /* tst.b/w/l Dy */
+    0x4200, 0x4240, 0x4280,         /* clr.b/w/l Dy */
+};
+
+static uint16_t random_opcode(void) {
+    unsigned int pick = rand() % (sizeof(templates) / sizeof(templates[0]) + 2);
+    unsigned int x = rand() & 7;
+    unsigned int y = rand() & 7;
+
+    if (pick < sizeof(templates) / sizeof(templates[0]))
+        return templates[pick] | (x << 9) | y;
+    if (pick == sizeof(templates) / sizeof(templates[0]))
+        return 0x7000 | (x << 9) | (rand() & 0xff);     /* moveq */
+    return singles[rand() % (sizeof(singles) / sizeof(singles[0]))] | y;
+}
+
+#ifdef __linux__
+static int open_counter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+int main(int argc, char** argv) {
+    long long cycles = argc > 1 ? atoll(argv[1]) : 200000000LL;
+    unsigned int length = argc > 2 ? (unsigned int)atoi(argv[2]) : 8192;
+    unsigned int seed = argc > 3 ? (unsigned int)atoi(argv[3]) : 1;
+    int timeslice = argc > 4 ? atoi(argv[4]) : 100000;
+    const char* names[] = {"cache-misses", "L1D-read-misses", "instructions"};
+    long long counts[3] = {-1, -1, -1};
+    int counters[3] = {-1, -1, -1};
+    long long total = 0;
+    struct timespec start, end;
+    double seconds;
+    unsigned int address;
+    unsigned int i;
+
+    if (length == 0 || CODE_START + length * 2 + 4 > RAM_SIZE) {
+        fprintf(stderr, "loop must hold 1 to %d instructions\n", (RAM_SIZE - CODE_START - 4) / 2);
+        return EXIT_FAILURE;
+    }
+
+    srand(seed);
+    m68k_write_memory_32(0, 0x1000);
+    m68k_write_memory_32(4, CODE_START);
+    address = CODE_START;
+    for (i = 0; i < length; i++, address += 2)
+        m68k_write_memory_16(address, random_opcode());
+    m68k_write_memory_16(address, 0x4ef9);              /* jmp CODE_START */
+    m68k_write_memory_32(address + 2, CODE_START);
+
+    m68k_init();
+    m68k_set_cpu_type(M68K_CPU_TYPE_68000);
+    m68k_pulse_reset();
+
+#ifdef __linux__
+    counters[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    counters[1] = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                               (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    counters[2] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    for (i = 0; i < 3; i++)
+        if (counters[i] >= 0)
+            ioctl(counters[i], PERF_EVENT_IOC_ENABLE, 0);
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (total < cycles)
+        total += m68k_execute(timeslice);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+#ifdef __linux__
+    for (i = 0; i < 3; i++)
+        if (counters[i] >= 0) {
+            ioctl(counters[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counters[i], &counts[i], sizeof(counts[i])) != sizeof(counts[i]))
+                counts[i] = -1;
+            close(counters[i]);
+        }
+#endif
+
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%lld cycles in %.3fs: %.1f Mcycles/s\n", total, seconds, total / seconds / 1e6);
+    for (i = 0; i < 2; i++) {
+        if (counts[i] < 0)
+            printf("%s: not available\n", names[i]);
+        else if (counts[2] > 0)
+            printf("%s: %lld (%.1f per million host instructions)\n", names[i], counts[i],
+                   counts[i] * 1e6 / counts[2]);
+        else
+            printf("%s: %lld\n", names[i], counts[i]);
+    }
+    return EXIT_SUCCESS;
+}
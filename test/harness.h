@@ -0,0 +1,129 @@
+/* Shared by the feature tests (test_*.c): a flat 16 MB RAM that mirrors
+ * above 24 bits, with a bus error on any access to BERR_START and up, and
+ * a tally of failed checks.  Each test is built with the core options it
+ * needs (see the Makefile) and returns EXIT_FAILURE if a check failed.
+ */
+#ifndef TEST_HARNESS_H
+#define TEST_HARNESS_H
+
+#include "m68k.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RAM_SIZE 0x1000000
+#define BERR_START 0xf00000
+
+static uint8_t ram[RAM_SIZE];
+static unsigned int test_pass_count;
+static unsigned int test_fail_count;
+
+/* Called with the address of each access that gets a bus error */
+static void (*bus_error_hook)(unsigned int address);
+
+#define CHECK(COND) check((COND), #COND, __FILE__, __LINE__)
+
+static inline void check(int ok, const char* what, const char* file, int line) {
+    if (ok) {
+        test_pass_count++;
+        return;
+    }
+    test_fail_count++;
+    printf("%s:%d: check failed: %s\n", file, line, what);
+}
+
+static inline int bus_error(unsigned int address) {
+    if ((address % RAM_SIZE) < BERR_START)
+        return 0;
+    if (bus_error_hook != NULL)
+        bus_error_hook(address);
+    m68k_pulse_bus_error();
+    return 1;
+}
+
+unsigned int m68k_read_memory_8(unsigned int address) {
+    if (bus_error(address))
+        return 0;
+    return ram[address % RAM_SIZE];
+}
+unsigned int m68k_read_memory_16(unsigned int address) {
+    if (bus_error(address))
+        return 0;
+    return (ram[address % RAM_SIZE] << 8) | ram[(address + 1) % RAM_SIZE];
+}
+unsigned int m68k_read_memory_32(unsigned int address) {
+    if (bus_error(address))
+        return 0;
+    return ((unsigned int)m68k_read_memory_16(address) << 16) | m68k_read_memory_16(address + 2);
+}
+unsigned int m68k_read_disassembler_16(unsigned int address) {
+    return m68k_read_memory_16(address);
+}
+unsigned int m68k_read_disassembler_32(unsigned int address) {
+    return m68k_read_memory_32(address);
+}
+void m68k_write_memory_8(unsigned int address, unsigned int value) {
+    if (!bus_error(address))
+        ram[address % RAM_SIZE] = value;
+}
+void m68k_write_memory_16(unsigned int address, unsigned int value) {
+    if (bus_error(address))
+        return;
+    ram[address % RAM_SIZE] = value >> 8;
+    ram[(address + 1) % RAM_SIZE] = value;
+}
+void m68k_write_memory_32(unsigned int address, unsigned int value) {
+    if (bus_error(address))
+        return;
+    m68k_write_memory_16(address, value >> 16);
+    m68k_write_memory_16(address + 2, value);
+}
+
+/* Store words at address, returning the address after them */
+static inline unsigned int put_words(unsigned int address, const uint16_t* words, unsigned int count) {
+    unsigned int i;
+
+    for (i = 0; i < count; i++, address += 2) {
+        ram[address % RAM_SIZE] = words[i] >> 8;
+        ram[(address + 1) % RAM_SIZE] = words[i];
+    }
+    return address;
+}
+#define PUT(ADDRESS, ...) put_words((ADDRESS), (const uint16_t[]){__VA_ARGS__}, \
+    sizeof((const uint16_t[]){__VA_ARGS__}) / sizeof(uint16_t))
+
+static inline void put_32(unsigned int address, unsigned int value) {
+    PUT(address, value >> 16, value & 0xffff);
+}
+
+static inline unsigned int get_32(unsigned int address) {
+    return ((unsigned int)ram[address % RAM_SIZE] << 24) | (ram[(address + 1) % RAM_SIZE] << 16) |
+        (ram[(address + 2) % RAM_SIZE] << 8) | ram[(address + 3) % RAM_SIZE];
+}
+
+/* Clear memory, point every vector at a stop #$2700 at 0x400 and reset the
+ * CPU into supervisor mode at pc with the stack at 0x8000.
+ */
+static inline void setup_cpu(unsigned int cpu_type, unsigned int pc) {
+    unsigned int i;
+
+    memset(ram, 0, sizeof(ram));
+    for (i = 2; i < 256; i++)
+        put_32(i * 4, 0x400);
+    PUT(0x400, 0x4e72, 0x2700);
+    put_32(0, 0x8000);
+    put_32(4, pc);
+
+    m68k_init();
+    m68k_set_cpu_type(cpu_type);
+    m68k_pulse_reset();
+}
+
+static inline int test_result(const char* name) {
+    printf("%s: test_pass_count = %u\n", name, test_pass_count);
+    printf("%s: test_fail_count = %u\n", name, test_fail_count);
+    return test_fail_count == 0 && test_pass_count > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif /* TEST_HARNESS_H */
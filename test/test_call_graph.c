@@ -0,0 +1,70 @@
+/* Call graph: a call made after switching to another task's stack keeps the
+ * frames of the first task, which is returned to through them.
+ */
+#include "harness.h"
+
+#define MAX_FUNCS 8
+
+static struct {
+    unsigned int func;
+    unsigned long long calls, inclusive, exclusive;
+} funcs[MAX_FUNCS];
+static unsigned int func_count;
+static unsigned long long outside;
+
+static void parse_line(const char* line) {
+    unsigned long long total;
+
+    if (sscanf(line, "%llu cycles, %llu outside", &total, &outside) == 2)
+        return;
+    if (func_count < MAX_FUNCS &&
+        sscanf(line, "%x %llu %llu %llu", &funcs[func_count].func, &funcs[func_count].calls,
+               &funcs[func_count].inclusive, &funcs[func_count].exclusive) == 4)
+        func_count++;
+}
+
+static int find(unsigned int func) {
+    unsigned int i;
+
+    for (i = 0; i < func_count; i++)
+        if (funcs[i].func == func)
+            return (int)i;
+    return -1;
+}
+
+int main(void) {
+    int f, g;
+
+    setup_cpu(M68K_CPU_TYPE_68000, 0x1000);
+    PUT(0x1000,
+        0x6100, 0x00fe,                         /* bsr $1100 */
+        0x4e71, 0x4e71, 0x4e71, 0x4e71,         /* nop x 4 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+    PUT(0x1100,
+        0x2e7c, 0x0000, 0xc000,                 /* movea.l #$c000, a7 */
+        0x6100, 0x00f8);                        /* bsr $1200 */
+    PUT(0x1200,
+        0x2e7c, 0x0000, 0x7ffc,                 /* movea.l #$7ffc, a7 */
+        0x4e75);                                /* rts */
+
+    m68k_clear_call_graph();
+    m68k_execute(1000);
+    CHECK(m68k_get_reg(NULL, M68K_REG_PC) == 0x1010);
+
+    m68k_dump_call_graph(parse_line, MAX_FUNCS);
+    f = find(0x1100);
+    g = find(0x1200);
+    CHECK(func_count == 2 && f >= 0 && g >= 0);
+    if (f < 0 || g < 0)
+        return test_result("call_graph");
+
+    /* g ran as a call from f, and the rts through f's frame ended both */
+    CHECK(funcs[f].calls == 1 && funcs[g].calls == 1);
+    CHECK(funcs[f].inclusive == funcs[f].exclusive + funcs[g].inclusive);
+    CHECK(funcs[g].inclusive == funcs[g].exclusive);
+
+    /* The nops and the stop after the return are outside any call */
+    CHECK(outside > 4 * 4);
+
+    return test_result("call_graph");
+}
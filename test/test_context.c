@@ -0,0 +1,64 @@
+/* Context switching: a context saved from one instance and restored into
+ * another, or copied straight into another instance, carries the registers
+ * but not the memory map, and the instances' maps and caches stay their
+ * own after either is destroyed.
+ */
+#include "harness.h"
+
+static uint8_t rom[0x10000];
+
+static unsigned int reg(m68k_register_t r) {
+    return m68k_get_reg(NULL, r);
+}
+
+int main(void) {
+    void* saved;
+    void* b;
+    void* c;
+
+    setup_cpu(M68K_CPU_TYPE_68000, 0x1000);
+    m68k_map_memory(0x200000, sizeof(rom), rom, M68K_MAP_READ);
+    rom[0] = 0x12;
+    rom[1] = 0x34;
+    PUT(0x1000,
+        0x3239, 0x0020, 0x0000,                 /* move.w $200000, d1 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+    m68k_execute(1);
+
+    saved = malloc(m68k_context_size());
+    CHECK(saved != NULL);
+    if (saved == NULL)
+        return test_result("context");
+    CHECK(m68k_get_context(saved) == m68k_context_size());
+    m68k_execute(100);
+    CHECK(reg(M68K_REG_D1) == 0x1234);
+
+    /* Restored into an instance without a map, the read goes to the host */
+    b = m68k_create(M68K_CPU_TYPE_68000, NULL);
+    m68k_select_context(b);
+    m68k_set_context(saved);
+    m68k_execute(100);
+    CHECK(reg(M68K_REG_PC) == 0x100a);
+    CHECK(reg(M68K_REG_D1) == 0);
+
+    /* Copied into an instance, which keeps its own (empty) map */
+    m68k_select_context(NULL);
+    m68k_set_context(saved);
+    c = m68k_create(M68K_CPU_TYPE_68000, NULL);
+    m68k_get_context(c);
+    m68k_select_context(c);
+    m68k_execute(100);
+    CHECK(reg(M68K_REG_PC) == 0x100a);
+    CHECK(reg(M68K_REG_D1) == 0);
+
+    /* Destroying them leaves the first instance's map in place */
+    m68k_select_context(NULL);
+    m68k_destroy(b);
+    m68k_destroy(c);
+    m68k_set_context(saved);
+    m68k_execute(100);
+    CHECK(reg(M68K_REG_D1) == 0x1234);
+
+    free(saved);
+    return test_result("context");
+}
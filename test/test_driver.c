@@ -242,6 +242,30 @@ void ram_slot_init(ram_slot_t* dev) {
     dev->dev.write32 = ram_slot_write32;
 }
 
+// Blocks within one ram slot are copied, anything else is declined
+static ram_slot_t* ram_slot_block(unsigned int address, unsigned int size) {
+    memory_device_t* dev = memory_map[address / BLOCK_SIZE];
+    if (dev->read8 != ram_slot_read8 || (dev->mask & address) + size > RAM_SLOT_SIZE)
+        return NULL;
+    return (ram_slot_t*)dev;
+}
+
+int m68k_read_memory_block(unsigned int address, unsigned char* data, unsigned int size) {
+    ram_slot_t* ram = ram_slot_block(address, size);
+    if (!ram)
+        return 0;
+    memcpy(data, ram->memory + (ram->dev.mask & address), size);
+    return 1;
+}
+
+int m68k_write_memory_block(unsigned int address, const unsigned char* data, unsigned int size) {
+    ram_slot_t* ram = ram_slot_block(address, size);
+    if (!ram)
+        return 0;
+    memcpy(ram->memory + (ram->dev.mask & address), data, size);
+    return 1;
+}
+
 //
 // Rom slot
 #define ROM_SLOT_SIZE 0x10000
@@ -320,6 +344,12 @@ void setup_memory(void) {
     memory_map_add(&g_extra_ram1.dev, 0x300000, RAM_SLOT_SIZE);
 
     memory_map_add(&g_test_device.dev, 0x100000, 0x10000);
+
+    // Let the core access RAM and ROM directly (if M68K_FAST_MEMORY_MAP is on)
+    m68k_map_memory(0x0, RAM_SLOT_SIZE, g_stack.memory, M68K_MAP_RW);
+    for (unsigned i = 0; i < N_ROMS; ++i)
+        m68k_map_memory(RAM_SLOT_SIZE + ROM_SLOT_SIZE * i, ROM_SLOT_SIZE, g_roms[i].memory, M68K_MAP_READ);
+    m68k_map_memory(0x300000, RAM_SLOT_SIZE, g_extra_ram1.memory, M68K_MAP_RW);
 }
 
 void setup_bootsec(void) {
@@ -0,0 +1,93 @@
+/* Event queue: a CPU spinning on a branch to itself or halted by STOP burns
+ * cycles only up to the next event, events due together run in the order
+ * they were scheduled, and an interrupt raised by an event wakes a stopped
+ * CPU on time.
+ */
+#include "harness.h"
+
+#define MAX_LOG 8
+
+static struct {
+    int id;
+    unsigned int pc;
+    unsigned long long cycle;
+} event_log[MAX_LOG];
+static int log_count;
+
+static void on_event(void* param, unsigned long long cycle) {
+    int id = (int)(intptr_t)param;
+
+    (void)cycle;
+    if (log_count < MAX_LOG) {
+        event_log[log_count].id = id;
+        event_log[log_count].pc = m68k_get_reg(NULL, M68K_REG_PC);
+        event_log[log_count].cycle = m68k_get_cycle_count();
+        log_count++;
+    }
+    if (id == 1)
+        m68k_schedule_event(m68k_get_cycle_count() + 333, on_event, (void*)4);
+    if (id == 5)
+        m68k_set_irq(1);
+}
+
+/* Reset and take the reset cycles */
+static unsigned long long start(void) {
+    setup_cpu(M68K_CPU_TYPE_68000, 0x1000);
+    m68k_execute(1);
+    log_count = 0;
+    return m68k_get_cycle_count();
+}
+
+static void test_branch_to_self(void) {
+    unsigned long long base = start();
+    int cancelled;
+    int ran;
+
+    PUT(0x1000,
+        0x60fe);                                /* bra.s $1000 */
+
+    /* Taken at the first bra after each deadline, 10 cycles apart.  The
+     * first schedules another 333 cycles on while the second is still due.
+     */
+    m68k_schedule_event(base + 1005, on_event, (void*)1);
+    m68k_schedule_event(base + 1010, on_event, (void*)2);
+    cancelled = m68k_schedule_event(base + 1200, on_event, (void*)3);
+    CHECK(m68k_cancel_event(cancelled) == 1);
+    CHECK(m68k_cancel_event(cancelled) == 0);
+
+    /* The clock agrees with the cycles run, past the last bra */
+    ran = m68k_execute(100000);
+    CHECK(ran >= 100000 && ran <= 100000 + 10);
+    CHECK(m68k_get_cycle_count() == base + ran);
+    CHECK(log_count == 3);
+    CHECK(event_log[0].id == 1 && event_log[0].cycle == base + 1010);
+    CHECK(event_log[1].id == 2 && event_log[1].cycle == base + 1010);
+    CHECK(event_log[2].id == 4 && event_log[2].cycle == base + 1350);
+    CHECK(event_log[2].pc == 0x1000);
+}
+
+static void test_stop(void) {
+    unsigned long long base = start();
+
+    put_32(0x64, 0x1100);                       /* level 1 autovector */
+    PUT(0x1000,
+        0x4e72, 0x2000);                        /* stop #$2000 */
+    PUT(0x1100,
+        0x7e01,                                 /* moveq #1, d7 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+
+    /* The event finds the CPU still stopped, at its deadline */
+    m68k_schedule_event(base + 5000, on_event, (void*)5);
+    CHECK(m68k_execute(100000) == 100000);
+    CHECK(log_count == 1);
+    CHECK(event_log[0].cycle == base + 5000 && event_log[0].pc == 0x1004);
+    CHECK(m68k_get_reg(NULL, M68K_REG_D7) == 1);
+    CHECK(m68k_get_reg(NULL, M68K_REG_PC) == 0x1106);
+    CHECK(m68k_get_cycle_count() == base + 100000);
+}
+
+int main(void) {
+    test_branch_to_self();
+    test_stop();
+    return test_result("events");
+}
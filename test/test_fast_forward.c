@@ -0,0 +1,237 @@
+/* Fast-forwarded loops: delay, polling, copy and fill loops end with the
+ * registers, flags, memory and cycles that running every pass would give,
+ * whether the timeslice or an event stops them part way, and a copy over
+ * code drops the cached blocks it overwrites.
+ */
+#include "harness.h"
+
+#define MAPPED_SIZE 0x100000
+
+static unsigned int event_pc, event_d0;
+static unsigned long long event_cycle;
+
+static unsigned int reg(m68k_register_t r) {
+    return m68k_get_reg(NULL, r);
+}
+
+/* Record where the event found the CPU */
+static void on_event(void* param, unsigned long long cycle) {
+    (void)cycle;
+    event_pc = reg(M68K_REG_PC);
+    event_d0 = reg(M68K_REG_D0);
+    event_cycle = m68k_get_cycle_count();
+    if (param != NULL)
+        *(uint8_t*)param = 0x80;
+}
+
+/* Reset, take the reset cycles and map the low megabyte as plain memory */
+static unsigned long long start(void) {
+    setup_cpu(M68K_CPU_TYPE_68000, 0x1000);
+    m68k_execute(1);
+    m68k_map_memory(0, MAPPED_SIZE, ram, M68K_MAP_RW);
+    return m68k_get_cycle_count();
+}
+
+static void test_dbf_delay(void) {
+    unsigned long long base = start();
+
+    PUT(0x1000,
+        0x303c, 0x03e7,                         /* move.w #999, d0 */
+        0x51c8, 0xfffe,                         /* dbf d0, $1004 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+
+    /* An event part way through is taken at the next dbf, 8 + 301 * 10 */
+    m68k_schedule_event(base + 3013, on_event, NULL);
+    CHECK(m68k_execute(8 + 999 * 10) == 8 + 999 * 10);
+    CHECK(event_pc == 0x1004 && event_d0 == 698);
+    CHECK(event_cycle == base + 3018);
+    CHECK(reg(M68K_REG_PC) == 0x1004);
+    CHECK(reg(M68K_REG_D0) == 0);
+
+    /* The last dbf runs out */
+    CHECK(m68k_execute(14) == 14);
+    CHECK(reg(M68K_REG_PC) == 0x1008);
+    CHECK(reg(M68K_REG_D0) == 0xffff);
+    CHECK(m68k_get_cycle_count() == base + 8 + 999 * 10 + 14);
+}
+
+static void test_subq_delay(void) {
+    start();
+    PUT(0x1000,
+        0x223c, 0x0001, 0x869f,                 /* move.l #99999, d1 */
+        0x5781,                                 /* subq.l #3, d1 */
+        0x66fc,                                 /* bne.s $1006 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+
+    CHECK(m68k_execute(12 + 1000 * 18) == 12 + 1000 * 18);
+    CHECK(reg(M68K_REG_PC) == 0x1006);
+    CHECK(reg(M68K_REG_D1) == 99999 - 3000);
+    CHECK((reg(M68K_REG_SR) & 0x1f) == 0);
+
+    /* 33333 passes, the last without the branch */
+    CHECK(m68k_execute(33333 * 18 - 2 - 1000 * 18) == 33333 * 18 - 2 - 1000 * 18);
+    CHECK(reg(M68K_REG_PC) == 0x100a);
+    CHECK(reg(M68K_REG_D1) == 0);
+    CHECK((reg(M68K_REG_SR) & 0x1f) == 0x04);
+
+    /* A byte count that steps over zero wraps and keeps going */
+    start();
+    PUT(0x1000,
+        0x223c, 0x0000, 0x0105,                 /* move.l #$105, d1 */
+        0x5501,                                 /* subq.b #2, d1 */
+        0x66fc);                                /* bne.s $1006 */
+
+    CHECK(m68k_execute(12 + 3 * 14) == 12 + 3 * 14);
+    CHECK(reg(M68K_REG_D1) == 0x1ff);
+    CHECK((reg(M68K_REG_SR) & 0x1f) == 0x19);
+    CHECK(m68k_execute(10 * 14) == 10 * 14);
+    CHECK(reg(M68K_REG_PC) == 0x1006);
+    CHECK(reg(M68K_REG_D1) == 0x1eb);
+    CHECK((reg(M68K_REG_SR) & 0x1f) == 0x08);
+}
+
+/* Poll with a 12 cycle test of $3000 and a beq.s back to it */
+static void test_poll(uint16_t test_op, uint16_t test_ext) {
+    unsigned long long base = start();
+    unsigned long long now;
+
+    PUT(0x1000,
+        test_op, test_ext,                      /* tst.b $3000 or btst #7, (a0) */
+        0x67fa,                                 /* beq.s $1000 */
+        0x7e01,                                 /* moveq #1, d7 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+    m68k_set_reg(M68K_REG_A0, 0x3000);
+
+    /* 45 passes, then the test that runs over the timeslice */
+    CHECK(m68k_execute(1000) == 45 * 22 + 12);
+    CHECK(reg(M68K_REG_PC) == 0x1004);
+
+    /* The host sets the flag between timeslices */
+    ram[0x3000] = 0x80;
+    CHECK(m68k_execute(10 + 12 + 8) == 10 + 12 + 8);
+    CHECK(reg(M68K_REG_PC) == 0x1006);
+    CHECK(m68k_execute(4) == 4);
+    CHECK(reg(M68K_REG_D7) == 1);
+
+    /* Or from an event, taken at the first instruction after it */
+    base = start();
+    PUT(0x1000,
+        test_op, test_ext,
+        0x67fa,
+        0x7e01,
+        0x4e72, 0x2700);
+    m68k_set_reg(M68K_REG_A0, 0x3000);
+    now = m68k_get_cycle_count();
+    CHECK(now == base);
+    m68k_schedule_event(base + 500, on_event, &ram[0x3000]);
+    CHECK(m68k_execute(23 * 22 + 12 + 8) == 23 * 22 + 12 + 8);
+    CHECK(event_pc == 0x1000 && event_cycle == base + 23 * 22);
+    CHECK(reg(M68K_REG_PC) == 0x1006);
+    CHECK(m68k_execute(4) == 4);
+    CHECK(reg(M68K_REG_D7) == 1);
+}
+
+static unsigned int get_16(unsigned int address) {
+    return (ram[address] << 8) | ram[address + 1];
+}
+
+static void test_copy(void) {
+    unsigned int i;
+    int same = 1;
+
+    start();
+    for (i = 0; i < 256; i++)
+        PUT(0x4000 + i * 2, (uint16_t)(i * 0x0123));
+    PUT(0x1000,
+        0x41f9, 0x0000, 0x4000,                 /* lea $4000, a0 */
+        0x43f9, 0x0000, 0x6000,                 /* lea $6000, a1 */
+        0x303c, 0x00ff,                         /* move.w #255, d0 */
+        0x32d8,                                 /* move.w (a0)+, (a1)+ */
+        0x51c8, 0xfffc,                         /* dbf d0, $1010 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+
+    /* 100 words, with the flags of the last */
+    CHECK(m68k_execute(32 + 100 * 22) == 32 + 100 * 22);
+    CHECK(reg(M68K_REG_PC) == 0x1010);
+    CHECK(reg(M68K_REG_A0) == 0x4000 + 200 && reg(M68K_REG_A1) == 0x6000 + 200);
+    CHECK(reg(M68K_REG_D0) == 155);
+    CHECK(memcmp(&ram[0x4000], &ram[0x6000], 200) == 0 && get_16(0x6000 + 200) == 0);
+    CHECK((reg(M68K_REG_SR) & 0x0f) == ((get_16(0x6000 + 198) & 0x8000) ? 0x08 : 0));
+
+    CHECK(m68k_execute(156 * 12 + 155 * 10 + 14) == 156 * 12 + 155 * 10 + 14);
+    CHECK(reg(M68K_REG_PC) == 0x1016);
+    CHECK(reg(M68K_REG_D0) == 0xffff);
+    CHECK(memcmp(&ram[0x4000], &ram[0x6000], 512) == 0 && get_16(0x6000 + 512) == 0);
+    CHECK(reg(M68K_REG_A1) == 0x6000 + 512);
+
+    start();
+    memset(&ram[0x6800], 0xff, 0x200);
+    PUT(0x1000,
+        0x43f9, 0x0000, 0x6800,                 /* lea $6800, a1 */
+        0x243c, 0x89ab, 0xcdef,                 /* move.l #$89abcdef, d2 */
+        0x303c, 0x003f,                         /* move.w #63, d0 */
+        0x22c2,                                 /* move.l d2, (a1)+ */
+        0x51c8, 0xfffc,                         /* dbf d0, $1010 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+
+    CHECK(m68k_execute(32 + 64 * 12 + 63 * 10 + 14) == 32 + 64 * 12 + 63 * 10 + 14);
+    CHECK(reg(M68K_REG_PC) == 0x1016);
+    CHECK(reg(M68K_REG_A1) == 0x6900);
+    for (i = 0; i < 64; i++)
+        same &= get_32(0x6800 + i * 4) == 0x89abcdef;
+    CHECK(same);
+    CHECK(get_32(0x6900) == 0xffffffff);
+    CHECK((reg(M68K_REG_SR) & 0x0f) == 0x08);
+}
+
+/* Raise an NMI */
+static void on_nmi_event(void* param, unsigned long long cycle) {
+    (void)param;
+    (void)cycle;
+    m68k_set_irq(7);
+}
+
+/* A routine that has run once is copied over, and called from an NMI taken
+ * part way through the copy, before the loop writes next to it again.
+ */
+static void test_copy_over_code(void) {
+    unsigned long long base = start();
+
+    put_32(0x7c, 0x1400);                       /* level 7 autovector */
+    PUT(0x1000,
+        0x6100, 0x0142,                         /* bsr $1144 */
+        0x41f9, 0x0000, 0x1212,                 /* lea $1212, a0 */
+        0x43f9, 0x0000, 0x1112,                 /* lea $1112, a1 */
+        0x303c, 0x001f,                         /* move.w #31, d0 */
+        0x32d8,                                 /* move.w (a0)+, (a1)+ */
+        0x51c8, 0xfffc,                         /* dbf d0, $1014 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+    PUT(0x1144,
+        0x7a01,                                 /* moveq #1, d5 */
+        0x4e75);                                /* rts */
+    PUT(0x1244,
+        0x7a02,                                 /* moveq #2, d5 */
+        0x4e75);                                /* rts */
+    PUT(0x1400,
+        0x3c05,                                 /* move.w d5, d6 */
+        0x6100, 0xfd40,                         /* bsr $1144 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+
+    /* 70 cycles to the loop, then 29 of its 32 passes */
+    m68k_schedule_event(base + 70 + 29 * 22, on_nmi_event, NULL);
+    m68k_execute(70 + 29 * 22 + 200);
+    CHECK(reg(M68K_REG_PC) == 0x140a);
+    CHECK(reg(M68K_REG_D0) == 2);
+    CHECK(reg(M68K_REG_D6) == 1);
+    CHECK(reg(M68K_REG_D5) == 2);
+}
+
+int main(void) {
+    test_dbf_delay();
+    test_subq_delay();
+    test_poll(0x4a38, 0x3000);
+    test_poll(0x0810, 0x0007);
+    test_copy();
+    test_copy_over_code();
+    return test_result("fast_forward");
+}
@@ -0,0 +1,46 @@
+/* Flight recorder: the ring holds an instruction that takes an address
+ * error, and records only data addresses.
+ */
+#include "harness.h"
+
+int main(void) {
+    m68k_flight_record records[16];
+    unsigned int count;
+
+    setup_cpu(M68K_CPU_TYPE_68000, 0x1000);
+    put_32(12, 0x2000);                         /* address error vector */
+    PUT(0x1000,
+        0x207c, 0x0000, 0x3001,                 /* movea.l #$3001, a0 */
+        0x4e71,                                 /* nop */
+        0x3239, 0x0000, 0x3010,                 /* move.w $3010, d1 */
+        0x3010);                                /* move.w (a0), d0 */
+    PUT(0x2000,
+        0x4e71,                                 /* nop */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+
+    m68k_clear_flight_recorder();
+    m68k_execute(1000);
+
+    count = m68k_get_flight_records(records, 16);
+    CHECK(count == 6);
+    if (count != 6)
+        return test_result("flight");
+
+    CHECK(records[0].pc == 0x1000 && records[0].ir == 0x207c);
+    CHECK(records[1].pc == 0x1006 && records[1].ir == 0x4e71);
+    CHECK(records[2].pc == 0x1008 && records[2].ir == 0x3239);
+    CHECK(records[3].pc == 0x100e && records[3].ir == 0x3010);
+    CHECK(records[4].pc == 0x2000);
+    CHECK(records[5].pc == 0x2002);
+
+    /* The faulting instruction is charged the exception's cycles */
+    CHECK(records[3].cycles >= 50);
+
+    /* Opcode and extension word fetches are not data accesses */
+    CHECK(records[0].address == 0);
+    CHECK(records[1].address == 0);
+    CHECK(records[2].address == 0x3010);
+    CHECK(records[4].address == 0);
+
+    return test_result("flight");
+}
@@ -0,0 +1,64 @@
+/* JIT: with lockstep checking on, changes a callback makes through the API
+ * from a compiled block are kept, and the code buffer is never writable and
+ * executable at once.
+ */
+#include "harness.h"
+
+static unsigned int host_calls;
+
+/* Count the loop in d3 and end the first timeslice half way */
+static int on_tas(void) {
+    m68k_set_reg(M68K_REG_D3, ++host_calls);
+    if (host_calls == 500)
+        m68k_end_timeslice();
+    return 1;
+}
+
+/* No mapping of the process is both writable and executable */
+static int no_wx_mappings(void) {
+#ifdef __linux__
+    FILE* maps = fopen("/proc/self/maps", "r");
+    char line[512];
+    int ok = 1;
+
+    if (maps == NULL)
+        return 1;
+    while (fgets(line, sizeof(line), maps) != NULL) {
+        char perms[8];
+
+        if (sscanf(line, "%*s %7s", perms) == 1 && perms[1] == 'w' && perms[2] == 'x')
+            ok = 0;
+    }
+    fclose(maps);
+    return ok;
+#else
+    return 1;
+#endif
+}
+
+int main(void) {
+    setup_cpu(M68K_CPU_TYPE_68000, 0x1000);
+    PUT(0x1000,
+        0x7000,                                 /* moveq #0, d0 */
+        0x7600,                                 /* moveq #0, d3 */
+        0x5280,                                 /* addq.l #1, d0 */
+        0x4af9, 0x0000, 0x3000,                 /* tas $3000 */
+        0x0c80, 0x0000, 0x03e8,                 /* cmpi.l #1000, d0 */
+        0x66f0,                                 /* bne.s $1004 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+    m68k_set_tas_instr_callback(on_tas);
+
+    m68k_execute(1000000);
+    CHECK(m68k_get_reg(NULL, M68K_REG_D0) == 500);
+    CHECK(m68k_get_reg(NULL, M68K_REG_D3) == 500);
+    CHECK(no_wx_mappings());
+
+    m68k_execute(1000000);
+    CHECK(m68k_get_reg(NULL, M68K_REG_PC) == 0x1018);
+    CHECK(m68k_get_reg(NULL, M68K_REG_D0) == 1000);
+    CHECK(m68k_get_reg(NULL, M68K_REG_D3) == 1000);
+    CHECK(host_calls == 1000);
+    CHECK(m68k_jit_lockstep_mismatches() == 0);
+
+    return test_result("jit");
+}
@@ -0,0 +1,133 @@
+/* 68040 MMU: table walks and their used and modified bits, the ATC loaded
+ * by PTEST and dropped by PFLUSH, MMUSR after PTEST, and the bus error
+ * frames of an MMU fault and of a host bus error.
+ */
+#include "harness.h"
+
+#define ROOT_TABLE    0x10000
+#define POINTER_TABLE 0x10200
+#define PAGE_TABLE    0x10400
+
+/* Page descriptor of the 4K page at a logical address below 256K */
+#define PAGE_DESC(ADDRESS) (PAGE_TABLE + ((ADDRESS) >> 12) * 4)
+
+static unsigned int d_reg(int n) {
+    return m68k_get_reg(NULL, (m68k_register_t)(M68K_REG_D0 + n));
+}
+
+/* Identity map the first 256K, except for a page moved to 0x30000, a write
+ * protected page and an invalid page.
+ */
+static void setup_tables(void) {
+    unsigned int page;
+
+    put_32(ROOT_TABLE, POINTER_TABLE | 2);
+    put_32(POINTER_TABLE, PAGE_TABLE | 2);
+    for (page = 0; page < 0x40000; page += 0x1000)
+        put_32(PAGE_DESC(page), page | 3);
+    put_32(PAGE_DESC(0x20000), 0x30000 | 3);
+    put_32(PAGE_DESC(0x21000), 0x21000 | 4 | 3);
+    put_32(PAGE_DESC(0x22000), 0);
+}
+
+static void test_mmu_040(void) {
+    unsigned long long hits, misses;
+    unsigned int sp;
+
+    setup_cpu(M68K_CPU_TYPE_68040, 0x1000);
+    setup_tables();
+    put_32(8, 0x2000);                          /* bus error vector */
+    put_32(0x30010, 0x11111111);
+    put_32(0x31010, 0x22222222);
+    PUT(0x1000,
+        0x203c, 0x0001, 0x0000,                 /* move.l #ROOT_TABLE, d0 */
+        0x4e7b, 0x0806,                         /* movec d0, urp */
+        0x4e7b, 0x0807,                         /* movec d0, srp */
+        0x203c, 0x0000, 0x8000,                 /* move.l #$8000, d0 */
+        0x4e7b, 0x0003,                         /* movec d0, tc */
+        0x7005,                                 /* moveq #5, d0 */
+        0x4e7b, 0x0001,                         /* movec d0, dfc */
+        0x41f9, 0x0002, 0x0000,                 /* lea $20000, a0 */
+        0x43f9, 0x0002, 0x1000,                 /* lea $21000, a1 */
+        0x45f9, 0x0002, 0x2000,                 /* lea $22000, a2 */
+        0xf568,                                 /* ptestr (a0) */
+        0x4e7a, 0x3805,                         /* movec mmusr, d3 */
+        0x23fc, 0x0003, 0x1003, 0x0001, 0x0480, /* move.l #$31003, PAGE_DESC($20000) */
+        0x2439, 0x0002, 0x0010,                 /* move.l $20010, d2 */
+        0xf518,                                 /* pflusha */
+        0x2c39, 0x0002, 0x0010,                 /* move.l $20010, d6 */
+        0x223c, 0x1234, 0x5678,                 /* move.l #$12345678, d1 */
+        0x23c1, 0x0002, 0x0010,                 /* move.l d1, $20010 */
+        0xf568,                                 /* ptestr (a0) */
+        0x4e7a, 0x7805,                         /* movec mmusr, d7 */
+        0xf549,                                 /* ptestw (a1) */
+        0x4e7a, 0x4805,                         /* movec mmusr, d4 */
+        0xf56a,                                 /* ptestr (a2) */
+        0x4e7a, 0x5805,                         /* movec mmusr, d5 */
+        0x23c1, 0x0002, 0x1004);                /* move.l d1, $21004 */
+    PUT(0x2000,
+        0x4e72, 0x2700);                        /* stop #$2700 */
+
+    m68k_execute(10000);
+
+    /* PTEST walks the tables once, setting U, and fills the ATC */
+    CHECK(d_reg(3) == 0x30001);
+    CHECK(d_reg(2) == 0x11111111);
+
+    /* PFLUSHA drops it, and the next access sees the new descriptor */
+    CHECK(d_reg(6) == 0x22222222);
+
+    /* Writing a clean page walks the tables again to set M */
+    CHECK(get_32(0x31010) == 0x12345678);
+    CHECK(get_32(0x30010) == 0x11111111);
+    CHECK(get_32(PAGE_DESC(0x20000)) == (0x31000 | 0x18 | 3));
+    CHECK(get_32(POINTER_TABLE) == (PAGE_TABLE | 8 | 2));
+    CHECK(get_32(ROOT_TABLE) == (POINTER_TABLE | 8 | 2));
+    CHECK(d_reg(7) == (0x31000 | 0x10 | 1));
+
+    /* Write protected, and invalid: neither is used or modified */
+    CHECK(d_reg(4) == (0x21000 | 4 | 1));
+    CHECK(d_reg(5) == 0);
+    CHECK(get_32(PAGE_DESC(0x21000)) == (0x21000 | 4 | 3));
+
+    m68k_get_pmmu_atc_stats(&hits, &misses);
+    CHECK(hits > 0 && misses > 0);
+
+    /* The write to the protected page is an access fault, with a format 7
+     * frame for the long write of fc 5 to $21004.
+     */
+    sp = m68k_get_reg(NULL, M68K_REG_SP);
+    CHECK(m68k_get_reg(NULL, M68K_REG_PC) == 0x2004);
+    CHECK(sp == 0x8000 - 60);
+    CHECK(get_32(sp + 2) == 0x106c);
+    CHECK((get_32(sp + 4) & 0xffff) == 0x7008);
+    CHECK(get_32(sp + 8) == 0x21004);
+    CHECK((get_32(sp + 12) >> 16) == 0x0405);
+    CHECK(get_32(sp + 20) == 0x21004);
+}
+
+/* A bus error from the host carries no access details, and never gets the
+ * long bus fault frame that MMU faults use.
+ */
+static void test_host_bus_error(void) {
+    unsigned int sp;
+
+    setup_cpu(M68K_CPU_TYPE_68030, 0x1000);
+    put_32(8, 0x2000);                          /* bus error vector */
+    PUT(0x1000,
+        0x3239, 0x00f0, 0x0000);                /* move.w $f00000, d1 */
+    PUT(0x2000,
+        0x4e72, 0x2700);                        /* stop #$2700 */
+
+    m68k_execute(1000);
+
+    sp = m68k_get_reg(NULL, M68K_REG_SP);
+    CHECK(m68k_get_reg(NULL, M68K_REG_PC) == 0x2004);
+    CHECK((get_32(sp + 4) & 0xf000) == 0x8000);
+}
+
+int main(void) {
+    test_mmu_040();
+    test_host_bus_error();
+    return test_result("mmu");
+}
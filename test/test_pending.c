@@ -0,0 +1,134 @@
+/* Pending faults: once an access has faulted, the rest of the instruction
+ * makes no callbacks and no immediate reads to the host before the
+ * exception is taken, and each instance keeps its own faulting state.
+ */
+#include "harness.h"
+
+static int faulted;
+static unsigned int late_calls;
+
+unsigned int m68k_read_immediate_16(unsigned int address) {
+    late_calls += faulted;
+    return m68k_read_memory_16(address);
+}
+unsigned int m68k_read_immediate_32(unsigned int address) {
+    late_calls += faulted;
+    return m68k_read_memory_32(address);
+}
+unsigned int m68k_read_pcrelative_8(unsigned int address) {
+    late_calls += faulted;
+    return m68k_read_memory_8(address);
+}
+unsigned int m68k_read_pcrelative_16(unsigned int address) {
+    late_calls += faulted;
+    return m68k_read_memory_16(address);
+}
+unsigned int m68k_read_pcrelative_32(unsigned int address) {
+    late_calls += faulted;
+    return m68k_read_memory_32(address);
+}
+
+static void on_bus_error(unsigned int address) {
+    (void)address;
+    faulted = 1;
+}
+
+/* The exception itself only uses supervisor function codes */
+static void on_set_fc(unsigned int fc) {
+    if (!(fc & 4))
+        late_calls += faulted;
+}
+
+static int on_tas(void) {
+    late_calls += faulted;
+    return 1;
+}
+
+/* The handler's first instruction ends the test */
+static void on_instr_hook(unsigned int pc) {
+    if (pc == 0x2000)
+        faulted = 0;
+}
+
+/* Run the user mode instruction at 0x1004 into a bus error */
+static void run_user(const char* what, const uint16_t* code, unsigned int words) {
+    setup_cpu(M68K_CPU_TYPE_68000, 0x1000);
+    put_32(8, 0x2000);                          /* bus error vector */
+    PUT(0x1000, 0x46fc, 0x0000);                /* move.w #0, sr */
+    put_words(0x1004, code, words);
+    PUT(0x2000, 0x4e72, 0x2700);                /* stop #$2700 */
+
+    bus_error_hook = on_bus_error;
+    m68k_set_fc_callback(on_set_fc);
+    m68k_set_tas_instr_callback(on_tas);
+    m68k_set_instr_hook_callback(on_instr_hook);
+    faulted = 0;
+    late_calls = 0;
+    m68k_execute(1000);
+
+    CHECK(m68k_get_reg(NULL, M68K_REG_PC) == 0x2004);
+    if (late_calls != 0)
+        printf("%s: %u calls after the fault\n", what, late_calls);
+    CHECK(late_calls == 0);
+}
+
+/* A bus error pulsed on instance A between timeslices is taken from A's
+ * state when A runs again, with the register the host set meanwhile, even
+ * after instance B has faulted on the same thread.
+ */
+static void test_two_instances(void) {
+    void* a;
+    void* b;
+    unsigned int sp;
+
+    bus_error_hook = NULL;
+    a = m68k_create(M68K_CPU_TYPE_68000, NULL);
+    b = m68k_create(M68K_CPU_TYPE_68000, NULL);
+    CHECK(a != NULL && b != NULL);
+    if (a == NULL || b == NULL)
+        return;
+
+    m68k_select_context(a);
+    setup_cpu(M68K_CPU_TYPE_68000, 0x1000);
+    put_32(8, 0x2000);                          /* bus error vector */
+    PUT(0x1000,
+        0x60fe);                                /* bra.s $1000 */
+    PUT(0x1100,
+        0x7605,                                 /* moveq #5, d3 */
+        0x3239, 0x00f0, 0x0000);                /* move.w $f00000, d1 */
+    PUT(0x2000,
+        0x4e72, 0x2700);                        /* stop #$2700 */
+    m68k_execute(1000);
+    m68k_pulse_bus_error();
+    m68k_set_reg(M68K_REG_D3, 0x12345678);
+
+    m68k_select_context(b);
+    m68k_pulse_reset();
+    m68k_set_reg(M68K_REG_SP, 0x7000);
+    m68k_set_reg(M68K_REG_PC, 0x1100);
+    m68k_execute(1000);
+    CHECK(m68k_get_reg(NULL, M68K_REG_PC) == 0x2004);
+    CHECK(m68k_get_reg(NULL, M68K_REG_D3) == 5);
+
+    m68k_select_context(a);
+    m68k_execute(1000);
+    sp = m68k_get_reg(NULL, M68K_REG_SP);
+    CHECK(m68k_get_reg(NULL, M68K_REG_PC) == 0x2004);
+    CHECK(m68k_get_reg(NULL, M68K_REG_D3) == 0x12345678);
+    CHECK(sp == 0x8000 - 58);                   /* format $8 frame */
+    CHECK(get_32(sp + 2) == 0x1000);
+
+    m68k_select_context(NULL);
+    m68k_destroy(a);
+    m68k_destroy(b);
+}
+
+int main(void) {
+    static const uint16_t tas[] = {0x4af9, 0x00f0, 0x0000};                 /* tas $f00000 */
+    static const uint16_t move[] = {0x23f9, 0x00f0, 0x0000, 0x0000, 0x3000}; /* move.l $f00000, $3000 */
+
+    run_user("tas", tas, 3);
+    run_user("move", move, 5);
+    test_two_instances();
+    return test_result("pending");
+}
@@ -0,0 +1,106 @@
+/* Profile counters: instructions and cycles by handler, exceptions and
+ * interrupts by vector, and FPU instructions by type and fpgen opmode.
+ */
+#include "harness.h"
+
+static unsigned long long count[0x10000];
+static unsigned long long cycles[0x10000];
+static m68k_profile other;
+static int dumped_moveq;
+
+static int handler(const char* name) {
+    unsigned int i;
+
+    for (i = 0; i < m68k_profile_handlers(); i++)
+        if (strcmp(m68k_profile_handler_name(i), name) == 0)
+            return (int)i;
+    return -1;
+}
+
+static void snapshot(void) {
+    CHECK(m68k_profile_handlers() <= sizeof(count) / sizeof(count[0]));
+    m68k_profile_snapshot(count, cycles, &other);
+}
+
+static void find_moveq(const char* line) {
+    if (strcmp(line, "10 40 m68k_op_moveq_32") == 0)
+        dumped_moveq = 1;
+}
+
+static void test_handlers(void) {
+    int moveq, dbf, trap, rte;
+
+    setup_cpu(M68K_CPU_TYPE_68000, 0x1000);
+    put_32(0x8c, 0x1100);                       /* trap #3 vector */
+    PUT(0x1000,
+        0x303c, 0x0009,                         /* move.w #9, d0 */
+        0x7201,                                 /* moveq #1, d1 */
+        0x51c8, 0xfffc,                         /* dbf d0, $1004 */
+        0x4e43,                                 /* trap #3 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+    PUT(0x1100,
+        0x4e73);                                /* rte */
+
+    m68k_profile_reset();
+    m68k_execute(1000);
+    CHECK(m68k_get_reg(NULL, M68K_REG_PC) == 0x1010);
+    snapshot();
+
+    moveq = handler("m68k_op_moveq_32");
+    dbf = handler("m68k_op_dbf_16");
+    trap = handler("m68k_op_trap");
+    rte = handler("m68k_op_rte_32");
+    CHECK(moveq >= 0 && dbf >= 0 && trap >= 0 && rte >= 0);
+    if (moveq < 0 || dbf < 0 || trap < 0 || rte < 0)
+        return;
+
+    /* Nine taken dbf of 10 cycles and the one that runs out */
+    CHECK(count[moveq] == 10 && cycles[moveq] == 10 * 4);
+    CHECK(count[dbf] == 10 && cycles[dbf] == 9 * 10 + 14);
+    CHECK(count[trap] == 1 && cycles[trap] == 34);
+    CHECK(count[rte] == 1 && cycles[rte] == 20);
+    CHECK(other.vectors[35] == 1);
+
+    m68k_profile_dump(find_moveq);
+    CHECK(dumped_moveq);
+
+    /* An interrupt wakes the stopped CPU */
+    m68k_set_irq(7);
+    m68k_execute(1000);
+    m68k_profile_snapshot(NULL, NULL, &other);
+    CHECK(other.vectors[31] == 1 && other.vectors[35] == 1);
+
+    m68k_profile_reset();
+    snapshot();
+    CHECK(count[moveq] == 0 && cycles[dbf] == 0 && other.vectors[31] == 0);
+}
+
+static void test_fpu(void) {
+    int fpu;
+
+    setup_cpu(M68K_CPU_TYPE_68040, 0x1000);
+    PUT(0x1000,
+        0xf200, 0x0080,                         /* fmove.x fp0, fp1 */
+        0xf200, 0x00a2,                         /* fadd.x fp0, fp1 */
+        0xf200, 0x00a2,                         /* fadd.x fp0, fp1 */
+        0xf202, 0x6000,                         /* fmove.l fp0, d2 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+
+    m68k_profile_reset();
+    m68k_execute(1000);
+    CHECK(m68k_get_reg(NULL, M68K_REG_PC) == 0x1014);
+    snapshot();
+
+    fpu = handler("m68k_op_040fpu0_32");
+    CHECK(fpu >= 0 && count[fpu] == 4);
+
+    /* Three register to register operations and one move out */
+    CHECK(other.fpu_ops[0] == 3 && other.fpu_ops[3] == 1);
+    CHECK(other.fpu_gen[0x00] == 1 && other.fpu_gen[0x22] == 2);
+}
+
+int main(void) {
+    test_handlers();
+    test_fpu();
+    return test_result("profile");
+}
@@ -0,0 +1,90 @@
+/* Sampling profiler: main calls f, which calls g, each with a LINK A6 frame.
+ * Every sample follows the frame chain back to main, most land in g's delay
+ * loop, and the dump prints them as folded stacks.
+ */
+#include "harness.h"
+
+#define PERIOD 97
+#define SLOTS 4096 /* M68K_SAMPLE_SLOTS */
+
+static unsigned long long total, in_loop, bad;
+static int dumped_loop, dumped_annotated;
+
+/* Tally the stacks and check that each one is part of the chain main -> f
+ * -> g.  Main runs with a null A6, which ends the chain.
+ */
+static void read_samples(void) {
+    unsigned int pc[8];
+    unsigned long long count;
+    unsigned int depth;
+    unsigned int i;
+
+    total = in_loop = bad = 0;
+    for (i = 0; i < SLOTS; i++) {
+        depth = m68k_get_sample(i, pc, &count);
+        if (depth == 0)
+            continue;
+        total += count;
+        if (depth == 3 && pc[2] == 0x1004 && pc[1] == 0x1108 && pc[0] >= 0x1200 && pc[0] < 0x1210) {
+            if (pc[0] == 0x1208)
+                in_loop += count;
+        } else if (!(depth == 2 && pc[1] == 0x1004) && !(depth == 1 && pc[0] < 0x1200)) {
+            bad += count;
+        }
+    }
+}
+
+static void find_loop(const char* line) {
+    if (strncmp(line, "001004;001108;001208 ", 21) != 0)
+        return;
+    if (strstr(line, "dbra") != NULL)
+        dumped_annotated = 1;
+    else
+        dumped_loop = 1;
+}
+
+int main(void) {
+    int ran;
+
+    setup_cpu(M68K_CPU_TYPE_68000, 0x1000);
+    m68k_execute(1);
+    m68k_map_memory(0, 0x100000, ram, M68K_MAP_RW);
+    PUT(0x1000,
+        0x6100, 0x00fe,                         /* bsr $1100 */
+        0x60fa);                                /* bra.s $1000 */
+    PUT(0x1100,
+        0x4e56, 0x0000,                         /* link a6, #0 */
+        0x6100, 0x00fa,                         /* bsr $1200 */
+        0x4e5e,                                 /* unlk a6 */
+        0x4e75);                                /* rts */
+    PUT(0x1200,
+        0x4e56, 0x0000,                         /* link a6, #0 */
+        0x303c, 0x03e7,                         /* move.w #999, d0 */
+        0x51c8, 0xfffe,                         /* dbf d0, $1208 */
+        0x4e5e,                                 /* unlk a6 */
+        0x4e75);                                /* rts */
+
+    CHECK(m68k_start_sampling(PERIOD, 8));
+    ran = m68k_execute(1000000);
+    read_samples();
+
+    /* One sample every period, nearly all of them in g's loop */
+    CHECK(total == (unsigned long long)ran / PERIOD);
+    CHECK(in_loop * 100 > total * 95);
+    CHECK(bad == 0);
+
+    m68k_dump_samples(find_loop, 0);
+    m68k_dump_samples(find_loop, 1);
+    CHECK(dumped_loop && dumped_annotated);
+
+    /* Stopping keeps the samples, clearing drops them */
+    m68k_stop_sampling();
+    m68k_execute(100000);
+    read_samples();
+    CHECK(total == (unsigned long long)ran / PERIOD);
+    m68k_clear_samples();
+    read_samples();
+    CHECK(total == 0);
+
+    return test_result("sampler");
+}
@@ -0,0 +1,74 @@
+/* Trace file: instructions that take a bus or address error are written
+ * with the accesses of their exception, which are not charged to the next
+ * instruction.
+ */
+#include "harness.h"
+
+#define TRACE_PATH "test_trace.trc"
+#define MAX_RECORDS 16
+
+static m68k_trace_record records[MAX_RECORDS];
+static unsigned int count;
+
+static int keep_record(const m68k_trace_record* record, void* param) {
+    (void)param;
+    if (count < MAX_RECORDS)
+        records[count] = *record;
+    count++;
+    return 0;
+}
+
+static unsigned int writes(const m68k_trace_record* record) {
+    unsigned int i, n = 0;
+
+    for (i = 0; i < record->accesses; i++)
+        n += record->access[i].write != 0;
+    return n;
+}
+
+static unsigned int last_read(const m68k_trace_record* record) {
+    const m68k_trace_access* access = &record->access[record->accesses - 1];
+
+    return access->write ? 0 : access->address;
+}
+
+int main(void) {
+    setup_cpu(M68K_CPU_TYPE_68000, 0x1000);
+    put_32(8, 0x2000);                          /* bus error vector */
+    put_32(12, 0x2100);                         /* address error vector */
+    PUT(0x1000,
+        0x207c, 0x0000, 0x3001,                 /* movea.l #$3001, a0 */
+        0x3239, 0x00f0, 0x0000);                /* move.w $f00000, d1 */
+    PUT(0x2000,
+        0x3010);                                /* move.w (a0), d0 */
+    PUT(0x2100,
+        0x4e72, 0x2700);                        /* stop #$2700 */
+
+    CHECK(m68k_start_trace(TRACE_PATH));
+    m68k_execute(1000);
+    CHECK(m68k_stop_trace());
+
+    CHECK(m68k_read_trace(TRACE_PATH, 0, keep_record, NULL));
+    remove(TRACE_PATH);
+    CHECK(count == 4);
+    if (count != 4)
+        return test_result("trace");
+
+    CHECK(records[0].pc == 0x1000 && records[0].accesses == 0);
+
+    /* Bus error: the frame writes, then the vector fetch */
+    CHECK(records[1].pc == 0x1006 && records[1].ir == 0x3239);
+    CHECK(records[1].accesses > 1 && writes(&records[1]) == records[1].accesses - 1);
+    CHECK(last_read(&records[1]) == 8);
+    CHECK(records[1].regs[15] < 0x8000);
+
+    /* Address error: a 7 word frame */
+    CHECK(records[2].pc == 0x2000 && records[2].ir == 0x3010);
+    CHECK(records[2].accesses > 1 && writes(&records[2]) == records[2].accesses - 1);
+    CHECK(last_read(&records[2]) == 12);
+    CHECK(records[2].regs[15] == records[1].regs[15] - 14);
+
+    CHECK(records[3].pc == 0x2100 && records[3].accesses == 0);
+
+    return test_result("trace");
+}
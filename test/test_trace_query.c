@@ -0,0 +1,150 @@
+/* Trace queries: state, memory, last write and next PC from a trace with a
+ * checkpoint every 1000 instructions, then again with the chunks moved past
+ * 4 GB in the file.
+ */
+#define _FILE_OFFSET_BITS 64
+#include "harness.h"
+#include <sys/types.h>
+
+#define TRACE_PATH "test_trace_query.trc"
+#define LARGE_PATH "test_trace_query_large.trc"
+#define ITERATIONS 4096
+#define LENGTH (2 + ITERATIONS * 4 + 1)
+#define PAD_CHUNK 0x60000000u
+#define PAD_CHUNKS 3
+#define PAD ((PAD_CHUNKS) * (12 + (unsigned long long)PAD_CHUNK))
+
+/* Instruction number of the start of loop iteration k */
+#define ITERATION(K) (2 + (unsigned long long)(K) * 4)
+
+static unsigned long long get_u64(const uint8_t* p) {
+    unsigned long long value = 0;
+    int i;
+
+    for (i = 7; i >= 0; i--)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+static void set_u64(uint8_t* p, unsigned long long value) {
+    int i;
+
+    for (i = 0; i < 8; i++, value >>= 8)
+        p[i] = (uint8_t)value;
+}
+
+static void check_queries(const char* path) {
+    m68k_trace_query* query = m68k_open_trace_query(path);
+    unsigned int regs[M68K_TRACE_REGS];
+    unsigned char data[8], known[8];
+    m68k_trace_access access;
+    unsigned long long found;
+    unsigned int pc, k;
+
+    CHECK(query != NULL);
+    if (query == NULL)
+        return;
+    CHECK(m68k_trace_length(query) == LENGTH);
+
+    for (k = 0; k < ITERATIONS; k += 1023) {
+        CHECK(m68k_query_state(query, ITERATION(k), &pc, regs));
+        CHECK(pc == 0x1008 && regs[0] == k && regs[8] == 0x10000 + k * 4);
+
+        /* The long before a0 was written in the last iteration */
+        CHECK(m68k_query_memory(query, ITERATION(k), 0x10000 + k * 4 - 4, 8, data, known));
+        if (k > 0)
+            CHECK(known[0] && known[3] && data[0] == 0 && data[2] == (k >> 8) && data[3] == (k & 0xff));
+        CHECK(!known[4] && !known[7]);
+
+        if (k > 0) {
+            CHECK(m68k_query_last_write(query, ITERATION(k), 0x10000 + k * 4 - 2, &found, &access));
+            CHECK(found == ITERATION(k - 1) + 1 && access.write && access.value == k);
+        }
+    }
+
+    CHECK(m68k_query_next_pc(query, 0, 0x1014, &found) && found == LENGTH - 1);
+    CHECK(!m68k_query_next_pc(query, 0, 0x2000, &found));
+    m68k_close_trace_query(query);
+}
+
+static int keep_last(const m68k_trace_record* record, void* param) {
+    *(m68k_trace_record*)param = *record;
+    return 0;
+}
+
+/* Copy the trace with padding chunks before the first one, and the index
+ * and trailer moved to match.
+ */
+static int write_large(void) {
+    FILE* in = fopen(TRACE_PATH, "rb");
+    FILE* out = fopen(LARGE_PATH, "wb");
+    uint8_t* trace = NULL;
+    unsigned long long index_offset, entries, i;
+    long size;
+    int ok = 0;
+
+    if (in == NULL || out == NULL || fseek(in, 0, SEEK_END) != 0 || (size = ftell(in)) < 40)
+        goto done;
+    trace = malloc(size);
+    rewind(in);
+    if (trace == NULL || fread(trace, 1, size, in) != (size_t)size)
+        goto done;
+
+    index_offset = get_u64(trace + size - 32);
+    entries = get_u64(trace + size - 24) + get_u64(trace + size - 16);
+    for (i = 0; i < entries; i++)
+        set_u64(trace + index_offset + i * 32, get_u64(trace + index_offset + i * 32) + PAD);
+    set_u64(trace + size - 32, index_offset + PAD);
+
+    if (fwrite(trace, 1, 8, out) != 8)
+        goto done;
+    for (i = 0; i < PAD_CHUNKS; i++) {
+        uint8_t header[12] = {0};
+
+        header[0] = (uint8_t)PAD_CHUNK;
+        header[1] = (uint8_t)(PAD_CHUNK >> 8);
+        header[2] = (uint8_t)(PAD_CHUNK >> 16);
+        header[3] = (uint8_t)((PAD_CHUNK >> 24) | 0x80);
+        if (fwrite(header, 1, 12, out) != 12 || fseeko(out, (off_t)PAD_CHUNK, SEEK_CUR) != 0)
+            goto done;
+    }
+    ok = fwrite(trace + 8, 1, size - 8, out) == (size_t)size - 8;
+
+done:
+    free(trace);
+    if (in != NULL)
+        fclose(in);
+    if (out != NULL && fclose(out) != 0)
+        ok = 0;
+    return ok;
+}
+
+int main(void) {
+    m68k_trace_record last;
+
+    setup_cpu(M68K_CPU_TYPE_68000, 0x1000);
+    PUT(0x1000,
+        0x41f9, 0x0001, 0x0000,                 /* lea $10000, a0 */
+        0x7000,                                 /* moveq #0, d0 */
+        0x5280,                                 /* addq.l #1, d0 */
+        0x20c0,                                 /* move.l d0, (a0)+ */
+        0x0c80, 0x0000, ITERATIONS,             /* cmpi.l #ITERATIONS, d0 */
+        0x66f4,                                 /* bne.s $1008 */
+        0x4e72, 0x2700);                        /* stop #$2700 */
+
+    CHECK(m68k_start_trace(TRACE_PATH));
+    m68k_execute(1000000);
+    CHECK(m68k_stop_trace());
+    check_queries(TRACE_PATH);
+
+    /* Offsets past 4 GB, in a sparse file */
+    CHECK(write_large());
+    check_queries(LARGE_PATH);
+    memset(&last, 0, sizeof(last));
+    CHECK(m68k_read_trace(LARGE_PATH, LENGTH - 10, keep_last, &last));
+    CHECK(last.number == LENGTH - 1 && last.pc == 0x1014);
+
+    remove(TRACE_PATH);
+    remove(LARGE_PATH);
+    return test_result("trace_query");
+}